@@ -0,0 +1,112 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_BLOOM_FILTER_HPP
+#define NP1_BLOOM_FILTER_HPP
+
+
+#include <stdint.h>
+#include <string.h>
+#include "rstd/detail/mem.hpp"
+
+
+namespace np1 {
+
+/// A blocked Bloom filter over 64-bit hash values.  See http://en.wikipedia.org/wiki/Bloom_filter.
+/**
+ * All the bits for a hash value are in one cache-line-sized block, one bit in each word of the block, so
+ * might_contain() touches one cache line.  With BITS_PER_KEY bits per key the false positive rate is around 1%.
+ */
+class bloom_filter {
+public:
+  enum {
+    WORDS_PER_BLOCK = 8,
+    BLOCK_SIZE = WORDS_PER_BLOCK * sizeof(uint64_t),
+    BITS_PER_KEY = 12
+  };
+
+public:
+  explicit bloom_filter(size_t expected_number_keys) {
+    size_t number_blocks = 1;
+    while (number_blocks * BLOCK_SIZE * 8 < expected_number_keys * BITS_PER_KEY) {
+      number_blocks *= 2;
+    }
+
+    m_block_mask = number_blocks - 1;
+
+    // Blocks must not straddle cache lines.
+    m_allocation = (unsigned char *)rstd::detail::mem::alloc((number_blocks + 1) * BLOCK_SIZE);
+    m_blocks = (uint64_t *)(((uintptr_t)m_allocation + BLOCK_SIZE - 1) & ~((uintptr_t)BLOCK_SIZE - 1));
+    memset(m_blocks, 0, number_blocks * BLOCK_SIZE);
+  }
+
+  ~bloom_filter() {
+    rstd::detail::mem::free(m_allocation);
+  }
+
+  void insert(uint64_t hval) {
+    hval = mix(hval);
+    uint64_t *block = get_block(hval);
+    size_t i;
+    for (i = 0; i < WORDS_PER_BLOCK; ++i) {
+      block[i] |= get_bit(hval, i);
+    }
+  }
+
+  /// False means that the hash value was definitely never inserted.
+  bool might_contain(uint64_t hval) const {
+    hval = mix(hval);
+    const uint64_t *block = get_block(hval);
+    size_t i;
+    for (i = 0; i < WORDS_PER_BLOCK; ++i) {
+      if (!(block[i] & get_bit(hval, i))) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /// The number of bytes in the filter itself.
+  size_t memory_size() const { return (m_block_mask + 1) * BLOCK_SIZE; }
+
+private:
+  /// Disable copy.
+  bloom_filter(const bloom_filter &);
+  bloom_filter &operator = (const bloom_filter &);
+
+private:
+  // The callers' hash values might not be very well mixed so mix them some more.  This is the MurmurHash3
+  // finalizer.
+  static uint64_t mix(uint64_t hval) {
+    hval ^= hval >> 33;
+    hval *= 0xff51afd7ed558ccdULL;
+    hval ^= hval >> 33;
+    hval *= 0xc4ceb9fe1a85ec53ULL;
+    hval ^= hval >> 33;
+    return hval;
+  }
+
+  // The high bits choose the block and the low bits choose the bits within it.
+  uint64_t *get_block(uint64_t hval) const {
+    return m_blocks + ((hval >> 32) & m_block_mask) * WORDS_PER_BLOCK;
+  }
+
+  static uint64_t get_bit(uint64_t hval, size_t word_number) {
+    static const uint32_t salts[WORDS_PER_BLOCK] = {
+      0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+
+    return ((uint64_t)1) << (((uint32_t)hval * salts[word_number]) >> 26);
+  }
+
+private:
+  unsigned char *m_allocation;
+  uint64_t *m_blocks;
+  size_t m_block_mask;
+};
+
+
+} // namespaces
+
+
+#endif
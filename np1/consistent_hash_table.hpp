@@ -4,53 +4,41 @@
 #define NP1_CONSISTENT_HASH_TABLE_HPP
 
 
-#include "np1/skip_list.hpp"
+#include <stdlib.h>
+#include "rstd/vector.hpp"
 #include "np1/hash/fnv1a64.hpp"
 
 namespace np1 {
 
 /// See http://en.wikipedia.org/wiki/Consistent_hashing
+/**
+ * The points on the circle live in one flat array.  While the table is being loaded, inserts just append to the
+ * array and a small open-addressing set catches duplicate points.  The first lookup or iteration after a load
+ * sorts the array and lays the points out in Eytzinger (breadth-first) order so that lower_bound() is a
+ * branch-free walk down an implicit tree that touches as few cache lines as possible.  Inserting after that
+ * is fine but it means sorting again on the next lookup, so load everything first.
+ */
 template <typename V, typename Hash_Function>
 class consistent_hash_table {
 private:
-  struct entry {
-    entry() : m_point(0) {}
-    entry(uint64_t p, const V &v) : m_point(p), m_value(v) {}
+  struct ring_entry {
     uint64_t m_point; // point on consistent hash circle.
-    V m_value;
+    size_t m_value_number;
   };
 
-  struct less_than {
-    bool operator()(const entry &e1, const entry &e2) const {
-      return e1.m_point < e2.m_point;
-    }
-
-    bool operator()(uint64_t p, const entry &e2) const {
-      return p < e2.m_point;
-    }
-
-    bool operator()(const entry &e1, uint64_t p) const {
-      return e1.m_point < p;
-    }
-  };
-
-  typedef skip_list<entry, less_than> skip_list_type;
-  
 public:
   // The iterator makes the hash table look like a circle.  end() is the
   // iteration starting point.
   class const_iterator {
   public:
-    const_iterator() {}
-    const_iterator(typename skip_list_type::const_iterator b,
-                   typename skip_list_type::const_iterator e,
-                   typename skip_list_type::const_iterator s)
-      : m_begin(b), m_end(e), m_iteration_start_point(s), m_curr(s) {}
-    const V &operator*() const { return m_curr->m_value; }
-    const V *operator->() const { return &m_curr->m_value; }
+    const_iterator() : m_values(0), m_begin(0), m_end(0), m_iteration_start_point(0), m_curr(0) {}
+    const_iterator(const V *values, const ring_entry *b, const ring_entry *e, const ring_entry *s)
+      : m_values(values), m_begin(b), m_end(e), m_iteration_start_point(s), m_curr(s) {}
+    const V &operator*() const { return m_values[m_curr->m_value_number]; }
+    const V *operator->() const { return &m_values[m_curr->m_value_number]; }
     const_iterator &operator++() {
       if (m_curr == m_end) {
-        return *this;    
+        return *this;
       }
 
       ++m_curr;
@@ -59,7 +47,7 @@ public:
       } else if (m_curr == m_end) {
         m_curr = m_begin;
         if (m_begin == m_iteration_start_point) {
-          m_curr = m_end;    
+          m_curr = m_end;
         }
       }
 
@@ -70,19 +58,18 @@ public:
     bool operator != (const const_iterator &o) { return m_curr != o.m_curr; }
 
   private:
-    typename skip_list_type::const_iterator m_begin;
-    typename skip_list_type::const_iterator m_end;
-    typename skip_list_type::const_iterator m_iteration_start_point;
-    typename skip_list_type::const_iterator m_curr;
+    const V *m_values;
+    const ring_entry *m_begin;
+    const ring_entry *m_end;
+    const ring_entry *m_iteration_start_point;
+    const ring_entry *m_curr;
   };
 
   class iterator : public const_iterator {
   public:
     iterator() {}
-    iterator(typename skip_list_type::const_iterator b,
-             typename skip_list_type::const_iterator e,
-             typename skip_list_type::const_iterator s)
-      : const_iterator(b, e, s) {}
+    iterator(const V *values, const ring_entry *b, const ring_entry *e, const ring_entry *s)
+      : const_iterator(values, b, e, s) {}
 
     V &operator*() { return (V &)const_iterator::operator*(); }
     V *operator->() { return (V *)const_iterator::operator->(); }
@@ -94,8 +81,12 @@ public:
 
 
 public:
+  /// number_duplicate_entries is the number of points ("virtual nodes") that each value gets on the circle.  More
+  /// points spread the values more evenly around the circle at the cost of memory and lookup time.
   explicit consistent_hash_table(size_t number_duplicate_entries)
-    : m_number_duplicate_entries(number_duplicate_entries) {}
+    : m_number_duplicate_entries(number_duplicate_entries), m_is_frozen(false), m_number_used_point_slots(0) {
+    NP1_ASSERT(m_number_duplicate_entries > 0, "A consistent hash table needs at least one entry per value");
+  }
 
   ~consistent_hash_table() {}
 
@@ -103,31 +94,42 @@ public:
   // to succeed, it's just very very very likely to succeed :).
   bool insert(const V &v) {
     Hash_Function hf;
+    thaw();
 
     // i needs to be a uint64_t so that it hashes to the same value on all
     // platforms.
+    size_t value_number = m_values.size();
     bool success = false;
     for (uint64_t i = 0; i < m_number_duplicate_entries; ++i) {
-      if (m_entries.insert(entry(hf(v, i), v))) {
+      if (insert_point(hf(v, i), value_number)) {
         success = true;
       }
     }
 
+    if (success) {
+      m_values.push_back(v);
+    }
+
     return success;
   }
 
-  
+
   // Insert into the consistent hash, hashing to a slightly different value if
   // an entry already exists for the value.
   void insert_allow_duplicates(const V &v) {
     Hash_Function hf;
+    thaw();
+
+    size_t value_number = m_values.size();
+    m_values.push_back(v);
 
     // i needs to be a uint64_t so that it hashes to the same value on all
     // platforms.
     uint64_t i = 0;
-    while (true) {
-      if (m_entries.insert(entry(hf(v, i), v))) {
-        return;
+    size_t number_inserted = 0;
+    while (number_inserted < m_number_duplicate_entries) {
+      if (insert_point(hf(v, i), value_number)) {
+        ++number_inserted;
       }
 
       ++i;
@@ -142,37 +144,180 @@ public:
   template <typename K>
   iterator lower_bound(const K &k) {
     Hash_Function hf;
-    
-    typename skip_list_type::iterator iter = m_entries.lower_bound(hf(k, 0));
-    if (m_entries.end() == iter) {
+    freeze();
+
+    uint64_t point = hf(k, 0);
+    size_t number_entries = m_ring.size();
+    const search_node *tree = m_search_tree.begin();
+
+    // Walk down the implicit tree, going right whenever the node is less than the point.  When we fall off the
+    // bottom, node's trailing 1 bits are the number of right turns since the last left turn, and the node we last
+    // turned left at is the answer.
+    size_t node = 1;
+    while (node <= number_entries) {
+      node = 2 * node + (tree[node].m_point < point);
+    }
+
+    node >>= __builtin_ffsl(~node);
+    if (0 == node) {
       // As the hash table is one big circle, just return the first entry,
       // if any.
-      return begin();    
+      return begin();
     }
 
-    return iterator(m_entries.begin(), m_entries.end(), iter);
+    const ring_entry *ring = m_ring.begin();
+    return iterator(m_values.begin(), ring, ring + number_entries, ring + tree[node].m_ring_number);
   }
 
   // Remove all entries.
-  void clear() { m_entries.clear(); }
+  void clear() {
+    m_values.clear();
+    m_ring.clear();
+    m_search_tree.clear();
+    m_point_slots.clear();
+    m_number_used_point_slots = 0;
+    m_is_frozen = false;
+  }
 
   // Return the number of unique entries in the hash table.
-  size_t size() const { return m_entries.size()/m_number_duplicate_entries; }
+  size_t size() const { return m_ring.size()/m_number_duplicate_entries; }
 
   // Iterator functions.
-  iterator begin() { return iterator(m_entries.begin(), m_entries.end(), m_entries.begin()); }
+  iterator begin() { freeze(); return iterator(m_values.begin(), ring_begin(), ring_end(), ring_begin()); }
   const_iterator begin() const {
-    return const_iterator(m_entries.begin(), m_entries.end(), m_entries.begin());
+    freeze();
+    return const_iterator(m_values.begin(), ring_begin(), ring_end(), ring_begin());
   }
 
-  iterator end() { return iterator(m_entries.end(), m_entries.end(), m_entries.end()); }
+  iterator end() { freeze(); return iterator(m_values.begin(), ring_end(), ring_end(), ring_end()); }
   const_iterator end() const {
-    return const_iterator(m_entries.end(), m_entries.end(), m_entries.end());
+    freeze();
+    return const_iterator(m_values.begin(), ring_end(), ring_end(), ring_end());
+  }
+
+private:
+  // A node in the Eytzinger-ordered search tree.  Node 0 is unused, the children of node n are 2n and 2n + 1.
+  struct search_node {
+    uint64_t m_point;
+    size_t m_ring_number;
+  };
+
+  enum { INITIAL_NUMBER_POINT_SLOTS = 64 };
+
+  const ring_entry *ring_begin() const { return m_ring.begin(); }
+  const ring_entry *ring_end() const { return m_ring.begin() + m_ring.size(); }
+
+  static int compare_ring_entries(const void *p1, const void *p2) {
+    uint64_t point1 = ((const ring_entry *)p1)->m_point;
+    uint64_t point2 = ((const ring_entry *)p2)->m_point;
+    return (point1 < point2) ? -1 : ((point1 > point2) ? 1 : 0);
+  }
+
+  // Add a point to the circle, returns false if the point is already there.
+  bool insert_point(uint64_t point, size_t value_number) {
+    if (!find_or_add_point_slot(point)) {
+      return false;
+    }
+
+    ring_entry e;
+    e.m_point = point;
+    e.m_value_number = value_number;
+    m_ring.push_back(e);
+    return true;
+  }
+
+  // The points are hash values already so they go straight into the set, mixed a little in case the caller's hash
+  // function has weak low bits.  A slot of 0 is empty, so point 0 is stored as ~0 and vice versa; the ring keeps
+  // the real value so that's harmless.
+  bool find_or_add_point_slot(uint64_t point) {
+    if (2 * (m_number_used_point_slots + 1) > m_point_slots.size()) {
+      grow_point_slots();
+    }
+
+    uint64_t stored_point = (0 == point) ? ~(uint64_t)0 : point;
+    size_t mask = m_point_slots.size() - 1;
+    size_t slot_number = (size_t)((stored_point * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+    while (m_point_slots[slot_number] != 0) {
+      if (m_point_slots[slot_number] == stored_point) {
+        return false;
+      }
+
+      slot_number = (slot_number + 1) & mask;
+    }
+
+    m_point_slots[slot_number] = stored_point;
+    ++m_number_used_point_slots;
+    return true;
+  }
+
+  void grow_point_slots() {
+    size_t new_number_slots =
+      (m_point_slots.size() > 0) ? m_point_slots.size() * 2 : (size_t)INITIAL_NUMBER_POINT_SLOTS;
+    while (2 * (m_ring.size() + 1) > new_number_slots) {
+      new_number_slots *= 2;
+    }
+
+    m_point_slots.clear();
+    m_point_slots.resize(new_number_slots);
+    memset(m_point_slots.begin(), 0, new_number_slots * sizeof(uint64_t));
+    m_number_used_point_slots = 0;
+
+    size_t i;
+    for (i = 0; i < m_ring.size(); ++i) {
+      find_or_add_point_slot(m_ring[i].m_point);
+    }
+  }
+
+  // Sort the circle and build the search tree.  The point set is only needed while loading so it goes away.
+  void freeze() const {
+    if (m_is_frozen) {
+      return;
+    }
+
+    if (m_ring.size() > 0) {
+      qsort(m_ring.begin(), m_ring.size(), sizeof(ring_entry), compare_ring_entries);
+    }
+
+    m_search_tree.clear();
+    m_search_tree.resize(m_ring.size() + 1);
+    size_t ring_number = 0;
+    build_search_tree(1, ring_number);
+
+    m_point_slots.clear();
+    m_number_used_point_slots = 0;
+    m_is_frozen = true;
+  }
+
+  // An in-order walk of the implicit tree visits the nodes in sorted order.
+  void build_search_tree(size_t node, size_t &ring_number) const {
+    if (node <= m_ring.size()) {
+      build_search_tree(2 * node, ring_number);
+      m_search_tree[node].m_point = m_ring[ring_number].m_point;
+      m_search_tree[node].m_ring_number = ring_number;
+      ++ring_number;
+      build_search_tree(2 * node + 1, ring_number);
+    }
+  }
+
+  // Get ready for more inserts after a freeze.
+  void thaw() {
+    if (!m_is_frozen) {
+      return;
+    }
+
+    m_search_tree.clear();
+    m_is_frozen = false;
+    grow_point_slots();
   }
 
 private:
-  skip_list_type m_entries;
   size_t m_number_duplicate_entries;
+  rstd::vector<V> m_values;
+  mutable rstd::vector<ring_entry> m_ring;
+  mutable rstd::vector<search_node> m_search_tree;
+  mutable bool m_is_frozen;
+  mutable rstd::vector<uint64_t> m_point_slots;
+  mutable size_t m_number_used_point_slots;
 };
 
 
@@ -7,11 +7,19 @@
 
 #define NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_SIZE "NP1_MAX_RECORD_HASH_TABLE_SIZE"
 #define NP1_ENVIRONMENT_DEFAULT_MAX_RECORD_HASH_TABLE_SIZE "9223372036854775807"
+#define NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY "NP1_MAX_RECORD_HASH_TABLE_MEMORY"
+#define NP1_ENVIRONMENT_DEFAULT_MAX_RECORD_HASH_TABLE_MEMORY "4294967296"
 #define NP1_ENVIRONMENT_SORT_CHUNK_SIZE_NAME "NP1_SORT_CHUNK_SIZE"
 #define NP1_ENVIRONMENT_DEFAULT_SORT_CHUNK_SIZE "104857600"
 #define NP1_ENVIRONMENT_SORT_INITIAL_NUMBER_THREADS "NP1_SORT_INITIAL_NUMBER_THREADS"
 #define NP1_ENVIRONMENT_DEFAULT_SORT_INITIAL_NUMBER_THREADS "5"
+#define NP1_ENVIRONMENT_JOIN_INITIAL_NUMBER_THREADS "NP1_JOIN_INITIAL_NUMBER_THREADS"
+#define NP1_ENVIRONMENT_DEFAULT_JOIN_INITIAL_NUMBER_THREADS "1"
+#define NP1_ENVIRONMENT_GROUP_INITIAL_NUMBER_THREADS "NP1_GROUP_INITIAL_NUMBER_THREADS"
+#define NP1_ENVIRONMENT_DEFAULT_GROUP_INITIAL_NUMBER_THREADS "1"
 #define NP1_ENVIRONMENT_R17_PATH "NP1_R17_PATH"
+#define NP1_ENVIRONMENT_RECORD_ARENA_HUGE_PAGES "NP1_RECORD_ARENA_HUGE_PAGES"
+#define NP1_ENVIRONMENT_DEFAULT_RECORD_ARENA_HUGE_PAGES "1"
 
 namespace np1 {
 
@@ -23,6 +31,11 @@ public:
     return str::dec_to_int64(value ? value : NP1_ENVIRONMENT_DEFAULT_MAX_RECORD_HASH_TABLE_SIZE);
   }
 
+  static uint64_t max_hash_table_memory() {
+    const char *value = getenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY);
+    return str::dec_to_int64(value ? value : NP1_ENVIRONMENT_DEFAULT_MAX_RECORD_HASH_TABLE_MEMORY);
+  }
+
   static size_t sort_chunk_size() {
     const char *value = getenv(NP1_ENVIRONMENT_SORT_CHUNK_SIZE_NAME);
     return str::dec_to_int64(value ? value : NP1_ENVIRONMENT_DEFAULT_SORT_CHUNK_SIZE);    
@@ -33,6 +46,21 @@ public:
     return str::dec_to_int64(value ? value : NP1_ENVIRONMENT_DEFAULT_SORT_INITIAL_NUMBER_THREADS);    
   }
   
+  static size_t join_initial_number_threads() {
+    const char *value = getenv(NP1_ENVIRONMENT_JOIN_INITIAL_NUMBER_THREADS);
+    return str::dec_to_int64(value ? value : NP1_ENVIRONMENT_DEFAULT_JOIN_INITIAL_NUMBER_THREADS);
+  }
+
+  static size_t group_initial_number_threads() {
+    const char *value = getenv(NP1_ENVIRONMENT_GROUP_INITIAL_NUMBER_THREADS);
+    return str::dec_to_int64(value ? value : NP1_ENVIRONMENT_DEFAULT_GROUP_INITIAL_NUMBER_THREADS);
+  }
+
+  static bool record_arena_huge_pages() {
+    const char *value = getenv(NP1_ENVIRONMENT_RECORD_ARENA_HUGE_PAGES);
+    return str::dec_to_int64(value ? value : NP1_ENVIRONMENT_DEFAULT_RECORD_ARENA_HUGE_PAGES) != 0;
+  }
+
   static rstd::string r17_path() {
     const char *value = getenv(NP1_ENVIRONMENT_R17_PATH);
     return rstd::string(value);
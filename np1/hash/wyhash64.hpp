@@ -0,0 +1,148 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_HASH_WYHASH64_HPP
+#define NP1_HASH_WYHASH64_HPP
+
+
+#include <string.h>
+#include "np1/simple_types.hpp"
+
+namespace np1 {
+namespace hash {
+namespace wyhash64 {
+
+/**
+ * This hash function is Wang Yi's public-domain "wyhash", see https://github.com/wangyi-fudan/wyhash.  It eats
+ * 16 bytes per 64x64->128 bit multiply instead of FNV-1a's one byte per multiply, so it's much faster on long
+ * strings.  Words are read as little-endian so hash values are the same on every architecture, which matters
+ * because record hashes are written to files and sent to other hosts.  See rel::detail::helper::hash_add.
+ */
+
+namespace detail {
+
+const uint64_t P0 = 0xa0761d6478bd642fULL;
+const uint64_t P1 = 0xe7037ed1a0b428dbULL;
+const uint64_t P2 = 0x8ebc6af09c88c6e3ULL;
+const uint64_t P3 = 0x589965cc75374cc3ULL;
+
+/// Multiply a and b, putting the low 64 bits of the product in a and the high 64 bits in b.
+inline void mum(uint64_t &a, uint64_t &b) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 r = a;
+  r *= b;
+  a = (uint64_t)r;
+  b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  a = lo;
+  b = hi;
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+  mum(a, b);
+  return a ^ b;
+}
+
+inline uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+inline uint64_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+/// Read 1 to 3 bytes.
+inline uint64_t read_small(const unsigned char *p, size_t len) {
+  return (((uint64_t)p[0]) << 16) | (((uint64_t)p[len >> 1]) << 8) | p[len - 1];
+}
+
+} // namespace detail
+
+
+/// Add an array of bytes into the hash value.
+inline uint64_t add(const void *key, size_t len, uint64_t hval) {
+  const unsigned char *p = (const unsigned char *)key;
+  uint64_t seed = hval ^ detail::mix(hval ^ detail::P0, detail::P1);
+  uint64_t a;
+  uint64_t b;
+
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t middle = (len >> 3) << 2;
+      a = (detail::read32(p) << 32) | detail::read32(p + middle);
+      b = (detail::read32(p + len - 4) << 32) | detail::read32(p + len - 4 - middle);
+    } else if (len > 0) {
+      a = detail::read_small(p, len);
+      b = 0;
+    } else {
+      a = 0;
+      b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t seed1 = seed;
+      uint64_t seed2 = seed;
+      do {
+        seed = detail::mix(detail::read64(p) ^ detail::P1, detail::read64(p + 8) ^ seed);
+        seed1 = detail::mix(detail::read64(p + 16) ^ detail::P2, detail::read64(p + 24) ^ seed1);
+        seed2 = detail::mix(detail::read64(p + 32) ^ detail::P3, detail::read64(p + 40) ^ seed2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+
+      seed ^= seed1 ^ seed2;
+    }
+
+    while (i > 16) {
+      seed = detail::mix(detail::read64(p) ^ detail::P1, detail::read64(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+
+    a = detail::read64(p + i - 16);
+    b = detail::read64(p + i - 8);
+  }
+
+  a ^= detail::P1;
+  b ^= seed;
+  detail::mum(a, b);
+  return detail::mix(a ^ detail::P0 ^ len, b ^ detail::P1);
+}
+
+
+// Do a hash when you have no previous hash value.
+inline uint64_t init(uint64_t somedata = 0x12345) {
+  unsigned char bytes[sizeof(somedata)];
+  size_t i;
+  for (i = 0; i < sizeof(somedata); ++i) {
+    bytes[i] = (unsigned char)(somedata >> (8 * i));
+  }
+
+  return add(bytes, sizeof(bytes), detail::P2);
+}
+
+
+} // namespaces
+}
+}
+
+
+#endif
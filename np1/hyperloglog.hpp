@@ -0,0 +1,295 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_HYPERLOGLOG_HPP
+#define NP1_HYPERLOGLOG_HPP
+
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rstd/string.hpp"
+#include "rstd/vector.hpp"
+
+
+namespace np1 {
+
+/// A HyperLogLog distinct-value counter over 64-bit hash values.  See Flajolet et al, "HyperLogLog: the analysis
+/// of a near-optimal cardinality estimation algorithm".
+/**
+ * There are 2^precision one-byte registers and the standard error of the estimate is 1.04/sqrt(2^precision),
+ * about 0.8% for the default precision.  Small counts are worked out with linear counting, which is exact for a
+ * handful of values.  Until there are enough values to make it worthwhile the registers aren't allocated and the
+ * (register, rank) pairs are kept in a sorted list instead, so lots of small counters don't use lots of memory.
+ *
+ * Counters with the same precision can be merged, and can be written out as strings for that.  The strings
+ * start with a format tag so that counters from an incompatible version, eg one that hashed the values
+ * differently, are rejected instead of being merged into a wrong count.
+ */
+class hyperloglog {
+public:
+  enum { MIN_PRECISION = 4, MAX_PRECISION = 18, DEFAULT_PRECISION = 14 };
+
+  // Change this when the string format changes or when the hash values that callers add change.  Version 1
+  // is rel.group's record hash with wyhash64.
+  enum { FORMAT_VERSION = 1 };
+
+public:
+  explicit hyperloglog(size_t precision = DEFAULT_PRECISION) : m_precision(precision), m_number_sorted_pairs(0) {
+    NP1_ASSERT((precision >= MIN_PRECISION) && (precision <= MAX_PRECISION),
+               "HyperLogLog precision must be between 4 and 18");
+  }
+
+  ~hyperloglog() {}
+
+  size_t precision() const { return m_precision; }
+
+  void add(uint64_t hval) {
+    size_t register_number = (size_t)(hval >> (64 - m_precision));
+    // The guard bit stops the rank from going past the number of bits that are left.
+    uint64_t remaining_bits = (hval << m_precision) | ((uint64_t)1 << (m_precision - 1));
+    unsigned char rank = (unsigned char)(__builtin_clzll(remaining_bits) + 1);
+    add(register_number, rank);
+  }
+
+  /// Add all the values that other has counted.  Returns false if the precisions are different.
+  bool merge(const hyperloglog &other) {
+    if (other.m_precision != m_precision) {
+      return false;
+    }
+
+    if (!other.m_registers.empty()) {
+      size_t i;
+      for (i = 0; i < other.m_registers.size(); ++i) {
+        if (other.m_registers[i] > 0) {
+          add(i, other.m_registers[i]);
+        }
+      }
+    } else {
+      rstd::vector<uint32_t>::const_iterator i = other.m_pairs.begin();
+      rstd::vector<uint32_t>::const_iterator iz = other.m_pairs.end();
+      for (; i != iz; ++i) {
+        add(pair_register_number(*i), pair_rank(*i));
+      }
+    }
+
+    return true;
+  }
+
+  uint64_t estimate() const {
+    size_t number_registers = (size_t)1 << m_precision;
+    double sum = 0;
+    size_t number_zero_registers = 0;
+    if (!m_registers.empty()) {
+      size_t i;
+      for (i = 0; i < number_registers; ++i) {
+        sum += ldexp(1.0, -(int)m_registers[i]);
+        number_zero_registers += (0 == m_registers[i]);
+      }
+    } else {
+      sort_pairs();
+      rstd::vector<uint32_t>::const_iterator i = m_pairs.begin();
+      rstd::vector<uint32_t>::const_iterator iz = m_pairs.end();
+      for (; i != iz; ++i) {
+        sum += ldexp(1.0, -(int)pair_rank(*i));
+      }
+
+      number_zero_registers = number_registers - m_pairs.size();
+      sum += number_zero_registers;
+    }
+
+    double m = (double)number_registers;
+    double alpha = (16 == number_registers) ? 0.673
+                    : (32 == number_registers) ? 0.697
+                    : (64 == number_registers) ? 0.709
+                    : 0.7213/(1 + 1.079/m);
+    double estimate = alpha * m * m / sum;
+    if ((estimate <= 2.5 * m) && (number_zero_registers > 0)) {
+      estimate = m * log(m/(double)number_zero_registers);
+    }
+
+    return (uint64_t)(estimate + 0.5);
+  }
+
+  /// Write the counter as a string that from_string() understands:  "hll" and the format version, the
+  /// precision, then either "s" and the register:rank pairs or "d" and the registers in hex.
+  rstd::string to_string() const {
+    char buffer[32];
+    sprintf(buffer, "hll%u %u ", (unsigned int)FORMAT_VERSION, (unsigned int)m_precision);
+    rstd::string s(buffer);
+    if (!m_registers.empty()) {
+      s.push_back('d');
+      size_t i;
+      for (i = 0; i < m_registers.size(); ++i) {
+        sprintf(buffer, "%02x", (unsigned int)m_registers[i]);
+        s.append(buffer);
+      }
+    } else {
+      s.push_back('s');
+      sort_pairs();
+      rstd::vector<uint32_t>::const_iterator i = m_pairs.begin();
+      rstd::vector<uint32_t>::const_iterator iz = m_pairs.end();
+      for (; i != iz; ++i) {
+        sprintf(buffer, " %u:%u", (unsigned int)pair_register_number(*i), (unsigned int)pair_rank(*i));
+        s.append(buffer);
+      }
+    }
+
+    return s;
+  }
+
+  /// Replace the contents of the counter with one written by to_string().  Returns false if s is not a counter
+  /// or was written with a different format version.
+  bool from_string(const char *s, size_t length) {
+    rstd::string copy(s, length);
+    const char *p = copy.c_str();
+    char *end;
+    if (strncmp(p, "hll", 3) != 0) {
+      return false;
+    }
+
+    unsigned long format_version = strtoul(p + 3, &end, 10);
+    if ((end == p + 3) || (FORMAT_VERSION != format_version) || (' ' != *end)) {
+      return false;
+    }
+
+    p = end + 1;
+    unsigned long precision = strtoul(p, &end, 10);
+    if ((end == p) || (precision < MIN_PRECISION) || (precision > MAX_PRECISION) || (' ' != *end)) {
+      return false;
+    }
+
+    m_precision = precision;
+    m_registers.clear();
+    m_pairs.clear();
+    m_number_sorted_pairs = 0;
+    p = end + 1;
+    size_t number_registers = (size_t)1 << m_precision;
+    if ('d' == *p) {
+      ++p;
+      if (strlen(p) != 2 * number_registers) {
+        return false;
+      }
+
+      m_registers.resize(number_registers);
+      size_t i;
+      for (i = 0; i < number_registers; ++i, p += 2) {
+        char hex[3] = { p[0], p[1], '\0' };
+        m_registers[i] = (unsigned char)strtoul(hex, &end, 16);
+        if (end != hex + 2) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    if ('s' != *p) {
+      return false;
+    }
+
+    ++p;
+    while (' ' == *p) {
+      unsigned long register_number = strtoul(p + 1, &end, 10);
+      if ((end == p + 1) || (':' != *end) || (register_number >= number_registers)) {
+        return false;
+      }
+
+      p = end + 1;
+      unsigned long rank = strtoul(p, &end, 10);
+      if ((end == p) || (0 == rank) || (rank > 65 - m_precision)) {
+        return false;
+      }
+
+      add(register_number, (unsigned char)rank);
+      p = end;
+    }
+
+    return '\0' == *p;
+  }
+
+private:
+  static size_t pair_register_number(uint32_t pair) { return pair >> 8; }
+  static unsigned char pair_rank(uint32_t pair) { return (unsigned char)(pair & 0xff); }
+
+  static int compare_pairs(const void *p1, const void *p2) {
+    uint32_t pair1 = *(const uint32_t *)p1;
+    uint32_t pair2 = *(const uint32_t *)p2;
+    return (pair1 < pair2) ? -1 : ((pair1 > pair2) ? 1 : 0);
+  }
+
+  void add(size_t register_number, unsigned char rank) {
+    if (!m_registers.empty()) {
+      if (rank > m_registers[register_number]) {
+        m_registers[register_number] = rank;
+      }
+
+      return;
+    }
+
+    m_pairs.push_back((uint32_t)((register_number << 8) | rank));
+    size_t number_registers = (size_t)1 << m_precision;
+    if (m_pairs.size() >= max_number_pairs()) {
+      sort_pairs();
+      // The list is 4 bytes a register, so once a quarter of the registers are in use the registers are smaller.
+      if (m_pairs.size() >= number_registers/4) {
+        make_registers();
+      }
+    }
+  }
+
+  // Keep twice as many unsorted pairs as sorted ones before sorting again.
+  size_t max_number_pairs() const {
+    size_t max_pairs = 2 * m_number_sorted_pairs;
+    return (max_pairs < 16) ? 16 : max_pairs;
+  }
+
+  // Sort the pairs and keep only the highest rank for each register.
+  void sort_pairs() const {
+    if (m_number_sorted_pairs == m_pairs.size()) {
+      return;
+    }
+
+    qsort(m_pairs.begin(), m_pairs.size(), sizeof(uint32_t), compare_pairs);
+    size_t number_kept = 0;
+    size_t i;
+    for (i = 0; i < m_pairs.size(); ++i) {
+      if ((i + 1 < m_pairs.size()) && (pair_register_number(m_pairs[i]) == pair_register_number(m_pairs[i + 1]))) {
+        continue;
+      }
+
+      m_pairs[number_kept++] = m_pairs[i];
+    }
+
+    m_pairs.resize(number_kept);
+    m_number_sorted_pairs = number_kept;
+  }
+
+  void make_registers() {
+    m_registers.resize((size_t)1 << m_precision);
+    memset(m_registers.begin(), 0, m_registers.size());
+    rstd::vector<uint32_t>::const_iterator i = m_pairs.begin();
+    rstd::vector<uint32_t>::const_iterator iz = m_pairs.end();
+    for (; i != iz; ++i) {
+      if (pair_rank(*i) > m_registers[pair_register_number(*i)]) {
+        m_registers[pair_register_number(*i)] = pair_rank(*i);
+      }
+    }
+
+    m_pairs.clear();
+    m_number_sorted_pairs = 0;
+  }
+
+private:
+  size_t m_precision;
+  rstd::vector<unsigned char> m_registers;
+  mutable rstd::vector<uint32_t> m_pairs;
+  mutable size_t m_number_sorted_pairs;
+};
+
+
+} // namespaces
+
+
+#endif
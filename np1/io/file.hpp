@@ -9,6 +9,7 @@
 #include "np1/io/detail/stream_helper.hpp"
 #include "np1/preproc.hpp"
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -332,34 +333,47 @@ public:
 
   /// Get the mtime in microseconds, size in bytes, and whether or not this file is actually a directory.
   static bool get_info(const char *file_name, uint64_t &mtime, uint64_t &sz, bool &is_directory) {
-#ifdef NP1_NEED_FSTAT_AS_SYSCALL
-    struct stat64 stat_buf;
-    int syscall_id;
-#if __WORDSIZE == 64
-    syscall_id = SYS_stat;
-#else
-    syscall_id = SYS_stat64;
-#endif
-    if (syscall(syscall_id, file_name, &stat_buf) != 0) {
+    stat_type stat_buf;
+    if (!get_stat(file_name, stat_buf)) {
       return false;
     }
-    
+
     mtime = stat_buf.st_mtime;
     sz = stat_buf.st_size;
     is_directory = !!S_ISDIR(stat_buf.st_mode);
-#else
-    struct stat stat_buf;
-    if (stat(file_name, &stat_buf) != 0) {
+    mtime *= 1000000;
+    return true;
+  }
+
+  /// Everything the filesystem can tell us about whether a file has been changed or replaced.  If any of these
+  /// are different then the file's contents might be different.
+  struct identity {
+    uint64_t m_size;
+    uint64_t m_mtime_sec;
+    uint64_t m_mtime_nsec;
+    uint64_t m_ctime_sec;
+    uint64_t m_ctime_nsec;
+    uint64_t m_device;
+    uint64_t m_inode;
+  };
+
+  /// Get the identity of a file, returns false on error.
+  static bool get_identity(const char *file_name, identity &id, bool &is_directory) {
+    stat_type stat_buf;
+    if (!get_stat(file_name, stat_buf)) {
       return false;
     }
 
-    mtime = stat_buf.st_mtime;
-    sz = stat_buf.st_size;
+    memset(&id, 0, sizeof(id));
+    id.m_size = stat_buf.st_size;
+    id.m_mtime_sec = stat_buf.st_mtim.tv_sec;
+    id.m_mtime_nsec = stat_buf.st_mtim.tv_nsec;
+    id.m_ctime_sec = stat_buf.st_ctim.tv_sec;
+    id.m_ctime_nsec = stat_buf.st_ctim.tv_nsec;
+    id.m_device = stat_buf.st_dev;
+    id.m_inode = stat_buf.st_ino;
     is_directory = !!S_ISDIR(stat_buf.st_mode);
-#endif
-    mtime *= 1000000;
     return true;
-
   }
 
   /// Get the mtime in microseconds, returns false on failure.
@@ -440,6 +454,27 @@ private:
   file &operator = (const file &);
 
 private:
+#ifdef NP1_NEED_FSTAT_AS_SYSCALL
+  typedef struct stat64 stat_type;
+#else
+  typedef struct stat stat_type;
+#endif
+
+  static bool get_stat(const char *file_name, stat_type &stat_buf) {
+#ifdef NP1_NEED_FSTAT_AS_SYSCALL
+    int syscall_id;
+#if __WORDSIZE == 64
+    syscall_id = SYS_stat;
+#else
+    syscall_id = SYS_stat64;
+#endif
+    return (syscall(syscall_id, file_name, &stat_buf) == 0);
+#else
+    return (stat(file_name, &stat_buf) == 0);
+#endif
+  }
+
+
   /// Get an invalid handle value.
   static inline handle_type invalid_handle_value() {
 #ifdef _WIN32
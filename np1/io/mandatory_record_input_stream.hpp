@@ -101,6 +101,72 @@ public:
     return true;
   }
 
+  /// Parse records and call the callback for batches of up to Max_Batch_Size records at a time, like this:
+  /// batch_callback(const Record_Ref *records, size_t number_records).  The record refs are only valid
+  /// during the call.
+  /**
+   * Returns true if parsing completed normally, false if 
+   * a callback asked us to stop.    Exits the program on fatal error. 
+   */
+  template <size_t Max_Batch_Size, typename Batch_Callback>
+  inline bool parse_record_batches(Batch_Callback batch_callback) {
+    enum { INITIAL_BUFFER_SIZE = 256 * 1024 };
+    rstd::vector<unsigned char> buffer;    
+    buffer.resize(INITIAL_BUFFER_SIZE);
+    unsigned char *buffer_end = &buffer[0] + buffer.size();
+    unsigned char *buffer_read_pos = &buffer[0];
+    const unsigned char *start_record = buffer_read_pos;
+    ssize_t number_bytes_read;    
+    uint64_t record_number = 1;
+    Record_Ref batch[Max_Batch_Size];
+    size_t batch_size = 0;
+
+    while ((number_bytes_read =
+              m_stream.read_some(buffer_read_pos, 
+                                  buffer_end - buffer_read_pos)) > 0) {        
+      const unsigned char *buffer_data_end = buffer_read_pos + number_bytes_read;        
+      const unsigned char *end_record;
+      
+      while ((end_record = Record_Ref::get_record_end(start_record,
+                                                      buffer_data_end - start_record))) {
+        batch[batch_size++] = Record_Ref(start_record, end_record, record_number);
+        if (Max_Batch_Size == batch_size) {
+          if (!batch_callback((const Record_Ref *)batch, batch_size)) {
+            return false;
+          }
+
+          batch_size = 0;
+        }
+
+        start_record = end_record;
+        ++record_number;
+      }
+
+      // The records in the batch are about to move so deal with them now.
+      if (batch_size > 0) {
+        if (!batch_callback((const Record_Ref *)batch, batch_size)) {
+          return false;
+        }
+
+        batch_size = 0;
+      }
+
+      ssize_t remainder_length = buffer_data_end - start_record;
+      if (remainder_length >= (ssize_t)buffer.size()) {
+        size_t start_record_offset = start_record - &buffer[0];
+        buffer.resize(buffer.size() + INITIAL_BUFFER_SIZE);
+        buffer_end = &buffer[0] + buffer.size();
+        start_record = &buffer[0] + start_record_offset;
+      }
+      
+      memmove(&buffer[0], start_record, remainder_length);
+      buffer_read_pos = &buffer[0] + remainder_length;
+      start_record = &buffer[0];
+    }
+    
+    return true;
+  }
+
   bool close() { return m_stream.close(); }
 
   /// Assumes that the output stream is also a mandatory stream.
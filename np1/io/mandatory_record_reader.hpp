@@ -0,0 +1,84 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_IO_MANDATORY_RECORD_READER_HPP
+#define NP1_IO_MANDATORY_RECORD_READER_HPP
+
+#include "rstd/vector.hpp"
+#include "np1/io/mandatory_input_stream.hpp"
+#include "np1/assert.hpp"
+
+namespace np1  {
+namespace io {
+
+/// Reads records from a stream one at a time, for when the caller can't hand control to a parse_records callback.
+/// Use mandatory_record_input_stream::parse_headings to read the headings first.  All failures crash the process.
+template <typename Inner_Stream, typename Record_Ref>
+class mandatory_record_reader {
+private:
+  // Ensure that the inner stream is unbuffered.
+  typedef typename Inner_Stream::is_unbuffered inner_is_unbuffered_type;
+
+  enum { INITIAL_BUFFER_SIZE = 256 * 1024 };
+
+public:
+  /// Constructor.
+  explicit mandatory_record_reader(Inner_Stream &s)
+    : m_stream(s), m_start_offset(0), m_end_offset(0), m_record_number(1) {
+    m_buffer.resize(INITIAL_BUFFER_SIZE);
+  }
+
+  /// Destructor.
+  ~mandatory_record_reader() {}
+
+  /// Read one record.  The record is only valid until the next call.  Crashes on error, returns false on EOF.
+  bool read_record(Record_Ref &r) {
+    while (true) {
+      const unsigned char *start_record = &m_buffer[0] + m_start_offset;
+      const unsigned char *end_record = Record_Ref::get_record_end(start_record, m_end_offset - m_start_offset);
+      if (end_record) {
+        r = Record_Ref(start_record, end_record, m_record_number++);
+        m_start_offset = end_record - &m_buffer[0];
+        return true;
+      }
+
+      // There's probably an incomplete record left in the buffer.  Move it to the start of the buffer and make sure
+      // that there's room for more.
+      size_t remainder_length = m_end_offset - m_start_offset;
+      memmove(&m_buffer[0], start_record, remainder_length);
+      m_start_offset = 0;
+      m_end_offset = remainder_length;
+      if (remainder_length >= m_buffer.size()) {
+        m_buffer.resize(m_buffer.size() + INITIAL_BUFFER_SIZE);
+      }
+
+      size_t number_bytes_read = m_stream.read_some(&m_buffer[0] + m_end_offset, m_buffer.size() - m_end_offset);
+      if (0 == number_bytes_read) {
+        NP1_ASSERT(0 == remainder_length, "Stream " + m_stream.name() + ": Incomplete record at end of stream");
+        return false;
+      }
+
+      m_end_offset += number_bytes_read;
+    }
+
+    return false;
+  }
+
+private:
+  /// Disable copy.
+  mandatory_record_reader(const mandatory_record_reader &);
+  mandatory_record_reader &operator = (const mandatory_record_reader &);
+
+private:
+  mandatory_input_stream<Inner_Stream> m_stream;
+  rstd::vector<unsigned char> m_buffer;
+  size_t m_start_offset;
+  size_t m_end_offset;
+  uint64_t m_record_number;
+};
+
+
+} // namespaces
+}
+
+
+#endif
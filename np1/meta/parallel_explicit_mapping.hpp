@@ -51,10 +51,11 @@ private:
       typedef io::mandatory_record_input_stream<io::file, rel::record, rel::record_ref> child_output_stream_type;
       child_output_stream_type child_output_stream(child_output_file);
 
-      // Read the headings, writing them only if they haven't already been written.
+      // Read the headings, writing them only if they haven't already been written.  The children's outputs are
+      // concatenated so any sort order that the children recorded doesn't hold for the final output.
       rel::record headings(child_output_stream.parse_headings());
       if (!m_output_headings_written) {
-        headings.write(m_final_output);
+        headings.ref().write_with_checksum(m_final_output, 0);
         m_output_headings_written = true;
       }
       
@@ -75,6 +76,45 @@ private:
 public:
   static void run(Input_Stream &input, Final_Output_Stream &output,
                   const rstd::vector<rel::rlang::token> &tokens) {
+    // If the script ends in a group then each host does the partial group and the results are merged here.
+    rstd::vector<rel::rlang::token> remote_tokens;
+    rstd::vector<rel::rlang::token> merge_tokens;
+    if (!get_combiner_tokens(tokens, remote_tokens, merge_tokens)) {
+      run_mapping(input, output, tokens);
+      return;
+    }
+
+    FILE *partial_output_fp = tmpfile();
+    NP1_ASSERT(partial_output_fp, "Unable to create temporary file for partial group output");
+    io::file partial_output_file;
+    partial_output_file.from_handle(partial_output_fp);
+    bool has_partial_output;
+
+    {
+      typedef io::buffered_output_stream<io::file> buffered_output_type;
+      typedef io::mandatory_output_stream<buffered_output_type> mandatory_buffered_output_type;
+      buffered_output_type buffered_partial_output(partial_output_file);
+      mandatory_buffered_output_type mandatory_partial_output(buffered_partial_output);
+      has_partial_output =
+        parallel_explicit_mapping<Input_Stream, mandatory_buffered_output_type>::run_mapping(
+          input, mandatory_partial_output, remote_tokens);
+      mandatory_partial_output.hard_flush();
+    }
+
+    if (has_partial_output) {
+      NP1_ASSERT(partial_output_file.rewind(), "Unable to rewind partial group output file");
+      io::mandatory_record_input_stream<io::file, rel::record, rel::record_ref> partial_input(partial_output_file);
+      rel::group group_op;
+      group_op(partial_input, output, merge_tokens);
+    }
+
+    partial_output_file.release();
+    fclose(partial_output_fp);
+  }
+
+  /// Run the script for each file without looking at it.  Returns true if there was any output.
+  static bool run_mapping(Input_Stream &input, Final_Output_Stream &output,
+                          const rstd::vector<rel::rlang::token> &tokens) {
     /* Get the headers and the interesting fields out of them. */
     rel::record input_headings(input.parse_headings());
     size_t file_name_field_id =
@@ -93,6 +133,55 @@ public:
     
     // Run all the processes in the pool.
     process_pool_map.wait_all();
+    return output_headings_written;
+  }
+
+  /// If the script's last stream operator is rel.group, get the script with the partial form of the group and
+  /// the arguments of the group that merges the partial outputs.
+  static bool get_combiner_tokens(const rstd::vector<rel::rlang::token> &tokens,
+                                  rstd::vector<rel::rlang::token> &remote_tokens,
+                                  rstd::vector<rel::rlang::token> &merge_tokens) {
+    // Find the start of the last stream operator, ie just after the last pipe that's not in brackets.
+    size_t last_operator_start = 0;
+    size_t depth = 0;
+    size_t i;
+    for (i = 0; i < tokens.size(); ++i) {
+      if (rel::rlang::token::TYPE_OPEN_PAREN == tokens[i].type()) {
+        ++depth;
+      } else if ((rel::rlang::token::TYPE_CLOSE_PAREN == tokens[i].type()) && (depth > 0)) {
+        --depth;
+      } else if ((0 == depth) && (rel::rlang::token::TYPE_OPERATOR == tokens[i].type())
+                  && (str::cmp(tokens[i].text(), "|") == 0)) {
+        last_operator_start = i + 1;
+      }
+    }
+
+    // rel.group ( arguments )
+    if ((tokens.size() < last_operator_start + 4)
+        || (str::cmp(tokens[last_operator_start].text(), "rel.group") != 0)
+        || (rel::rlang::token::TYPE_OPEN_PAREN != tokens[last_operator_start + 1].type())
+        || (rel::rlang::token::TYPE_CLOSE_PAREN != tokens[tokens.size() - 1].type())) {
+      return false;
+    }
+
+    rstd::vector<rel::rlang::token> group_tokens;
+    for (i = last_operator_start + 2; i < tokens.size() - 1; ++i) {
+      group_tokens.push_back(tokens[i]);
+    }
+
+    rstd::vector<rel::rlang::token> partial_group_tokens;
+    if (!rel::group::get_combiner_arguments(group_tokens, partial_group_tokens, merge_tokens)) {
+      return false;
+    }
+
+    remote_tokens.clear();
+    for (i = 0; i < last_operator_start + 2; ++i) {
+      remote_tokens.push_back(tokens[i]);
+    }
+
+    remote_tokens.append(partial_group_tokens);
+    remote_tokens.push_back(tokens[tokens.size() - 1]);
+    return true;
   }
 
 private:
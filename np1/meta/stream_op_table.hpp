@@ -90,6 +90,7 @@ void script_run(io::unbuffered_stream_base &input, io::unbuffered_stream_base &o
 #include "np1/rel/join_natural.hpp"
 #include "np1/rel/join_left.hpp"
 #include "np1/rel/join_anti.hpp"
+#include "np1/rel/join_merge.hpp"
 #include "np1/rel/join_consistent_hash.hpp"
 #include "np1/rel/select.hpp"
 #include "np1/rel/record_count.hpp"
@@ -179,7 +180,13 @@ struct rel_group_wrap : public stream_op_wrap_base {
       "`rel.group(min header_name)` is equivalent to SQL's `SELECT MIN(header_name) FROM ... GROUP BY ...`.  No new column is created, the `header_name` column is used to hold the minimum value.  \n"
       "`rel.group(max header_name)` is equivalent to SQL's `SELECT MAX(header_name) FROM ... GROUP BY ...`.  No new column is created, the `header_name` column is used to hold the maximum value.  \n"
       "`rel.group(sum header_name)` is equivalent to SQL's `SELECT SUM(header_name) FROM ... GROUP BY ...`.  The new heading is called `int:_sum`.  \n"
-      "`rel.group(median header_name)` finds the median in the same way that `rel.group(avg header_name)` finds the average.  The new heading is called `int:_median`.  The `median` aggregator is only in r17 1.8.0 and later.  \n";
+      "`rel.group(median header_name)` finds the median in the same way that `rel.group(avg header_name)` finds the average.  The new heading is called `int:_median`.  When there's an even number of records in a group the median is the lower of the two middle values.  Each group's `int`, `uint` and `double` values are kept in memory, or in temporary files when there are too many, and the middle one is picked out without sorting the input.  The `median` aggregator is only in r17 1.8.0 and later.  \n"
+      "`rel.group(median_approx header_name)` and `rel.group(percentile(p, header_name))` find an approximate median or `p`th percentile (0-100) in one pass, using a quantile sketch of a fixed size for each group instead of sorting the whole input.  The answers are always values from the group and are usually within 1% of the exact answer's rank, and are exact for groups of fewer than 200 records.  The new headings are called `int:_median_approx` and `int:_percentile`.  `rel.group(quantile_sketch header_name)` writes out each group's sketch in a new `string:_quantile_sketch` column instead.  When `header_name` is a `string:_quantile_sketch` column, the sketches are merged, so sketches from different hosts can be combined with a second `rel.group`.  The answers from merged sketches are doubles.  These aggregators are only in r17 2.2.0 and later.  \n"
+      "`rel.group(count_distinct_approx header_name)` is like SQL's `SELECT COUNT(DISTINCT header_name) FROM ... GROUP BY ...` but uses a HyperLogLog counter of a fixed size for each group instead of remembering every value.  The count is exact for small groups and usually within 2% otherwise.  `rel.group(count_distinct_approx(precision, header_name))` uses 2^precision one-byte registers per group (4-18, default 14, about 0.8% standard error).  The new heading is called `uint:_count_distinct_approx`.  `rel.group(hll_sketch header_name)` or `rel.group(hll_sketch(precision, header_name))` writes out each group's counter in a new `string:_hll_sketch` column instead, and `rel.group(hll_merge _hll_sketch)` merges the counters, eg from different hosts, and writes the count.  Counters written by an incompatible version of r17 are rejected rather than merged.  `count_distinct_approx` and `hll_sketch` also merge when `header_name` is a `string:_hll_sketch` column.  These aggregators are only in r17 2.2.0 and later.  \n"
+      "In r17 2.2.0 and later, when the groups won't fit in the number of bytes given by the `NP1_MAX_RECORD_HASH_TABLE_MEMORY` environment variable (default 4GB), the records of the groups that don't fit are partitioned into temporary files which are then grouped one at a time.  The groups that fit are written first.  \n"
+      "In r17 2.2.0 and later, more than one aggregator can be given, e.g. `rel.group(count, sum bytes, min ts, max ts, avg latency)`, and all of them are worked out in one pass.  The groups are on the columns that aren't aggregated, and there is one new column per aggregator, in the order given.  `count`'s column is called `uint:_count` as usual and the others are named after the aggregator and the column, e.g. `sum bytes` makes `uint:_sum_bytes` when `bytes` is a `uint` column.  Only `count`, `sum`, `avg`, `min` and `max` can be used together.  \n"
+      "In r17 2.2.0 and later, when the `NP1_GROUP_INITIAL_NUMBER_THREADS` environment variable is more than 1 (default 1) and the input is not sorted on the groups, `count`, `sum` and `avg` on their own and any combination of aggregators are worked out by that many child processes.  Each child aggregates a batch of the input and then the partial aggregates are merged by key, one partition per child.  The output is the same but the groups come out in a different order.  \n"
+      "In r17 2.2.0 and later, `rel.group(partial, aggregators)` writes partial aggregates instead of finished ones and `rel.group(merge_partial)` merges partial aggregates, so that a group can be split up, e.g. between hosts.  The aggregators can be any of `count`, `sum`, `avg`, `min` and `max`.  The merged output is the same as `rel.group(aggregators)` would have written, except that `min` and `max` on their own make a new column in the same way as when there's more than one aggregator.  \n";
   };
   virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
@@ -194,9 +201,11 @@ struct rel_group_wrap : public stream_op_wrap_base {
 
 
 
+#define NP1_JOIN_SPILL_DESCRIPTION "  In r17 2.2.0 and later, when `other_file_name` won't fit in the number of bytes given by the `NP1_MAX_RECORD_HASH_TABLE_MEMORY` environment variable (default 4GB), the records that don't fit and the input records that might match them are partitioned into temporary files which are then joined one pair at a time.  The output is the same as when everything fits in memory.  In r17 2.2.0 and later, when the `NP1_JOIN_INITIAL_NUMBER_THREADS` environment variable is more than 1 (default 1) and `other_file_name` fits in memory, the input is joined in batches by that many child processes.  The output is the same."
+
 struct rel_join_natural_wrap : public stream_op_wrap_base {
   virtual const char *name() const { return "rel.join.natural"; }
-  virtual const char *description() const { return "`rel.join.natural('other_file_name')` joins the input to `other_file_name`."; };
+  virtual const char *description() const { return "`rel.join.natural('other_file_name')` joins the input to `other_file_name`." NP1_JOIN_SPILL_DESCRIPTION "  In r17 2.2.0 and later, when the input is a quarter of the size of `other_file_name` or smaller, the input is read into memory instead of `other_file_name`.  The columns are the same but the records come out in `other_file_name` order."; };
   virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual void call(mandatory_delimited_input_type &mandatory_delimited_input,
@@ -210,7 +219,7 @@ struct rel_join_natural_wrap : public stream_op_wrap_base {
 
 struct rel_join_left_wrap : public stream_op_wrap_base {
   virtual const char *name() const { return "rel.join.left"; }
-  virtual const char *description() const { return "`rel.join.left('other_file_name')` left-joins the input to `other_file_name`."; };
+  virtual const char *description() const { return "`rel.join.left('other_file_name')` left-joins the input to `other_file_name`." NP1_JOIN_SPILL_DESCRIPTION; };
   virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual void call(mandatory_delimited_input_type &mandatory_delimited_input,
@@ -225,7 +234,7 @@ struct rel_join_left_wrap : public stream_op_wrap_base {
 
 struct rel_join_anti_wrap : public stream_op_wrap_base {
   virtual const char *name() const { return "rel.join.anti"; }
-  virtual const char *description() const { return "`rel.join.anti('other_file_name')` antijoins the input to `other_file_name`."; };
+  virtual const char *description() const { return "`rel.join.anti('other_file_name')` antijoins the input to `other_file_name`." NP1_JOIN_SPILL_DESCRIPTION; };
   virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual void call(mandatory_delimited_input_type &mandatory_delimited_input,
@@ -237,9 +246,56 @@ struct rel_join_anti_wrap : public stream_op_wrap_base {
 } rel_join_anti_instance;
 
 
+#define NP1_JOIN_MERGE_DESCRIPTION "  The input and `other_file_name` must both be sorted on the common headings.  If they both remember the same sort order (see `rel.order_by`) then that order is used, otherwise they must be sorted ascending on the common headings in the order that the headings appear in the input.  Only the current run of equal records from `other_file_name` is held in memory, so any size of input and file can be joined.  It's an error if either is out of order."
+
+struct rel_join_merge_wrap : public stream_op_wrap_base {
+  virtual const char *name() const { return "rel.join.merge"; }
+  virtual const char *since() const { return "2.2.0"; }
+  virtual const char *description() const { return "`rel.join.merge('other_file_name')` joins the input to `other_file_name` in the same way as `rel.join.natural`." NP1_JOIN_MERGE_DESCRIPTION; };
+  virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
+  virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
+  virtual void call(mandatory_delimited_input_type &mandatory_delimited_input,
+                    mandatory_buffered_output_type &mandatory_output,
+                    const rstd::vector<rel::rlang::token> &tokens) const {
+    rel::join_merge op;
+    op(mandatory_delimited_input, mandatory_output, tokens, rel::detail::join_helper::NATURAL);
+  }  
+} rel_join_merge_instance;
+
+
+struct rel_join_merge_left_wrap : public stream_op_wrap_base {
+  virtual const char *name() const { return "rel.join.merge.left"; }
+  virtual const char *since() const { return "2.2.0"; }
+  virtual const char *description() const { return "`rel.join.merge.left('other_file_name')` left-joins the input to `other_file_name` in the same way as `rel.join.left`." NP1_JOIN_MERGE_DESCRIPTION; };
+  virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
+  virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
+  virtual void call(mandatory_delimited_input_type &mandatory_delimited_input,
+                    mandatory_buffered_output_type &mandatory_output,
+                    const rstd::vector<rel::rlang::token> &tokens) const {
+    rel::join_merge op;
+    op(mandatory_delimited_input, mandatory_output, tokens, rel::detail::join_helper::LEFT);
+  }  
+} rel_join_merge_left_instance;
+
+
+struct rel_join_merge_anti_wrap : public stream_op_wrap_base {
+  virtual const char *name() const { return "rel.join.merge.anti"; }
+  virtual const char *since() const { return "2.2.0"; }
+  virtual const char *description() const { return "`rel.join.merge.anti('other_file_name')` antijoins the input to `other_file_name` in the same way as `rel.join.anti`." NP1_JOIN_MERGE_DESCRIPTION; };
+  virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
+  virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
+  virtual void call(mandatory_delimited_input_type &mandatory_delimited_input,
+                    mandatory_buffered_output_type &mandatory_output,
+                    const rstd::vector<rel::rlang::token> &tokens) const {
+    rel::join_merge op;
+    op(mandatory_delimited_input, mandatory_output, tokens, rel::detail::join_helper::ANTI);
+  }  
+} rel_join_merge_anti_instance;
+
+
 struct rel_join_consistent_hash : public stream_op_wrap_base {
   virtual const char *name() const { return "rel.join.consistent_hash"; }
-  virtual const char *description() const { return "`rel.join.consistent_hash('other_file_name')` joins the input to `other_file_name` using a consistent hash (http://en.wikipedia.org/wiki/Consistent_hashing).  This operator will refuse to join two streams with common header names.  Streams may contain duplicate records.  The more times that a record appears in a stream, the more likely it is to be matched & included in the join."; };
+  virtual const char *description() const { return "`rel.join.consistent_hash('other_file_name')` joins the input to `other_file_name` using a consistent hash (http://en.wikipedia.org/wiki/Consistent_hashing).  This operator will refuse to join two streams with common header names.  Streams may contain duplicate records.  The more times that a record appears in a stream, the more likely it is to be matched & included in the join.  `rel.join.consistent_hash('other_file_name', number_virtual_nodes)` puts each `other_file_name` record on the hash circle `number_virtual_nodes` times, which spreads the input records more evenly across the `other_file_name` records.  The default is 1."; };
   virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual void call(mandatory_delimited_input_type &mandatory_delimited_input,
@@ -256,11 +312,12 @@ struct rel_join_consistent_hash : public stream_op_wrap_base {
 
 #define NP1_GENERIC_SORT_DESCRIPTION " will sort by heading a then b, then c"
 #define NP1_GENERIC_SORT_MEMORY_USAGE "Currently the size of the sort input is limited to the available virtual memory minus 30 bytes per record overhead."
+#define NP1_GENERIC_SORT_ORDER_DESCRIPTION "  In r17 2.2.0 and later the sorted stream remembers its sort order.  `rel.group` and `rel.unique` use the sort order to hold only one group at a time in memory, and `rel.join.natural` and `rel.join.left` merge instead of reading the whole file into memory when the input and the file are sorted the same way on the common headings."
 
 struct rel_order_by_wrap : public stream_op_wrap_base {
   virtual const char *name() const { return "rel.order_by"; }
   virtual const char *description() const {
-    return "`rel.order_by(a, b, c)`" NP1_GENERIC_SORT_DESCRIPTION " using the default search strategy: a stable merge sort.  " NP1_GENERIC_SORT_MEMORY_USAGE;
+    return "`rel.order_by(a, b, c)`" NP1_GENERIC_SORT_DESCRIPTION " using the default search strategy: a stable merge sort.  " NP1_GENERIC_SORT_MEMORY_USAGE NP1_GENERIC_SORT_ORDER_DESCRIPTION;
   };
   virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
   virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
@@ -420,7 +477,7 @@ struct rel_where_wrap : public stream_op_wrap_base {
 struct rel_unique_wrap : public stream_op_wrap_base {
   virtual const char *name() const { return "rel.unique"; }
   virtual const char *description() const {
-    return "`rel.unique()` includes only a single copy of duplicate records in the output stream.  Approximately equivalent to SQL's DISTINCT clause.";
+    return "`rel.unique()` includes only a single copy of duplicate records in the output stream.  Approximately equivalent to SQL's DISTINCT clause.  The first copy of each record is the one that's included, and the output is in input order.  If there are too many distinct records to fit in `NP1_MAX_RECORD_HASH_TABLE_MEMORY` bytes then the rest are partitioned into temporary files and dealt with afterwards.";
   };
 
   virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
@@ -435,6 +492,25 @@ struct rel_unique_wrap : public stream_op_wrap_base {
 } rel_unique_instance;
 
 
+struct rel_unique_fingerprint_wrap : public stream_op_wrap_base {
+  virtual const char *name() const { return "rel.unique.fingerprint"; }
+  virtual const char *since() const { return "2.2.0"; }
+  virtual const char *description() const {
+    return "`rel.unique.fingerprint()` is the same as `rel.unique()` except that it remembers a 128-bit hash of each distinct record instead of the record itself, so it uses much less memory when records are wide.  There is a very small chance that two different records will have the same hash, in which case only the first of them is included in the output.";
+  };
+
+  virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
+  virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
+
+  virtual void call(mandatory_delimited_input_type &mandatory_delimited_input,
+                    mandatory_buffered_output_type &mandatory_output,
+                    const rstd::vector<rel::rlang::token> &tokens) const {
+    rel::unique op;
+    op(mandatory_delimited_input, mandatory_output, tokens, true);
+  }
+} rel_unique_fingerprint_instance;
+
+
 struct rel_str_split : public stream_op_wrap_base {
   virtual const char *name() const { return "rel.str_split"; }
   virtual const char *description() const {
@@ -795,7 +871,7 @@ struct io_file_read_wrap : public stream_op_wrap_base {
       NP1_ASSERT(are_all_headings_equal(file_names),
                   "If one file argument to io.file.read is an r17 native file, all files must be r17 native files with the same set of headings.");
 
-      copy_native_files(file_names, mandatory_output);            
+      copy_native_files(file_names, mandatory_output);
     } else {
       copy_non_native_files(file_names, mandatory_output);
     }
@@ -804,6 +880,8 @@ struct io_file_read_wrap : public stream_op_wrap_base {
   static void copy_native_files(const rstd::vector<rstd::string> &file_names,
                                 io::mandatory_output_stream<io::unbuffered_stream_base> &mandatory_output) {
     bool written_first_file = false;
+    // The files are concatenated so the sort order of any one file doesn't hold for the whole output.
+    bool keep_sort_order = (file_names.size() == 1);
     rstd::vector<rstd::string>::const_iterator i = file_names.begin();
     rstd::vector<rstd::string>::const_iterator iz = file_names.end();
     for (; i != iz; ++i) {
@@ -813,13 +891,13 @@ struct io_file_read_wrap : public stream_op_wrap_base {
         NP1_ASSERT(file.open_ro(file_name.c_str()), "Unable to open & map compressed input file " + file_name);
         io::mandatory_input_stream<io::gzfile> mandatory_input(file);
         io::mandatory_record_input_stream<io::gzfile, rel::record, rel::record_ref> record_input(file);
-        record_input.parse_records(record_callback(mandatory_output, written_first_file));
+        record_input.parse_records(record_callback(mandatory_output, written_first_file, keep_sort_order));
       } else {
         io::file file;
         NP1_ASSERT(file.open_ro(file_name.c_str()), "Unable to open & map input file " + file_name);
         io::mandatory_input_stream<io::file> mandatory_input(file);
         io::mandatory_record_input_stream<io::file, rel::record, rel::record_ref> record_input(file);
-        record_input.parse_records(record_callback(mandatory_output, written_first_file));
+        record_input.parse_records(record_callback(mandatory_output, written_first_file, keep_sort_order));
       }
       
       written_first_file = true;
@@ -827,12 +905,16 @@ struct io_file_read_wrap : public stream_op_wrap_base {
   }
 
   struct record_callback {
-    record_callback(io::mandatory_output_stream<io::unbuffered_stream_base> &output, bool written_first_file) 
-      : m_output(output), m_written_first_file(written_first_file), m_seen_first_record(false) {}
+    record_callback(io::mandatory_output_stream<io::unbuffered_stream_base> &output, bool written_first_file,
+                    bool keep_sort_order) 
+      : m_output(output), m_written_first_file(written_first_file), m_keep_sort_order(keep_sort_order),
+        m_seen_first_record(false) {}
       
     bool operator()(const rel::record_ref &r) {
-      if (!m_written_first_file || m_seen_first_record) {
+      if (m_seen_first_record || (!m_written_first_file && m_keep_sort_order)) {
         r.write(m_output);
+      } else if (!m_written_first_file) {
+        r.write_with_checksum(m_output, 0);
       }
 
       m_seen_first_record = true;      
@@ -841,6 +923,7 @@ struct io_file_read_wrap : public stream_op_wrap_base {
     
     io::mandatory_output_stream<io::unbuffered_stream_base> &m_output;
     bool m_written_first_file;
+    bool m_keep_sort_order;
     bool m_seen_first_record;
   };
 
@@ -905,7 +988,7 @@ struct io_file_read_wrap : public stream_op_wrap_base {
     for (; i != iz; ++i) {
       rel::record headings = parse_headings(*i);
       if (has_first_file_headings) {
-        if (!headings.ref().is_equal(first_file_headings.ref())) {
+        if (!headings.ref().is_equal_ignoring_checksum(first_file_headings.ref())) {
           return false;
         }
       } else {
@@ -963,6 +1046,39 @@ struct io_file_overwrite_wrap : public stream_op_wrap_base {
 
 
 
+struct io_index_build_wrap : public stream_op_wrap_base {
+  virtual const char *name() const { return "io.index.build"; }
+  virtual const char *since() const { return "2.2.0"; }
+  virtual const char *description() const {
+    return "`io.index.build(file_name, a, b, c)` builds a hash index of the uncompressed r17 native file `file_name` on headings `a`, `b` and `c`, and writes it to `file_name` followed by `.r17_index`.  "
+            "`rel.join.natural`, `rel.join.left` and `rel.join.anti` use the index instead of reading `file_name` into memory when the common headings are exactly the index headings and `file_name` has the same size, modification and change times (to the nanosecond), device and inode as when the index was built.  "
+            "The index and the file are mapped into memory rather than read, so concurrent joins against the same file share the same memory.  "
+            "The input stream is ignored.";
+  }
+
+  virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_NONE; }
+  virtual stream_op_table_io_type_type output_type() const { return STREAM_OP_TABLE_IO_TYPE_NONE; }
+
+  virtual void call(io::unbuffered_stream_base &input,
+                    io::unbuffered_stream_base &output,
+                    const rstd::vector<rel::rlang::token> &tokens) const {
+    rstd::vector<rstd::vector<rel::rlang::token> > arguments = rel::rlang::compiler::split_expressions(tokens);
+    NP1_ASSERT(arguments.size() >= 2, "io.index.build needs a file name and at least one heading name");
+    rstd::string file_name(rel::rlang::compiler::eval_to_string_only(arguments[0]));
+
+    rstd::vector<rstd::string> key_heading_names;
+    size_t i;
+    for (i = 1; i < arguments.size(); ++i) {
+      arguments[i][0].assert(arguments[i].size() == 1, "Complex expressions are not allowed here- only heading names");
+      key_heading_names.push_back(arguments[i][0].text());
+    }
+
+    rel::detail::record_index::build(file_name, key_heading_names);
+  }
+} io_index_build_instance;
+
+
+
 struct io_directory_list_wrap : public stream_op_wrap_base {
   virtual const char *name() const { return "io.directory.list"; }
   virtual const char *description() const {
@@ -1252,7 +1368,11 @@ struct meta_parallel_explicit_mapping_wrap : public stream_op_wrap_base {
             "It reads the [`" NP1_META_PARALLEL_EXPLICIT_MAPPING_HEADING_FILE_NAME "`, `" NP1_META_PARALLEL_EXPLICIT_MAPPING_HEADING_HOST_NAME "`] mapping from the input.  "
             "The current user must be able to SSH to the remote machine(s) without a password.  "
             "r17 must be in the PATH on all remote machine(s).  "
-            "The output of inline_script must be a normal record stream.";
+            "The output of inline_script must be a normal record stream.  "
+            "In r17 2.2.0 and later, when inline_script ends in `rel.group`, each host only works out partial aggregates and they're merged "
+            "locally, so the output is the same as grouping all the files at once.  "
+            "This works for `count`, `sum`, `avg`, `min`, `max` and the approximate aggregators, which are merged from their sketches.  "
+            "The `median` and `sum_count` aggregators aren't merged.";
   }
 
   virtual stream_op_table_io_type_type input_type() const { return STREAM_OP_TABLE_IO_TYPE_R17_NATIVE; }
@@ -1350,6 +1470,9 @@ private:
       &rel_join_natural_instance,
       &rel_join_left_instance,
       &rel_join_anti_instance,
+      &rel_join_merge_instance,
+      &rel_join_merge_left_instance,
+      &rel_join_merge_anti_instance,
       &rel_join_consistent_hash_instance,
       &rel_order_by_instance,
       &rel_order_by_desc_instance,
@@ -1362,6 +1485,7 @@ private:
       &rel_record_split_instance,
       &rel_where_instance,
       &rel_unique_instance,
+      &rel_unique_fingerprint_instance,
       &rel_str_split,
       &rel_assert_empty_instance,
       &rel_assert_nonempty_instance,
@@ -1380,6 +1504,7 @@ private:
       &io_file_read_instance,
       &io_file_append_instance,
       &io_file_overwrite_instance,
+      &io_index_build_instance,
       &io_directory_list_instance,
       &io_ls_instance,
       &io_directory_list_recurse_instance,
@@ -132,6 +132,11 @@ void mandatory_execvp(const rstd::vector<rstd::string> &args, int stdin_fd, int
 // Class to help get stuff done concurrently.  A process is forked for each job, it's not literally a pool of long-lived
 // processes.  This class uses a very basic control system algorithm to set the maximum number of processes allowed
 // in a pool.  It varies the pool size dynamically.
+//
+// r17 has no thread support, so this is how the sort, hash join probing and rel.group use more than one CPU.  A
+// child sees a copy-on-write snapshot of the parent's memory, so read-only structures like hash tables are shared
+// for free, and it hands its results back in a temporary file.  The NP1_*_INITIAL_NUMBER_THREADS environment
+// variables are really initial pool sizes.
 template <typename On_Exit>
 class pool {
 public:
@@ -0,0 +1,264 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_QUANTILE_SKETCH_HPP
+#define NP1_QUANTILE_SKETCH_HPP
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "rstd/string.hpp"
+#include "rstd/vector.hpp"
+#include "np1/str.hpp"
+
+
+namespace np1 {
+
+/// A KLL quantile sketch.  See Karnin, Lang & Liberty, "Optimal Quantile Approximation in Streams".
+/**
+ * The sketch keeps a sample of the values it's been given in levels, where each value at level h stands for 2^h
+ * of the original values.  When the sketch gets too big the lowest level that's over its capacity is sorted and
+ * every second value moves up a level, so the memory used is bounded by roughly 3k values no matter how many are
+ * added.  The rank error is around 1.7% for the default k.  Which of each pair of values moves up alternates
+ * rather than being random so that the same input always gives the same answers.
+ *
+ * Sketches can be merged, so partial sketches can be worked out in different places and combined later.  They
+ * can be written out as strings for that.  The answers are always values that were given to the sketch.
+ */
+class quantile_sketch {
+public:
+  enum { DEFAULT_K = 200, MIN_LEVEL_CAPACITY = 2 };
+
+public:
+  explicit quantile_sketch(size_t k = DEFAULT_K) : m_k(k), m_n(0), m_size(0), m_compaction_offset(0) {
+    m_levels.resize(1);
+  }
+
+  ~quantile_sketch() {}
+
+  void add(double value) {
+    m_levels[0].push_back(value);
+    ++m_n;
+    ++m_size;
+    if (m_size >= max_size()) {
+      compact();
+    }
+  }
+
+  /// Add all the values that other has been given.
+  void merge(const quantile_sketch &other) {
+    while (m_levels.size() < other.m_levels.size()) {
+      m_levels.resize(m_levels.size() + 1);
+    }
+
+    size_t h;
+    for (h = 0; h < other.m_levels.size(); ++h) {
+      const rstd::vector<double> &other_level = other.m_levels[h];
+      rstd::vector<double>::const_iterator i = other_level.begin();
+      rstd::vector<double>::const_iterator iz = other_level.end();
+      for (; i != iz; ++i) {
+        m_levels[h].push_back(*i);
+      }
+    }
+
+    m_n += other.m_n;
+    m_size += other.m_size;
+    while (m_size >= max_size()) {
+      compact();
+    }
+  }
+
+  /// The number of values that the sketch has been given.
+  uint64_t count() const { return m_n; }
+
+  /// Get the value at quantile q, 0 <= q <= 1.  0.5 is the median.  When the number of values is even the median
+  /// is the lower of the two middle values.  The sketch must not be empty.
+  double quantile(double q) const {
+    NP1_ASSERT(m_n > 0, "Quantile of an empty sketch");
+    rstd::vector<weighted_value> values;
+    size_t h;
+    for (h = 0; h < m_levels.size(); ++h) {
+      rstd::vector<double>::const_iterator i = m_levels[h].begin();
+      rstd::vector<double>::const_iterator iz = m_levels[h].end();
+      for (; i != iz; ++i) {
+        weighted_value wv;
+        wv.m_value = *i;
+        wv.m_weight = (uint64_t)1 << h;
+        values.push_back(wv);
+      }
+    }
+
+    qsort(values.begin(), values.size(), sizeof(weighted_value), compare_weighted_values);
+
+    double target_weight = ((q < 0) ? 0 : ((q > 1) ? 1 : q)) * m_n;
+    uint64_t weight = 0;
+    rstd::vector<weighted_value>::const_iterator i = values.begin();
+    rstd::vector<weighted_value>::const_iterator iz = values.end();
+    for (; i != iz; ++i) {
+      weight += i->m_weight;
+      if ((double)weight >= target_weight) {
+        return i->m_value;
+      }
+    }
+
+    return values[values.size() - 1].m_value;
+  }
+
+  /// Write the sketch as a string that from_string() understands:  k, count, then the values at each level.
+  rstd::string to_string() const {
+    char buffer[64];
+    sprintf(buffer, "%llu %llu", (unsigned long long)m_k, (unsigned long long)m_n);
+    rstd::string s(buffer);
+    size_t h;
+    for (h = 0; h < m_levels.size(); ++h) {
+      s.push_back('|');
+      rstd::vector<double>::const_iterator i = m_levels[h].begin();
+      rstd::vector<double>::const_iterator iz = m_levels[h].end();
+      for (; i != iz; ++i) {
+        if (i != m_levels[h].begin()) {
+          s.push_back(' ');
+        }
+
+        str::to_round_trip_dec_str(buffer, *i);
+        s.append(buffer);
+      }
+    }
+
+    return s;
+  }
+
+  /// Replace the contents of the sketch with a sketch written by to_string().  Returns false if s is not a sketch.
+  bool from_string(const char *s, size_t length) {
+    rstd::string copy(s, length);
+    const char *p = copy.c_str();
+    const char *copy_end = p + copy.length();
+    char *end;
+    uint64_t k = strtoull(p, &end, 10);
+    if ((end == p) || (0 == k)) {
+      return false;
+    }
+
+    p = end;
+    uint64_t n = strtoull(p, &end, 10);
+    if (end == p) {
+      return false;
+    }
+
+    p = end;
+    m_k = k;
+    m_n = n;
+    m_size = 0;
+    m_levels.clear();
+    while ('|' == *p) {
+      ++p;
+      m_levels.resize(m_levels.size() + 1);
+      while (('\0' != *p) && ('|' != *p)) {
+        double value = str::partial_dec_to_double(p, copy_end, &end);
+        if (end == p) {
+          return false;
+        }
+
+        m_levels[m_levels.size() - 1].push_back(value);
+        ++m_size;
+        p = end;
+        while (' ' == *p) {
+          ++p;
+        }
+      }
+    }
+
+    if (m_levels.empty()) {
+      m_levels.resize(1);
+    }
+
+    return '\0' == *p;
+  }
+
+private:
+  struct weighted_value {
+    double m_value;
+    uint64_t m_weight;
+  };
+
+  static int compare_weighted_values(const void *p1, const void *p2) {
+    double v1 = ((const weighted_value *)p1)->m_value;
+    double v2 = ((const weighted_value *)p2)->m_value;
+    return (v1 < v2) ? -1 : ((v1 > v2) ? 1 : 0);
+  }
+
+  static int compare_doubles(const void *p1, const void *p2) {
+    double v1 = *(const double *)p1;
+    double v2 = *(const double *)p2;
+    return (v1 < v2) ? -1 : ((v1 > v2) ? 1 : 0);
+  }
+
+  // The top level holds k values and each level below holds 2/3 as many as the one above it.
+  size_t level_capacity(size_t h) const {
+    double capacity = (double)m_k;
+    size_t depth;
+    for (depth = m_levels.size() - 1 - h; depth > 0; --depth) {
+      capacity = capacity * 2 / 3;
+    }
+
+    return ((size_t)capacity < MIN_LEVEL_CAPACITY) ? (size_t)MIN_LEVEL_CAPACITY : (size_t)capacity;
+  }
+
+  size_t max_size() const {
+    size_t size = 0;
+    size_t h;
+    for (h = 0; h < m_levels.size(); ++h) {
+      size += level_capacity(h);
+    }
+
+    return size;
+  }
+
+  // Halve the lowest level that's over capacity.
+  void compact() {
+    size_t h;
+    for (h = 0; h < m_levels.size(); ++h) {
+      if (m_levels[h].size() >= level_capacity(h)) {
+        break;
+      }
+    }
+
+    if (h == m_levels.size()) {
+      h = 0;
+    }
+
+    if (h + 1 == m_levels.size()) {
+      m_levels.resize(m_levels.size() + 1);
+    }
+
+    rstd::vector<double> level;
+    level.swap(m_levels[h]);
+    qsort(level.begin(), level.size(), sizeof(double), compare_doubles);
+
+    // With an odd number of values the first one stays where it is.
+    size_t i = 0;
+    if (level.size() % 2 != 0) {
+      m_levels[h].push_back(level[0]);
+      i = 1;
+    }
+
+    for (; i < level.size(); i += 2) {
+      m_levels[h + 1].push_back(level[i + m_compaction_offset]);
+      --m_size;
+    }
+
+    m_compaction_offset = 1 - m_compaction_offset;
+  }
+
+private:
+  size_t m_k;
+  uint64_t m_n;
+  size_t m_size;
+  size_t m_compaction_offset;
+  rstd::vector<rstd::vector<double> > m_levels;
+};
+
+
+} // namespaces
+
+
+#endif
@@ -4,7 +4,7 @@
 #define NP1_NP1_REGEX_PATTERN_CACHE_HPP
 
 #include "np1/regex/pattern.hpp"
-#include "np1/hash/fnv1a64.hpp"
+#include "np1/hash/wyhash64.hpp"
 
 namespace np1 {
 namespace regex {
@@ -31,8 +31,8 @@ private:
 private:
   pattern &do_get(const str::ref &pattern_str, bool case_sensitive) {
     size_t pattern_str_len = pattern_str.length();
-    uint64_t hval = hash::fnv1a64::add(pattern_str.ptr(),
-                                        pattern_str_len, hash::fnv1a64::init());
+    uint64_t hval = hash::wyhash64::add(pattern_str.ptr(),
+                                         pattern_str_len, hash::wyhash64::init());
     size_t offset = (size_t)hval & (CACHE_HASH_TABLE_SIZE-1);
     entry *e = &m_entries[offset];
     if ((str::cmp(pattern_str, e->m_pattern_string) != 0) || (case_sensitive != e->m_is_case_sensitive)) {    
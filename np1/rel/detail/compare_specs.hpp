@@ -16,6 +16,8 @@ public:
   typedef const compare_spec *const_iterator;
   
 public:
+  compare_specs() {}
+
   // The specs in spec vector will be in the same order as the headings.
   template <typename Record>
   compare_specs(const Record &headings, const char **selected_heading_names, 
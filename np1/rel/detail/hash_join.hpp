@@ -0,0 +1,734 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_DETAIL_HASH_JOIN_HPP
+#define NP1_REL_DETAIL_HASH_JOIN_HPP
+
+
+#include "rstd/list.hpp"
+#include "rstd/vector.hpp"
+#include "np1/bloom_filter.hpp"
+#include "np1/environment.hpp"
+#include "np1/process.hpp"
+#include "np1/io/buffered_output_stream.hpp"
+#include "np1/io/file.hpp"
+#include "np1/io/mandatory_input_stream.hpp"
+#include "np1/io/mandatory_output_stream.hpp"
+#include "np1/io/heap_buffer_output_stream.hpp"
+#include "np1/rel/record_arena.hpp"
+#include "np1/rel/detail/compare_specs.hpp"
+#include "np1/rel/detail/join_helper.hpp"
+#include "np1/rel/detail/record_index.hpp"
+#include "np1/rel/detail/record_partitions.hpp"
+#include "np1/rel/detail/spilling_record_multihashmap.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace detail {
+
+/// Joins where the second input is read into a hash table and the first input is streamed past it.
+/**
+ * When the second input won't fit in NP1_MAX_RECORD_HASH_TABLE_MEMORY bytes this becomes a hybrid hash join.  The
+ * keys that fit stay in memory and the second-input records with other keys are partitioned into temporary files.
+ * First-input records that don't match an in-memory key are partitioned the same way, and then each pair of
+ * partitions is joined in the same way, one level down.
+ *
+ * The output must come out in the same order as it would if everything fit in memory, so while partitioning is
+ * going on every output record carries the number of the first-input record it came from in its checksum.  Once
+ * all the partitions have been joined their outputs are merged on that number.
+ *
+ * When the hash table is too big to stay in the CPU cache, a Bloom filter of the keys is checked first so that
+ * input1 records with no match cost one cache miss instead of a trip through the table.
+ *
+ * When NP1_JOIN_INITIAL_NUMBER_THREADS is more than 1 and input2 fit in memory, input1 is split into batches
+ * which are probed by child processes.  The output is written in input1 order, same as always.
+ *
+ * When input2's file has an up-to-date record_index on the join headings, input1 is probed against the mapped
+ * index instead and there's no hash table at all.
+ */
+namespace hash_join
+{
+
+typedef spilling_record_multihashmap<join_helper::empty_type> map_type;
+
+
+// Hash tables with fewer keys than this probably fit in the cache so there's no point in a Bloom filter.
+enum { MIN_BLOOM_FILTER_KEYS = 64 * 1024 };
+
+
+// Writes the joined records to the real output.
+template <typename Output>
+class stream_sink {
+public:
+  explicit stream_sink(Output &output) : m_output(output) {}
+
+  void write(const record_ref &r, uint64_t tag) {
+    // Records that have been through a partition have a tag in their checksum, which must not escape.
+    r.write_with_checksum(m_output, 0);
+  }
+
+  void write_merged(const record_ref &r1, const record_ref &r2,
+                    const rstd::vector<size_t> &r2_non_common_field_numbers,
+                    rstd::vector<str::ref> &r2_non_common_field_refs_storage, uint64_t tag) {
+    join_helper::record_merge_write(
+      m_output, r1, r2, r2_non_common_field_numbers, r2_non_common_field_refs_storage);
+  }
+
+private:
+  Output &m_output;
+};
+
+
+// Writes the joined records to a temporary file, tagged with the number of the first-input record that they
+// came from.
+class partition_sink {
+public:
+  enum { INITIAL_BUFFER_SIZE = 4096 };
+
+public:
+  explicit partition_sink(record_partitions::partition &p) : m_partition(p), m_buffer(INITIAL_BUFFER_SIZE) {}
+
+  void write(const record_ref &r, uint64_t tag) {
+    m_partition.write_with_checksum(r, tag);
+  }
+
+  void write_merged(const record_ref &r1, const record_ref &r2,
+                    const rstd::vector<size_t> &r2_non_common_field_numbers,
+                    rstd::vector<str::ref> &r2_non_common_field_refs_storage, uint64_t tag) {
+    m_buffer.reset();
+    join_helper::record_merge_write(
+      m_buffer, r1, r2, r2_non_common_field_numbers, r2_non_common_field_refs_storage);
+    write(record_ref(m_buffer.ptr(), m_buffer.ptr() + m_buffer.size(), 0), tag);
+  }
+
+private:
+  /// Disable copy.
+  partition_sink(const partition_sink &);
+  partition_sink &operator = (const partition_sink &);
+
+private:
+  record_partitions::partition &m_partition;
+  io::heap_buffer_output_stream m_buffer;
+};
+
+
+// If file2 has an up-to-date index on the common headings then there's no hash table to build.  The index decides
+// the order of the headings, so the compare specs are set up once we know whether there is one.  Returns true if
+// the index was opened.
+bool open_index(const rstd::string &file_name2, const record &file1_headers, const record &file2_headers,
+                const rstd::vector<rstd::string> &common_heading_names, record_index &index2,
+                compare_specs &compare_specs1, compare_specs &compare_specs2) {
+  bool is_indexed = index2.open(file_name2, common_heading_names);
+  const rstd::vector<rstd::string> &key_heading_names =
+    is_indexed ? index2.key_heading_names() : common_heading_names;
+  compare_specs(file1_headers, key_heading_names).swap(compare_specs1);
+  compare_specs(file2_headers, key_heading_names).swap(compare_specs2);
+
+  // Check that the join participants are all data types we support.
+  join_helper::validate_compare_specs(compare_specs1);
+  join_helper::validate_compare_specs(compare_specs2);
+  return is_indexed;
+}
+
+
+class joiner {
+public:
+  // empty_r2 is only used by left joins, it's the record to use when there's no match.
+  joiner(join_helper::join_type type, const compare_specs &specs1, const compare_specs &specs2,
+         const rstd::vector<size_t> &file2_non_common_field_numbers, const record *empty_r2)
+    : m_type(type), m_specs1(specs1), m_specs2(specs2),
+      m_file2_non_common_field_numbers(file2_non_common_field_numbers), m_empty_r2(empty_r2) {
+    NP1_ASSERT((join_helper::LEFT != m_type) || m_empty_r2, "Left joins need an empty second-input record");
+  }
+
+  // Join the two inputs.  The headings must already have been read from both inputs and written to the output.
+  template <typename Input1, typename Input2, typename Output>
+  void operator()(Input1 &input1, Input2 &input2, Output &output) {
+    stream_sink<Output> sink(output);
+    size_t number_threads = environment::join_initial_number_threads();
+    if (number_threads <= 1) {
+      join(input1, false, input2, sink, 0);
+      return;
+    }
+
+    // Probing in parallel only works when input2 fit in memory.
+    level_join<stream_sink<Output> > lj(*this, input2, false, sink, 0);
+    if (lj.is_partitioned()) {
+      input1.parse_records(probe_record_callback<stream_sink<Output> >(lj));
+    } else {
+      parallel_prober<Output> prober(lj, output, number_threads);
+      input1.parse_records(parallel_probe_record_callback<Output>(prober));
+      prober.finish();
+    }
+
+    lj.finish();
+  }
+
+  // Like operator() but input1 might be the small side.  Up to max_input1_size bytes of input1 are read into
+  // memory first.  If that's all of input1 then the hash table is built from input1 and input2 is streamed past
+  // it instead.  Only for natural joins.  The columns are the same either way but the records come out in input2
+  // order rather than input1 order, so the output headings must not have been written yet.  They're written
+  // here once it's clear which order the records are in, with input1_order only if it still holds.
+  template <typename Input1, typename Input2, typename Output>
+  void operator()(Input1 &input1, Input2 &input2, Output &output, uint64_t max_input1_size,
+                  const record &output_headings, const sort_order &input1_order) {
+    NP1_ASSERT(join_helper::NATURAL == m_type, "Only natural joins can build the hash table from either input");
+    buffered_input1_join<Input2, Output> buffered_join(
+      *this, input2, output, max_input1_size, output_headings, input1_order);
+    input1.parse_records(buffered_input1_record_callback<Input2, Output>(buffered_join));
+    buffered_join.finish();
+  }
+
+  // Join input1 to input2's file through its index, so there's no hash table to build.  The specs must be in the
+  // index's key order.
+  template <typename Input1, typename Output>
+  void join_index(Input1 &input1, const record_index &index2, Output &output) {
+    stream_sink<Output> sink(output);
+    input1.parse_records(index_probe_record_callback<stream_sink<Output> >(*this, index2, sink));
+  }
+
+private:
+  template <typename Input1, typename Input2, typename Sink>
+  void join(Input1 &input1, bool input1_is_tagged, Input2 &input2, Sink &sink, size_t level) {
+    level_join<Sink> lj(*this, input2, input1_is_tagged, sink, level);
+    input1.parse_records(probe_record_callback<Sink>(lj));
+    lj.finish();
+  }
+
+
+  struct build_record_callback {
+    explicit build_record_callback(map_type &map2) : m_map2(map2) {}
+
+    bool operator()(const record_ref &r2) const {
+      m_map2.insert(r2, join_helper::empty_type());
+      return true;
+    }
+
+    map_type &m_map2;
+  };
+
+
+  struct bloom_filter_insert_callback {
+    explicit bloom_filter_insert_callback(bloom_filter &filter) : m_filter(filter) {}
+    void operator()(uint64_t hval) const { m_filter.insert(hval); }
+    bloom_filter &m_filter;
+  };
+
+
+  // One level of the join.  The constructor reads input2 into the hash table, then probe() is called for each
+  // input1 record, then finish() joins any partitions.
+  template <typename Sink>
+  class level_join {
+  public:
+    template <typename Input2>
+    level_join(joiner &j, Input2 &input2, bool input1_is_tagged, Sink &sink, size_t level)
+      : m_joiner(j), m_input1_is_tagged(input1_is_tagged), m_sink(sink), m_level(level),
+        m_partitions1(j.m_specs1, level), m_partitions2(j.m_specs2, level),
+        m_map2(new (rstd::detail::mem::alloc(sizeof(map_type))) map_type(j.m_specs2, m_partitions2, level)),
+        m_filter2(NULL), m_resident_output(NULL), m_resident_sink(NULL) {
+      input2.parse_records(build_record_callback(*m_map2));
+
+      if (m_map2->size() >= MIN_BLOOM_FILTER_KEYS) {
+        m_filter2 = new (rstd::detail::mem::alloc(sizeof(bloom_filter))) bloom_filter(m_map2->size());
+        bloom_filter_insert_callback insert_callback(*m_filter2);
+        m_map2->for_each_hash(insert_callback);
+      }
+
+      // Some of input2 didn't fit so the output needs to be tagged and merged.
+      if (m_partitions2.size() > 0) {
+        m_resident_output =
+          new (rstd::detail::mem::alloc(sizeof(record_partitions::partition))) record_partitions::partition();
+        m_resident_sink = new (rstd::detail::mem::alloc(sizeof(partition_sink))) partition_sink(*m_resident_output);
+      }
+    }
+
+    ~level_join() {
+      free_map();
+      if (m_resident_output) {
+        rstd::detail::mem::destruct_and_free(m_resident_sink);
+        rstd::detail::mem::destruct_and_free(m_resident_output);
+      }
+    }
+
+    // The record_ref we get here is from input1.
+    void probe(const record_ref &r1) {
+      uint64_t tag = m_input1_is_tagged ? r1.checksum() : r1.record_number();
+      const map_type::equal_list_type *equal_list = find(r1);
+      if (!m_resident_output) {
+        probe(r1, equal_list, tag, m_sink);
+      } else if (equal_list) {
+        probe(r1, equal_list, tag, *m_resident_sink);
+      } else {
+        // The matching records, if any, are in a partition.
+        m_partitions1.write_with_checksum(r1, tag);
+      }
+    }
+
+    // True if some of input2 didn't fit in memory.
+    bool is_partitioned() const { return m_resident_output != NULL; }
+
+    // Probe with an input1 record and write the output to any sink.  This doesn't change the level_join so it's
+    // safe to call from a child process, but it's only for when nothing is partitioned.
+    template <typename Probe_Sink>
+    void probe_resident(const record_ref &r1, Probe_Sink &sink) {
+      NP1_ASSERT(!is_partitioned(), "Attempt to probe only the resident records when some are partitioned");
+      probe(r1, find(r1), 0, sink);
+    }
+
+    void finish() {
+      if (!m_resident_output) {
+        return;
+      }
+
+      // The hash table is no longer needed so make room to join the partitions.
+      free_map();
+
+      rstd::vector<record_partitions::partition *> outputs;
+      outputs.push_back(m_resident_output);
+
+      size_t i;
+      for (i = 0; i < m_partitions1.size(); ++i) {
+        if (m_partitions1[i].number_records() > 0) {
+          record_partitions::partition *output =
+            new (rstd::detail::mem::alloc(sizeof(record_partitions::partition))) record_partitions::partition();
+          outputs.push_back(output);
+          partition_sink output_sink(*output);
+          m_joiner.join(m_partitions1[i], true, m_partitions2[i], output_sink, m_level + 1);
+        }
+      }
+
+      record_partitions::merge_tagged(outputs, m_sink);
+
+      for (i = 1; i < outputs.size(); ++i) {
+        rstd::detail::mem::destruct_and_free(outputs[i]);
+      }
+    }
+
+  private:
+    /// Disable copy.
+    level_join(const level_join &);
+    level_join &operator = (const level_join &);
+
+  private:
+    template <typename Probe_Sink>
+    void probe(const record_ref &r1, const map_type::equal_list_type *equal_list, uint64_t tag,
+               Probe_Sink &sink) {
+      if (join_helper::ANTI == m_joiner.m_type) {
+        if (!equal_list) {
+          sink.write(r1, tag);
+        }
+
+        return;
+      }
+
+      if (equal_list) {
+        map_type::equal_list_type::const_iterator i = equal_list->begin();
+        map_type::equal_list_type::const_iterator iz = equal_list->end();
+        for (; i != iz; ++i) {
+          sink.write_merged(r1, i->first, m_joiner.m_file2_non_common_field_numbers,
+                            m_file2_non_common_field_refs_storage, tag);
+        }
+      } else if (join_helper::LEFT == m_joiner.m_type) {
+        sink.write_merged(r1, m_joiner.m_empty_r2->ref(), m_joiner.m_file2_non_common_field_numbers,
+                          m_file2_non_common_field_refs_storage, tag);
+      }
+    }
+
+    const map_type::equal_list_type *find(const record_ref &r1) {
+      if (!m_filter2) {
+        return m_map2->find(r1, m_joiner.m_specs1);
+      }
+
+      uint64_t hval = m_map2->hash(r1, m_joiner.m_specs1);
+      return m_filter2->might_contain(hval) ? m_map2->find(r1, m_joiner.m_specs1, hval) : NULL;
+    }
+
+    void free_map() {
+      if (m_filter2) {
+        rstd::detail::mem::destruct_and_free(m_filter2);
+        m_filter2 = NULL;
+      }
+
+      if (m_map2) {
+        rstd::detail::mem::destruct_and_free(m_map2);
+        m_map2 = NULL;
+      }
+    }
+
+  private:
+    joiner &m_joiner;
+    bool m_input1_is_tagged;
+    Sink &m_sink;
+    size_t m_level;
+    record_partitions m_partitions1;
+    record_partitions m_partitions2;
+    map_type *m_map2;
+    bloom_filter *m_filter2;
+    record_partitions::partition *m_resident_output;
+    partition_sink *m_resident_sink;
+    rstd::vector<str::ref> m_file2_non_common_field_refs_storage;
+  };
+
+
+  template <typename Sink>
+  struct probe_record_callback {
+    explicit probe_record_callback(level_join<Sink> &lj) : m_level_join(lj) {}
+
+    bool operator()(const record_ref &r1) const {
+      m_level_join.probe(r1);
+      return true;
+    }
+
+    level_join<Sink> &m_level_join;
+  };
+
+
+  // Probes batches of input1 in child processes.  The hash table is read-only by the time that probing starts so
+  // each child can use its copy of the table.  Each child writes its output to a temporary file and the files
+  // are copied to the real output in input1 order as the children finish.
+  template <typename Output>
+  class parallel_prober {
+  public:
+    enum { BATCH_SIZE = 16 * 1024 * 1024 };
+
+  private:
+    typedef level_join<stream_sink<Output> > level_join_type;
+    typedef io::buffered_output_stream<io::file> buffered_output_type;
+    typedef io::mandatory_output_stream<buffered_output_type> mandatory_buffered_output_type;
+
+    struct batch {
+      explicit batch(FILE *fp) : m_output_fp(fp), m_is_done(false) {}
+      FILE *m_output_fp;
+      bool m_is_done;
+    };
+
+    struct on_child_process_exit {
+      explicit on_child_process_exit(batch *b) : m_batch(b) {}
+      void operator()() { m_batch->m_is_done = true; }
+      batch *m_batch;
+    };
+
+    typedef process::pool<on_child_process_exit> process_pool_type;
+
+    struct async_probe_batch {
+      async_probe_batch(level_join_type &lj, const io::heap_buffer_output_stream &batch_buffer, FILE *output_fp)
+        : m_level_join(lj), m_batch_buffer(batch_buffer), m_output_fp(output_fp) {}
+
+      void operator()() {
+        // Executed in the child process.
+        io::file output_f;
+        output_f.from_handle(m_output_fp);
+        buffered_output_type buffered_output_f(output_f);
+        mandatory_buffered_output_type mandatory_buffered_output_f(buffered_output_f);
+        stream_sink<mandatory_buffered_output_type> sink(mandatory_buffered_output_f);
+
+        const unsigned char *p = m_batch_buffer.ptr();
+        const unsigned char *end = p + m_batch_buffer.size();
+        while (p < end) {
+          const unsigned char *record_end = record_ref::get_record_end(p, end - p);
+          NP1_ASSERT(record_end, "Incomplete record in join batch");
+          m_level_join.probe_resident(record_ref(p, record_end, 0), sink);
+          p = record_end;
+        }
+
+        mandatory_buffered_output_f.hard_flush();
+        output_f.release();
+      }
+
+      level_join_type &m_level_join;
+      const io::heap_buffer_output_stream &m_batch_buffer;
+      FILE *m_output_fp;
+    };
+
+  public:
+    parallel_prober(level_join_type &lj, Output &output, size_t number_threads)
+      : m_level_join(lj), m_output(output), m_batch_buffer(BATCH_SIZE), m_child_processes(number_threads) {}
+
+    ~parallel_prober() {
+      m_child_processes.wait_all();
+      while (!m_batches.empty()) {
+        fclose(m_batches.front()->m_output_fp);
+        rstd::detail::mem::destruct_and_free(m_batches.front());
+        m_batches.pop_front();
+      }
+    }
+
+    void add(const record_ref &r1) {
+      r1.write(m_batch_buffer);
+      if (m_batch_buffer.size() >= BATCH_SIZE) {
+        start_batch();
+      }
+    }
+
+    void finish() {
+      if (m_batch_buffer.size() > 0) {
+        start_batch();
+      }
+
+      m_child_processes.wait_all();
+      write_finished_batches();
+    }
+
+  private:
+    /// Disable copy.
+    parallel_prober(const parallel_prober &);
+    parallel_prober &operator = (const parallel_prober &);
+
+  private:
+    void start_batch() {
+      FILE *output_fp = tmpfile();
+      NP1_ASSERT(output_fp, "Unable to create temporary file for join");
+      batch *b = new (rstd::detail::mem::alloc(sizeof(batch))) batch(output_fp);
+      m_batches.push_back(b);
+      m_child_processes.add(async_probe_batch(m_level_join, m_batch_buffer, output_fp), on_child_process_exit(b));
+      m_batch_buffer.reset();
+
+      while (m_child_processes.has_process_exited()) {}
+      write_finished_batches();
+    }
+
+    // Copy the output of finished batches to the real output, stopping at the first unfinished batch.
+    void write_finished_batches() {
+      while (!m_batches.empty() && m_batches.front()->m_is_done) {
+        batch *b = m_batches.front();
+        io::file output_f;
+        output_f.from_handle(b->m_output_fp);
+        NP1_ASSERT(output_f.rewind(), "Unable to rewind temporary join file");
+        io::mandatory_input_stream<io::file> mandatory_output_f(output_f);
+        mandatory_output_f.copy(m_output);
+        output_f.release();
+        fclose(b->m_output_fp);
+        rstd::detail::mem::destruct_and_free(b);
+        m_batches.pop_front();
+      }
+    }
+
+  private:
+    level_join_type &m_level_join;
+    Output &m_output;
+    io::heap_buffer_output_stream m_batch_buffer;
+    rstd::list<batch *> m_batches;
+    process_pool_type m_child_processes;
+  };
+
+
+  template <typename Output>
+  struct parallel_probe_record_callback {
+    explicit parallel_probe_record_callback(parallel_prober<Output> &prober) : m_prober(prober) {}
+
+    bool operator()(const record_ref &r1) const {
+      m_prober.add(r1);
+      return true;
+    }
+
+    parallel_prober<Output> &m_prober;
+  };
+
+
+  // Holds on to input1 until it's clear which input is the smaller one.  If input1 gets too big then it's too
+  // late to go back and read it again, so the buffered records are replayed into an ordinary level_join and
+  // the rest of input1 is sent straight there.
+  template <typename Input2, typename Output>
+  class buffered_input1_join {
+  private:
+    typedef stream_sink<Output> sink_type;
+
+  public:
+    buffered_input1_join(joiner &j, Input2 &input2, Output &output, uint64_t max_input1_size,
+                         const record &output_headings, const sort_order &input1_order)
+      : m_joiner(j), m_input2(input2), m_output(output), m_sink(output), m_max_input1_size(max_input1_size),
+        m_input1_size(0), m_output_headings(output_headings), m_input1_order(input1_order), m_level_join(NULL) {}
+
+    ~buffered_input1_join() {
+      if (m_level_join) {
+        rstd::detail::mem::destruct_and_free(m_level_join);
+      }
+    }
+
+    void add(const record_ref &r1) {
+      if (m_level_join) {
+        m_level_join->probe(r1);
+        return;
+      }
+
+      m_input1_size += r1.byte_size();
+      if (m_input1_size <= m_max_input1_size) {
+        m_input1.push_back(m_input1_arena.copy(r1));
+        return;
+      }
+
+      // The output is in input1 order.
+      m_input1_order.write_headings(m_output, m_output_headings.ref());
+      m_level_join =
+        new (rstd::detail::mem::alloc(sizeof(level_join<sink_type>)))
+          level_join<sink_type>(m_joiner, m_input2, false, m_sink, 0);
+      rstd::vector<record_ref>::const_iterator i = m_input1.begin();
+      rstd::vector<record_ref>::const_iterator iz = m_input1.end();
+      for (; i != iz; ++i) {
+        m_level_join->probe(*i);
+      }
+
+      m_input1.clear();
+      m_input1_arena.clear();
+      m_level_join->probe(r1);
+    }
+
+    void finish() {
+      if (m_level_join) {
+        m_level_join->finish();
+        return;
+      }
+
+      // All of input1 fit, so hash input1 and stream input2.  The output is in input2 order, which is not
+      // recorded anywhere.
+      sort_order().write_headings(m_output, m_output_headings.ref());
+      record_multihashmap<join_helper::empty_type> map1(m_joiner.m_specs1);
+      rstd::vector<record_ref>::const_iterator i = m_input1.begin();
+      rstd::vector<record_ref>::const_iterator iz = m_input1.end();
+      for (; i != iz; ++i) {
+        map1.insert(*i, join_helper::empty_type());
+      }
+
+      m_input1.clear();
+      m_input1_arena.clear();
+      m_input2.parse_records(swapped_probe_record_callback<sink_type>(m_joiner, map1, m_sink));
+    }
+
+  private:
+    /// Disable copy.
+    buffered_input1_join(const buffered_input1_join &);
+    buffered_input1_join &operator = (const buffered_input1_join &);
+
+  private:
+    joiner &m_joiner;
+    Input2 &m_input2;
+    Output &m_output;
+    sink_type m_sink;
+    uint64_t m_max_input1_size;
+    uint64_t m_input1_size;
+    const record &m_output_headings;
+    sort_order m_input1_order;
+    record_arena m_input1_arena;
+    rstd::vector<record_ref> m_input1;
+    level_join<sink_type> *m_level_join;
+  };
+
+
+  template <typename Input2, typename Output>
+  struct buffered_input1_record_callback {
+    explicit buffered_input1_record_callback(buffered_input1_join<Input2, Output> &bj) : m_buffered_join(bj) {}
+
+    bool operator()(const record_ref &r1) const {
+      m_buffered_join.add(r1);
+      return true;
+    }
+
+    buffered_input1_join<Input2, Output> &m_buffered_join;
+  };
+
+
+  // The record callback for input2 when the hash table was built from input1.
+  template <typename Sink>
+  struct swapped_probe_record_callback {
+    swapped_probe_record_callback(joiner &j, record_multihashmap<join_helper::empty_type> &map1, Sink &sink)
+      : m_joiner(j), m_map1(map1), m_sink(sink) {}
+
+    // The record_ref we get here is from input2.
+    bool operator()(const record_ref &r2) {
+      const record_multihashmap<join_helper::empty_type>::equal_list_type *equal_list =
+        m_map1.find(r2, m_joiner.m_specs2);
+      if (equal_list) {
+        record_multihashmap<join_helper::empty_type>::equal_list_type::const_iterator i = equal_list->begin();
+        record_multihashmap<join_helper::empty_type>::equal_list_type::const_iterator iz = equal_list->end();
+        for (; i != iz; ++i) {
+          m_sink.write_merged(i->first, r2, m_joiner.m_file2_non_common_field_numbers,
+                              m_file2_non_common_field_refs_storage, 0);
+        }
+      }
+
+      return true;
+    }
+
+    joiner &m_joiner;
+    record_multihashmap<join_helper::empty_type> &m_map1;
+    Sink &m_sink;
+    rstd::vector<str::ref> m_file2_non_common_field_refs_storage;
+  };
+
+  // Called by the index for each input2 record that might match an input1 record.
+  template <typename Sink>
+  class index_match_callback {
+  public:
+    index_match_callback(joiner &j, const record_ref &r1, Sink &sink,
+                         rstd::vector<str::ref> &file2_non_common_field_refs_storage)
+      : m_joiner(j), m_r1(r1), m_sink(sink), m_file2_non_common_field_refs_storage(file2_non_common_field_refs_storage),
+        m_found(false) {}
+
+    bool operator()(const record_ref &r2) {
+      if (hetero_record_compare(m_r1, m_joiner.m_specs1, r2, m_joiner.m_specs2) != 0) {
+        return true;
+      }
+
+      m_found = true;
+      if (join_helper::ANTI == m_joiner.m_type) {
+        return false;
+      }
+
+      m_sink.write_merged(m_r1, r2, m_joiner.m_file2_non_common_field_numbers,
+                          m_file2_non_common_field_refs_storage, 0);
+      return true;
+    }
+
+    bool found() const { return m_found; }
+
+  private:
+    joiner &m_joiner;
+    const record_ref &m_r1;
+    Sink &m_sink;
+    rstd::vector<str::ref> &m_file2_non_common_field_refs_storage;
+    bool m_found;
+  };
+
+
+  // The record callback for input1 when input2 is indexed.
+  template <typename Sink>
+  struct index_probe_record_callback {
+    index_probe_record_callback(joiner &j, const record_index &index2, Sink &sink)
+      : m_joiner(j), m_index2(index2), m_sink(sink) {}
+
+    bool operator()(const record_ref &r1) {
+      index_match_callback<Sink> match_callback(m_joiner, r1, m_sink, m_file2_non_common_field_refs_storage);
+      m_index2.for_each_candidate(record_index::hash(r1, m_joiner.m_specs1), match_callback);
+      if (!match_callback.found()) {
+        if (join_helper::ANTI == m_joiner.m_type) {
+          m_sink.write(r1, 0);
+        } else if (join_helper::LEFT == m_joiner.m_type) {
+          m_sink.write_merged(r1, m_joiner.m_empty_r2->ref(), m_joiner.m_file2_non_common_field_numbers,
+                              m_file2_non_common_field_refs_storage, 0);
+        }
+      }
+
+      return true;
+    }
+
+    joiner &m_joiner;
+    const record_index &m_index2;
+    Sink &m_sink;
+    rstd::vector<str::ref> m_file2_non_common_field_refs_storage;
+  };
+
+private:
+  join_helper::join_type m_type;
+  compare_specs m_specs1;
+  compare_specs m_specs2;
+  rstd::vector<size_t> m_file2_non_common_field_numbers;
+  const record *m_empty_r2;
+};
+
+} // namespaces
+}
+}
+}
+
+
+#endif
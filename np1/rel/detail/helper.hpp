@@ -4,7 +4,7 @@
 #define NP1_REL_DETAIL_HELPER_HPP
 
 
-#include "np1/hash/fnv1a64.hpp"
+#include "np1/hash/wyhash64.hpp"
 #include "np1/rel/rlang/dt.hpp"
 
 namespace np1 {
@@ -12,18 +12,16 @@ namespace rel {
 namespace detail {
 namespace helper {
 
-
-uint64_t hash_add(uint8_t b, uint64_t hval) {
-  return hash::fnv1a64::add(b, hval);
-}
-
-
+// Record hashes are kept in two formats that outlive the process: the index files written by io.index.build
+// (record_index, which has a format version) and the hll_sketch strings from rel.group (hyperloglog, which has
+// a format tag).  Both are read on other hosts, so the hash values must be the same on every architecture, and
+// changing the hash function means changing both versions.
 uint64_t hash_add(const char *p, size_t len, uint64_t hval) {
-  return hash::fnv1a64::add(p, len, hval);
+  return hash::wyhash64::add(p, len, hval);
 }
   
 uint64_t hash_init(size_t somedata = 0x12345) {
-  return hash::fnv1a64::init(somedata);
+  return hash::wyhash64::init(somedata);
 }
  
 
@@ -72,10 +70,20 @@ uint64_t string_hash_add(const char *str, size_t length, uint64_t hval) {
 
 
 uint64_t istring_hash_add(const char *str, size_t length, uint64_t hval) {
+  // Fold the case a chunk at a time so that the hash function still gets to eat whole words.
+  enum { CHUNK_SIZE = 256 };
+  char lower[CHUNK_SIZE];
   const char *end = str + length;
-  for (; str < end; ++str) {
-    hval = hash_add(tolower(*str), hval);
-  }
+  do {
+    size_t chunk_length = ((size_t)(end - str) < CHUNK_SIZE) ? end - str : CHUNK_SIZE;
+    size_t i;
+    for (i = 0; i < chunk_length; ++i) {
+      lower[i] = tolower(str[i]);
+    }
+
+    hval = hash_add(lower, chunk_length, hval);
+    str += chunk_length;
+  } while (str < end);
    
   return hval;  
 }
@@ -156,9 +164,10 @@ int int_compare(const char *f1, size_t f1_length, const char *f2, size_t f2_leng
   f1 = strip_leading_spaces_and_zeroes(f1, f1_length, f1_length);
   f2 = strip_leading_spaces_and_zeroes(f2, f2_length, f2_length);
   
-  // Avoid converting to integer if possible.
-  if (*f1 == '-') {
-    if (*f2 == '-') {
+  // Avoid converting to integer if possible.  Zero is stripped right down to nothing, so check the lengths
+  // before looking at the first character.
+  if ((f1_length > 0) && (*f1 == '-')) {
+    if ((f2_length > 0) && (*f2 == '-')) {
       ++f1;
       ++f2;
       --f1_length;
@@ -169,7 +178,7 @@ int int_compare(const char *f1, size_t f1_length, const char *f2, size_t f2_leng
     return -1;    
   }
   
-  if (*f2 == '-') {
+  if ((f2_length > 0) && (*f2 == '-')) {
     return 1;
   }
   
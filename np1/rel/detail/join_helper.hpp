@@ -4,6 +4,7 @@
 #define NP1_REL_DETAIL_JOIN_HELPER_HPP
 
 
+#include "np1/rel/detail/sort_order.hpp"
 
 
 namespace np1 {
@@ -17,6 +18,13 @@ namespace join_helper
 typedef struct empty_struct {} empty_type;  
 
 
+enum join_type {
+  NATURAL,
+  LEFT,
+  ANTI
+};
+
+
 
 // Figure out the common and non-common headings between two heading records.
 void find_common_and_non_common_headings(const record &file1_headers, const record &file2_headers,
@@ -101,51 +109,57 @@ void record_merge_write(
 }
 
 
-// Called for each record that matches during a merge.
-template <typename Output>
-struct matching_record_callback {
-  matching_record_callback(
-    Output &output, 
-    const rstd::vector<size_t> &file2_non_common_field_numbers,
-    rstd::vector<str::ref> &file2_non_common_field_refs_storage,
-    const record_ref &ref1,
-    bool &called)
-  : m_output(output)
-  , m_file2_non_common_field_numbers(file2_non_common_field_numbers)
-  , m_file2_non_common_field_refs_storage(file2_non_common_field_refs_storage)
-  , m_ref1(ref1)
-  , m_called(called) {
-    m_called = false;
+/* Make the merged headings:  the first input's headings followed by the second input's non-common headings. */
+record make_merged_headings(
+              const record &file1_headers, 
+              const record &file2_headers, 
+              const rstd::vector<size_t> &file2_non_common_field_numbers) {
+  rstd::vector<str::ref> headings;
+  size_t number_file1_fields = file1_headers.number_fields();
+  size_t i;
+  for (i = 0; i < number_file1_fields; ++i) {
+    headings.push_back(file1_headers.mandatory_field(i));
   }
-  
-  bool operator()(const record &r2, const empty_type &v) {
-    record_merge_write(m_output, m_ref1, r2.ref(),
-                        m_file2_non_common_field_numbers,
-                        m_file2_non_common_field_refs_storage);
-    m_called = true;
-    return true;
+
+  rstd::vector<size_t>::const_iterator n_i = file2_non_common_field_numbers.begin();
+  rstd::vector<size_t>::const_iterator n_iz = file2_non_common_field_numbers.end();
+  for (; n_i != n_iz; ++n_i) {
+    headings.push_back(file2_headers.mandatory_field(*n_i));
   }
-  
-  Output &m_output;
-  const rstd::vector<size_t> &m_file2_non_common_field_numbers;
-  rstd::vector<str::ref> &m_file2_non_common_field_refs_storage;
-  const record_ref &m_ref1;
-  bool &m_called;
-};
+
+  return record(headings, 0);
+}
 
 
-// The record callback for when we're reading in the file that will be inserted
-// into memory.
-struct insert_record_callback {
-  explicit insert_record_callback(detail::record_multihashmap<empty_type> &m) : m_map(m) {}
-   
-  bool operator()(const record_ref &r) const {
-    m_map.insert(r, empty_type());    
-    return true;
+/* Write out the merged headings.  The output is in the same order as the first input, and the first input's
+ * fields keep their field numbers, so the first input's sort order still holds. */
+template <typename Output>
+void record_merge_write_headings(
+              Output &output,
+              const record &file1_headers, 
+              const record &file2_headers, 
+              const rstd::vector<size_t> &file2_non_common_field_numbers) {
+  sort_order::from_headings(file1_headers.ref()).write_headings(
+    output, make_merged_headings(file1_headers, file2_headers, file2_non_common_field_numbers).ref());
+}
+
+
+// Make a record that contains only empty fields, using the supplied headings
+// to figure out what "empty" is.
+record make_record_with_empty_fields(const record_ref &headings) {
+  rstd::vector<rstd::string> empty_fields;
+
+  size_t field_id;
+  size_t number_fields = headings.number_fields();
+  for (field_id = 0; field_id < number_fields; ++field_id) {
+    str::ref heading = headings.mandatory_field(field_id);
+    str::ref empty_field = 
+      rlang::dt::empty_value(rlang::dt::mandatory_from_string(helper::mandatory_get_heading_type_tag(heading)));
+    empty_fields.push_back(empty_field.to_string());
   }
-  
-  detail::record_multihashmap<empty_type> &m_map;
-};
+
+  return record(empty_fields, 0);
+}
 
 
 // We don't support joins on double fields because floating point equality comparison is not reliable.
@@ -0,0 +1,202 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_DETAIL_MERGE_JOIN_HPP
+#define NP1_REL_DETAIL_MERGE_JOIN_HPP
+
+
+#include "rstd/list.hpp"
+#include "np1/rel/detail/compare_specs.hpp"
+#include "np1/rel/detail/record_multihashmap.hpp"
+#include "np1/rel/detail/sort_order.hpp"
+#include "np1/rel/detail/join_helper.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace detail {
+
+/// Joins where both inputs are sorted on the join headings.  Only the current run of equal records from the
+/// second input is held in memory.
+namespace merge_join
+{
+
+// If both inputs are sorted in the same direction on the common headings, and in the same heading order, then
+// get the common heading names in sort order and return true.
+bool get_merge_heading_names(const record &file1_headers, const record &file2_headers,
+                             const rstd::vector<rstd::string> &common_heading_names,
+                             rstd::vector<rstd::string> &merge_heading_names) {
+  if (common_heading_names.empty()) {
+    return false;
+  }
+
+  sort_order order1 = sort_order::from_headings(file1_headers.ref());
+  sort_order order2 = sort_order::from_headings(file2_headers.ref());
+  if (!order1.is_sorted() || !order2.is_sorted() || (order1.is_descending() != order2.is_descending())) {
+    return false;
+  }
+
+  if (!order1.is_grouped_by(compare_specs(file1_headers, common_heading_names))) {
+    return false;
+  }
+
+  rstd::vector<rstd::string> merge_heading_names2;
+  if (!order1.leading_heading_names(file1_headers.ref(), common_heading_names.size(), merge_heading_names)
+      || !order2.leading_heading_names(file2_headers.ref(), common_heading_names.size(), merge_heading_names2)) {
+    return false;
+  }
+
+  size_t i;
+  for (i = 0; i < merge_heading_names.size(); ++i) {
+    if (!(merge_heading_names[i] == merge_heading_names2[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// The record callback for the first input.  Reads through the second input as it goes.
+template <typename Output, typename File2_Reader>
+class record_callback {
+public:
+  // empty_r2 is the record to use when there's no match in a left join, it's ignored for other join types.
+  record_callback(Output &output, File2_Reader &reader2, const compare_specs &specs1, const compare_specs &specs2,
+                  bool is_descending, join_helper::join_type type,
+                  const rstd::vector<size_t> &file2_non_common_field_numbers, const record *empty_r2)
+    : m_output(output)
+    , m_reader2(reader2)
+    , m_specs1(specs1)
+    , m_specs2(specs2)
+    , m_is_descending(is_descending)
+    , m_type(type)
+    , m_file2_non_common_field_numbers(file2_non_common_field_numbers)
+    , m_empty_r2(empty_r2)
+    , m_has_next2(false)
+    , m_has_last1(false) {
+    NP1_ASSERT((join_helper::LEFT != m_type) || m_empty_r2, "Left joins need an empty second-input record");
+    record_ref r2;
+    if (m_reader2.read_record(r2)) {
+      m_next2.assign(r2);
+      m_has_next2 = true;
+    }
+
+    next_run();
+  }
+
+  // The record_ref we get here is from file1.
+  bool operator()(const record_ref &ref1) {
+    check_input1_order(ref1);
+
+    bool found = false;
+    while (!m_run.empty()) {
+      int result = compare(ref1, m_specs1, m_run.front(), m_specs2);
+      if (result < 0) {
+        break;
+      }
+
+      if (0 == result) {
+        found = true;
+        if (join_helper::ANTI == m_type) {
+          break;
+        }
+
+        rstd::list<record>::const_iterator i = m_run.begin();
+        rstd::list<record>::const_iterator iz = m_run.end();
+        for (; i != iz; ++i) {
+          join_helper::record_merge_write(
+            m_output, ref1, i->ref(), m_file2_non_common_field_numbers, m_file2_non_common_field_refs_storage);
+        }
+
+        break;
+      }
+
+      next_run();
+    }
+
+    if (!found) {
+      if (join_helper::ANTI == m_type) {
+        ref1.write(m_output);
+      } else if (join_helper::LEFT == m_type) {
+        join_helper::record_merge_write(
+          m_output, ref1, m_empty_r2->ref(), m_file2_non_common_field_numbers, m_file2_non_common_field_refs_storage);
+      }
+    }
+
+    return true;
+  }
+
+private:
+  // Compare in the sort direction.
+  template <typename Record1, typename Record2>
+  int compare(const Record1 &r1, const compare_specs &specs1, const Record2 &r2, const compare_specs &specs2) const {
+    int result = hetero_record_compare(r1, specs1, r2, specs2);
+    return m_is_descending ? -result : result;
+  }
+
+  // The first input is read just once so its order is cheap to check too.  Only the first record of each run of
+  // equal records is copied.
+  void check_input1_order(const record_ref &ref1) {
+    if (m_has_last1) {
+      int result = compare(ref1, m_specs1, m_last1, m_specs1);
+      NP1_ASSERT(result >= 0, "Input is not sorted on the join headings.  Record number: "
+                                + str::to_dec_str(ref1.record_number()));
+      if (0 == result) {
+        return;
+      }
+    }
+
+    m_last1.assign(ref1);
+    m_has_last1 = true;
+  }
+
+  // Replace the current run with the next run of equal records from file2.
+  void next_run() {
+    m_run.clear();
+    if (!m_has_next2) {
+      return;
+    }
+
+    m_run.push_back(record());
+    m_run.back().swap(m_next2);
+    m_has_next2 = false;
+
+    record_ref r2;
+    while (m_reader2.read_record(r2)) {
+      int result = compare(r2, m_specs2, m_run.front(), m_specs2);
+      NP1_ASSERT(result >= 0, "Join file is not sorted on the join headings.  Record number: "
+                                + str::to_dec_str(r2.record_number()));
+      if (result > 0) {
+        m_next2.assign(r2);
+        m_has_next2 = true;
+        return;
+      }
+
+      m_run.push_back(record(r2));
+    }
+  }
+
+private:
+  Output &m_output;
+  File2_Reader &m_reader2;
+  compare_specs m_specs1;
+  compare_specs m_specs2;
+  bool m_is_descending;
+  join_helper::join_type m_type;
+  rstd::vector<size_t> m_file2_non_common_field_numbers;
+  rstd::vector<str::ref> m_file2_non_common_field_refs_storage;
+  const record *m_empty_r2;
+  rstd::list<record> m_run;
+  record m_next2;
+  bool m_has_next2;
+  record m_last1;
+  bool m_has_last1;
+};
+
+} // namespaces
+}
+}
+}
+
+
+#endif
@@ -0,0 +1,350 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_DETAIL_RECORD_INDEX_HPP
+#define NP1_REL_DETAIL_RECORD_INDEX_HPP
+
+
+#include "rstd/vector.hpp"
+#include "np1/uuid.hpp"
+#include "np1/io/file.hpp"
+#include "np1/io/gzfile.hpp"
+#include "np1/io/file_mapping.hpp"
+#include "np1/io/buffered_output_stream.hpp"
+#include "np1/io/mandatory_output_stream.hpp"
+#include "np1/io/mandatory_mapped_record_input_file.hpp"
+#include "np1/rel/record.hpp"
+#include "np1/rel/detail/compare_specs.hpp"
+#include "np1/rel/detail/join_helper.hpp"
+#include "np1/rel/detail/record_multihashmap.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace detail {
+
+/// A hash index of an uncompressed r17 native file, kept in a file next to it so that joins against the same
+/// file don't have to build the same hash table every time.
+/**
+ * The index file is a header, the key heading names, a bucket directory and then one (hash, offset) entry per
+ * record, grouped by bucket and in file order within each bucket.  Both the index and the data file are mapped
+ * read-only, so every process that's joining against the same file shares the same pages.
+ *
+ * The header remembers the data file's size, inode and modification and change times, to the nanosecond.  If any
+ * of them have changed then the index is ignored.
+ */
+class record_index {
+public:
+  // Version 1 hashed with FNV-1a.  Version 2 only remembered the data file's size and mtime in seconds.
+  enum {
+    FORMAT_VERSION = 3,
+    MIN_BUCKET_BITS = 1
+  };
+
+  static const uint64_t MAGIC = 0x78646e4937317200ULL;
+
+private:
+  struct header {
+    uint64_t m_magic;
+    uint64_t m_format_version;
+    io::file::identity m_data_file_identity;
+    uint64_t m_bucket_bits;
+    uint64_t m_number_records;
+    uint64_t m_key_heading_names_length;
+  };
+
+  struct entry {
+    uint64_t m_hval;
+    uint64_t m_offset;
+  };
+
+public:
+  record_index()
+    : m_data_mapping(NULL), m_index_mapping(NULL), m_directory(NULL), m_entries(NULL), m_bucket_bits(0) {}
+
+  ~record_index() {
+    close();
+  }
+
+  /// The name of the index file for a data file.
+  static rstd::string index_file_name(const rstd::string &data_file_name) {
+    return data_file_name + ".r17_index";
+  }
+
+  /// Build the index for a data file.  The index is written to a temporary file which is then renamed, so
+  /// processes that are using the old index are not disturbed.
+  static void build(const rstd::string &data_file_name, const rstd::vector<rstd::string> &key_heading_names) {
+    NP1_ASSERT(!io::gzfile::is_gzfile(data_file_name.c_str()),
+               "Only uncompressed files can be indexed: " + data_file_name);
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    h.m_magic = MAGIC;
+    h.m_format_version = FORMAT_VERSION;
+    NP1_ASSERT(get_data_file_identity(data_file_name, h.m_data_file_identity),
+               "Unable to get information about file " + data_file_name);
+
+    io::file data_file;
+    NP1_ASSERT(data_file.open_ro(data_file_name.c_str()), "Unable to open input file " + data_file_name);
+    io::file_mapping data_mapping(data_file.handle());
+    io::mandatory_mapped_record_input_file<record_ref> reader(data_mapping);
+    record_ref headings = reader.mandatory_read_record();
+
+    // Remember the full heading names so that the types are checked too.
+    rstd::vector<rstd::string> full_key_heading_names;
+    rstd::vector<rstd::string>::const_iterator name_i = key_heading_names.begin();
+    rstd::vector<rstd::string>::const_iterator name_iz = key_heading_names.end();
+    for (; name_i != name_iz; ++name_i) {
+      full_key_heading_names.push_back(
+        headings.mandatory_field(headings.mandatory_find_heading(*name_i)).to_string());
+    }
+
+    compare_specs specs(headings, full_key_heading_names);
+    join_helper::validate_compare_specs(specs);
+
+    // Hash all the records.
+    const unsigned char *data_start = (const unsigned char *)data_mapping.ptr();
+    rstd::vector<entry> unsorted_entries;
+    record_ref r;
+    while (reader.read_record(r)) {
+      entry e;
+      e.m_hval = hash(r, specs);
+      e.m_offset = (const unsigned char *)r.start() - data_start;
+      unsorted_entries.push_back(e);
+    }
+
+    h.m_number_records = unsorted_entries.size();
+    h.m_bucket_bits = MIN_BUCKET_BITS;
+    while (((uint64_t)1 << h.m_bucket_bits) < h.m_number_records) {
+      ++h.m_bucket_bits;
+    }
+
+    // Group the entries by bucket with a counting sort, which keeps them in file order within each bucket.
+    size_t number_buckets = (size_t)1 << h.m_bucket_bits;
+    rstd::vector<uint64_t> directory;
+    directory.resize(number_buckets + 1);
+    rstd::vector<entry>::const_iterator entry_i = unsorted_entries.begin();
+    rstd::vector<entry>::const_iterator entry_iz = unsorted_entries.end();
+    for (; entry_i != entry_iz; ++entry_i) {
+      ++directory[bucket(entry_i->m_hval, h.m_bucket_bits) + 1];
+    }
+
+    size_t i;
+    for (i = 1; i <= number_buckets; ++i) {
+      directory[i] += directory[i - 1];
+    }
+
+    rstd::vector<uint64_t> next_positions(directory);
+    rstd::vector<entry> entries;
+    entries.resize(unsorted_entries.size());
+    for (entry_i = unsorted_entries.begin(); entry_i != entry_iz; ++entry_i) {
+      entries[next_positions[bucket(entry_i->m_hval, h.m_bucket_bits)]++] = *entry_i;
+    }
+
+    unsorted_entries.clear();
+
+    // Write it all out.
+    rstd::string key_heading_names_str = join_names(full_key_heading_names);
+    h.m_key_heading_names_length = key_heading_names_str.length();
+
+    rstd::string final_file_name = index_file_name(data_file_name);
+    rstd::string temp_file_name = final_file_name + ".tmp." + uuid::generate().to_string();
+    {
+      io::file index_file;
+      NP1_ASSERT(index_file.create_wo(temp_file_name.c_str()), "Unable to create file " + temp_file_name);
+      io::buffered_output_stream<io::file> buffered_output(index_file);
+      io::mandatory_output_stream<io::buffered_output_stream<io::file> > output(buffered_output);
+      output.write(&h, sizeof(h));
+      output.write(key_heading_names_str.c_str(), key_heading_names_str.length());
+      static const char padding[sizeof(uint64_t)] = { 0 };
+      output.write(padding, padded_length(h.m_key_heading_names_length) - h.m_key_heading_names_length);
+      output.write(directory.begin(), directory.size() * sizeof(uint64_t));
+      if (entries.size() > 0) {
+        output.write(entries.begin(), entries.size() * sizeof(entry));
+      }
+
+      output.hard_flush();
+    }
+
+    NP1_ASSERT(io::file::rename(temp_file_name.c_str(), final_file_name.c_str()),
+                "Unable to rename file " + temp_file_name + " to " + final_file_name);
+  }
+
+  /// Open the index for a data file.  Returns false if there's no index, if it's out of date or if it's not on
+  /// exactly the supplied key headings, in any order.
+  bool open(const rstd::string &data_file_name, const rstd::vector<rstd::string> &key_heading_names) {
+    close();
+
+    io::file::identity data_file_identity;
+    uint64_t index_file_size;
+    if (!get_data_file_identity(data_file_name, data_file_identity)
+        || !io::file::get_size(index_file_name(data_file_name).c_str(), index_file_size)
+        || (index_file_size < sizeof(header))
+        || !m_index_file.open_ro(index_file_name(data_file_name).c_str())) {
+      return false;
+    }
+
+    m_index_mapping = rstd::detail::mem::alloc_construct<io::file_mapping>(m_index_file.handle());
+    const unsigned char *index_start = (const unsigned char *)m_index_mapping->ptr();
+    const unsigned char *index_end = index_start + m_index_mapping->size();
+
+    const header *h = (const header *)index_start;
+    if ((h->m_magic != MAGIC) || (h->m_format_version != FORMAT_VERSION)
+        || (memcmp(&h->m_data_file_identity, &data_file_identity, sizeof(data_file_identity)) != 0)) {
+      close();
+      return false;
+    }
+
+    const char *names_start = (const char *)(index_start + sizeof(header));
+    m_directory = (const uint64_t *)((const unsigned char *)names_start
+                                      + padded_length(h->m_key_heading_names_length));
+    m_entries = (const entry *)(m_directory + ((size_t)1 << h->m_bucket_bits) + 1);
+    NP1_ASSERT((const unsigned char *)(m_entries + h->m_number_records) == index_end,
+                "Index file " + index_file_name(data_file_name) + " is the wrong size");
+    m_bucket_bits = h->m_bucket_bits;
+
+    m_key_heading_names = split_names(rstd::string(names_start, h->m_key_heading_names_length));
+    if (!is_same_set(m_key_heading_names, key_heading_names)) {
+      close();
+      return false;
+    }
+
+    NP1_ASSERT(m_data_file.open_ro(data_file_name.c_str()), "Unable to open input file " + data_file_name);
+    m_data_mapping = rstd::detail::mem::alloc_construct<io::file_mapping>(m_data_file.handle());
+    NP1_ASSERT(m_data_mapping->size() == data_file_identity.m_size, "File " + data_file_name + " changed while it was opened");
+    return true;
+  }
+
+  void close() {
+    if (m_data_mapping) {
+      rstd::detail::mem::destruct_and_free(m_data_mapping);
+      m_data_mapping = NULL;
+    }
+
+    if (m_index_mapping) {
+      rstd::detail::mem::destruct_and_free(m_index_mapping);
+      m_index_mapping = NULL;
+    }
+
+    m_data_file.close();
+    m_index_file.close();
+    m_directory = NULL;
+    m_entries = NULL;
+    m_key_heading_names.clear();
+  }
+
+  /// The full key heading names in the order that they're hashed.  Compare specs for probing must be in this
+  /// order.
+  const rstd::vector<rstd::string> &key_heading_names() const { return m_key_heading_names; }
+
+  static uint64_t hash(const record_ref &r, const compare_specs &specs) {
+    return record_hash(r, specs, helper::hash_init());
+  }
+
+  /// Call callback(r2) for each data file record whose keys have the hash value, in file order, until the
+  /// callback returns false.  The records still need to be compared because different keys can have the same
+  /// hash value.
+  template <typename Callback>
+  void for_each_candidate(uint64_t hval, Callback &callback) const {
+    const unsigned char *data_start = (const unsigned char *)m_data_mapping->ptr();
+    const unsigned char *data_end = data_start + m_data_mapping->size();
+    size_t b = bucket(hval, m_bucket_bits);
+    const entry *entry_i = m_entries + m_directory[b];
+    const entry *entry_iz = m_entries + m_directory[b + 1];
+    for (; entry_i != entry_iz; ++entry_i) {
+      if (entry_i->m_hval == hval) {
+        const unsigned char *start = data_start + entry_i->m_offset;
+        const unsigned char *end = record_ref::get_record_end(start, data_end - start);
+        NP1_ASSERT(end, "Index refers to an incomplete record");
+        if (!callback(record_ref(start, end, 0))) {
+          return;
+        }
+      }
+    }
+  }
+
+private:
+  /// Disable copy.
+  record_index(const record_index &);
+  record_index &operator = (const record_index &);
+
+private:
+  static bool get_data_file_identity(const rstd::string &file_name, io::file::identity &id) {
+    bool is_directory;
+    return io::file::get_identity(file_name.c_str(), id, is_directory) && !is_directory;
+  }
+
+  // The high bits of the hash are better mixed than the low bits.
+  static size_t bucket(uint64_t hval, uint64_t bucket_bits) {
+    return (size_t)(hval >> (64 - bucket_bits));
+  }
+
+  static uint64_t padded_length(uint64_t length) {
+    return (length + sizeof(uint64_t) - 1) & ~((uint64_t)sizeof(uint64_t) - 1);
+  }
+
+  static rstd::string join_names(const rstd::vector<rstd::string> &names) {
+    rstd::string result;
+    size_t i;
+    for (i = 0; i < names.size(); ++i) {
+      result = (i > 0) ? result + "\t" + names[i] : names[i];
+    }
+
+    return result;
+  }
+
+  static rstd::vector<rstd::string> split_names(const rstd::string &s) {
+    rstd::vector<rstd::string> names;
+    const char *p = s.c_str();
+    const char *end = p + s.length();
+    while (p < end) {
+      const char *tab = (const char *)memchr(p, '\t', end - p);
+      if (!tab) {
+        tab = end;
+      }
+
+      names.push_back(rstd::string(p, tab - p));
+      p = tab + 1;
+    }
+
+    return names;
+  }
+
+  static bool is_same_set(const rstd::vector<rstd::string> &names1, const rstd::vector<rstd::string> &names2) {
+    if (names1.size() != names2.size()) {
+      return false;
+    }
+
+    size_t i1;
+    size_t i2;
+    for (i1 = 0; i1 < names1.size(); ++i1) {
+      bool found = false;
+      for (i2 = 0; !found && (i2 < names2.size()); ++i2) {
+        found = (names1[i1] == names2[i2]);
+      }
+
+      if (!found) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+private:
+  io::file m_data_file;
+  io::file m_index_file;
+  io::file_mapping *m_data_mapping;
+  io::file_mapping *m_index_mapping;
+  const uint64_t *m_directory;
+  const entry *m_entries;
+  uint64_t m_bucket_bits;
+  rstd::vector<rstd::string> m_key_heading_names;
+};
+
+
+} // namespaces
+}
+}
+
+
+#endif
@@ -1,12 +1,17 @@
 // Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
 // Please see LICENSE file for details.
-#ifndef RELOPT_RECORD_MULTIHASHMAP_HPP
-#define RELOPT_RECORD_MULTIHASHMAP_HPP
+#ifndef NP1_REL_DETAIL_RECORD_MULTIHASHMAP_HPP
+#define NP1_REL_DETAIL_RECORD_MULTIHASHMAP_HPP
 
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "rstd/vector.hpp"
-#include "rstd/list.hpp"
 #include "rstd/pair.hpp"
+#include "rstd/swap.hpp"
+#include "np1/rel/record_arena.hpp"
 #include "np1/rel/detail/helper.hpp"
 #include "np1/rel/detail/compare_specs.hpp"
 
@@ -59,97 +64,258 @@ int record_compare(const Record1 &r1, const Record2 &r2,
   return hetero_record_compare(r1, specs, r2, specs);
 }
   
+/// Add the fields named in the specs to the hash value.
+template <typename Record>
+uint64_t record_hash(const Record &r, const compare_specs &specs, uint64_t hval) {
+  compare_specs::const_iterator spec = specs.begin();
+  compare_specs::const_iterator spec_iz = specs.end();
+  
+  for (; spec != spec_iz; ++spec) {        
+    const str::ref f = r.field(spec->field_number());    
+          
+    if (f.is_null()) {
+      rstd::string error_message =
+        "Unable to find field " + str::to_dec_str(spec->field_number())
+        + " while hashing.  Record number: "
+        + str::to_dec_str(r.record_number());
+          
+      NP1_ASSERT(false, error_message);
+    }
+    
+    hval = spec->hash_function()(f.ptr(), f.length(), hval);               
+  }
+
+  return hval;
+}
+
+
 // A non-unique hash table of records.
+/**
+ * This is an open-addressing table in the style of Google's "Swiss tables".  Each slot holds the full 64-bit hash
+ * of a key and a pointer to the list of records that have that key.  Alongside the slots there is an array of
+ * one-byte control words, one per slot, that hold either CONTROL_EMPTY or the top 7 bits of the slot's hash.  Lookups
+ * scan GROUP_SIZE control words at a time (with SSE2 where we have it) so that most misses never touch a slot, let
+ * alone a record.
+ *
+ * The records themselves live in a record_arena and the lists in append-only pools.  Nothing ever moves, so growing
+ * the table just re-places the slots using their stored hashes: no record is ever re-hashed or copied.  Iteration is
+ * in the order that the keys were first inserted.
+ */
 template <typename Value>
 class record_multihashmap {
 public:
   /// Hash table tuning stuff.
   enum {
-    INITIAL_APPROX_MAX_CHAIN_SIZE = 20,
-    
-    // The hash algorithm likes power-of-two tables.    
-    INITIAL_HASH_TABLE_SIZE = 65536    
+    // The table is always a power of two in size.  Growing it is cheap so there's no need to start big.
+    INITIAL_HASH_TABLE_SIZE = 1024,
+
+    // The number of control words that are examined at once.
+    GROUP_SIZE = 16,
+
+    // The table grows when it's more than this many eighths full.
+    MAX_LOAD_EIGHTHS = 7
   };
-  
-  // A list of records that compare equal.
-  typedef rstd::list<rstd::pair<record, Value> > equal_list_type;
-  
-  // A chain of records that hash to the same value.
-  typedef rstd::list<equal_list_type> hash_chain_type;
-  
-  // The hash table itself - a list of chains.
-  typedef rstd::vector<hash_chain_type> hash_map_type;
-  
+
+  typedef Value value_type;
+
+private:
+  enum {
+    CONTROL_EMPTY = 0x80,
+
+    // The number of records or equal lists per pool chunk.
+    POOL_CHUNK_SIZE = 1024
+  };
+
+  // A single record/value pair, linked to the next one with the same key.
+  struct entry {
+    entry(const record_ref &r, const Value &v) : m_value(r, v), m_next(NULL) {}
+
+    rstd::pair<record_ref, Value> m_value;
+    entry *m_next;
+  };
+
+  // Objects that never move once they've been created, so it's safe to point at them.
+  template <typename T>
+  class stable_pool {
+  public:
+    stable_pool() : m_size(0) {}
+    ~stable_pool() { clear(); }
+
+    // Get some uninitialized memory for a new object, which the caller must construct in place.
+    void *alloc() {
+      if (m_size / POOL_CHUNK_SIZE >= m_chunks.size()) {
+        m_chunks.push_back((T *)rstd::detail::mem::alloc(POOL_CHUNK_SIZE * sizeof(T)));
+      }
+
+      T *p = m_chunks[m_size / POOL_CHUNK_SIZE] + (m_size % POOL_CHUNK_SIZE);
+      ++m_size;
+      return p;
+    }
+
+    size_t size() const { return m_size; }
+    size_t memory_size() const { return m_chunks.size() * POOL_CHUNK_SIZE * sizeof(T); }
+    T &operator[](size_t n) const { return m_chunks[n / POOL_CHUNK_SIZE][n % POOL_CHUNK_SIZE]; }
+
+    void clear() {
+      size_t i;
+      for (i = 0; i < m_size; ++i) {
+        (*this)[i].~T();
+      }
+
+      typename rstd::vector<T *>::iterator chunk_i = m_chunks.begin();
+      typename rstd::vector<T *>::iterator chunk_iz = m_chunks.end();
+      for (; chunk_i != chunk_iz; ++chunk_i) {
+        rstd::detail::mem::free(*chunk_i);
+      }
+
+      m_chunks.clear();
+      m_size = 0;
+    }
+
+    void swap(stable_pool &other) {
+      m_chunks.swap(other.m_chunks);
+      rstd::swap(m_size, other.m_size);
+    }
+
+  private:
+    /// Disable copy.
+    stable_pool(const stable_pool &);
+    stable_pool &operator = (const stable_pool &);
+
+  private:
+    rstd::vector<T *> m_chunks;
+    size_t m_size;
+  };
+
+public:
+  // A list of records that compare equal, in the order they were inserted.
+  class equal_list_type {
+  public:
+    class const_iterator {
+    public:
+      explicit const_iterator(const entry *e) : m_entry(e) {}
+      const rstd::pair<record_ref, Value> &operator*() const { return m_entry->m_value; }
+      const rstd::pair<record_ref, Value> *operator->() const { return &m_entry->m_value; }
+      const_iterator &operator++() { m_entry = m_entry->m_next; return *this; }
+      bool operator == (const const_iterator &other) const { return m_entry == other.m_entry; }
+      bool operator != (const const_iterator &other) const { return m_entry != other.m_entry; }
+
+    private:
+      const entry *m_entry;
+    };
+
+  public:
+    explicit equal_list_type(entry *e) : m_head(e), m_tail(e), m_size(1) {}
+
+    rstd::pair<record_ref, Value> &front() { return m_head->m_value; }
+    const rstd::pair<record_ref, Value> &front() const { return m_head->m_value; }
+    size_t size() const { return m_size; }
+    const_iterator begin() const { return const_iterator(m_head); }
+    const_iterator end() const { return const_iterator(NULL); }
+
+    void push_back(entry *e) {
+      m_tail->m_next = e;
+      m_tail = e;
+      ++m_size;
+    }
+
+  private:
+    entry *m_head;
+    entry *m_tail;
+    size_t m_size;
+  };
+
+private:
+  struct slot {
+    uint64_t m_hash;
+    equal_list_type *m_equal_list;
+  };
+
+  // GROUP_SIZE control words, starting anywhere in the control array.
+  class control_group {
+  public:
+#ifdef __SSE2__
+    explicit control_group(const unsigned char *p) : m_control(_mm_loadu_si128((const __m128i *)p)) {}
+
+    // Get a bitmask with a bit set for every control word that is equal to c.
+    uint32_t match(unsigned char c) const {
+      return _mm_movemask_epi8(_mm_cmpeq_epi8(m_control, _mm_set1_epi8((char)c)));
+    }
+
+  private:
+    __m128i m_control;
+#else
+    explicit control_group(const unsigned char *p) : m_control(p) {}
+
+    uint32_t match(unsigned char c) const {
+      uint32_t mask = 0;
+      size_t i;
+      for (i = 0; i < GROUP_SIZE; ++i) {
+        if (m_control[i] == c) {
+          mask |= ((uint32_t)1) << i;
+        }
+      }
+
+      return mask;
+    }
+
+  private:
+    const unsigned char *m_control;
+#endif
+  };
+
 public:
   record_multihashmap(const compare_specs &specs,
                       size_t initial_size_hint = INITIAL_HASH_TABLE_SIZE)
-    : m_specs(specs), m_approx_max_chain_size(INITIAL_APPROX_MAX_CHAIN_SIZE),
+    : m_specs(specs), m_mask(0),
       m_max_hash_table_size(environment::max_hash_table_size()) {
     if (initial_size_hint > m_max_hash_table_size) {
       initial_size_hint = m_max_hash_table_size;
     }
 
-    NP1_ASSERT(try_init(initial_size_hint, 0) == hash_map_type::SEARCH_CAPACITY_SUCCESS,
-                "Unable to initialize hash map");
+    size_t capacity = GROUP_SIZE;
+    while (capacity < initial_size_hint) {
+      capacity *= 2;
+    }
+
+    init(capacity);
   }
 
 
   ~record_multihashmap() {}
   
-  // Insert a value into this hash map.
-  void insert(const record_ref &r, const Value &v) {
-    NP1_ASSERT(m_map.size() > 0, "Attempt to insert into an invalid multihashmap");
-    hash_chain_type *hash_chain = find_hash_chain(r, m_specs);
-    
-    // Try to find a list of records in this hash chain that compare
-    // equal to the new record.
-    equal_list_type *equal_list = find_equal_list(r, *hash_chain, m_specs);
-    
+  // Insert a value into this hash map.  Returns the list of records that compare equal to r, which now ends
+  // with the new record.
+  equal_list_type *insert(const record_ref &r, const Value &v) {
+    uint64_t hval = hash(r, m_specs);
+    entry *e = new (m_entries.alloc()) entry(m_arena.copy(r), v);
+
+    // Try to find a list of records that compare equal to the new record.
+    equal_list_type *equal_list = find(r, m_specs, hval);
     if (equal_list) {
-      equal_list->push_back(rstd::make_pair(record(r), v));
-    } else {
-      // There are no matching records, just make a new list.
-      equal_list_type new_list;
-      new_list.push_back(rstd::make_pair(record(r), v));
-      hash_chain->push_back(equal_list_type());
-      hash_chain->back().swap(new_list);
+      equal_list->push_back(e);
+      return equal_list;
     }
-            
-    if (hash_chain->size() > m_approx_max_chain_size) {
-      // The chain is too long.  Ideally we'll make a new & bigger hash map and 
-      // copy all the elements into it.  TODO: take table utilisation
-      // into account to avoid DOS where someone deliberately adds
-      // values that hash to the same number.
-      // The hash algorithm likes power-of-two tables.  If we can't easily
-      // allocate a new hash table or we've exceeded the user-specified maximum
-      // then just increase the max chain size.
-      if (m_map.size() >= m_max_hash_table_size) {
-        ++m_approx_max_chain_size;
-      } else {
-        size_t desired_hash_table_size = m_map.size() * 2;
-        if (desired_hash_table_size > m_max_hash_table_size) {
-          desired_hash_table_size = m_max_hash_table_size;
-        }
 
-        record_multihashmap new_hash_map(m_specs);
-        switch (new_hash_map.try_init(desired_hash_table_size, m_map.size())) {
-        case hash_map_type::SEARCH_CAPACITY_SUCCESS:
-          for_each(insertion_iterator(new_hash_map));
-          swap(new_hash_map);
-          break;
-  
-        case hash_map_type::SEARCH_CAPACITY_SUCCESS_WITH_RETRY:
-          for_each(insertion_iterator(new_hash_map));
-          swap(new_hash_map);
-          ++m_approx_max_chain_size;
-          break;
-  
-        case hash_map_type::SEARCH_CAPACITY_FAIL:
-          ++m_approx_max_chain_size;
-          break;
-        }
-      }
+    // There are no matching records, just make a new list.
+    if (is_too_full()) {
+      grow();
     }
+
+    equal_list = new (m_equal_lists.alloc()) equal_list_type(e);
+    place(m_control, m_slots, m_mask, hval, equal_list);
+    return equal_list;
+  }
+
+  // Like insert() but only if there are already records that compare equal to r.  Returns NULL, and inserts
+  // nothing, if there aren't.
+  equal_list_type *insert_if_key_exists(const record_ref &r, const Value &v) {
+    equal_list_type *equal_list = find(r, m_specs, hash(r, m_specs));
+    if (equal_list) {
+      equal_list->push_back(new (m_entries.alloc()) entry(m_arena.copy(r), v));
+    }
+
+    return equal_list;
   }
 
   
@@ -159,7 +325,7 @@ public:
   equal_list_type *find(const record_ref &r) { return find(r, m_specs); }
   
   equal_list_type *find(const record_ref &r, const compare_specs &specs) {
-     return find_equal_list(r, *find_hash_chain(r, specs), specs);
+    return find(r, specs, hash(r, specs));
   }
   
   const equal_list_type *find(const record_ref &r) const {
@@ -174,7 +340,7 @@ public:
   // Iterate over all the values.
   /**
    * The iterator must have the following prototype:
-   * bool iter(const record &r, const Value &v);
+   * bool iter(const record_ref &r, const Value &v);
    * 
    * If iter returns true then iteration will continue, otherwise it will 
    * stop.
@@ -183,18 +349,11 @@ public:
    */
   template <typename Iterator>
   bool for_each(Iterator iter) const {
-    typename hash_map_type::const_iterator chain_i;
-    typename hash_map_type::const_iterator chain_iz = m_map.end();
-        
-    for (chain_i = m_map.begin(); chain_i != chain_iz; ++chain_i) {
-      typename hash_chain_type::const_iterator equal_list_i;
-      typename hash_chain_type::const_iterator equal_list_iz = chain_i->end();      
-      for (equal_list_i = chain_i->begin(); 
-        (equal_list_i != equal_list_iz);
-        ++equal_list_i) {
-        if (!for_each(iter, *equal_list_i)) {
-          return false;
-        }
+    size_t number_equal_lists = m_equal_lists.size();
+    size_t i;
+    for (i = 0; i < number_equal_lists; ++i) {
+      if (!for_each(iter, m_equal_lists[i])) {
+        return false;
       }
     }
     
@@ -205,9 +364,9 @@ public:
   // Iterate over all the values in the supplied equals list.
   template <typename Iterator>
   bool for_each(Iterator iter, const equal_list_type &equal_list) const {
-    typename equal_list_type::const_iterator entry_i; 
+    typename equal_list_type::const_iterator entry_i = equal_list.begin(); 
     typename equal_list_type::const_iterator entry_iz = equal_list.end();
-    for (entry_i = equal_list.begin(); (entry_i != entry_iz); ++entry_i) {
+    for (; (entry_i != entry_iz); ++entry_i) {
       if (!iter(entry_i->first, entry_i->second)) {
         return false;
       }
@@ -236,97 +395,165 @@ public:
   
   
   void swap(record_multihashmap &other) {
-    m_map.swap(other.m_map);
+    m_control.swap(other.m_control);
+    m_slots.swap(other.m_slots);
+    rstd::swap(m_mask, other.m_mask);
+    m_equal_lists.swap(other.m_equal_lists);
+    m_entries.swap(other.m_entries);
     m_specs.swap(other.m_specs);
+    m_arena.swap(other.m_arena);
+    rstd::swap(m_max_hash_table_size, other.m_max_hash_table_size);
   }
 
-private:
-  hash_chain_type *find_hash_chain(const record_ref &r, const compare_specs &specs) {
-    size_t hash_offset = hash(r, specs);
-    return &m_map[hash_offset];
-  }
-  
-  // Returns NULL if there is no such equal list.
-  equal_list_type *find_equal_list(const record_ref &r, const hash_chain_type &hash_chain, const compare_specs &specs) {
-    typename hash_chain_type::const_iterator equal_list_i;
-    typename hash_chain_type::const_iterator equal_list_iz 
-                            = hash_chain.end();
-    for (equal_list_i = hash_chain.begin(); 
-        (equal_list_i != equal_list_iz);
-        ++equal_list_i) {
-      NP1_ASSERT(equal_list_i->size(), "Empty equal_list");
-      if (hetero_record_compare(equal_list_i->front().first, m_specs,
-                                r, specs) == 0) {
-        return (equal_list_type *)&(*equal_list_i);
+  // Like find(r, specs) but for callers that already have the hash of r, see hash().
+  equal_list_type *find(const record_ref &r, const compare_specs &specs, uint64_t hval) {
+    unsigned char control = hash_to_control(hval);
+    size_t offset = hval & m_mask;
+    size_t stride = 0;
+
+    while (true) {
+      control_group group(&m_control[offset]);
+      uint32_t matches = group.match(control);
+      for (; matches; matches &= matches - 1) {
+        slot &s = m_slots[(offset + __builtin_ctz(matches)) & m_mask];
+        if ((s.m_hash == hval)
+            && (hetero_record_compare(s.m_equal_list->front().first, m_specs, r, specs) == 0)) {
+          return s.m_equal_list;
+        }
+      }
+
+      if (group.match(CONTROL_EMPTY)) {
+        return NULL;
       }
+
+      // Triangular probing visits every group when the table size is a power of two.
+      stride += GROUP_SIZE;
+      offset = (offset + stride) & m_mask;
     }
 
     return NULL;
   }
-  
-
-  // An iterator to insert records into a new hash map.
-  struct insertion_iterator {
-    insertion_iterator(record_multihashmap &m) : m_new_hash_map(m) {}
-    bool operator()(const record &r, const Value &v) const {
-      m_new_hash_map.insert(r.ref(), v);
-      return true;    
-    }
-    
-    record_multihashmap &m_new_hash_map;
-  };
-  
 
-  // Hash a record and modulate the hash for the size of the hash table.
+  // Hash a record the same way that the map does.
   template <typename Record>
-  size_t hash(const Record &r, const compare_specs &specs) const {
-    compare_specs::const_iterator spec = specs.begin();
-    compare_specs::const_iterator spec_iz = specs.end();
-    uint64_t hval = helper::hash_init();
-    
-    for (; spec != spec_iz; ++spec) {        
-      const str::ref f = r.field(spec->field_number());    
-            
-      if (f.is_null()) {
-        rstd::string error_message =
-          "Unable to find field " + str::to_dec_str(spec->field_number())
-          + " while hashing.  Record number: "
-          + str::to_dec_str(r.record_number());
-            
-        NP1_ASSERT(false, error_message);
+  uint64_t hash(const Record &r, const compare_specs &specs) const {
+    return record_hash(r, specs, helper::hash_init());
+  }
+
+  // Call callback(hval) with the hash of each distinct key.
+  template <typename Hash_Callback>
+  void for_each_hash(Hash_Callback &callback) const {
+    size_t i;
+    for (i = 0; i <= m_mask; ++i) {
+      if (m_control[i] != CONTROL_EMPTY) {
+        callback(m_slots[i].m_hash);
       }
-      
-      hval = spec->hash_function()(f.ptr(), f.length(), hval);               
     }
+  }
+
+  /// Where the records live.  Callers that change a stored record should put the new one here too.
+  record_arena &arena() { return m_arena; }
+
+  /// The number of distinct keys.
+  size_t size() const { return m_equal_lists.size(); }
 
-    return (size_t)(((size_t)hval) % m_map.size());
+  /// Roughly how much memory the map is using, in bytes.
+  size_t memory_size() const {
+    return m_control.size() + m_slots.size() * sizeof(slot) + m_equal_lists.memory_size() + m_entries.memory_size()
+            + m_arena.allocated_size();
   }
-  
-  typename hash_map_type::search_capacity_result_type
-  try_init(size_t initial_size_hint, size_t old_map_size) {
-    if (initial_size_hint <= 0) {
-      initial_size_hint = 1;
+
+  /// Roughly how much memory the keys and records are taking up, in bytes.  Unlike memory_size() this doesn't
+  /// count the empty table or memory that's been allocated but not used yet, so it starts at 0.
+  size_t used_memory_size() const {
+    return size() * (sizeof(slot) + 1) * 8 / MAX_LOAD_EIGHTHS + m_equal_lists.size() * sizeof(equal_list_type)
+            + m_entries.size() * sizeof(entry) + m_arena.used_size();
+  }
+
+private:
+  /// Disable copy.
+  record_multihashmap(const record_multihashmap &);
+  record_multihashmap &operator = (const record_multihashmap &);
+
+private:
+  // The control word for a slot holding hval.
+  static unsigned char hash_to_control(uint64_t hval) { return (unsigned char)(hval >> 57); }
+
+  // Put an equal list in the first empty slot on hval's probe sequence.
+  static void place(rstd::vector<unsigned char> &control, rstd::vector<slot> &slots, size_t mask,
+                    uint64_t hval, equal_list_type *equal_list) {
+    size_t offset = hval & mask;
+    size_t stride = 0;
+
+    while (true) {
+      uint32_t empties = control_group(&control[offset]).match(CONTROL_EMPTY);
+      if (empties) {
+        size_t slot_number = (offset + __builtin_ctz(empties)) & mask;
+        control[slot_number] = hash_to_control(hval);
+        // The first few control words are mirrored after the end so that groups can run off the end.
+        if (slot_number < GROUP_SIZE - 1) {
+          control[mask + 1 + slot_number] = hash_to_control(hval);
+        }
+
+        slots[slot_number].m_hash = hval;
+        slots[slot_number].m_equal_list = equal_list;
+        return;
+      }
+
+      stride += GROUP_SIZE;
+      offset = (offset + stride) & mask;
     }
+  }
 
-    size_t min_capacity = old_map_size * 1.25;
-    if (0 == min_capacity) {
-      min_capacity = 1;
+  // The user-specified maximum table size is a soft limit: once we've reached it we let the table fill right up
+  // before growing any more.
+  bool is_too_full() const {
+    size_t capacity = m_mask + 1;
+    size_t number_used = m_equal_lists.size();
+    if (number_used + 1 >= capacity) {
+      return true;
     }
 
-    typename hash_map_type::search_capacity_result_type result =
-      m_map.search_capacity(initial_size_hint, old_map_size+1);
-        
-    m_map.resize(m_map.capacity());
+    return (capacity < m_max_hash_table_size) && ((number_used + 1) * 8 > capacity * MAX_LOAD_EIGHTHS);
+  }
 
-    return result;
+  void init(size_t capacity) {
+    m_control.resize(capacity + GROUP_SIZE - 1);
+    memset(&m_control[0], CONTROL_EMPTY, m_control.size());
+    m_slots.resize(capacity);
+    m_mask = capacity - 1;
   }
-  
+
+  // Double the size of the table.  The slots know their hashes so we don't need to look at the records.
+  void grow() {
+    size_t new_capacity = (m_mask + 1) * 2;
+    rstd::vector<unsigned char> new_control;
+    rstd::vector<slot> new_slots;
+    new_control.resize(new_capacity + GROUP_SIZE - 1);
+    memset(&new_control[0], CONTROL_EMPTY, new_control.size());
+    new_slots.resize(new_capacity);
+
+    size_t i;
+    for (i = 0; i <= m_mask; ++i) {
+      if (m_control[i] != CONTROL_EMPTY) {
+        place(new_control, new_slots, new_capacity - 1, m_slots[i].m_hash, m_slots[i].m_equal_list);
+      }
+    }
+
+    m_control.swap(new_control);
+    m_slots.swap(new_slots);
+    m_mask = new_capacity - 1;
+  }
+
 private:
-  // A vector of hash chains where each exact-matching entry is a list of
-  // records.
-  hash_map_type m_map;
   compare_specs m_specs;
-  size_t m_approx_max_chain_size;
+  // The control words, with the first GROUP_SIZE - 1 repeated at the end.
+  rstd::vector<unsigned char> m_control;
+  rstd::vector<slot> m_slots;
+  size_t m_mask;
+  stable_pool<equal_list_type> m_equal_lists;
+  stable_pool<entry> m_entries;
+  record_arena m_arena;
   uint64_t m_max_hash_table_size;
 };
   
@@ -0,0 +1,195 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_DETAIL_RECORD_PARTITIONS_HPP
+#define NP1_REL_DETAIL_RECORD_PARTITIONS_HPP
+
+
+#include "rstd/vector.hpp"
+#include "np1/io/file.hpp"
+#include "np1/io/buffered_output_stream.hpp"
+#include "np1/io/mandatory_output_stream.hpp"
+#include "np1/io/mandatory_record_input_stream.hpp"
+#include "np1/io/mandatory_record_reader.hpp"
+#include "np1/rel/record.hpp"
+#include "np1/rel/detail/compare_specs.hpp"
+#include "np1/rel/detail/record_multihashmap.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace detail {
+
+/// Temporary files that records are hash-partitioned into when there are too many to hold in memory.  Records
+/// that compare equal under the specs always end up in the same partition.  Each level of partitioning hashes
+/// differently so that a partition that's still too big can itself be partitioned.
+class record_partitions {
+public:
+  enum {
+    NUMBER_PARTITIONS = 16,
+    HASH_SEED = 0x70617274
+  };
+
+  /// A single partition.  Once it's been written it can be read like any other record input stream.
+  class partition {
+  private:
+    typedef io::buffered_output_stream<io::file> buffered_output_type;
+    typedef io::mandatory_output_stream<buffered_output_type> mandatory_output_type;
+
+  public:
+    partition() : m_buffered_output(m_file), m_output(m_buffered_output), m_number_records(0) {
+      // tmpfile() files disappear by themselves when they're closed.
+      FILE *fp = tmpfile();
+      NP1_ASSERT(fp, "Unable to create temporary file for partitioning");
+      int fd = dup(fileno(fp));
+      fclose(fp);
+      NP1_ASSERT(fd != -1, "Unable to duplicate temporary file handle for partitioning");
+      m_file.from_handle(fd);
+    }
+
+    ~partition() {}
+
+    void write(const record_ref &r) {
+      r.write(m_output);
+      ++m_number_records;
+    }
+
+    /// Write a record, replacing its checksum.  Callers use the checksum to remember where the record came from.
+    void write_with_checksum(const record_ref &r, uint64_t checksum) {
+      r.write_with_checksum(m_output, checksum);
+      ++m_number_records;
+    }
+
+    uint64_t number_records() const { return m_number_records; }
+
+    /// Read back all the records written so far.
+    template <typename Record_Callback>
+    bool parse_records(Record_Callback record_callback) {
+      m_output.soft_flush();
+      NP1_ASSERT(m_file.rewind(), "Unable to rewind temporary partition file");
+      io::mandatory_record_input_stream<io::file, record, record_ref> input(m_file);
+      return input.parse_records(record_callback);
+    }
+
+    /// Get the file ready to be read from the start, for callers that want a mandatory_record_reader.
+    io::file &rewound_file() {
+      m_output.soft_flush();
+      NP1_ASSERT(m_file.rewind(), "Unable to rewind temporary partition file");
+      return m_file;
+    }
+
+  private:
+    /// Disable copy.
+    partition(const partition &);
+    partition &operator = (const partition &);
+
+  private:
+    io::file m_file;
+    buffered_output_type m_buffered_output;
+    mandatory_output_type m_output;
+    uint64_t m_number_records;
+  };
+
+public:
+  record_partitions(const compare_specs &specs, size_t level)
+    : m_specs(specs), m_hash_init(helper::hash_init(HASH_SEED + level)) {}
+
+  ~record_partitions() {
+    rstd::vector<partition *>::iterator partition_i = m_partitions.begin();
+    rstd::vector<partition *>::iterator partition_iz = m_partitions.end();
+    for (; partition_i != partition_iz; ++partition_i) {
+      rstd::detail::mem::destruct_and_free(*partition_i);
+    }
+  }
+
+  /// Write a record to its partition.  The files are only created when the first record is written.
+  void write(const record_ref &r) {
+    mandatory_get_partition(r).write(r);
+  }
+
+  /// Write a record to its partition, replacing its checksum.
+  void write_with_checksum(const record_ref &r, uint64_t checksum) {
+    mandatory_get_partition(r).write_with_checksum(r, checksum);
+  }
+
+  /// The number of partitions, which is 0 if nothing has been written.
+  size_t size() const { return m_partitions.size(); }
+
+  partition &operator[](size_t n) { return *m_partitions[n]; }
+
+  /// Merge partitions whose records carry a tag in their checksums, calling sink.write(r, tag) for every record
+  /// in tag order.  Each partition must be in tag order already.
+  template <typename Sink>
+  static void merge_tagged(rstd::vector<partition *> &partitions, Sink &sink) {
+    rstd::vector<merge_input *> inputs;
+    rstd::vector<partition *>::iterator partition_i = partitions.begin();
+    rstd::vector<partition *>::iterator partition_iz = partitions.end();
+    for (; partition_i != partition_iz; ++partition_i) {
+      merge_input *input =
+        new (rstd::detail::mem::alloc(sizeof(merge_input))) merge_input((*partition_i)->rewound_file());
+      if (input->next()) {
+        inputs.push_back(input);
+      } else {
+        rstd::detail::mem::destruct_and_free(input);
+      }
+    }
+
+    while (!inputs.empty()) {
+      size_t smallest = 0;
+      size_t i;
+      for (i = 1; i < inputs.size(); ++i) {
+        if (inputs[i]->m_head.checksum() < inputs[smallest]->m_head.checksum()) {
+          smallest = i;
+        }
+      }
+
+      merge_input *input = inputs[smallest];
+      sink.write(input->m_head, input->m_head.checksum());
+
+      if (!input->next()) {
+        rstd::detail::mem::destruct_and_free(input);
+        inputs.erase(inputs.begin() + smallest);
+      }
+    }
+  }
+
+private:
+  /// Disable copy.
+  record_partitions(const record_partitions &);
+  record_partitions &operator = (const record_partitions &);
+
+private:
+  // One of the partitions that's being merged.
+  struct merge_input {
+    explicit merge_input(io::file &f) : m_reader(f) {}
+    bool next() { return m_reader.read_record(m_head); }
+
+    io::mandatory_record_reader<io::file, record_ref> m_reader;
+    record_ref m_head;
+  };
+
+  partition &mandatory_get_partition(const record_ref &r) {
+    if (m_partitions.empty()) {
+      size_t i;
+      for (i = 0; i < NUMBER_PARTITIONS; ++i) {
+        m_partitions.push_back(new (rstd::detail::mem::alloc(sizeof(partition))) partition());
+      }
+    }
+
+    // The high bits of the hash are better mixed than the low bits.
+    uint64_t hval = record_hash(r, m_specs, m_hash_init);
+    return *m_partitions[(hval >> 32) % NUMBER_PARTITIONS];
+  }
+
+private:
+  compare_specs m_specs;
+  uint64_t m_hash_init;
+  rstd::vector<partition *> m_partitions;
+};
+
+
+} // namespaces
+}
+}
+
+
+#endif
@@ -0,0 +1,87 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_DETAIL_RECORD_RUN_MAP_HPP
+#define NP1_REL_DETAIL_RECORD_RUN_MAP_HPP
+
+
+#include "rstd/list.hpp"
+#include "rstd/pair.hpp"
+#include "np1/rel/record_arena.hpp"
+#include "np1/rel/detail/compare_specs.hpp"
+#include "np1/rel/detail/record_multihashmap.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace detail {
+
+/// A stand-in for record_multihashmap for use when the input is sorted so that all the records that compare
+/// equal are adjacent.  Only the current run of equal records is held in memory.  When a new run starts, the
+/// previous run is handed to the run callback, which has the same prototype as a record_multihashmap::for_each
+/// iterator.
+template <typename Value, typename Run_Callback>
+class record_run_map {
+public:
+  typedef Value value_type;
+
+  // The current run.
+  typedef rstd::list<rstd::pair<record_ref, Value> > equal_list_type;
+
+public:
+  record_run_map(const compare_specs &specs, Run_Callback run_callback)
+    : m_specs(specs), m_run_callback(run_callback) {}
+
+  ~record_run_map() {}
+
+  /// Start a new run, finishing off the current one.  Returns the new run.
+  equal_list_type *insert(const record_ref &r, const Value &v) {
+    flush();
+    m_run.push_back(rstd::make_pair(m_arena.copy(r), v));
+    return &m_run;
+  }
+
+  /// Returns the current run if the record belongs to it, otherwise NULL.
+  equal_list_type *find(const record_ref &r) {
+    if (!m_run.empty() && (record_compare(m_run.front().first, r, m_specs) == 0)) {
+      return &m_run;
+    }
+
+    return NULL;
+  }
+
+  /// Hand the current run (if any) to the run callback and forget about it.  Call this after the last insert.
+  bool flush() {
+    bool result = true;
+    typename equal_list_type::const_iterator entry_i = m_run.begin();
+    typename equal_list_type::const_iterator entry_iz = m_run.end();
+    for (; result && (entry_i != entry_iz); ++entry_i) {
+      result = m_run_callback(entry_i->first, entry_i->second);
+    }
+
+    m_run.clear();
+    m_arena.reset();
+    return result;
+  }
+
+  /// Where the current run's records live.
+  record_arena &arena() { return m_arena; }
+
+private:
+  /// Disable copy.
+  record_run_map(const record_run_map &);
+  record_run_map &operator = (const record_run_map &);
+
+private:
+  compare_specs m_specs;
+  Run_Callback m_run_callback;
+  equal_list_type m_run;
+  record_arena m_arena;
+};
+
+
+} // namespaces
+}
+}
+
+
+#endif
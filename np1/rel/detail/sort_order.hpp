@@ -0,0 +1,169 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_DETAIL_SORT_ORDER_HPP
+#define NP1_REL_DETAIL_SORT_ORDER_HPP
+
+
+#include "rstd/vector.hpp"
+#include "rstd/string.hpp"
+#include "np1/rel/record_ref.hpp"
+#include "np1/rel/detail/compare_specs.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace detail {
+
+/// The order of a stream, as recorded by the operator that sorted it.
+/**
+ * The sort headings and direction are stored in the checksum slot of the headings record's postlude.  Nothing
+ * else reads the checksum of a headings record, so older versions of r17 just see an unsorted stream.  The
+ * 64-bit value is laid out like this, least significant byte first:
+ *
+ *   byte 0:    SORT_ORDER_MAGIC_ASCENDING or SORT_ORDER_MAGIC_DESCENDING.
+ *   byte 1:    the number of sort headings, 1 to MAX_NUMBER_FIELDS.
+ *   bytes 2-7: the 0-based field numbers of the sort headings, most significant first.
+ *
+ * A sort on more headings than will fit is recorded as a sort on the leading headings, which is still true.
+ */
+class sort_order {
+public:
+  enum {
+    SORT_ORDER_MAGIC_ASCENDING = 0x53,
+    SORT_ORDER_MAGIC_DESCENDING = 0x73,
+    MAX_NUMBER_FIELDS = 6,
+    MAX_FIELD_NUMBER = 0xff
+  };
+
+public:
+  /// An unsorted stream.
+  sort_order() : m_is_descending(false) {}
+
+  /// The order produced by sorting on the supplied specs.
+  sort_order(const compare_specs &specs, bool is_descending) : m_is_descending(is_descending) {
+    compare_specs::const_iterator spec = specs.begin();
+    compare_specs::const_iterator spec_iz = specs.end();
+    for (; (spec != spec_iz) && (m_field_numbers.size() < MAX_NUMBER_FIELDS); ++spec) {
+      if (spec->field_number() >= MAX_FIELD_NUMBER) {
+        break;
+      }
+
+      // Sorting on the same heading twice is the same as sorting on it once.
+      if (!contains(m_field_numbers.begin(), m_field_numbers.end(), spec->field_number())) {
+        m_field_numbers.push_back(spec->field_number());
+      }
+    }
+  }
+
+  ~sort_order() {}
+
+  /// Get the sort order from a headings record.
+  static sort_order from_headings(const record_ref &headings) {
+    sort_order result;
+    uint64_t checksum = headings.checksum();
+    unsigned char magic = checksum & 0xff;
+    size_t number_fields = (checksum >> 8) & 0xff;
+    if (((magic != SORT_ORDER_MAGIC_ASCENDING) && (magic != SORT_ORDER_MAGIC_DESCENDING))
+        || (0 == number_fields) || (number_fields > MAX_NUMBER_FIELDS)) {
+      return result;
+    }
+
+    size_t number_headings = headings.number_fields();
+    size_t i;
+    for (i = 0; i < number_fields; ++i) {
+      size_t field_number = (checksum >> (16 + i * 8)) & 0xff;
+      if (field_number >= number_headings) {
+        // Not something we wrote.
+        return sort_order();
+      }
+
+      result.m_field_numbers.push_back(field_number);
+    }
+
+    result.m_is_descending = (SORT_ORDER_MAGIC_DESCENDING == magic);
+    return result;
+  }
+
+  bool is_sorted() const { return m_field_numbers.size() > 0; }
+  bool is_descending() const { return m_is_descending; }
+  const rstd::vector<size_t> &field_numbers() const { return m_field_numbers; }
+
+  /// Write the headings with this sort order attached.
+  template <typename Mandatory_Output_Stream>
+  void write_headings(Mandatory_Output_Stream &mos, const record_ref &headings) const {
+    headings.write_with_checksum(mos, to_checksum());
+  }
+
+  /// Are all the records that compare equal under the specs adjacent in the stream?
+  bool is_grouped_by(const compare_specs &specs) const {
+    if (specs.size() > m_field_numbers.size()) {
+      return false;
+    }
+
+    compare_specs::const_iterator spec = specs.begin();
+    compare_specs::const_iterator spec_iz = specs.end();
+    for (; spec != spec_iz; ++spec) {
+      if (!contains(m_field_numbers.begin(), m_field_numbers.begin() + specs.size(), spec->field_number())) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /// Get the names of the leading number_headings sort headings, or return false if the stream isn't sorted
+  /// on that many headings.
+  bool leading_heading_names(const record_ref &headings, size_t number_headings,
+                             rstd::vector<rstd::string> &names) const {
+    if (number_headings > m_field_numbers.size()) {
+      return false;
+    }
+
+    names.clear();
+    size_t i;
+    for (i = 0; i < number_headings; ++i) {
+      names.push_back(headings.mandatory_field(m_field_numbers[i]).to_string());
+    }
+
+    return true;
+  }
+
+  uint64_t to_checksum() const {
+    if (!is_sorted()) {
+      return 0;
+    }
+
+    uint64_t checksum = m_is_descending ? SORT_ORDER_MAGIC_DESCENDING : SORT_ORDER_MAGIC_ASCENDING;
+    checksum |= ((uint64_t)m_field_numbers.size()) << 8;
+    size_t i;
+    for (i = 0; i < m_field_numbers.size(); ++i) {
+      checksum |= ((uint64_t)m_field_numbers[i]) << (16 + i * 8);
+    }
+
+    return checksum;
+  }
+
+private:
+  static bool contains(rstd::vector<size_t>::const_iterator i, rstd::vector<size_t>::const_iterator iz,
+                       size_t field_number) {
+    for (; i != iz; ++i) {
+      if (*i == field_number) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+private:
+  rstd::vector<size_t> m_field_numbers;
+  bool m_is_descending;
+};
+
+
+} // namespaces
+}
+}
+
+
+#endif
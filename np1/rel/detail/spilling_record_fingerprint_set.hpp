@@ -0,0 +1,141 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_DETAIL_SPILLING_RECORD_FINGERPRINT_SET_HPP
+#define NP1_REL_DETAIL_SPILLING_RECORD_FINGERPRINT_SET_HPP
+
+
+#include "rstd/vector.hpp"
+#include "np1/environment.hpp"
+#include "np1/rel/detail/helper.hpp"
+#include "np1/rel/detail/compare_specs.hpp"
+#include "np1/rel/detail/record_multihashmap.hpp"
+#include "np1/rel/detail/record_partitions.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace detail {
+
+/// A set of records that only keeps a 128-bit fingerprint of each record instead of the record itself.
+/**
+ * Two different records with the same fingerprint are treated as the same record, which is very unlikely but
+ * not impossible, so this is only for callers that can live with that.  The set stays within a memory budget
+ * in the same way as spilling_record_multihashmap.
+ */
+class spilling_record_fingerprint_set {
+public:
+  enum {
+    MAX_LEVEL = 8,
+    INITIAL_NUMBER_SLOTS = 1024,
+    HASH_SEED_LOW = 0x66707231,
+    HASH_SEED_HIGH = 0x66707232
+  };
+
+public:
+  spilling_record_fingerprint_set(const compare_specs &specs, record_partitions &partitions, size_t level)
+    : m_specs(specs), m_partitions(partitions), m_hash_init_low(helper::hash_init(HASH_SEED_LOW + level)),
+      m_hash_init_high(helper::hash_init(HASH_SEED_HIGH + level)), m_size(0),
+      m_max_memory_size(environment::max_hash_table_memory()), m_is_spilling(false),
+      m_can_spill(level < MAX_LEVEL) {
+    m_slots.resize(INITIAL_NUMBER_SLOTS);
+    memset(m_slots.begin(), 0, m_slots.size() * sizeof(fingerprint));
+  }
+
+  ~spilling_record_fingerprint_set() {}
+
+  /// Returns true if the record wasn't already in the set and now is.  Returns false if it was already in the
+  /// set, or if the set is full and the record went to a partition with its checksum replaced.
+  bool insert_with_checksum(const record_ref &r, uint64_t checksum) {
+    fingerprint fp;
+    fp.m_low = record_hash(r, m_specs, m_hash_init_low);
+    fp.m_high = record_hash(r, m_specs, m_hash_init_high);
+    // An all-zero slot is empty.
+    fp.m_low |= (0 == fp.m_high);
+
+    fingerprint *slot = find_slot(fp);
+    if (slot->is_equal(fp)) {
+      return false;
+    }
+
+    if (m_is_spilling) {
+      m_partitions.write_with_checksum(r, checksum);
+      return false;
+    }
+
+    *slot = fp;
+    ++m_size;
+    if (10 * m_size > 7 * m_slots.size()) {
+      grow();
+    }
+
+    m_is_spilling = m_can_spill && (used_memory_size() > m_max_memory_size);
+    return true;
+  }
+
+  size_t size() const { return m_size; }
+
+  size_t memory_size() const { return m_slots.size() * sizeof(fingerprint); }
+
+  /// The memory taken up by the fingerprints themselves, which is what counts against the budget.  The rest of
+  /// the table is overhead that doesn't depend on the budget.
+  size_t used_memory_size() const { return m_size * sizeof(fingerprint); }
+
+private:
+  /// Disable copy.
+  spilling_record_fingerprint_set(const spilling_record_fingerprint_set &);
+  spilling_record_fingerprint_set &operator = (const spilling_record_fingerprint_set &);
+
+private:
+  struct fingerprint {
+    bool is_empty() const { return (0 == m_low) && (0 == m_high); }
+    bool is_equal(const fingerprint &other) const { return (m_low == other.m_low) && (m_high == other.m_high); }
+
+    uint64_t m_low;
+    uint64_t m_high;
+  };
+
+  // Find the slot that holds fp, or the empty slot where it should go.
+  fingerprint *find_slot(const fingerprint &fp) {
+    size_t mask = m_slots.size() - 1;
+    size_t slot_number = (size_t)fp.m_high & mask;
+    while (!m_slots[slot_number].is_empty() && !m_slots[slot_number].is_equal(fp)) {
+      slot_number = (slot_number + 1) & mask;
+    }
+
+    return &m_slots[slot_number];
+  }
+
+  void grow() {
+    rstd::vector<fingerprint> old_slots;
+    old_slots.swap(m_slots);
+    m_slots.resize(old_slots.size() * 2);
+    memset(m_slots.begin(), 0, m_slots.size() * sizeof(fingerprint));
+
+    rstd::vector<fingerprint>::const_iterator i = old_slots.begin();
+    rstd::vector<fingerprint>::const_iterator iz = old_slots.end();
+    for (; i != iz; ++i) {
+      if (!i->is_empty()) {
+        *find_slot(*i) = *i;
+      }
+    }
+  }
+
+private:
+  compare_specs m_specs;
+  record_partitions &m_partitions;
+  uint64_t m_hash_init_low;
+  uint64_t m_hash_init_high;
+  rstd::vector<fingerprint> m_slots;
+  size_t m_size;
+  uint64_t m_max_memory_size;
+  bool m_is_spilling;
+  bool m_can_spill;
+};
+
+
+} // namespaces
+}
+}
+
+
+#endif
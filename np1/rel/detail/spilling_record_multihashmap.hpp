@@ -0,0 +1,114 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_DETAIL_SPILLING_RECORD_MULTIHASHMAP_HPP
+#define NP1_REL_DETAIL_SPILLING_RECORD_MULTIHASHMAP_HPP
+
+
+#include "np1/environment.hpp"
+#include "np1/rel/detail/compare_specs.hpp"
+#include "np1/rel/detail/record_multihashmap.hpp"
+#include "np1/rel/detail/record_partitions.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace detail {
+
+/// A stand-in for record_multihashmap that stays within a memory budget.
+/**
+ * Once the map's keys and records are using more than NP1_MAX_RECORD_HASH_TABLE_MEMORY bytes it stops taking new
+ * keys.  The empty table and the memory that's set aside but not used yet don't count, otherwise they'd eat all
+ * of a small budget and leave one key per level.  Records with
+ * keys that are already in the map still go into the map, but inserting a record with a new key writes the
+ * record to a partition instead.  Every record with that key will then go to the same partition, so the caller
+ * can finish off the keys in the map and then deal with each partition separately, in the same way, with
+ * level + 1.  The map always takes at least one key, and there's no spilling beyond MAX_LEVEL, so recursion
+ * always ends.
+ */
+template <typename Value>
+class spilling_record_multihashmap {
+public:
+  enum { MAX_LEVEL = 8 };
+
+  typedef Value value_type;
+  typedef typename record_multihashmap<Value>::equal_list_type equal_list_type;
+
+public:
+  spilling_record_multihashmap(const compare_specs &specs, record_partitions &partitions, size_t level)
+    : m_map(specs), m_partitions(partitions), m_max_memory_size(environment::max_hash_table_memory()),
+      m_is_spilling(false), m_can_spill(level < MAX_LEVEL) {}
+
+  ~spilling_record_multihashmap() {}
+
+  /// Returns the list of records that compare equal to r, like record_multihashmap::insert(), or NULL if the
+  /// record went to a partition instead of the map.
+  equal_list_type *insert(const record_ref &r, const Value &v) {
+    if (m_is_spilling) {
+      equal_list_type *equal_list = m_map.insert_if_key_exists(r, v);
+      if (!equal_list) {
+        m_partitions.write(r);
+      }
+
+      return equal_list;
+    }
+
+    equal_list_type *equal_list = m_map.insert(r, v);
+    m_is_spilling = m_can_spill && (m_map.used_memory_size() > m_max_memory_size);
+    return equal_list;
+  }
+
+  /// The same as insert() except that a record that goes to a partition has its checksum replaced.  Callers use
+  /// the checksum to remember where the record came from.
+  equal_list_type *insert_with_checksum(const record_ref &r, const Value &v, uint64_t checksum) {
+    if (!m_is_spilling) {
+      return insert(r, v);
+    }
+
+    equal_list_type *equal_list = m_map.insert_if_key_exists(r, v);
+    if (!equal_list) {
+      m_partitions.write_with_checksum(r, checksum);
+    }
+
+    return equal_list;
+  }
+
+  equal_list_type *find(const record_ref &r) { return m_map.find(r); }
+
+  equal_list_type *find(const record_ref &r, const compare_specs &specs) { return m_map.find(r, specs); }
+
+  equal_list_type *find(const record_ref &r, const compare_specs &specs, uint64_t hval) {
+    return m_map.find(r, specs, hval);
+  }
+
+  uint64_t hash(const record_ref &r, const compare_specs &specs) const { return m_map.hash(r, specs); }
+
+  template <typename Hash_Callback>
+  void for_each_hash(Hash_Callback &callback) const { m_map.for_each_hash(callback); }
+
+  size_t size() const { return m_map.size(); }
+
+  template <typename Iterator>
+  bool for_each(Iterator iter) const { return m_map.for_each(iter); }
+
+  record_arena &arena() { return m_map.arena(); }
+
+private:
+  /// Disable copy.
+  spilling_record_multihashmap(const spilling_record_multihashmap &);
+  spilling_record_multihashmap &operator = (const spilling_record_multihashmap &);
+
+private:
+  record_multihashmap<Value> m_map;
+  record_partitions &m_partitions;
+  uint64_t m_max_memory_size;
+  bool m_is_spilling;
+  bool m_can_spill;
+};
+
+
+} // namespaces
+}
+}
+
+
+#endif
@@ -4,7 +4,23 @@
 #define NP1_NP1_REL_GROUP_HPP
 
 
+#include "rstd/list.hpp"
+#include "rstd/pair.hpp"
+#include "np1/environment.hpp"
+#include "np1/hyperloglog.hpp"
+#include "np1/process.hpp"
+#include "np1/quantile_sketch.hpp"
+#include "np1/io/buffered_output_stream.hpp"
+#include "np1/io/file.hpp"
+#include "np1/io/mandatory_input_stream.hpp"
+#include "np1/io/mandatory_output_stream.hpp"
+#include "np1/io/mandatory_record_input_stream.hpp"
+#include "np1/io/heap_buffer_output_stream.hpp"
 #include "np1/rel/detail/record_multihashmap.hpp"
+#include "np1/rel/detail/record_partitions.hpp"
+#include "np1/rel/detail/record_run_map.hpp"
+#include "np1/rel/detail/spilling_record_multihashmap.hpp"
+#include "np1/rel/detail/sort_order.hpp"
 #include "np1/rel/detail/sort_manager.hpp"
 #include "np1/rel/detail/merge_sort.hpp"
 #include "np1/rel/rlang/rlang.hpp"
@@ -35,6 +51,16 @@ namespace detail {
 #define NP1_REL_GROUP_AGGREGATOR_SUM "sum"
 #define NP1_REL_GROUP_AGGREGATOR_SUM_COUNT "sum_count"
 #define NP1_REL_GROUP_AGGREGATOR_MEDIAN "median"
+#define NP1_REL_GROUP_AGGREGATOR_MEDIAN_APPROX "median_approx"
+#define NP1_REL_GROUP_AGGREGATOR_PERCENTILE "percentile"
+#define NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH "quantile_sketch"
+#define NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX "count_distinct_approx"
+#define NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH "hll_sketch"
+#define NP1_REL_GROUP_AGGREGATOR_HLL_MERGE "hll_merge"
+
+// Keywords that go before the aggregators to split a group into two steps.
+#define NP1_REL_GROUP_PARTIAL "partial"
+#define NP1_REL_GROUP_MERGE_PARTIAL "merge_partial"
 
 
 // Output heading names.
@@ -42,6 +68,15 @@ namespace detail {
 #define NP1_REL_GROUP_OUTPUT_HEADING_AVG "_avg"
 #define NP1_REL_GROUP_OUTPUT_HEADING_SUM "_sum"
 #define NP1_REL_GROUP_OUTPUT_HEADING_MEDIAN "_median"
+#define NP1_REL_GROUP_OUTPUT_HEADING_MIN "_min"
+#define NP1_REL_GROUP_OUTPUT_HEADING_MAX "_max"
+#define NP1_REL_GROUP_OUTPUT_HEADING_MEDIAN_APPROX "_median_approx"
+#define NP1_REL_GROUP_OUTPUT_HEADING_PERCENTILE "_percentile"
+#define NP1_REL_GROUP_OUTPUT_HEADING_QUANTILE_SKETCH "_quantile_sketch"
+#define NP1_REL_GROUP_OUTPUT_HEADING_COUNT_DISTINCT_APPROX "uint:_count_distinct_approx"
+#define NP1_REL_GROUP_OUTPUT_HEADING_HLL_SKETCH "_hll_sketch"
+#define NP1_REL_GROUP_OUTPUT_HEADING_PARTIAL_RECORD_COUNT "uint:_partial_record_count"
+#define NP1_REL_GROUP_OUTPUT_HEADING_PARTIAL_PREFIX "_partial"
 
 
 
@@ -50,11 +85,36 @@ public:
   template <typename Input_Stream, typename Output_Stream>
   void operator()(Input_Stream &input, Output_Stream &output,
                   const rstd::vector<rel::rlang::token> &tokens) {    
+    // More than one aggregator means one pass with a row of accumulators per group.
+    rstd::vector<rstd::vector<rel::rlang::token> > aggregator_expressions =
+      rlang::compiler::split_expressions(tokens);
+
+    // Partial aggregates are merged later, eg after each host has aggregated its own files.
+    if (is_keyword_expression(aggregator_expressions, NP1_REL_GROUP_PARTIAL)) {
+      aggregator_expressions.erase(aggregator_expressions.begin());
+      NP1_ASSERT(aggregator_expressions.size() > 0, "No aggregator supplied to rel.group(" NP1_REL_GROUP_PARTIAL ")");
+      group_multiple(aggregator_expressions, input, output, true);
+      return;
+    }
+
+    if (is_keyword_expression(aggregator_expressions, NP1_REL_GROUP_MERGE_PARTIAL)) {
+      NP1_ASSERT(aggregator_expressions.size() == 1,
+                 "The aggregator '" NP1_REL_GROUP_MERGE_PARTIAL "' can't be used with other aggregators");
+      group_merge_partial(input, output);
+      return;
+    }
+
+    if (aggregator_expressions.size() > 1) {
+      group_multiple(aggregator_expressions, input, output, false);
+      return;
+    }
+
     // Get the argument(s).
     const char *aggregator; 
     const char *aggregator_heading_name;
+    double aggregator_parameter;
 
-    parse_arguments(tokens, &aggregator, &aggregator_heading_name);
+    parse_arguments(tokens, &aggregator, &aggregator_heading_name, &aggregator_parameter);
     
     // Read the headings from input.
     record input_headings(input.parse_headings());
@@ -67,6 +127,21 @@ public:
     record output_headings(
       get_output_headings(aggregator, aggregator_heading_name, aggregator_type_tag, input_headings));
 
+    // Counts, sums and averages can be worked out in parallel with the same rows of accumulators that are used
+    // for multiple aggregators, the output is the same.
+    if ((environment::group_initial_number_threads() > 1)
+        && ((str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT) == 0)
+            || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_AVG) == 0)
+            || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_SUM) == 0))) {
+      multiple_aggregator_list aggregators;
+      aggregators.push_back(make_multiple_aggregator(input_headings, aggregator, aggregator_heading_name));
+      rstd::vector<rstd::string> aggregator_heading_names;
+      aggregator_heading_names.push_back(
+        output_headings.mandatory_field(output_headings.number_fields() - 1).to_string());
+      aggregate_multiple(input_headings, aggregators, aggregator_heading_names, input, output, false);
+      return;
+    }
+
     // Do the real work.    
     if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT) == 0) {
       group_count(input_headings, output_headings, input, output);
@@ -82,6 +157,20 @@ public:
       group_max(input_headings, output_headings, aggregator_heading_name, input, output);
     } else if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN) == 0) {                   
       group_median(input_headings, output_headings, aggregator_heading_name, input, output);
+    } else if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN_APPROX) == 0) {
+      group_quantile(input_headings, output_headings, aggregator_heading_name, 0.5, input, output);
+    } else if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_PERCENTILE) == 0) {
+      NP1_ASSERT(aggregator_parameter <= 100, "The percentile must be between 0 and 100");
+      group_quantile(input_headings, output_headings, aggregator_heading_name, aggregator_parameter/100, input, output);
+    } else if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH) == 0) {
+      group_quantile(input_headings, output_headings, aggregator_heading_name, -1, input, output);
+    } else if ((str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX) == 0)
+               || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0)
+               || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_MERGE) == 0)) {
+      group_count_distinct(
+        input_headings, output_headings, aggregator_heading_name,
+        (aggregator_parameter < 0) ? (size_t)hyperloglog::DEFAULT_PRECISION : (size_t)aggregator_parameter,
+        str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0, input, output);
     } else {
       NP1_ASSERT(false, "Unknown aggregator: " + rstd::string(aggregator));
     }
@@ -94,12 +183,9 @@ public:
                           Input_Stream &input, Output_Stream &output) {
     rstd::vector<rstd::string> input_heading_names = input_headings.fields();
     detail::compare_specs specs(input_headings, input_heading_names);
-    validate_specs(specs);
-    detail::record_multihashmap<uint64_t> group_map(specs);
-    input.parse_records(count_record_callback(group_map));
-    output_headings.write(output);
-    group_map.for_each(
-      output_count_aggregated_record_callback<Output_Stream>(output));    
+    aggregate<uint64_t, count_record_callback>(
+      input_headings, output_headings, specs, detail::compare_spec(), input, output,
+      output_count_aggregated_record_callback<Output_Stream>(output));
   }
 
 
@@ -224,14 +310,11 @@ public:
                         const char *aggregator_heading_name, Input_Stream &input, Output_Stream &output) {
     str::ref aggregator_type_tag = mandatory_get_aggregator_heading_type_tag(input_headings, aggregator_heading_name);
     rlang::dt::data_type aggregator_type = rlang::dt::mandatory_from_string(aggregator_type_tag);
-    if ((rlang::dt::TYPE_INT == aggregator_type) || (rlang::dt::TYPE_UINT == aggregator_type)) {
-      min_max_helper_struct<int64_t, min_int64_record_callback> helper;
-      helper(input_headings, output_headings, aggregator_heading_name, input, output);
-    } else {
+    if ((rlang::dt::TYPE_INT != aggregator_type) && (rlang::dt::TYPE_UINT != aggregator_type)) {
       validate_type_is_double(aggregator_type, NP1_REL_GROUP_AGGREGATOR_MIN, aggregator_type_tag);
-      min_max_helper_struct<double, min_double_record_callback> helper;
-      helper(input_headings, output_headings, aggregator_heading_name, input, output);
     }
+
+    min_max_helper<min_record_callback>(input_headings, output_headings, aggregator_heading_name, input, output);
   }
 
 
@@ -241,42 +324,230 @@ public:
                         const char *aggregator_heading_name, Input_Stream &input, Output_Stream &output) {
     str::ref aggregator_type_tag = mandatory_get_aggregator_heading_type_tag(input_headings, aggregator_heading_name);
     rlang::dt::data_type aggregator_type = rlang::dt::mandatory_from_string(aggregator_type_tag);
-    if ((rlang::dt::TYPE_INT == aggregator_type) || (rlang::dt::TYPE_UINT == aggregator_type)) {
-      min_max_helper_struct<int64_t, max_int64_record_callback> helper;
-      helper(input_headings, output_headings, aggregator_heading_name, input, output);
-    } else {
-      validate_type_is_double(aggregator_type, NP1_REL_GROUP_AGGREGATOR_MAX, aggregator_type_tag);        
-      min_max_helper_struct<double, max_double_record_callback> helper;
-      helper(input_headings, output_headings, aggregator_heading_name, input, output);
+    if ((rlang::dt::TYPE_INT != aggregator_type) && (rlang::dt::TYPE_UINT != aggregator_type)) {
+      validate_type_is_double(aggregator_type, NP1_REL_GROUP_AGGREGATOR_MAX, aggregator_type_tag);
     }
+
+    min_max_helper<max_record_callback>(input_headings, output_headings, aggregator_heading_name, input, output);
   }
   
   // Median
   template <typename Input_Stream, typename Output_Stream>
   static void group_median(const record &input_headings, const record &output_headings,
                            const char *aggregator_heading_name, Input_Stream &input, Output_Stream &output) {
-    // group_count as well as sort the whole input then walk the sorted records and pick the middle one.
-    // Sorting everything wastes space, but the alternative (storing a list of aggregator input values for each
-    // matching record) runs the risk of fragmenting RAM with resulting horrible performance or even the dreaded
-    // OOM.  The sorting code is built for large data sets and can run in parallel.
     rstd::vector<rstd::string> count_heading_names = input_headings.fields();
     size_t aggregator_heading_id = input_headings.mandatory_find_heading(aggregator_heading_name);
     count_heading_names.erase(count_heading_names.begin() + aggregator_heading_id);
     detail::compare_specs count_specs(input_headings, count_heading_names);
     validate_specs(count_specs);
-    detail::record_multihashmap<uint64_t> count_group_map(count_specs);
 
+    // Numbers are kept with their records in each group and the middle one is selected at the end, so the only
+    // things sorted are the group keys.
+    str::ref aggregator_type_tag = mandatory_get_aggregator_heading_type_tag(input_headings, aggregator_heading_name);
+    rlang::dt::data_type aggregator_type = rlang::dt::mandatory_from_string(aggregator_type_tag);
+    if ((rlang::dt::TYPE_INT == aggregator_type) || (rlang::dt::TYPE_UINT == aggregator_type)
+        || (rlang::dt::TYPE_DOUBLE == aggregator_type)) {
+      output_headings.write(output);
+      size_t number_fields = input_headings.number_fields();
+      if (rlang::dt::TYPE_INT == aggregator_type) {
+        median_values_aggregate<int64_t>(count_specs, aggregator_heading_id, number_fields, input, output, 0);
+      } else if (rlang::dt::TYPE_UINT == aggregator_type) {
+        median_values_aggregate<uint64_t>(count_specs, aggregator_heading_id, number_fields, input, output, 0);
+      } else {
+        median_values_aggregate<double>(count_specs, aggregator_heading_id, number_fields, input, output, 0);
+      }
+
+      return;
+    }
+
+    // Anything else is group_count as well as sort the whole input then walk the sorted records and pick the
+    // middle one.  The sorting code is built for large data sets and can run in parallel.
     rstd::vector<rstd::string> sort_heading_names = input_headings.fields();
     detail::compare_specs sort_specs(input_headings, sort_heading_names);
-    detail::compare_specs_less_than_sort_operator lt(sort_specs);
-    typedef detail::sort_manager<detail::compare_specs_less_than_sort_operator, detail::merge_sort> sort_manager_type;
-    typename sort_manager_type::sort_state sort_state(lt);
-    sort_manager_type sorter(sort_state);
 
-    input.parse_records(median_record_callback<sort_manager_type>(count_group_map, sorter));
     output_headings.write(output);
-    output_median_aggregated_record_callback<Output_Stream> aggregated_callback(count_group_map, count_specs, output);
-    sorter.finalize(aggregated_callback);
+    median_aggregate(count_specs, sort_specs, input, output, 0);
+  }
+
+
+  // The median equivalent of hash_aggregate.  Groups that don't fit in memory are partitioned off and dealt with
+  // afterwards, so only the records of the groups in memory go to the sorter.
+  template <typename Input_Stream, typename Output_Stream>
+  static void median_aggregate(const detail::compare_specs &count_specs, const detail::compare_specs &sort_specs,
+                               Input_Stream &input, Output_Stream &output, size_t level) {
+    detail::record_partitions partitions(count_specs, level);
+
+    {
+      median_count_map_type count_group_map(count_specs, partitions, level);
+      detail::compare_specs_less_than_sort_operator lt(sort_specs);
+      typedef detail::sort_manager<detail::compare_specs_less_than_sort_operator, detail::merge_sort>
+        sort_manager_type;
+      typename sort_manager_type::sort_state sort_state(lt);
+      sort_manager_type sorter(sort_state);
+
+      input.parse_records(median_record_callback<sort_manager_type>(count_group_map, sorter));
+      output_median_aggregated_record_callback<Output_Stream> aggregated_callback(
+        count_group_map, count_specs, output);
+      sorter.finalize(aggregated_callback);
+    }
+
+    size_t i;
+    for (i = 0; i < partitions.size(); ++i) {
+      if (partitions[i].number_records() > 0) {
+        median_aggregate(count_specs, sort_specs, partitions[i], output, level + 1);
+      }
+    }
+  }
+
+
+  // Exact median of a numeric column.  Each group's values and records go in chunks in the map's arena.  If the map
+  // outgrows its memory budget then the records of every group in it are written to the partitions along with the
+  // rest of the input, and each partition is dealt with afterwards in the same way.  Otherwise the groups are written
+  // out in key order, the same as the sorting median.
+  template <typename Number, typename Input_Stream, typename Output_Stream>
+  static void median_values_aggregate(const detail::compare_specs &specs, size_t value_field_number,
+                                      size_t number_fields, Input_Stream &input, Output_Stream &output,
+                                      size_t level) {
+    detail::record_partitions partitions(specs, level);
+
+    {
+      median_values_map_type group_map(specs);
+      bool is_spilling = false;
+      input.parse_records(
+        median_values_record_callback<Number>(
+          group_map, partitions, value_field_number,
+          level < detail::spilling_record_multihashmap<median_value_list *>::MAX_LEVEL, is_spilling));
+      if (!is_spilling) {
+        detail::merge_sort sorter;
+        group_map.for_each(merge_sort_insert_callback(sorter));
+        sorter.sort(detail::compare_specs_less_than_sort_operator(specs));
+        output_median_values_aggregated_record_callback<Output_Stream, Number> output_callback(
+          group_map, output, value_field_number, number_fields);
+        sorter.walk_sorted(output_callback);
+      }
+    }
+
+    size_t i;
+    for (i = 0; i < partitions.size(); ++i) {
+      if (partitions[i].number_records() > 0) {
+        median_values_aggregate<Number>(specs, value_field_number, number_fields, partitions[i], output, level + 1);
+      }
+    }
+  }
+
+
+  // Rearrange the values so that values[n] is the value that would be there if they were sorted, everything
+  // before it is no bigger and everything after it is no smaller.  This is Hoare's selection algorithm.
+  template <typename Value>
+  static Value select_nth(Value *values, size_t number_values, size_t n) {
+    ssize_t left = 0;
+    ssize_t right = number_values - 1;
+    ssize_t target = n;
+    while (left < right) {
+      // The median of three values makes a sorted or reverse-sorted group cheap.  It also means there's a value
+      // at each end that stops the scans below.
+      ssize_t middle = left + (right - left)/2;
+      if (values[middle] < values[left]) {
+        swap_values(values[middle], values[left]);
+      }
+
+      if (values[right] < values[left]) {
+        swap_values(values[right], values[left]);
+      }
+
+      if (values[right] < values[middle]) {
+        swap_values(values[right], values[middle]);
+      }
+
+      Value pivot = values[middle];
+      ssize_t i = left;
+      ssize_t j = right;
+      while (i <= j) {
+        while (values[i] < pivot) {
+          ++i;
+        }
+
+        while (pivot < values[j]) {
+          --j;
+        }
+
+        if (i <= j) {
+          swap_values(values[i], values[j]);
+          ++i;
+          --j;
+        }
+      }
+
+      // Everything up to j is no bigger than the pivot, everything from i on is no smaller and anything in
+      // between is the pivot.
+      if (target <= j) {
+        right = j;
+      } else if (target >= i) {
+        left = i;
+      } else {
+        break;
+      }
+    }
+
+    return values[target];
+  }
+
+  template <typename Value>
+  static void swap_values(Value &v1, Value &v2) {
+    Value temp = v1;
+    v1 = v2;
+    v2 = temp;
+  }
+
+
+  // Approximate median, percentile and the sketches that they come from.  Each group has a quantile_sketch so
+  // this is one pass in a fixed amount of memory per group.  A negative quantile means write out the sketch
+  // itself so that it can be merged with others later, and when the aggregator heading is a column of sketches
+  // the sketches are merged rather than added to.
+  template <typename Input_Stream, typename Output_Stream>
+  static void group_quantile(const record &input_headings, const record &output_headings,
+                             const char *aggregator_heading_name, double quantile, Input_Stream &input,
+                             Output_Stream &output) {
+    rstd::vector<rstd::string> input_heading_names = input_headings.fields();
+    size_t aggregator_heading_id = input_headings.mandatory_find_heading(aggregator_heading_name);
+    input_heading_names.erase(input_heading_names.begin() + aggregator_heading_id);
+    detail::compare_specs specs(input_headings, input_heading_names);
+
+    quantile_aggregator_spec aggregator_spec;
+    aggregator_spec.m_field_number = aggregator_heading_id;
+    aggregator_spec.m_is_sketch = is_quantile_sketch_heading(input_headings.mandatory_field(aggregator_heading_id));
+    aggregator_spec.m_type = get_quantile_type(input_headings, aggregator_heading_name);
+
+    aggregate<quantile_sketch *, quantile_record_callback>(
+      input_headings, output_headings, specs, aggregator_spec, input, output,
+      output_quantile_aggregated_record_callback<Output_Stream>(
+        output, field_id_list<1>(aggregator_heading_id), input_headings.number_fields(), quantile,
+        aggregator_spec.m_type));
+  }
+
+
+  // Approximate COUNT(DISTINCT column_name), the HyperLogLog counters that it comes from and merging the counters.
+  // Each group has a hyperloglog so this is one pass in a fixed amount of memory per group.  When the aggregator
+  // heading is a column of counters the counters are merged rather than added to.
+  template <typename Input_Stream, typename Output_Stream>
+  static void group_count_distinct(const record &input_headings, const record &output_headings,
+                                   const char *aggregator_heading_name, size_t precision, bool is_counter_output,
+                                   Input_Stream &input, Output_Stream &output) {
+    rstd::vector<rstd::string> input_heading_names = input_headings.fields();
+    size_t aggregator_heading_id = input_headings.mandatory_find_heading(aggregator_heading_name);
+    rstd::vector<rstd::string> aggregator_heading_names;
+    aggregator_heading_names.push_back(input_heading_names[aggregator_heading_id]);
+    input_heading_names.erase(input_heading_names.begin() + aggregator_heading_id);
+    detail::compare_specs specs(input_headings, input_heading_names);
+
+    hll_aggregator_spec aggregator_spec(
+      aggregator_heading_id, is_hll_sketch_heading(input_headings.mandatory_field(aggregator_heading_id)), precision,
+      detail::compare_specs(input_headings, aggregator_heading_names));
+
+    aggregate<hyperloglog *, hll_record_callback>(
+      input_headings, output_headings, specs, aggregator_spec, input, output,
+      output_hll_aggregated_record_callback<Output_Stream>(
+        output, field_id_list<1>(aggregator_heading_id), input_headings.number_fields(), is_counter_output));
   }
 
 
@@ -289,50 +560,103 @@ public:
     size_t aggregator_heading_id = input_headings.mandatory_find_heading(aggregator_heading_name);
     input_heading_names.erase(input_heading_names.begin() + aggregator_heading_id);
     detail::compare_specs specs(input_headings, input_heading_names);
-    validate_specs(specs);
-    detail::record_multihashmap<rstd::pair<Number_Type, int64_t> > sum_map(specs);
-    input.parse_records(sum_record_callback<Number_Type>(
-                          sum_map, 
-                          detail::compare_spec(input_headings, aggregator_heading_name)));
+    aggregate<rstd::pair<Number_Type, int64_t>, sum_record_callback>(
+      input_headings, output_headings, specs, detail::compare_spec(input_headings, aggregator_heading_name),
+      input, output, sum_map_callback);
+  }
+
+
+  // Helper for MIN and MAX.
+  template <template <typename> class Parse_Callback, typename Input_Stream, typename Output_Stream>
+  static void min_max_helper(const record &input_headings, const record &output_headings,
+                             const char *aggregator_heading_name, Input_Stream &input, Output_Stream &output) {
+    rstd::vector<rstd::string> input_heading_names = input_headings.fields();
+    size_t aggregator_heading_id = input_headings.mandatory_find_heading(aggregator_heading_name);
+    input_heading_names.erase(input_heading_names.begin() + aggregator_heading_id);
+    detail::compare_specs specs(input_headings, input_heading_names);
+    aggregate<size_t, Parse_Callback>(
+      input_headings, output_headings, specs, detail::compare_spec(input_headings, aggregator_heading_name),
+      input, output, output_record_callback<Output_Stream>(output));
+  }
+
 
+  // Helper for all the aggregators that keep one value per group.  Parse_Callback<Map> is constructed with the
+  // map and the aggregator spec (usually a compare_spec) and fills the map, Output_Callback writes out each finished
+  // group.  If the input is sorted so that each group's records are adjacent then we only need to keep the current
+  // group in memory, otherwise we use a hash table.
+  template <typename Value, template <typename> class Parse_Callback, typename Aggregator_Spec,
+            typename Input_Stream, typename Output_Stream, typename Output_Callback>
+  static void aggregate(const record &input_headings, const record &output_headings,
+                        const detail::compare_specs &specs, const Aggregator_Spec &aggregator_spec,
+                        Input_Stream &input, Output_Stream &output, Output_Callback output_callback) {
+    validate_specs(specs);
     output_headings.write(output);
-    sum_map.for_each(sum_map_callback);
+
+    if (detail::sort_order::from_headings(input_headings.ref()).is_grouped_by(specs)) {
+      typedef detail::record_run_map<Value, Output_Callback> run_map_type;
+      run_map_type run_map(specs, output_callback);
+      input.parse_records(Parse_Callback<run_map_type>(run_map, aggregator_spec));
+      run_map.flush();
+    } else {
+      hash_aggregate<Value, Parse_Callback>(specs, aggregator_spec, input, output_callback, 0);
+    }
   }
 
 
-  // Helper for MIN and MAX.
-  template <typename Number_Type, typename Parse_Callback>
-  struct min_max_helper_struct {
-    template <typename Input_Stream, typename Output_Stream>
-    void operator()(const record &input_headings, const record &output_headings,
-                    const char *aggregator_heading_name, Input_Stream &input, Output_Stream &output) {
-      rstd::vector<rstd::string> input_heading_names = input_headings.fields();
-      size_t aggregator_heading_id = input_headings.mandatory_find_heading(aggregator_heading_name);
-      input_heading_names.erase(input_heading_names.begin() + aggregator_heading_id);
-      detail::compare_specs specs(input_headings, input_heading_names);
-      validate_specs(specs);
-      detail::record_multihashmap<Number_Type> group_map(specs);
-      input.parse_records(Parse_Callback(
-                            group_map, 
-                            detail::compare_spec(input_headings, aggregator_heading_name)));
-  
-      output_headings.write(output);
-      group_map.for_each(output_record_callback<Output_Stream>(output));
+  // Aggregate in a hash table.  If the table outgrows its memory budget then the records of any new groups are
+  // partitioned into temporary files, and once the groups in the table have been written out each partition is
+  // aggregated in the same way.
+  template <typename Value, template <typename> class Parse_Callback, typename Aggregator_Spec,
+            typename Input_Stream, typename Output_Callback>
+  static void hash_aggregate(const detail::compare_specs &specs, const Aggregator_Spec &aggregator_spec,
+                             Input_Stream &input, Output_Callback output_callback, size_t level) {
+    typedef detail::spilling_record_multihashmap<Value> group_map_type;
+    detail::record_partitions partitions(specs, level);
+
+    {
+      group_map_type group_map(specs, partitions, level);
+      input.parse_records(Parse_Callback<group_map_type>(group_map, aggregator_spec));
+      group_map.for_each(output_callback);
     }
-  };  
-    
+
+    size_t i;
+    for (i = 0; i < partitions.size(); ++i) {
+      if (partitions[i].number_records() > 0) {
+        hash_aggregate<Value, Parse_Callback>(specs, aggregator_spec, partitions[i], output_callback, level + 1);
+      }
+    }
+  }
+
 
   static void parse_arguments(const rstd::vector<rel::rlang::token> &tokens,
                               const char **aggregator_p,
-                              const char **aggregator_heading_name_p) {
+                              const char **aggregator_heading_name_p,
+                              double *aggregator_parameter_p) {
     NP1_ASSERT(tokens.size() > 0, "No aggregator supplied to rel.group");
 
     // Get the name of the aggregator function and the field if appropriate.
     const char *aggregator = tokens[0].text();
     const char *aggregator_heading_name = NULL;
-    if (tokens.size() > 1) {
+    *aggregator_parameter_p = -1;
+    if ((tokens.size() > 1) && (rlang::token::TYPE_OPEN_PAREN == tokens[1].type())) {
+      // aggregator(number, header_name)
+      NP1_ASSERT((tokens.size() == 6) && (rlang::token::TYPE_COMMA == tokens[3].type())
+                  && (rlang::token::TYPE_CLOSE_PAREN == tokens[5].type()),
+                  "The aggregator '" + rstd::string(aggregator) + "' must be written as "
+                    + rstd::string(aggregator) + "(number, header_name)");
+      *aggregator_parameter_p = str::dec_to_double(str::ref(tokens[2].text()));
+      aggregator_heading_name = tokens[4].text();
+    } else if (tokens.size() > 1) {
       aggregator_heading_name = tokens[1].text();
     }
+
+    NP1_ASSERT((*aggregator_parameter_p < 0)
+                || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_PERCENTILE) == 0)
+                || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX) == 0)
+                || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0),
+                "The aggregator '" + rstd::string(aggregator) + "' does not take a number");
+    NP1_ASSERT((*aggregator_parameter_p >= 0) || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_PERCENTILE) != 0),
+                "The aggregator 'percentile' must be written as percentile(p, header_name)");
     
     // Check that the arguments are valid.
     if ((str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT) != 0)
@@ -341,7 +665,13 @@ public:
         && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MAX) != 0)
         && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_SUM) != 0)
         && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_SUM_COUNT) != 0)
-        && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN) != 0)) {       
+        && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN) != 0)
+        && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN_APPROX) != 0)
+        && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_PERCENTILE) != 0)
+        && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH) != 0)
+        && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX) != 0)
+        && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) != 0)
+        && (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_MERGE) != 0)) {       
       NP1_ASSERT(false, "Unknown aggregator: " + rstd::string(aggregator));
     }
     
@@ -350,7 +680,12 @@ public:
           || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MAX) == 0)
           || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_SUM) == 0)
           || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_SUM_COUNT) == 0)
-          || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN) == 0))
+          || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN) == 0)
+          || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN_APPROX) == 0)
+          || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH) == 0)
+          || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX) == 0)
+          || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0)
+          || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_MERGE) == 0))
         && !aggregator_heading_name) {
       NP1_ASSERT(false, "The aggregator '" + rstd::string(aggregator)
                           + "' requires a heading name");
@@ -371,7 +706,13 @@ public:
     if ((str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_AVG) == 0)
         || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_SUM) == 0)
         || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_SUM_COUNT) == 0)
-        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN) == 0)) {
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN) == 0)
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN_APPROX) == 0)
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_PERCENTILE) == 0)
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH) == 0)
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX) == 0)
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0)
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_MERGE) == 0)) {
       get_fields_except(
         header_fields, input_headings, input_headings.number_fields(),
         field_id_list<1>(detail::compare_spec(input_headings, aggregator_heading_name).field_number()));
@@ -404,6 +745,36 @@ public:
       typed_heading_name =
         detail::helper::make_typed_heading_name(aggregator_type_name, NP1_REL_GROUP_OUTPUT_HEADING_MEDIAN);
       header_fields.push_back(str::ref(typed_heading_name));
+    } else if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN_APPROX) == 0) {
+      typed_heading_name =
+        detail::helper::make_typed_heading_name(
+          rlang::dt::to_string(get_quantile_type(input_headings, aggregator_heading_name)),
+          NP1_REL_GROUP_OUTPUT_HEADING_MEDIAN_APPROX);
+      header_fields.push_back(str::ref(typed_heading_name));
+    } else if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_PERCENTILE) == 0) {
+      typed_heading_name =
+        detail::helper::make_typed_heading_name(
+          rlang::dt::to_string(get_quantile_type(input_headings, aggregator_heading_name)),
+          NP1_REL_GROUP_OUTPUT_HEADING_PERCENTILE);
+      header_fields.push_back(str::ref(typed_heading_name));
+    } else if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH) == 0) {
+      typed_heading_name =
+        detail::helper::make_typed_heading_name(
+          rlang::dt::to_string(rlang::dt::TYPE_STRING), NP1_REL_GROUP_OUTPUT_HEADING_QUANTILE_SKETCH);
+      header_fields.push_back(str::ref(typed_heading_name));
+    } else if ((str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX) == 0)
+               || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_MERGE) == 0)) {
+      NP1_ASSERT(
+        (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_MERGE) != 0)
+          || is_hll_sketch_heading(
+              input_headings.mandatory_field(input_headings.mandatory_find_heading(aggregator_heading_name))),
+        "The aggregator 'hll_merge' needs a string:" NP1_REL_GROUP_OUTPUT_HEADING_HLL_SKETCH " column");
+      header_fields.push_back(str::ref(NP1_REL_GROUP_OUTPUT_HEADING_COUNT_DISTINCT_APPROX));
+    } else if (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0) {
+      typed_heading_name =
+        detail::helper::make_typed_heading_name(
+          rlang::dt::to_string(rlang::dt::TYPE_STRING), NP1_REL_GROUP_OUTPUT_HEADING_HLL_SKETCH);
+      header_fields.push_back(str::ref(typed_heading_name));
     }
       
     return record(header_fields, 0);
@@ -417,7 +788,79 @@ public:
   }
 
 
+  /// Split a group into a partial step that can be run on each part of the input, eg on different hosts, and a
+  /// merge step that combines the partial steps' concatenated outputs into what the group would have written.
+  /// Returns false if the aggregators can't be split up, ie median and sum_count.
+  static bool get_combiner_arguments(const rstd::vector<rel::rlang::token> &tokens,
+                                     rstd::vector<rel::rlang::token> &partial_tokens,
+                                     rstd::vector<rel::rlang::token> &merge_tokens) {
+    partial_tokens.clear();
+    merge_tokens.clear();
+
+    const char *aggregator = NULL;
+    const char *aggregator_heading_name = NULL;
+    double aggregator_parameter = -1;
+    if (rlang::compiler::split_expressions(tokens).size() == 1) {
+      parse_arguments(tokens, &aggregator, &aggregator_heading_name, &aggregator_parameter);
+    }
+
+    if (!aggregator
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT) == 0)
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_SUM) == 0)
+        || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_AVG) == 0)) {
+      // Anything more than one aggregator is checked when the partial step starts.
+      partial_tokens.push_back(rlang::token(NP1_REL_GROUP_PARTIAL, rlang::token::TYPE_IDENTIFIER_VARIABLE));
+      partial_tokens.push_back(rlang::token(",", rlang::token::TYPE_COMMA));
+      partial_tokens.append(tokens);
+      merge_tokens.push_back(rlang::token(NP1_REL_GROUP_MERGE_PARTIAL, rlang::token::TYPE_IDENTIFIER_VARIABLE));
+    } else if ((str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MIN) == 0)
+               || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MAX) == 0)) {
+      // The minimum of the minimums is the minimum.
+      partial_tokens = tokens;
+      merge_tokens = tokens;
+    } else if ((str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_MEDIAN_APPROX) == 0)
+               || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_PERCENTILE) == 0)
+               || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH) == 0)) {
+      push_back_aggregator(partial_tokens, NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH, NULL, aggregator_heading_name);
+      push_back_aggregator(
+        merge_tokens, aggregator, (aggregator_parameter < 0) ? NULL : &tokens[2],
+        NP1_REL_GROUP_OUTPUT_HEADING_QUANTILE_SKETCH);
+    } else if ((str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX) == 0)
+               || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0)
+               || (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_MERGE) == 0)) {
+      push_back_aggregator(
+        partial_tokens, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH, (aggregator_parameter < 0) ? NULL : &tokens[2],
+        aggregator_heading_name);
+      push_back_aggregator(
+        merge_tokens,
+        (str::cmp(aggregator, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0)
+          ? NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH : NP1_REL_GROUP_AGGREGATOR_HLL_MERGE,
+        NULL, NP1_REL_GROUP_OUTPUT_HEADING_HLL_SKETCH);
+    } else {
+      return false;
+    }
+
+    return true;
+  }
+
+
 private:
+  // Write "aggregator heading_name" or "aggregator(parameter, heading_name)" as tokens.
+  static void push_back_aggregator(rstd::vector<rel::rlang::token> &tokens, const char *aggregator,
+                                   const rel::rlang::token *parameter, const char *aggregator_heading_name) {
+    tokens.push_back(rlang::token(aggregator, rlang::token::TYPE_IDENTIFIER_VARIABLE));
+    if (parameter) {
+      tokens.push_back(rlang::token("(", rlang::token::TYPE_OPEN_PAREN));
+      tokens.push_back(*parameter);
+      tokens.push_back(rlang::token(",", rlang::token::TYPE_COMMA));
+    }
+
+    tokens.push_back(rlang::token(aggregator_heading_name, rlang::token::TYPE_IDENTIFIER_VARIABLE));
+    if (parameter) {
+      tokens.push_back(rlang::token(")", rlang::token::TYPE_CLOSE_PAREN));
+    }
+  }
+
   static void validate_specs(const detail::compare_specs &specs) {
     NP1_ASSERT(
       !specs.has_double(),
@@ -430,125 +873,1188 @@ private:
         rstd::string(operator_name) + " does not support type: " + type_tag.to_string());
   }
   
-    
-  static int64_t get_number(const str::ref &field, int64_t unused) {
-    return str::dec_to_int64(field);
-  }
 
-  static double get_number(const str::ref &field, double unused) {
-    return str::dec_to_double(field);
-  }
 
-  
-  // The callback for the count aggregator.
-  struct count_record_callback {
-    count_record_callback(detail::record_multihashmap<uint64_t> &m) : m_map(m) {}  
-    bool operator()(const record_ref &r) const {
-      detail::record_multihashmap<uint64_t>::equal_list_type *eq_list;
-      eq_list = m_map.find(r);
-      if (eq_list) {
-        eq_list->front().second++;
-      } else {
-        m_map.insert(r, (uint64_t)1);  
-      }
-      
-      return true;
-    }
-    
-    detail::record_multihashmap<uint64_t> &m_map;  
+  // One of the aggregators in a multiple-aggregator group.
+  struct multiple_aggregator {
+    enum function_type { COUNT, SUM, AVG, MIN, MAX };
+
+    function_type m_function;
+    size_t m_field_number;
+    rlang::dt::data_type m_type;
   };
-  
-  
-  // The callback for the sum or avg aggregator.
-  //TODO: this will only work with numbers that sum to less than max-int64/max-double.  
-  // Surely this number is big enough?
-  template <typename Number_Type>
-  struct sum_record_callback {
-    sum_record_callback(
-      detail::record_multihashmap<rstd::pair<Number_Type, int64_t> > &m,
-      const detail::compare_spec &spec)
-    : m_map(m), m_spec(spec) {}
-    bool operator()(const record_ref &r) const {
-      // The first element in the pair is the sum, the second element is the
-      // count of elements.
-      typedef typename rstd::pair<Number_Type, int64_t> pair_type;
-      typedef typename detail::record_multihashmap<pair_type>::equal_list_type eq_list_type;
-      eq_list_type *eq_list;
-        
-      Number_Type num = field_to_number(r);
-      eq_list = m_map.find(r);    
-      if (eq_list) {
-        eq_list->front().second.first += num;
-        eq_list->front().second.second++;
+
+  typedef rstd::vector<multiple_aggregator> multiple_aggregator_list;
+
+  // Each group in a multiple-aggregator group has a row of these in the map's arena: the number of records in
+  // the group, then one for each aggregator, then one more for each aggregator that points to the text of a min
+  // or max.  The arena doesn't align anything so they're memcpy'd in and out.
+  union accumulator {
+    int64_t m_int;
+    uint64_t m_uint;
+    double m_double;
+    unsigned char *m_text;
+  };
+
+  typedef unsigned char *accumulator_row;
+
+
+  // SELECT COUNT(1), SUM(a), MIN(b)...GROUP BY...  The groups are keyed on all the headings that aren't aggregated.
+  template <typename Input_Stream, typename Output_Stream>
+  static void group_multiple(const rstd::vector<rstd::vector<rel::rlang::token> > &aggregator_expressions,
+                             Input_Stream &input, Output_Stream &output, bool is_partial) {
+    record input_headings(input.parse_headings());
+
+    multiple_aggregator_list aggregators;
+    rstd::vector<rstd::string> aggregator_heading_names;
+    rstd::vector<rstd::vector<rel::rlang::token> >::const_iterator expression_i = aggregator_expressions.begin();
+    rstd::vector<rstd::vector<rel::rlang::token> >::const_iterator expression_iz = aggregator_expressions.end();
+    for (; expression_i != expression_iz; ++expression_i) {
+      NP1_ASSERT(expression_i->size() > 0, "Empty aggregator supplied to rel.group");
+      const char *aggregator_name = (*expression_i)[0].text();
+      NP1_ASSERT(expression_i->size() <= 2, "Too many arguments for the aggregator '" + rstd::string(aggregator_name) + "'");
+      const char *aggregator_heading_name = (expression_i->size() > 1) ? (*expression_i)[1].text() : NULL;
+      multiple_aggregator aggregator = make_multiple_aggregator(input_headings, aggregator_name, aggregator_heading_name);
+      aggregators.push_back(aggregator);
+      if ((aggregator_expressions.size() == 1) && (multiple_aggregator::MIN != aggregator.m_function)
+          && (multiple_aggregator::MAX != aggregator.m_function)) {
+        // A partial count, sum or avg on its own is named in the usual way for when it's merged.
+        str::ref aggregator_type_tag =
+          aggregator_heading_name
+            ? mandatory_get_aggregator_heading_type_tag(input_headings, aggregator_heading_name) : str::ref();
+        record output_headings(
+          get_output_headings(aggregator_name, aggregator_heading_name, aggregator_type_tag, input_headings));
+        aggregator_heading_names.push_back(
+          output_headings.mandatory_field(output_headings.number_fields() - 1).to_string());
       } else {
-        m_map.insert(r, rstd::make_pair(num, (int64_t)1));
+        aggregator_heading_names.push_back(get_multiple_aggregator_heading_name(input_headings, aggregator));
       }
-      
-      return true;
     }
-      
-    Number_Type field_to_number(const record_ref &r) const {
-      Number_Type num = 0;
-      num = get_number(r.mandatory_field(m_spec.field_number()), num);      
-      return num;
-    }        
-    
-    detail::record_multihashmap<rstd::pair<Number_Type, int64_t> > &m_map;
-    detail::compare_spec m_spec;   
-  };
-  
 
-  // Sum the sum & count intermediate results.
-  template <typename Number_Type>
-  struct sum_sum_count_record_callback {
-    sum_sum_count_record_callback(
-      detail::record_multihashmap<rstd::pair<Number_Type, int64_t> > &m,
-      size_t sum_field_id,
-      size_t count_field_id)
-    : m_map(m), m_sum_field_id(sum_field_id), m_count_field_id(count_field_id) {}
+    aggregate_multiple(input_headings, aggregators, aggregator_heading_names, input, output, is_partial);
+  }
 
-    bool operator()(const record_ref &r) const {
-      // The first element in the pair is the sum, the second element is the
-      // count of elements.
-      typedef typename rstd::pair<Number_Type, int64_t> pair_type;
-      typedef typename detail::record_multihashmap<pair_type>::equal_list_type eq_list_type;
-      eq_list_type *eq_list;
-        
-      Number_Type sum = 0;
-      sum = get_number(r.mandatory_field(m_sum_field_id), sum);
-      int64_t count = str::dec_to_int64(r.mandatory_field(m_count_field_id));
-      eq_list = m_map.find(r);    
-      if (eq_list) {
-        eq_list->front().second.first += sum;
-        eq_list->front().second.second += count;
-      } else {
-        m_map.insert(r, rstd::make_pair(sum, count));
+
+  static bool is_keyword_expression(const rstd::vector<rstd::vector<rel::rlang::token> > &expressions,
+                                    const char *keyword) {
+    return (expressions.size() > 0) && (expressions[0].size() == 1)
+            && (str::cmp(expressions[0][0].text(), keyword) == 0);
+  }
+
+
+  // eg int:_partial_sum_bytes for int:_sum_bytes.
+  static rstd::string get_partial_heading_name(const rstd::string &heading_name) {
+    return detail::helper::make_typed_heading_name(
+            detail::helper::mandatory_get_heading_type_tag(heading_name).to_string(),
+            NP1_REL_GROUP_OUTPUT_HEADING_PARTIAL_PREFIX
+              + detail::helper::get_heading_without_type_tag(heading_name).to_string());
+  }
+
+
+  // Merge the output of rel.group(partial, ...).  The headings after the record count say which aggregator each
+  // column is for and what the finished column is called.
+  template <typename Input_Stream, typename Output_Stream>
+  static void group_merge_partial(Input_Stream &input, Output_Stream &output) {
+    record partial_headings(input.parse_headings());
+    size_t number_group_fields =
+      partial_headings.ref().find_field(str::ref(NP1_REL_GROUP_OUTPUT_HEADING_PARTIAL_RECORD_COUNT));
+    NP1_ASSERT(number_group_fields != (size_t)-1,
+               "The input to rel.group(" NP1_REL_GROUP_MERGE_PARTIAL ") must come from rel.group(" NP1_REL_GROUP_PARTIAL
+               ", ...)");
+
+    rstd::vector<rstd::string> output_heading_names;
+    rstd::vector<size_t> group_field_numbers;
+    size_t i;
+    for (i = 0; i < number_group_fields; ++i) {
+      output_heading_names.push_back(partial_headings.mandatory_field(i).to_string());
+      group_field_numbers.push_back(i);
+    }
+
+    rstd::vector<rstd::string> group_heading_names(output_heading_names);
+    multiple_aggregator_list aggregators;
+    for (i = number_group_fields + 1; i < partial_headings.number_fields(); ++i) {
+      str::ref partial_heading_name = partial_headings.mandatory_field(i);
+      str::ref type_tag = detail::helper::mandatory_get_heading_type_tag(partial_heading_name);
+      str::ref name = detail::helper::get_heading_without_type_tag(partial_heading_name);
+      size_t prefix_length = strlen(NP1_REL_GROUP_OUTPUT_HEADING_PARTIAL_PREFIX);
+      NP1_ASSERT((name.length() > prefix_length)
+                  && (strncmp(name.ptr(), NP1_REL_GROUP_OUTPUT_HEADING_PARTIAL_PREFIX, prefix_length) == 0),
+                 "Not a partial aggregate heading: " + partial_heading_name.to_string());
+
+      // eg _sum_bytes, which starts with the aggregator's name.
+      rstd::string output_name(name.ptr() + prefix_length, name.length() - prefix_length);
+      multiple_aggregator aggregator;
+      aggregator.m_function = get_partial_aggregator_function(output_name);
+      aggregator.m_field_number = i;
+      aggregator.m_type = rlang::dt::mandatory_from_string(type_tag);
+      aggregators.push_back(aggregator);
+      output_heading_names.push_back(detail::helper::make_typed_heading_name(type_tag.to_string(), output_name));
+    }
+
+    detail::compare_specs specs(partial_headings, group_heading_names);
+    aggregate<accumulator_row, partial_record_callback>(
+      partial_headings, record(output_heading_names, 0), specs,
+      partial_aggregate_spec(aggregators, number_group_fields), input, output,
+      output_multiple_aggregated_record_callback<Output_Stream>(output, group_field_numbers, aggregators));
+  }
+
+
+  static multiple_aggregator::function_type get_partial_aggregator_function(const rstd::string &output_name) {
+    static const struct {
+      const char *m_output_heading_prefix;
+      multiple_aggregator::function_type m_function;
+    } functions[] = {
+      { "_count", multiple_aggregator::COUNT },
+      { NP1_REL_GROUP_OUTPUT_HEADING_SUM, multiple_aggregator::SUM },
+      { NP1_REL_GROUP_OUTPUT_HEADING_AVG, multiple_aggregator::AVG },
+      { NP1_REL_GROUP_OUTPUT_HEADING_MIN, multiple_aggregator::MIN },
+      { NP1_REL_GROUP_OUTPUT_HEADING_MAX, multiple_aggregator::MAX }
+    };
+
+    size_t i;
+    for (i = 0; i < sizeof(functions)/sizeof(functions[0]); ++i) {
+      size_t prefix_length = strlen(functions[i].m_output_heading_prefix);
+      if ((strncmp(output_name.c_str(), functions[i].m_output_heading_prefix, prefix_length) == 0)
+          && (('\0' == output_name.c_str()[prefix_length]) || ('_' == output_name.c_str()[prefix_length]))) {
+        return functions[i].m_function;
       }
-      
-      return true;
     }
-      
-    detail::record_multihashmap<rstd::pair<Number_Type, int64_t> > &m_map;
-    size_t m_sum_field_id;
-    size_t m_count_field_id;
-  };
 
-  
-  
-  // The callback for an aggregator that selects just one element.
-  template <typename Selector_Operator, typename Number_Type>
-  struct selector_record_callback {
-    selector_record_callback(detail::record_multihashmap<Number_Type> &m,
-                  const detail::compare_spec &spec) 
-    : m_map(m), m_spec(spec), m_selector_operator(Selector_Operator()) {}
+    NP1_ASSERT(false, "Not a partial aggregate heading: " + output_name);
+    return multiple_aggregator::COUNT;
+  }
+
+
+  static multiple_aggregator make_multiple_aggregator(const record &input_headings, const char *aggregator_name,
+                                                      const char *aggregator_heading_name) {
+    multiple_aggregator aggregator;
+    if (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_COUNT) == 0) {
+      NP1_ASSERT(!aggregator_heading_name, "The aggregator 'count' does not take a heading name");
+      aggregator.m_function = multiple_aggregator::COUNT;
+      aggregator.m_field_number = 0;
+      aggregator.m_type = rlang::dt::TYPE_UINT;
+      return aggregator;
+    }
+
+    if (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_SUM) == 0) {
+      aggregator.m_function = multiple_aggregator::SUM;
+    } else if (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_AVG) == 0) {
+      aggregator.m_function = multiple_aggregator::AVG;
+    } else if (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_MIN) == 0) {
+      aggregator.m_function = multiple_aggregator::MIN;
+    } else if (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_MAX) == 0) {
+      aggregator.m_function = multiple_aggregator::MAX;
+    } else if ((str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_SUM_COUNT) == 0)
+               || (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_MEDIAN) == 0)
+               || (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_MEDIAN_APPROX) == 0)
+               || (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_PERCENTILE) == 0)
+               || (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_QUANTILE_SKETCH) == 0)
+               || (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_COUNT_DISTINCT_APPROX) == 0)
+               || (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_HLL_SKETCH) == 0)
+               || (str::cmp(aggregator_name, NP1_REL_GROUP_AGGREGATOR_HLL_MERGE) == 0)) {
+      NP1_ASSERT(false, "The aggregator '" + rstd::string(aggregator_name)
+                          + "' can't be used with other aggregators");
+    } else {
+      NP1_ASSERT(false, "Unknown aggregator: " + rstd::string(aggregator_name));
+    }
+
+    NP1_ASSERT(aggregator_heading_name,
+                "The aggregator '" + rstd::string(aggregator_name) + "' requires a heading name");
+    aggregator.m_field_number = input_headings.mandatory_find_heading(aggregator_heading_name);
+    str::ref type_tag = mandatory_get_aggregator_heading_type_tag(input_headings, aggregator_heading_name);
+    aggregator.m_type = rlang::dt::mandatory_from_string(type_tag);
+    if ((rlang::dt::TYPE_INT != aggregator.m_type) && (rlang::dt::TYPE_UINT != aggregator.m_type)) {
+      validate_type_is_double(aggregator.m_type, aggregator_name, type_tag);
+    }
+
+    return aggregator;
+  }
+
+
+  // eg uint:_sum_bytes for sum bytes.
+  static rstd::string get_multiple_aggregator_heading_name(const record &input_headings,
+                                                           const multiple_aggregator &aggregator) {
+    const char *output_heading_prefix = NP1_REL_GROUP_OUTPUT_HEADING_SUM;
+    switch (aggregator.m_function) {
+    case multiple_aggregator::COUNT:
+      return NP1_REL_GROUP_OUTPUT_HEADING_COUNT;
+
+    case multiple_aggregator::SUM:
+      output_heading_prefix = NP1_REL_GROUP_OUTPUT_HEADING_SUM;
+      break;
+
+    case multiple_aggregator::AVG:
+      output_heading_prefix = NP1_REL_GROUP_OUTPUT_HEADING_AVG;
+      break;
+
+    case multiple_aggregator::MIN:
+      output_heading_prefix = NP1_REL_GROUP_OUTPUT_HEADING_MIN;
+      break;
+
+    case multiple_aggregator::MAX:
+      output_heading_prefix = NP1_REL_GROUP_OUTPUT_HEADING_MAX;
+      break;
+    }
+
+    str::ref heading_name = input_headings.mandatory_field(aggregator.m_field_number);
+    return detail::helper::make_typed_heading_name(
+            detail::helper::mandatory_get_heading_type_tag(heading_name).to_string(),
+            rstd::string(output_heading_prefix) + "_"
+              + detail::helper::get_heading_without_type_tag(heading_name).to_string());
+  }
+
+
+  // Aggregate with a row of accumulators per group.  The output is the grouped-on headings then one heading per
+  // aggregator.
+  template <typename Input_Stream, typename Output_Stream>
+  static void aggregate_multiple(const record &input_headings, const multiple_aggregator_list &aggregators,
+                                 const rstd::vector<rstd::string> &aggregator_heading_names,
+                                 Input_Stream &input, Output_Stream &output, bool is_partial) {
+    size_t number_input_fields = input_headings.number_fields();
+    rstd::vector<bool> is_aggregated;
+    is_aggregated.resize(number_input_fields);
+    size_t i;
+    for (i = 0; i < number_input_fields; ++i) {
+      is_aggregated[i] = false;
+    }
+
+    for (i = 0; i < aggregators.size(); ++i) {
+      if (multiple_aggregator::COUNT != aggregators[i].m_function) {
+        is_aggregated[aggregators[i].m_field_number] = true;
+      }
+    }
+
+    rstd::vector<rstd::string> group_heading_names;
+    rstd::vector<size_t> group_field_numbers;
+    for (i = 0; i < number_input_fields; ++i) {
+      if (!is_aggregated[i]) {
+        group_heading_names.push_back(input_headings.mandatory_field(i).to_string());
+        group_field_numbers.push_back(i);
+      }
+    }
+
+    rstd::vector<rstd::string> output_heading_names(group_heading_names);
+    if (is_partial) {
+      output_heading_names.push_back(NP1_REL_GROUP_OUTPUT_HEADING_PARTIAL_RECORD_COUNT);
+    }
+
+    for (i = 0; i < aggregator_heading_names.size(); ++i) {
+      output_heading_names.push_back(
+        is_partial ? get_partial_heading_name(aggregator_heading_names[i]) : aggregator_heading_names[i]);
+    }
+
+    record output_headings(output_heading_names, 0);
+    detail::compare_specs specs(input_headings, group_heading_names);
+    if (is_partial) {
+      aggregate<accumulator_row, multiple_record_callback>(
+        input_headings, output_headings, specs, aggregators, input, output,
+        output_partial_aggregated_record_callback<Output_Stream>(output, group_field_numbers, aggregators));
+      return;
+    }
+
+    size_t number_threads = environment::group_initial_number_threads();
+    if ((number_threads > 1) && !detail::sort_order::from_headings(input_headings.ref()).is_grouped_by(specs)) {
+      validate_specs(specs);
+      output_headings.write(output);
+      parallel_aggregator<Output_Stream> aggregator(
+        specs, record(group_heading_names, 0), group_field_numbers, aggregators, output, number_threads);
+      input.parse_records(parallel_aggregate_record_callback<Output_Stream>(aggregator));
+      aggregator.finish();
+      return;
+    }
+
+    aggregate<accumulator_row, multiple_record_callback>(
+      input_headings, output_headings, specs, aggregators, input, output,
+      output_multiple_aggregated_record_callback<Output_Stream>(output, group_field_numbers, aggregators));
+  }
+
+
+  static accumulator get_accumulator(const unsigned char *row, size_t n) {
+    accumulator a;
+    memcpy(&a, row + n * sizeof(accumulator), sizeof(accumulator));
+    return a;
+  }
+
+  static void set_accumulator(unsigned char *row, size_t n, const accumulator &a) {
+    memcpy(row + n * sizeof(accumulator), &a, sizeof(accumulator));
+  }
+
+  static size_t row_size(const multiple_aggregator_list &aggregators) {
+    return (2 * aggregators.size() + 1) * sizeof(accumulator);
+  }
+
+  static size_t text_accumulator_number(const multiple_aggregator_list &aggregators, size_t i) {
+    return aggregators.size() + i + 1;
+  }
+
+  static bool is_min_or_max(const multiple_aggregator &aggregator) {
+    return (multiple_aggregator::MIN == aggregator.m_function) || (multiple_aggregator::MAX == aggregator.m_function);
+  }
+
+  // Mins and maxes are written out with the text of the field that they came from, the same as when they're
+  // the only aggregator.  The text is kept in the arena behind its capacity and length.
+  static str::ref get_accumulator_text(const unsigned char *row, size_t n) {
+    const unsigned char *text = get_accumulator(row, n).m_text;
+    uint32_t length;
+    memcpy(&length, text + sizeof(uint32_t), sizeof(length));
+    return str::ref((const char *)text + 2 * sizeof(uint32_t), length);
+  }
+
+  static size_t text_size(const str::ref &field) {
+    return 2 * sizeof(uint32_t) + field.length();
+  }
+
+  static void write_text(unsigned char *text, uint32_t capacity, const str::ref &field) {
+    uint32_t length = field.length();
+    memcpy(text, &capacity, sizeof(capacity));
+    memcpy(text + sizeof(uint32_t), &length, sizeof(length));
+    memcpy(text + 2 * sizeof(uint32_t), field.ptr(), length);
+  }
+
+  // Set the text of a min or max.  If the row already has text that's big enough then it's overwritten.
+  static void set_accumulator_text(unsigned char *row, size_t n, const str::ref &field, record_arena &arena,
+                                   bool is_first) {
+    uint32_t capacity = 0;
+    unsigned char *text = NULL;
+    if (!is_first) {
+      text = get_accumulator(row, n).m_text;
+      memcpy(&capacity, text, sizeof(capacity));
+    }
+
+    if (capacity < field.length()) {
+      accumulator a;
+      a.m_text = text = arena.alloc(text_size(field));
+      set_accumulator(row, n, a);
+      capacity = field.length();
+    }
+
+    write_text(text, capacity, field);
+  }
+
+  // True if a min or max should move from current to value.  A tie leaves it where it is.
+  static bool is_better(const accumulator &value, const accumulator &current, const multiple_aggregator &aggregator) {
+    int result = accumulator_compare(value, current, aggregator.m_type);
+    return (multiple_aggregator::MIN == aggregator.m_function) ? (result < 0) : (result > 0);
+  }
+
+  // Get the aggregator's field from the record.  Sums and averages of uints are done in int64s, the same as when
+  // they're the only aggregator.
+  static accumulator field_to_accumulator(const record_ref &r, const multiple_aggregator &aggregator) {
+    return string_to_accumulator(r.mandatory_field(aggregator.m_field_number), aggregator);
+  }
+
+  static accumulator string_to_accumulator(const str::ref &field, const multiple_aggregator &aggregator) {
+    accumulator a;
+    if (rlang::dt::TYPE_DOUBLE == aggregator.m_type) {
+      a.m_double = str::dec_to_double(field);
+    } else if ((rlang::dt::TYPE_UINT == aggregator.m_type)
+               && ((multiple_aggregator::MIN == aggregator.m_function)
+                    || (multiple_aggregator::MAX == aggregator.m_function))) {
+      a.m_uint = (uint64_t)str::dec_to_int64(field);
+    } else {
+      a.m_int = str::dec_to_int64(field);
+    }
+
+    return a;
+  }
+
+  // Returns <0, 0 or >0 in the same way as the compare functions.
+  static int accumulator_compare(const accumulator &a1, const accumulator &a2, rlang::dt::data_type type) {
+    if (rlang::dt::TYPE_DOUBLE == type) {
+      return (a1.m_double < a2.m_double) ? -1 : ((a1.m_double > a2.m_double) ? 1 : 0);
+    }
+
+    if (rlang::dt::TYPE_UINT == type) {
+      return (a1.m_uint < a2.m_uint) ? -1 : ((a1.m_uint > a2.m_uint) ? 1 : 0);
+    }
+
+    return (a1.m_int < a2.m_int) ? -1 : ((a1.m_int > a2.m_int) ? 1 : 0);
+  }
+
+  // Combine two values of the same sum or average.
+  static accumulator combine_accumulators(const accumulator &current, const accumulator &value,
+                                          const multiple_aggregator &aggregator) {
+    accumulator result = value;
+    switch (aggregator.m_function) {
+    case multiple_aggregator::SUM:
+    case multiple_aggregator::AVG:
+      if (rlang::dt::TYPE_DOUBLE == aggregator.m_type) {
+        result.m_double += current.m_double;
+      } else {
+        result.m_int += current.m_int;
+      }
+      break;
+
+    default:
+      break;
+    }
+
+    return result;
+  }
+
+  // Add a record to a group's row of accumulators.
+  static void accumulate(unsigned char *row, const record_ref &r, const multiple_aggregator_list &aggregators,
+                         record_arena &arena, bool is_first) {
+    accumulator count;
+    count.m_uint = is_first ? 1 : get_accumulator(row, 0).m_uint + 1;
+    set_accumulator(row, 0, count);
+
+    size_t i;
+    for (i = 0; i < aggregators.size(); ++i) {
+      const multiple_aggregator &aggregator = aggregators[i];
+      if (multiple_aggregator::COUNT == aggregator.m_function) {
+        continue;
+      }
+
+      accumulator value = field_to_accumulator(r, aggregator);
+      if (is_min_or_max(aggregator)) {
+        if (is_first || is_better(value, get_accumulator(row, i + 1), aggregator)) {
+          set_accumulator(row, i + 1, value);
+          set_accumulator_text(
+            row, text_accumulator_number(aggregators, i), r.mandatory_field(aggregator.m_field_number), arena,
+            is_first);
+        }
+
+        continue;
+      }
+
+      if (!is_first) {
+        value = combine_accumulators(get_accumulator(row, i + 1), value, aggregator);
+      }
+
+      set_accumulator(row, i + 1, value);
+    }
+  }
+
+  // Add another row of accumulators for the same group, eg one worked out by another process.  If is_first then
+  // row is new and this just copies other_row.
+  static void combine_rows(unsigned char *row, const unsigned char *other_row,
+                           const multiple_aggregator_list &aggregators, record_arena &arena, bool is_first) {
+    accumulator count;
+    count.m_uint = (is_first ? 0 : get_accumulator(row, 0).m_uint) + get_accumulator(other_row, 0).m_uint;
+    set_accumulator(row, 0, count);
+
+    size_t i;
+    for (i = 0; i < aggregators.size(); ++i) {
+      const multiple_aggregator &aggregator = aggregators[i];
+      accumulator value = get_accumulator(other_row, i + 1);
+      if (is_min_or_max(aggregator)) {
+        if (is_first || is_better(value, get_accumulator(row, i + 1), aggregator)) {
+          size_t text_number = text_accumulator_number(aggregators, i);
+          set_accumulator(row, i + 1, value);
+          set_accumulator_text(row, text_number, get_accumulator_text(other_row, text_number), arena, is_first);
+        }
+      } else if (is_first) {
+        set_accumulator(row, i + 1, value);
+      } else if (multiple_aggregator::COUNT != aggregator.m_function) {
+        set_accumulator(row, i + 1, combine_accumulators(get_accumulator(row, i + 1), value, aggregator));
+      }
+    }
+  }
+
+
+  // The callback for multiple aggregators.
+  template <typename Map>
+  struct multiple_record_callback {
+    multiple_record_callback(Map &m, const multiple_aggregator_list &aggregators)
+      : m_map(m), m_aggregators(aggregators) {}
+
+    bool operator()(const record_ref &r) const {
+      typename Map::equal_list_type *eq_list = m_map.find(r);
+      if (eq_list) {
+        accumulate(eq_list->front().second, r, m_aggregators, m_map.arena(), false);
+        return true;
+      }
+
+      // The row is allocated after the insert because the insert might start a new arena.  If the record went to
+      // a partition instead of the map then it doesn't need a row.
+      eq_list = m_map.insert(r, (accumulator_row)NULL);
+      if (eq_list) {
+        eq_list->front().second = m_map.arena().alloc(row_size(m_aggregators));
+        accumulate(eq_list->front().second, r, m_aggregators, m_map.arena(), true);
+      }
+
+      return true;
+    }
+
+    Map &m_map;
+    const multiple_aggregator_list &m_aggregators;
+  };
+
+
+  // The callback for writing out the records & aggregations for multiple aggregators.
+  template <typename Output_Stream>
+  struct output_multiple_aggregated_record_callback {
+    output_multiple_aggregated_record_callback(Output_Stream &output, const rstd::vector<size_t> &group_field_numbers,
+                                               const multiple_aggregator_list &aggregators)
+      : m_output(output), m_group_field_numbers(group_field_numbers), m_aggregators(aggregators) {
+      m_number_strings.resize(aggregators.size() * str::MAX_NUM_STR_LENGTH);
+    }
+
+    bool operator()(const record_ref &r, const accumulator_row &row) {
+      m_output_fields.clear();
+      size_t i;
+      for (i = 0; i < m_group_field_numbers.size(); ++i) {
+        m_output_fields.push_back(r.mandatory_field(m_group_field_numbers[i]));
+      }
+
+      uint64_t count = get_accumulator(row, 0).m_uint;
+      for (i = 0; i < m_aggregators.size(); ++i) {
+        const multiple_aggregator &aggregator = m_aggregators[i];
+        if (is_min_or_max(aggregator)) {
+          m_output_fields.push_back(get_accumulator_text(row, text_accumulator_number(m_aggregators, i)));
+          continue;
+        }
+
+        accumulator value = get_accumulator(row, i + 1);
+        char *num_string = &m_number_strings[i * str::MAX_NUM_STR_LENGTH];
+        bool is_double = (rlang::dt::TYPE_DOUBLE == aggregator.m_type);
+        switch (aggregator.m_function) {
+        case multiple_aggregator::COUNT:
+          str::to_dec_str(num_string, count);
+          break;
+
+        case multiple_aggregator::SUM:
+          is_double ? str::to_dec_str(num_string, value.m_double) : str::to_dec_str(num_string, value.m_int);
+          break;
+
+        case multiple_aggregator::AVG:
+          is_double
+            ? str::to_dec_str(num_string, value.m_double/count)
+            : str::to_dec_str(num_string, value.m_int/(int64_t)count);
+          break;
+
+        case multiple_aggregator::MIN:
+        case multiple_aggregator::MAX:
+          // Written out above.
+          break;
+        }
+
+        m_output_fields.push_back(str::ref(num_string, strlen(num_string)));
+      }
+
+      record_ref::write(m_output, m_output_fields);
+      return true;
+    }
+
+    Output_Stream &m_output;
+    rstd::vector<size_t> m_group_field_numbers;
+    multiple_aggregator_list m_aggregators;
+    rstd::vector<str::ref> m_output_fields;
+    rstd::vector<char> m_number_strings;
+  };
+
+
+
+  // Write a count, sum or average's accumulator so that string_to_accumulator can read it back.  Averages are
+  // written as their sums.
+  static void accumulator_to_string(char *num_string, const accumulator &a, const multiple_aggregator &aggregator) {
+    if (rlang::dt::TYPE_DOUBLE == aggregator.m_type) {
+      str::to_round_trip_dec_str(num_string, a.m_double);
+    } else {
+      str::to_dec_str(num_string, a.m_int);
+    }
+  }
+
+
+  // Partial aggregates are records made of the grouped-on fields, the number of records in the group and then
+  // each aggregator's accumulator.  Mins and maxes are written as the text they came from.
+  template <typename Output_Stream>
+  struct output_partial_aggregated_record_callback {
+    output_partial_aggregated_record_callback(Output_Stream &output, const rstd::vector<size_t> &group_field_numbers,
+                                              const multiple_aggregator_list &aggregators)
+      : m_output(output), m_group_field_numbers(group_field_numbers), m_aggregators(aggregators) {
+      m_number_strings.resize((aggregators.size() + 1) * str::MAX_NUM_STR_LENGTH);
+    }
+
+    bool operator()(const record_ref &r, const accumulator_row &row) {
+      m_output_fields.clear();
+      size_t i;
+      for (i = 0; i < m_group_field_numbers.size(); ++i) {
+        m_output_fields.push_back(r.mandatory_field(m_group_field_numbers[i]));
+      }
+
+      char *num_string = &m_number_strings[0];
+      str::to_dec_str(num_string, get_accumulator(row, 0).m_uint);
+      m_output_fields.push_back(str::ref(num_string, strlen(num_string)));
+
+      for (i = 0; i < m_aggregators.size(); ++i) {
+        if (is_min_or_max(m_aggregators[i])) {
+          m_output_fields.push_back(get_accumulator_text(row, text_accumulator_number(m_aggregators, i)));
+          continue;
+        }
+
+        num_string = &m_number_strings[(i + 1) * str::MAX_NUM_STR_LENGTH];
+        accumulator a = get_accumulator(row, i + 1);
+        if (multiple_aggregator::COUNT == m_aggregators[i].m_function) {
+          a = get_accumulator(row, 0);
+        }
+
+        accumulator_to_string(num_string, a, m_aggregators[i]);
+        m_output_fields.push_back(str::ref(num_string, strlen(num_string)));
+      }
+
+      record_ref::write(m_output, m_output_fields);
+      return true;
+    }
+
+    Output_Stream &m_output;
+    const rstd::vector<size_t> &m_group_field_numbers;
+    const multiple_aggregator_list &m_aggregators;
+    rstd::vector<str::ref> m_output_fields;
+    rstd::vector<char> m_number_strings;
+  };
+
+
+  // What's needed to merge partial aggregates.
+  struct partial_aggregate_spec {
+    partial_aggregate_spec(const multiple_aggregator_list &aggregators, size_t number_group_fields)
+      : m_aggregators(aggregators), m_number_group_fields(number_group_fields) {}
+
+    const multiple_aggregator_list &m_aggregators;
+    size_t m_number_group_fields;
+  };
+
+
+  // The callback for merging partial aggregates.
+  template <typename Map>
+  struct partial_record_callback {
+    partial_record_callback(Map &m, const partial_aggregate_spec &spec) : m_map(m), m_spec(spec) {
+      m_row.resize(row_size(spec.m_aggregators));
+    }
+
+    bool operator()(const record_ref &r) const {
+      accumulator count;
+      count.m_uint = (uint64_t)str::dec_to_int64(r.mandatory_field(m_spec.m_number_group_fields));
+      set_accumulator(m_row.begin(), 0, count);
+
+      size_t i;
+      size_t texts_size = 0;
+      for (i = 0; i < m_spec.m_aggregators.size(); ++i) {
+        if (is_min_or_max(m_spec.m_aggregators[i])) {
+          texts_size += text_size(r.mandatory_field(m_spec.m_number_group_fields + 1 + i));
+        }
+      }
+
+      m_texts.resize(texts_size);
+      unsigned char *text = m_texts.begin();
+      for (i = 0; i < m_spec.m_aggregators.size(); ++i) {
+        const str::ref field = r.mandatory_field(m_spec.m_number_group_fields + 1 + i);
+        set_accumulator(m_row.begin(), i + 1, string_to_accumulator(field, m_spec.m_aggregators[i]));
+        if (is_min_or_max(m_spec.m_aggregators[i])) {
+          accumulator a;
+          a.m_text = text;
+          set_accumulator(m_row.begin(), text_accumulator_number(m_spec.m_aggregators, i), a);
+          write_text(text, field.length(), field);
+          text += text_size(field);
+        }
+      }
+
+      typename Map::equal_list_type *eq_list = m_map.find(r);
+      if (eq_list) {
+        combine_rows(eq_list->front().second, m_row.begin(), m_spec.m_aggregators, m_map.arena(), false);
+        return true;
+      }
+
+      eq_list = m_map.insert(r, (accumulator_row)NULL);
+      if (eq_list) {
+        eq_list->front().second = m_map.arena().alloc(m_row.size());
+        combine_rows(eq_list->front().second, m_row.begin(), m_spec.m_aggregators, m_map.arena(), true);
+      }
+
+      return true;
+    }
+
+    Map &m_map;
+    const partial_aggregate_spec &m_spec;
+    mutable rstd::vector<unsigned char> m_row;
+    // The text of the mins and maxes in m_row, which only lasts until the next record.
+    mutable rstd::vector<unsigned char> m_texts;
+  };
+
+
+  // Aggregates unsorted input in child processes.  The input is split into batches and each child aggregates a
+  // batch into a temporary file of partial aggregates.  As the children finish, the partial aggregates are
+  // hash-partitioned on the grouped-on fields, so all the partial aggregates for a group end up in the same
+  // partition.  Then each partition is merged by a child into a temporary file of finished groups and the files
+  // are copied to the output.  The groups come out in a different order to the single-process aggregation.  See
+  // process::pool for why these are processes rather than threads.
+  template <typename Output_Stream>
+  class parallel_aggregator {
+  public:
+    enum { BATCH_SIZE = 16 * 1024 * 1024 };
+
+  private:
+    typedef io::buffered_output_stream<io::file> buffered_output_type;
+    typedef io::mandatory_output_stream<buffered_output_type> mandatory_buffered_output_type;
+
+    struct child_output {
+      explicit child_output(FILE *fp) : m_fp(fp), m_is_done(false) {}
+      FILE *m_fp;
+      bool m_is_done;
+    };
+
+    struct on_child_process_exit {
+      explicit on_child_process_exit(child_output *o) : m_child_output(o) {}
+      void operator()() { m_child_output->m_is_done = true; }
+      child_output *m_child_output;
+    };
+
+    typedef process::pool<on_child_process_exit> process_pool_type;
+
+    struct async_aggregate_batch {
+      async_aggregate_batch(parallel_aggregator &aggregator, FILE *output_fp)
+        : m_aggregator(aggregator), m_output_fp(output_fp) {}
+
+      void operator()() {
+        // Executed in the child process.
+        typedef detail::record_multihashmap<accumulator_row> map_type;
+        map_type group_map(m_aggregator.m_specs);
+        multiple_record_callback<map_type> callback(group_map, m_aggregator.m_aggregators);
+
+        const unsigned char *p = m_aggregator.m_batch_buffer.ptr();
+        const unsigned char *end = p + m_aggregator.m_batch_buffer.size();
+        while (p < end) {
+          const unsigned char *record_end = record_ref::get_record_end(p, end - p);
+          NP1_ASSERT(record_end, "Incomplete record in group batch");
+          callback(record_ref(p, record_end, 0));
+          p = record_end;
+        }
+
+        io::file output_f;
+        output_f.from_handle(m_output_fp);
+        buffered_output_type buffered_output_f(output_f);
+        mandatory_buffered_output_type mandatory_buffered_output_f(buffered_output_f);
+        group_map.for_each(
+          output_partial_aggregated_record_callback<mandatory_buffered_output_type>(
+            mandatory_buffered_output_f, m_aggregator.m_group_field_numbers, m_aggregator.m_aggregators));
+        mandatory_buffered_output_f.hard_flush();
+        output_f.release();
+      }
+
+      parallel_aggregator &m_aggregator;
+      FILE *m_output_fp;
+    };
+
+    struct async_merge_partition {
+      async_merge_partition(parallel_aggregator &aggregator, detail::record_partitions::partition &partition,
+                            FILE *output_fp)
+        : m_aggregator(aggregator), m_partition(partition), m_output_fp(output_fp) {}
+
+      void operator()() {
+        // Executed in the child process.
+        io::file output_f;
+        output_f.from_handle(m_output_fp);
+        buffered_output_type buffered_output_f(output_f);
+        mandatory_buffered_output_type mandatory_buffered_output_f(buffered_output_f);
+        partial_aggregate_spec spec(m_aggregator.m_aggregators, m_aggregator.m_partial_group_field_numbers.size());
+        hash_aggregate<accumulator_row, partial_record_callback>(
+          m_aggregator.m_partial_specs, spec, m_partition,
+          output_multiple_aggregated_record_callback<mandatory_buffered_output_type>(
+            mandatory_buffered_output_f, m_aggregator.m_partial_group_field_numbers, m_aggregator.m_aggregators),
+          1);
+        mandatory_buffered_output_f.hard_flush();
+        output_f.release();
+      }
+
+      parallel_aggregator &m_aggregator;
+      detail::record_partitions::partition &m_partition;
+      FILE *m_output_fp;
+    };
+
+  public:
+    parallel_aggregator(const detail::compare_specs &specs, const record &partial_headings,
+                        const rstd::vector<size_t> &group_field_numbers, const multiple_aggregator_list &aggregators,
+                        Output_Stream &output, size_t number_threads)
+      : m_specs(specs), m_partial_specs(partial_headings, partial_headings.fields()),
+        m_group_field_numbers(group_field_numbers), m_aggregators(aggregators), m_output(output),
+        m_batch_buffer(BATCH_SIZE), m_partitions(m_partial_specs, 0), m_child_processes(number_threads) {
+      size_t i;
+      for (i = 0; i < group_field_numbers.size(); ++i) {
+        m_partial_group_field_numbers.push_back(i);
+      }
+    }
+
+    ~parallel_aggregator() {
+      m_child_processes.wait_all();
+      while (!m_child_outputs.empty()) {
+        fclose(m_child_outputs.front()->m_fp);
+        rstd::detail::mem::destruct_and_free(m_child_outputs.front());
+        m_child_outputs.pop_front();
+      }
+    }
+
+    void add(const record_ref &r) {
+      r.write(m_batch_buffer);
+      if (m_batch_buffer.size() >= BATCH_SIZE) {
+        start_batch();
+      }
+    }
+
+    void finish() {
+      if (m_batch_buffer.size() > 0) {
+        start_batch();
+      }
+
+      m_child_processes.wait_all();
+      partition_finished_batches();
+
+      size_t i;
+      for (i = 0; i < m_partitions.size(); ++i) {
+        if (m_partitions[i].number_records() > 0) {
+          child_output *o = make_child_output();
+          m_child_processes.add(async_merge_partition(*this, m_partitions[i], o->m_fp), on_child_process_exit(o));
+        }
+      }
+
+      m_child_processes.wait_all();
+      while (!m_child_outputs.empty()) {
+        child_output *o = m_child_outputs.front();
+        io::file output_f;
+        output_f.from_handle(o->m_fp);
+        NP1_ASSERT(output_f.rewind(), "Unable to rewind temporary group file");
+        io::mandatory_input_stream<io::file> mandatory_output_f(output_f);
+        mandatory_output_f.copy(m_output);
+        output_f.release();
+        fclose(o->m_fp);
+        rstd::detail::mem::destruct_and_free(o);
+        m_child_outputs.pop_front();
+      }
+    }
+
+  private:
+    /// Disable copy.
+    parallel_aggregator(const parallel_aggregator &);
+    parallel_aggregator &operator = (const parallel_aggregator &);
+
+  private:
+    child_output *make_child_output() {
+      FILE *fp = tmpfile();
+      NP1_ASSERT(fp, "Unable to create temporary file for group");
+      child_output *o = new (rstd::detail::mem::alloc(sizeof(child_output))) child_output(fp);
+      m_child_outputs.push_back(o);
+      return o;
+    }
+
+    void start_batch() {
+      child_output *o = make_child_output();
+      m_child_processes.add(async_aggregate_batch(*this, o->m_fp), on_child_process_exit(o));
+      m_batch_buffer.reset();
+
+      while (m_child_processes.has_process_exited()) {}
+      partition_finished_batches();
+    }
+
+    // Partition the partial aggregates of finished batches, stopping at the first unfinished batch.
+    void partition_finished_batches() {
+      while (!m_child_outputs.empty() && m_child_outputs.front()->m_is_done) {
+        child_output *o = m_child_outputs.front();
+        io::file output_f;
+        output_f.from_handle(o->m_fp);
+        NP1_ASSERT(output_f.rewind(), "Unable to rewind temporary group file");
+        io::mandatory_record_input_stream<io::file, record, record_ref> partial_input(output_f);
+        partial_input.parse_records(partition_record_callback(m_partitions));
+        output_f.release();
+        fclose(o->m_fp);
+        rstd::detail::mem::destruct_and_free(o);
+        m_child_outputs.pop_front();
+      }
+    }
+
+    struct partition_record_callback {
+      explicit partition_record_callback(detail::record_partitions &partitions) : m_partitions(partitions) {}
+
+      bool operator()(const record_ref &r) const {
+        m_partitions.write(r);
+        return true;
+      }
+
+      detail::record_partitions &m_partitions;
+    };
+
+  private:
+    detail::compare_specs m_specs;
+    detail::compare_specs m_partial_specs;
+    rstd::vector<size_t> m_group_field_numbers;
+    rstd::vector<size_t> m_partial_group_field_numbers;
+    multiple_aggregator_list m_aggregators;
+    Output_Stream &m_output;
+    io::heap_buffer_output_stream m_batch_buffer;
+    detail::record_partitions m_partitions;
+    rstd::list<child_output *> m_child_outputs;
+    process_pool_type m_child_processes;
+  };
+
+
+  template <typename Output_Stream>
+  struct parallel_aggregate_record_callback {
+    explicit parallel_aggregate_record_callback(parallel_aggregator<Output_Stream> &aggregator)
+      : m_aggregator(aggregator) {}
+
+    bool operator()(const record_ref &r) const {
+      m_aggregator.add(r);
+      return true;
+    }
+
+    parallel_aggregator<Output_Stream> &m_aggregator;
+  };
+
+    
+  // A column of sketches from the quantile_sketch aggregator.
+  static bool is_quantile_sketch_heading(const str::ref &heading_name) {
+    return (str::cmp(detail::helper::get_heading_without_type_tag(heading_name),
+                     NP1_REL_GROUP_OUTPUT_HEADING_QUANTILE_SKETCH) == 0)
+            && (rlang::dt::TYPE_STRING
+                  == rlang::dt::mandatory_from_string(detail::helper::mandatory_get_heading_type_tag(heading_name)));
+  }
+
+  // The type of the values in the sketches.  The answers are always values that went into the sketch so they're
+  // the same type as the input, except that the type is lost when sketches are written out so answers from merged
+  // sketches are doubles.
+  static rlang::dt::data_type get_quantile_type(const record &input_headings, const char *aggregator_heading_name) {
+    str::ref heading_name = input_headings.mandatory_field(input_headings.mandatory_find_heading(aggregator_heading_name));
+    if (is_quantile_sketch_heading(heading_name)) {
+      return rlang::dt::TYPE_DOUBLE;
+    }
+
+    str::ref type_tag = detail::helper::mandatory_get_heading_type_tag(heading_name);
+    rlang::dt::data_type type = rlang::dt::mandatory_from_string(type_tag);
+    if ((rlang::dt::TYPE_INT != type) && (rlang::dt::TYPE_UINT != type)) {
+      validate_type_is_double(type, "quantile aggregators", type_tag);
+    }
+
+    return type;
+  }
+
+  // A column of counters from the hll_sketch aggregator.
+  static bool is_hll_sketch_heading(const str::ref &heading_name) {
+    return (str::cmp(detail::helper::get_heading_without_type_tag(heading_name),
+                     NP1_REL_GROUP_OUTPUT_HEADING_HLL_SKETCH) == 0)
+            && (rlang::dt::TYPE_STRING
+                  == rlang::dt::mandatory_from_string(detail::helper::mandatory_get_heading_type_tag(heading_name)));
+  }
+
+  struct hll_aggregator_spec {
+    hll_aggregator_spec(size_t field_number, bool is_counter, size_t precision,
+                        const detail::compare_specs &value_specs)
+      : m_field_number(field_number), m_is_counter(is_counter), m_precision(precision), m_value_specs(value_specs) {}
+
+    size_t m_field_number;
+    bool m_is_counter;
+    size_t m_precision;
+    // The values are hashed in the same way as rel.unique compares them, eg 1 and 01 are the same int.
+    detail::compare_specs m_value_specs;
+  };
+
+
+  // The callback for the HyperLogLog aggregators.
+  template <typename Map>
+  struct hll_record_callback {
+    hll_record_callback(Map &m, const hll_aggregator_spec &spec) : m_map(m), m_spec(spec) {}
+
+    bool operator()(const record_ref &r) const {
+      hyperloglog other;
+      if (m_spec.m_is_counter) {
+        str::ref field = r.mandatory_field(m_spec.m_field_number);
+        NP1_ASSERT(other.from_string(field.ptr(), field.length()),
+                   "Invalid HyperLogLog counter, or one from an incompatible version of r17: " + field.to_string());
+      }
+
+      typename Map::equal_list_type *eq_list = m_map.find(r);
+      if (!eq_list) {
+        // If the record went to a partition instead of the map then it doesn't need a counter.
+        eq_list = m_map.insert(r, (hyperloglog *)NULL);
+        if (!eq_list) {
+          return true;
+        }
+
+        eq_list->front().second =
+          new (rstd::detail::mem::alloc(sizeof(hyperloglog)))
+            hyperloglog(m_spec.m_is_counter ? other.precision() : m_spec.m_precision);
+      }
+
+      hyperloglog *counter = eq_list->front().second;
+      if (m_spec.m_is_counter) {
+        NP1_ASSERT(counter->merge(other), "HyperLogLog counters with different precisions can't be merged");
+      } else {
+        counter->add(detail::record_hash(r, m_spec.m_value_specs, detail::helper::hash_init()));
+      }
+
+      return true;
+    }
+
+    Map &m_map;
+    const hll_aggregator_spec &m_spec;
+  };
+
+
+  struct quantile_aggregator_spec {
+    size_t m_field_number;
+    bool m_is_sketch;
+    rlang::dt::data_type m_type;
+  };
+
+
+  // The callback for the quantile aggregators.
+  template <typename Map>
+  struct quantile_record_callback {
+    quantile_record_callback(Map &m, const quantile_aggregator_spec &spec) : m_map(m), m_spec(spec) {}
+
+    bool operator()(const record_ref &r) const {
+      typename Map::equal_list_type *eq_list = m_map.find(r);
+      if (!eq_list) {
+        // If the record went to a partition instead of the map then it doesn't need a sketch.
+        eq_list = m_map.insert(r, (quantile_sketch *)NULL);
+        if (!eq_list) {
+          return true;
+        }
+
+        eq_list->front().second = new (rstd::detail::mem::alloc(sizeof(quantile_sketch))) quantile_sketch;
+      }
+
+      quantile_sketch *sketch = eq_list->front().second;
+      str::ref field = r.mandatory_field(m_spec.m_field_number);
+      if (m_spec.m_is_sketch) {
+        quantile_sketch other;
+        NP1_ASSERT(other.from_string(field.ptr(), field.length()),
+                   "Invalid quantile sketch: " + field.to_string());
+        sketch->merge(other);
+      } else if (rlang::dt::TYPE_DOUBLE == m_spec.m_type) {
+        sketch->add(str::dec_to_double(field));
+      } else if (rlang::dt::TYPE_UINT == m_spec.m_type) {
+        sketch->add((double)(uint64_t)str::dec_to_int64(field));
+      } else {
+        sketch->add((double)str::dec_to_int64(field));
+      }
+
+      return true;
+    }
+
+    Map &m_map;
+    const quantile_aggregator_spec &m_spec;
+  };
+
+
+  static int64_t get_number(const str::ref &field, int64_t unused) {
+    return str::dec_to_int64(field);
+  }
+
+  static double get_number(const str::ref &field, double unused) {
+    return str::dec_to_double(field);
+  }
+
+  static uint64_t get_number(const str::ref &field, uint64_t unused) {
+    return (uint64_t)str::dec_to_int64(field);
+  }
+
+  
+  // The callback for the count aggregator.
+  template <typename Map>
+  struct count_record_callback {
+    count_record_callback(Map &m, const detail::compare_spec &unused) : m_map(m) {}  
+    bool operator()(const record_ref &r) const {
+      typename Map::equal_list_type *eq_list;
+      eq_list = m_map.find(r);
+      if (eq_list) {
+        eq_list->front().second++;
+      } else {
+        m_map.insert(r, (uint64_t)1);  
+      }
       
+      return true;
+    }
+    
+    Map &m_map;  
+  };
+  
+  
+  // The callback for the sum or avg aggregator.
+  //TODO: this will only work with numbers that sum to less than max-int64/max-double.  
+  // Surely this number is big enough?
+  template <typename Map>
+  struct sum_record_callback {
+    // The first element in the pair is the sum, the second element is the
+    // count of elements.
+    typedef typename Map::value_type::first_type Number_Type;
+
+    sum_record_callback(Map &m, const detail::compare_spec &spec)
+    : m_map(m), m_spec(spec) {}
     bool operator()(const record_ref &r) const {
-      typedef typename detail::record_multihashmap<Number_Type>::equal_list_type eq_list_type;
+      typename Map::equal_list_type *eq_list;
+        
+      Number_Type num = field_to_number(r);
+      eq_list = m_map.find(r);    
+      if (eq_list) {
+        eq_list->front().second.first += num;
+        eq_list->front().second.second++;
+      } else {
+        m_map.insert(r, rstd::make_pair(num, (int64_t)1));
+      }
+      
+      return true;
+    }
+      
+    Number_Type field_to_number(const record_ref &r) const {
+      Number_Type num = 0;
+      num = get_number(r.mandatory_field(m_spec.field_number()), num);      
+      return num;
+    }        
+    
+    Map &m_map;
+    detail::compare_spec m_spec;   
+  };
+  
+
+  // Sum the sum & count intermediate results.
+  template <typename Number_Type>
+  struct sum_sum_count_record_callback {
+    sum_sum_count_record_callback(
+      detail::record_multihashmap<rstd::pair<Number_Type, int64_t> > &m,
+      size_t sum_field_id,
+      size_t count_field_id)
+    : m_map(m), m_sum_field_id(sum_field_id), m_count_field_id(count_field_id) {}
+
+    bool operator()(const record_ref &r) const {
+      // The first element in the pair is the sum, the second element is the
+      // count of elements.
+      typedef typename rstd::pair<Number_Type, int64_t> pair_type;
+      typedef typename detail::record_multihashmap<pair_type>::equal_list_type eq_list_type;
       eq_list_type *eq_list;
+        
+      Number_Type sum = 0;
+      sum = get_number(r.mandatory_field(m_sum_field_id), sum);
+      int64_t count = str::dec_to_int64(r.mandatory_field(m_count_field_id));
+      eq_list = m_map.find(r);    
+      if (eq_list) {
+        eq_list->front().second.first += sum;
+        eq_list->front().second.second += count;
+      } else {
+        m_map.insert(r, rstd::make_pair(sum, count));
+      }
+      
+      return true;
+    }
+      
+    detail::record_multihashmap<rstd::pair<Number_Type, int64_t> > &m_map;
+    size_t m_sum_field_id;
+    size_t m_count_field_id;
+  };
+
+  
+  
+  // The callback for an aggregator that selects just one element.  The map value is the number of bytes that the
+  // selected record has available in the map's arena.
+  template <typename Selector_Operator, typename Map>
+  struct selector_record_callback {
+    selector_record_callback(Map &m, const detail::compare_spec &spec) 
+    : m_map(m), m_spec(spec), m_selector_operator(Selector_Operator()) {}
+      
+    bool operator()(const record_ref &r) const {
+      typename Map::equal_list_type *eq_list;
       
       eq_list = m_map.find(r);
       if (eq_list) {
-        const record &in_map_record = eq_list->front().first;
+        const record_ref &in_map_record = eq_list->front().first;
         
         str::ref in_map_field;
         str::ref field;
@@ -561,16 +2067,16 @@ private:
                                 in_map_field.ptr(), in_map_field.length()))) {
           // Recall that the comparison spec for the map does not 
           // include the aggregation field.
-          eq_list->front().first = record(r); 
+          m_map.arena().reassign(eq_list->front().first, eq_list->front().second, r);
         }      
       } else {
-        m_map.insert(r, (Number_Type)0);  
+        m_map.insert(r, r.byte_size());
       }
       
       return true;
     }
     
-    detail::record_multihashmap<Number_Type> &m_map;
+    Map &m_map;
     detail::compare_spec m_spec;
     Selector_Operator m_selector_operator;
   };
@@ -581,24 +2087,39 @@ private:
   struct max_operator { bool operator()(int i) const { return (i > 0); } };
   
   // Selector callbacks.
-  typedef selector_record_callback<min_operator, int64_t> min_int64_record_callback;
-  typedef selector_record_callback<min_operator, double> min_double_record_callback;
-  typedef selector_record_callback<max_operator, int64_t> max_int64_record_callback;
-  typedef selector_record_callback<max_operator, double> max_double_record_callback;
+  template <typename Map>
+  struct min_record_callback : public selector_record_callback<min_operator, Map> {
+    min_record_callback(Map &m, const detail::compare_spec &spec)
+      : selector_record_callback<min_operator, Map>(m, spec) {}
+  };
+
+  template <typename Map>
+  struct max_record_callback : public selector_record_callback<max_operator, Map> {
+    max_record_callback(Map &m, const detail::compare_spec &spec)
+      : selector_record_callback<max_operator, Map>(m, spec) {}
+  };
   
+  // The median aggregator counts the records in each group as well as sorting them.
+  typedef detail::spilling_record_multihashmap<uint64_t> median_count_map_type;
+
   // Callback for the median aggregator.
   template <typename Sort_Manager>
   struct median_record_callback {
-    median_record_callback(detail::record_multihashmap<uint64_t> &cgm, Sort_Manager &sm)
-      : m_count_callback(cgm), m_sorter(sm) {}
+    median_record_callback(median_count_map_type &cgm, Sort_Manager &sm) : m_count_group_map(cgm), m_sorter(sm) {}
 
     bool operator()(const record_ref &r) const {
-      m_count_callback(r);
-      m_sorter(r);
+      median_count_map_type::equal_list_type *eq_list = m_count_group_map.find(r);
+      if (eq_list) {
+        eq_list->front().second++;
+        m_sorter(r);
+      } else if (m_count_group_map.insert(r, (uint64_t)1)) {
+        m_sorter(r);
+      }
+
       return true;
     }
     
-    count_record_callback m_count_callback;
+    median_count_map_type &m_count_group_map;
     Sort_Manager &m_sorter;
   };
   
@@ -608,10 +2129,10 @@ private:
   template <typename Output_Stream>
   struct output_count_aggregated_record_callback {
     output_count_aggregated_record_callback(Output_Stream &output) : m_output(output) {}  
-    bool operator()(const record &r, size_t val) const {
+    bool operator()(const record_ref &r, size_t val) const {
       char counter_string[32];
       str::to_dec_str(counter_string, val);
-      record_ref::write(m_output, r.ref(), counter_string);
+      record_ref::write(m_output, r, counter_string);
       return true;
     }
     
@@ -660,9 +2181,9 @@ private:
 
   // Get all the fields from the record except the victim field.  number_fields
   // is supplied for performance reasons.
-  template <size_t N>
+  template <size_t N, typename Record>
   static void get_fields_except(rstd::vector<str::ref> &fields,
-                                const record &r, size_t number_fields,
+                                const Record &r, size_t number_fields,
                                 const field_id_list<N> &victim_field_numbers) {
     fields.resize(number_fields - victim_field_numbers.size());
     
@@ -689,7 +2210,7 @@ private:
                         bool is_sum) 
     : m_output(output), m_field_ids_to_omit(field_ids_to_omit), m_number_fields(number_fields), m_is_sum(is_sum) {}
 
-    bool operator()(const record &r, 
+    bool operator()(const record_ref &r, 
                     const rstd::pair<Number_Type, int64_t> &sum_count_pair) {
       // Get all the fields except the one that was involved in the
       // averaging.
@@ -717,6 +2238,81 @@ private:
 
 
 
+  // The callback for writing out the records & aggregation for the quantile aggregators.  Each group is written
+  // once so this is where its sketch is freed.
+  template <typename Output_Stream>
+  struct output_quantile_aggregated_record_callback {
+    output_quantile_aggregated_record_callback(Output_Stream &output, const field_id_list<1> &field_ids_to_omit,
+                                               size_t number_fields, double quantile, rlang::dt::data_type type)
+      : m_output(output), m_field_ids_to_omit(field_ids_to_omit), m_number_fields(number_fields),
+        m_quantile(quantile), m_type(type) {}
+
+    bool operator()(const record_ref &r, quantile_sketch * const &sketch) {
+      get_fields_except(m_output_fields, r, m_number_fields, m_field_ids_to_omit);
+
+      if (m_quantile < 0) {
+        rstd::string sketch_string(sketch->to_string());
+        record_ref::write(m_output, m_output_fields, sketch_string.c_str());
+      } else {
+        char num_string[str::MAX_NUM_STR_LENGTH];
+        double value = sketch->quantile(m_quantile);
+        if (rlang::dt::TYPE_DOUBLE == m_type) {
+          str::to_dec_str(num_string, value);
+        } else if (rlang::dt::TYPE_UINT == m_type) {
+          str::to_dec_str(num_string, (uint64_t)value);
+        } else {
+          str::to_dec_str(num_string, (int64_t)value);
+        }
+
+        record_ref::write(m_output, m_output_fields, num_string);
+      }
+
+      rstd::detail::mem::destruct_and_free(sketch);
+      return true;
+    }
+
+    Output_Stream &m_output;
+    field_id_list<1> m_field_ids_to_omit;
+    rstd::vector<str::ref> m_output_fields;
+    size_t m_number_fields;
+    double m_quantile;
+    rlang::dt::data_type m_type;
+  };
+
+
+  // The callback for writing out the records & aggregation for the HyperLogLog aggregators.  Each group is written
+  // once so this is where its counter is freed.
+  template <typename Output_Stream>
+  struct output_hll_aggregated_record_callback {
+    output_hll_aggregated_record_callback(Output_Stream &output, const field_id_list<1> &field_ids_to_omit,
+                                          size_t number_fields, bool is_counter_output)
+      : m_output(output), m_field_ids_to_omit(field_ids_to_omit), m_number_fields(number_fields),
+        m_is_counter_output(is_counter_output) {}
+
+    bool operator()(const record_ref &r, hyperloglog * const &counter) {
+      get_fields_except(m_output_fields, r, m_number_fields, m_field_ids_to_omit);
+
+      if (m_is_counter_output) {
+        rstd::string counter_string(counter->to_string());
+        record_ref::write(m_output, m_output_fields, counter_string.c_str());
+      } else {
+        char num_string[str::MAX_NUM_STR_LENGTH];
+        str::to_dec_str(num_string, counter->estimate());
+        record_ref::write(m_output, m_output_fields, num_string);
+      }
+
+      rstd::detail::mem::destruct_and_free(counter);
+      return true;
+    }
+
+    Output_Stream &m_output;
+    field_id_list<1> m_field_ids_to_omit;
+    rstd::vector<str::ref> m_output_fields;
+    size_t m_number_fields;
+    bool m_is_counter_output;
+  };
+
+
   // The callback for writing out the records & aggregation for the sum_count aggregator.
   template <typename Output_Stream, typename Number_Type, size_t N>
   struct output_sum_count_aggregated_record_callback {
@@ -726,7 +2322,7 @@ private:
                         size_t number_fields) 
     : m_output(output), m_field_ids_to_omit(field_ids_to_omit), m_number_fields(number_fields) {}
 
-    bool operator()(const record &r, const rstd::pair<Number_Type, int64_t> &sum_count_pair) {
+    bool operator()(const record_ref &r, const rstd::pair<Number_Type, int64_t> &sum_count_pair) {
       // Get all the fields except the one that was involved in the
       // averaging.
       get_fields_except(m_output_fields, r, m_number_fields, m_field_ids_to_omit);
@@ -753,7 +2349,7 @@ private:
   template <typename Output_Stream>
   struct output_record_callback {
     output_record_callback(Output_Stream &output) : m_output(output) {}  
-    bool operator()(const record &r, size_t val) const {
+    bool operator()(const record_ref &r, size_t val) const {
       r.write(m_output);    
       return true;
     }
@@ -762,10 +2358,195 @@ private:
   };
 
 
+  // A value for the exact numeric median and the record it came from.  If the value turns out to be the median
+  // then the record is written out as it is, so the output has the same text as the input.  Values that are
+  // equal are ordered by when they arrived, which picks the same record as sorting the whole input.
+  template <typename Number>
+  struct median_value {
+    median_value() : m_value(0), m_sequence(0) {}
+    median_value(Number value, uint64_t sequence, const record_ref &r)
+      : m_value(value), m_sequence(sequence), m_record(r) {}
+
+    bool operator < (const median_value &other) const {
+      return (m_value < other.m_value) || (!(other.m_value < m_value) && (m_sequence < other.m_sequence));
+    }
+
+    Number m_value;
+    uint64_t m_sequence;
+    record_ref m_record;
+  };
+
+  // The values of one group for the exact numeric median.  The values are kept in a list of chunks in the map's
+  // arena, each chunk twice as big as the one before up to a limit, so small groups don't waste much space and
+  // big groups don't have to be copied as they grow.
+  struct median_value_chunk {
+    enum { INITIAL_CAPACITY = 4, MAX_CAPACITY = 4096 };
+
+    // The values start straight after the chunk header.
+    template <typename Number>
+    median_value<Number> *values() { return (median_value<Number> *)(this + 1); }
+
+    median_value_chunk *m_next;
+    size_t m_size;
+    size_t m_capacity;
+  };
+
+  struct median_value_list {
+    median_value_chunk *m_first;
+    median_value_chunk *m_last;
+    uint64_t m_count;
+  };
+
+  typedef detail::record_multihashmap<median_value_list *> median_values_map_type;
+
+  // Allocate 8-byte-aligned space in an arena.  The records that share the arena can be any length.
+  static unsigned char *alloc_aligned(record_arena &arena, size_t size) {
+    unsigned char *p = arena.alloc(size + sizeof(uint64_t) - 1);
+    return (unsigned char *)(((size_t)p + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1));
+  }
+
+  template <typename Number>
+  static median_value_chunk *alloc_median_value_chunk(record_arena &arena, size_t capacity) {
+    median_value_chunk *chunk = (median_value_chunk *)alloc_aligned(
+      arena, sizeof(median_value_chunk) + capacity * sizeof(median_value<Number>));
+    chunk->m_next = NULL;
+    chunk->m_size = 0;
+    chunk->m_capacity = capacity;
+    return chunk;
+  }
+
+  // Callback for the exact numeric median aggregator.  Once the map is too big every record goes to the
+  // partitions, including the records that were in the map, which go first so that each group's records stay
+  // in the order they arrived.
+  template <typename Number>
+  struct median_values_record_callback {
+    median_values_record_callback(median_values_map_type &m, detail::record_partitions &p,
+                                  size_t value_field_number, bool can_spill, bool &is_spilling)
+      : m_map(m), m_partitions(p), m_value_field_number(value_field_number),
+        m_max_memory_size(environment::max_hash_table_memory()), m_can_spill(can_spill),
+        m_is_spilling(is_spilling) {}
+
+    bool operator()(const record_ref &r) {
+      if (m_is_spilling) {
+        m_partitions.write(r);
+        return true;
+      }
+
+      median_values_map_type::equal_list_type *eq_list = m_map.find(r);
+      median_value_list *list;
+      if (eq_list) {
+        list = eq_list->front().second;
+      } else {
+        list = (median_value_list *)alloc_aligned(m_map.arena(), sizeof(median_value_list));
+        list->m_first = list->m_last =
+          alloc_median_value_chunk<Number>(m_map.arena(), median_value_chunk::INITIAL_CAPACITY);
+        list->m_count = 0;
+        m_map.insert(r, list);
+      }
+
+      median_value_chunk *chunk = list->m_last;
+      if (chunk->m_size == chunk->m_capacity) {
+        size_t capacity = 2 * chunk->m_capacity;
+        chunk = alloc_median_value_chunk<Number>(
+          m_map.arena(), (capacity > median_value_chunk::MAX_CAPACITY) ? median_value_chunk::MAX_CAPACITY : capacity);
+        list->m_last->m_next = chunk;
+        list->m_last = chunk;
+      }
+
+      new (&chunk->template values<Number>()[chunk->m_size++]) median_value<Number>(
+        get_number(r.mandatory_field(m_value_field_number), Number()), list->m_count, m_map.arena().copy(r));
+      ++list->m_count;
+
+      if (m_can_spill && (m_map.memory_size() > m_max_memory_size)) {
+        m_map.for_each(*this);
+        m_is_spilling = true;
+      }
+
+      return true;
+    }
+
+    // Write out a group's records.
+    bool operator()(const record_ref &r, median_value_list * const &list) {
+      median_value_chunk *chunk;
+      for (chunk = list->m_first; chunk; chunk = chunk->m_next) {
+        size_t i;
+        for (i = 0; i < chunk->m_size; ++i) {
+          m_partitions.write(chunk->template values<Number>()[i].m_record);
+        }
+      }
+
+      return true;
+    }
+
+    median_values_map_type &m_map;
+    detail::record_partitions &m_partitions;
+    size_t m_value_field_number;
+    uint64_t m_max_memory_size;
+    bool m_can_spill;
+    bool &m_is_spilling;
+  };
+
+
+  // Put the keys of a map into a merge_sort.
+  struct merge_sort_insert_callback {
+    explicit merge_sort_insert_callback(detail::merge_sort &sorter) : m_sorter(sorter) {}
+
+    template <typename Value>
+    bool operator()(const record_ref &r, const Value &v) {
+      m_sorter.insert(r);
+      return true;
+    }
+
+    detail::merge_sort &m_sorter;
+  };
+
+
+  // The callback for writing out the records & aggregation for the exact numeric median.  It's given the group
+  // keys in order.
+  template <typename Output_Stream, typename Number>
+  struct output_median_values_aggregated_record_callback {
+    output_median_values_aggregated_record_callback(median_values_map_type &m, Output_Stream &output,
+                                                    size_t value_field_number, size_t number_fields)
+      : m_map(m), m_output(output), m_value_field_number(value_field_number), m_field_ids_to_omit(value_field_number),
+        m_number_fields(number_fields) {}
+
+    void operator()(const record_ref &r) {
+      median_values_map_type::equal_list_type *eq_list = m_map.find(r);
+      NP1_ASSERT(eq_list, "Failed to find equal_list in median values map!");
+      const median_value_list *list = eq_list->front().second;
+
+      m_values.resize(list->m_count);
+      median_value<Number> *values = m_values.begin();
+      median_value_chunk *chunk;
+      for (chunk = list->m_first; chunk; chunk = chunk->m_next) {
+        size_t i;
+        for (i = 0; i < chunk->m_size; ++i) {
+          *values++ = chunk->template values<Number>()[i];
+        }
+      }
+
+      // The lower of the two middle values when there's an even number of them.  The group's fields come from
+      // the median's own record, which matters when the keys compare equal without being identical.
+      const median_value<Number> median = select_nth(m_values.begin(), m_values.size(), (m_values.size() + 1)/2 - 1);
+      get_fields_except(m_output_fields, median.m_record, m_number_fields, m_field_ids_to_omit);
+      m_output_fields.push_back(median.m_record.mandatory_field(m_value_field_number));
+      record_ref::write(m_output, m_output_fields);
+    }
+
+    median_values_map_type &m_map;
+    Output_Stream &m_output;
+    size_t m_value_field_number;
+    field_id_list<1> m_field_ids_to_omit;
+    size_t m_number_fields;
+    rstd::vector<median_value<Number> > m_values;
+    rstd::vector<str::ref> m_output_fields;
+  };
+
+
   // The callback for finalizing the median aggregation.
   template <typename Output_Stream>
   struct output_median_aggregated_record_callback {
-    output_median_aggregated_record_callback(detail::record_multihashmap<uint64_t> &cgm,
+    output_median_aggregated_record_callback(median_count_map_type &cgm,
                                              const detail::compare_specs &cs,
                                              Output_Stream &o)
       : m_is_first(true), m_count_group_map(cgm), m_count_specs(cs), m_output(o), m_current_group_median_offset(0),
@@ -784,7 +2565,7 @@ private:
       m_is_first = false;
 
       // A new group!
-      detail::record_multihashmap<uint64_t>::equal_list_type *equal_list = m_count_group_map.find(r);
+      median_count_map_type::equal_list_type *equal_list = m_count_group_map.find(r);
       NP1_ASSERT(equal_list, "Failed to find equal_list in count_group_map!");
       uint64_t count = equal_list->front().second;
       m_current_group_median_offset = (count+1)/2;
@@ -800,7 +2581,7 @@ private:
     }
 
     bool m_is_first;
-    detail::record_multihashmap<uint64_t> &m_count_group_map;
+    median_count_map_type &m_count_group_map;
     const detail::compare_specs &m_count_specs;
     Output_Stream &m_output;
     record m_current_group_example;
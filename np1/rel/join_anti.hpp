@@ -8,6 +8,8 @@
 #include "np1/io/gzfile.hpp"
 #include "np1/consistent_hash_table.hpp"
 #include "np1/rel/detail/join_helper.hpp"
+#include "np1/rel/detail/hash_join.hpp"
+#include "np1/rel/detail/record_index.hpp"
 
 
 namespace np1 {
@@ -41,56 +43,27 @@ public:
     detail::join_helper::find_common_and_non_common_headings(
       file1_headers, file2_headers, common_heading_names, file2_non_common_field_numbers);
 
-    // Now read file2 into memory.
-    detail::compare_specs compare_specs2(file2_headers, common_heading_names);
-    detail::record_multihashmap<detail::join_helper::empty_type> map2(compare_specs2);
-    file2_stream.parse_records(detail::join_helper::insert_record_callback(map2));
-    
-    // Close file2 'cause it might be using a big buffer and we can use all the RAM we can lay our mitts on.
-    file2.close();
-        
-    // Set up the compare specs for file1.
-    detail::compare_specs compare_specs1(file1_headers, common_heading_names);
-    
-    // Check that the join participants are all data types we support.
-    detail::join_helper::validate_compare_specs(compare_specs1);
-    detail::join_helper::validate_compare_specs(compare_specs2);
+    // Use file2's index if it has one on the common headings.
+    detail::record_index index2;
+    detail::compare_specs compare_specs1;
+    detail::compare_specs compare_specs2;
+    bool is_indexed = detail::hash_join::open_index(
+      file_name2, file1_headers, file2_headers, common_heading_names, index2, compare_specs1, compare_specs2);
 
     // Antijoin- write out all records in file1 that have no match
     // in file2.  First, write out the headers.
     file1_headers.write(output);
-    
-    // Now read in file1 and antimerge :) as we go.
-    input.parse_records(
-      anti_merge_record_callback<Output_Stream>(output, map2, compare_specs1));
-  }
 
-private:  
-  // The record callback for when we're antijoining the file1 stream with 
-  // file2 (in memory).
-  template <typename Output>
-  struct anti_merge_record_callback {
-    anti_merge_record_callback(
-        Output &output, detail::record_multihashmap<detail::join_helper::empty_type> &map2,
-        const detail::compare_specs &specs1)
-    : m_output(output)
-    , m_map2(map2)
-    , m_specs1(specs1) {}
-    
-    // The record_ref we get here is from file1.
-    bool operator()(const record_ref &ref1) const {
-      if (!m_map2.find(ref1, m_specs1)) {
-        ref1.write(m_output);
-      }
-      
-      return true;
+    // Now read file2 into memory (or as much of it as will fit) and read in file1 and antimerge :) as we go.
+    detail::hash_join::joiner joiner(
+      detail::join_helper::ANTI, compare_specs1, compare_specs2, file2_non_common_field_numbers, NULL);
+    if (is_indexed) {
+      joiner.join_index(input, index2, output);
+      return;
     }
-    
-    Output &m_output;
-    detail::record_multihashmap<detail::join_helper::empty_type> &m_map2;
-    detail::compare_specs m_specs1;
-    rstd::vector<size_t> m_file2_non_common_field_numbers;
-  };
+
+    joiner(input, file2_stream, output);
+  }
 };
 
 } // namespaces
@@ -7,6 +7,7 @@
 #include "np1/io/mandatory_record_input_stream.hpp"
 #include "np1/io/gzfile.hpp"
 #include "np1/consistent_hash_table.hpp"
+#include "np1/rel/record_arena.hpp"
 #include "np1/rel/detail/join_helper.hpp"
 
 
@@ -20,7 +21,21 @@ public:
   void operator()(Input_Stream &input, Output_Stream &output,
                   const rstd::vector<rel::rlang::token> &tokens) {  
     /* Get the arguments. */
-    rstd::string file_name2(rel::rlang::compiler::eval_to_string_only(tokens));
+    rstd::vector<rstd::pair<rstd::string, rlang::dt::data_type> > arg_pairs = rlang::compiler::eval_to_strings(tokens);
+    NP1_ASSERT((arg_pairs.size() == 1) || (arg_pairs.size() == 2),
+                "Invalid number of arguments to rel.join.consistent_hash");
+    NP1_ASSERT(rlang::dt::TYPE_STRING == arg_pairs[0].second,
+                "First argument to rel.join.consistent_hash must be a string");
+    rstd::string file_name2(arg_pairs[0].first);
+
+    int64_t number_virtual_nodes = 1;
+    if (arg_pairs.size() == 2) {
+      NP1_ASSERT((rlang::dt::TYPE_INT == arg_pairs[1].second) || (rlang::dt::TYPE_UINT == arg_pairs[1].second),
+                  "Second argument to rel.join.consistent_hash must be an integer");
+      number_virtual_nodes = str::dec_to_int64(arg_pairs[1].first);
+      NP1_ASSERT(number_virtual_nodes > 0,
+                  "Second argument to rel.join.consistent_hash must be a nonzero positive integer");
+    }
           
     /* Get the list of headers from the first file. */
     record file1_headers(input.parse_headings());                
@@ -42,8 +57,9 @@ public:
       file1_headers, file2_headers, common_heading_names, file2_non_common_field_numbers);
 
     // Now read file2 into memory.
-    consistent_hash_table<record, consistent_hash_function> consistent_hash_table2(1);
-    file2_stream.parse_records(consistent_hash_table_insert_record_callback(consistent_hash_table2));
+    record_arena arena2;
+    consistent_hash_table<record_ref, consistent_hash_function> consistent_hash_table2(number_virtual_nodes);
+    file2_stream.parse_records(consistent_hash_table_insert_record_callback(consistent_hash_table2, arena2));
     
     // Close file2 'cause it might be using a big buffer and we can use all the RAM we can lay our mitts on.
     file2.close();
@@ -65,57 +81,59 @@ public:
   }
 
 private:
-  // Function for the consistent hash table.
+  // Function for the consistent hash table.  This is FNV-1a rather than the record hash function because the hash
+  // values decide which records match, and that mustn't change between versions or machines.
   struct consistent_hash_function {
-    uint64_t operator()(const record &r, uint64_t consistent_hash_internal) {
-      uint64_t hval = hash::fnv1a64::init();
-      size_t number_fields = r.number_fields();
-      size_t field_id;
-      for (field_id = 0; field_id < number_fields; ++field_id) {
-        str::ref field = r.mandatory_field(field_id);
-        hval = hash::fnv1a64::add(field.ptr(), field.length(), hval);
-      }
-      hval = hash::fnv1a64::add(&consistent_hash_internal, sizeof(consistent_hash_internal), hval);
-      return hval;
+    struct field_hasher {
+      explicit field_hasher(uint64_t hval) : m_hval(hval) {}
+      void operator()(const str::ref &field) { m_hval = hash::fnv1a64::add(field.ptr(), field.length(), m_hval); }
+      uint64_t m_hval;
+    };
+
+    uint64_t operator()(const record_ref &r, uint64_t consistent_hash_internal) {
+      field_hasher hasher(hash::fnv1a64::init());
+      r.for_each_field(hasher);
+      return hash::fnv1a64::add(&consistent_hash_internal, sizeof(consistent_hash_internal), hasher.m_hval);
     }
   };
 
   template <typename Output>
   struct consistent_hash_record_callback {
     consistent_hash_record_callback(
-        Output &output, consistent_hash_table<record, consistent_hash_function> &cht2,
+        Output &output, consistent_hash_table<record_ref, consistent_hash_function> &cht2,
         const rstd::vector<size_t> &file2_non_common_field_numbers)
         : m_output(output), m_cht2(cht2), m_file2_non_common_field_numbers(file2_non_common_field_numbers) {}
     
     // The record_ref we get here is from file1.
     bool operator()(const record_ref &ref1) {
-      //TODO: constructing a record object is very wasteful here.
-      consistent_hash_table<record, consistent_hash_function>::iterator iter2 = m_cht2.lower_bound(record(ref1));
+      consistent_hash_table<record_ref, consistent_hash_function>::iterator iter2 = m_cht2.lower_bound(ref1);
       NP1_ASSERT(iter2 != m_cht2.end(), "rel.join.consistent_hash expects a non-empty 'other' file.");
       
       detail::join_helper::record_merge_write(
-        m_output, ref1, iter2->ref(), m_file2_non_common_field_numbers, m_file2_non_common_field_refs_storage);
+        m_output, ref1, *iter2, m_file2_non_common_field_numbers, m_file2_non_common_field_refs_storage);
 
       return true;
     }
     
     Output &m_output;
-    consistent_hash_table<record, consistent_hash_function> &m_cht2;
+    consistent_hash_table<record_ref, consistent_hash_function> &m_cht2;
     rstd::vector<size_t> m_file2_non_common_field_numbers;
     rstd::vector<str::ref> m_file2_non_common_field_refs_storage;
   };
 
   // The record callback for inserting into the consistent hash table.
   struct consistent_hash_table_insert_record_callback {
-    explicit consistent_hash_table_insert_record_callback(
-              consistent_hash_table<record, consistent_hash_function> &cht) : m_cht(cht) {}
+    consistent_hash_table_insert_record_callback(
+              consistent_hash_table<record_ref, consistent_hash_function> &cht, record_arena &arena)
+      : m_cht(cht), m_arena(arena) {}
      
     bool operator()(const record_ref &r) const {
-      m_cht.insert_allow_duplicates(record(r));    
+      m_cht.insert_allow_duplicates(m_arena.copy(r));    
       return true;
     }
     
-    consistent_hash_table<record, consistent_hash_function> &m_cht;
+    consistent_hash_table<record_ref, consistent_hash_function> &m_cht;
+    record_arena &m_arena;
   };
 };
 
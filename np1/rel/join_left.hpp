@@ -6,8 +6,12 @@
 
 #include "np1/io/mandatory_record_input_stream.hpp"
 #include "np1/io/gzfile.hpp"
+#include "np1/io/mandatory_record_reader.hpp"
 #include "np1/consistent_hash_table.hpp"
 #include "np1/rel/detail/join_helper.hpp"
+#include "np1/rel/detail/hash_join.hpp"
+#include "np1/rel/detail/record_index.hpp"
+#include "np1/rel/detail/merge_join.hpp"
 
 
 namespace np1 {
@@ -41,96 +45,60 @@ public:
     detail::join_helper::find_common_and_non_common_headings(
       file1_headers, file2_headers, common_heading_names, file2_non_common_field_numbers);
 
-    // Now read file2 into memory.
-    detail::compare_specs compare_specs2(file2_headers, common_heading_names);
-    detail::record_multihashmap<detail::join_helper::empty_type> map2(compare_specs2);
-    file2_stream.parse_records(detail::join_helper::insert_record_callback(map2));
-    
-    // Close file2 'cause it might be using a big buffer and we can use all the RAM we can lay our mitts on.
-    file2.close();
-        
-    // Set up the compare specs for file1.
-    detail::compare_specs compare_specs1(file1_headers, common_heading_names);
-    
-    // Check that the join participants are all data types we support.
-    detail::join_helper::validate_compare_specs(compare_specs1);
-    detail::join_helper::validate_compare_specs(compare_specs2);
+    // If both inputs are sorted on the common headings then we can just merge them.
+    rstd::vector<rstd::string> merge_heading_names;
+    if (detail::merge_join::get_merge_heading_names(
+          file1_headers, file2_headers, common_heading_names, merge_heading_names)) {
+      merge(input, output, file2, file1_headers, file2_headers, merge_heading_names, file2_non_common_field_numbers);
+      return;
+    }
+
+    // Use file2's index if it has one on the common headings.
+    detail::record_index index2;
+    detail::compare_specs compare_specs1;
+    detail::compare_specs compare_specs2;
+    bool is_indexed = detail::hash_join::open_index(
+      file_name2, file1_headers, file2_headers, common_heading_names, index2, compare_specs1, compare_specs2);
 
-    rstd::vector<str::ref> file2_non_common_field_refs_storage;
-                      
     // Write out the headings.
-    detail::join_helper::record_merge_write(
-      output, file1_headers.ref(), file2_headers.ref(), file2_non_common_field_numbers,
-      file2_non_common_field_refs_storage);
-    
-    // Now read in file1 and merge as we go.
-    input.parse_records(
-      left_merge_record_callback<Output_Stream>(
-        output, map2, compare_specs1, file2_non_common_field_numbers,
-        make_record_with_empty_fields(file2_headers.ref()))); 
+    detail::join_helper::record_merge_write_headings(
+      output, file1_headers, file2_headers, file2_non_common_field_numbers);
+
+    // Now read file2 into memory (or as much of it as will fit) and read in file1 and merge as we go.
+    record empty_r2(detail::join_helper::make_record_with_empty_fields(file2_headers.ref()));
+    detail::hash_join::joiner joiner(
+      detail::join_helper::LEFT, compare_specs1, compare_specs2, file2_non_common_field_numbers, &empty_r2);
+    if (is_indexed) {
+      joiner.join_index(input, index2, output);
+      return;
+    }
+
+    joiner(input, file2_stream, output);
   }
 
 private:
-  // The record callback for when we're merging the file1 stream with 
-  // file2 (in memory) as part of a left join.
-  template <typename Output>
-  struct left_merge_record_callback {
-    left_merge_record_callback(
-        Output &output, detail::record_multihashmap<detail::join_helper::empty_type> &map2,
-        const detail::compare_specs &specs1,
-        const rstd::vector<size_t> &file2_non_common_field_numbers,
-        const record &empty_r2)
-    : m_output(output)
-    , m_map2(map2)
-    , m_specs1(specs1)
-    , m_file2_non_common_field_numbers(file2_non_common_field_numbers)
-    , m_empty_r2(empty_r2) {}
-    
-    // The record_ref we get here is from file1.
-    bool operator()(const record_ref &ref1) {
-      bool found = false;
-      bool ok = m_map2.for_each(
-                  detail::join_helper::matching_record_callback<Output>(
-                    m_output, m_file2_non_common_field_numbers, m_file2_non_common_field_refs_storage, ref1, found),
-                  ref1,
-                  m_specs1);
-
-      if (!ok) {
-        return false;
-      }
-  
-      if (!found) {
-        detail::join_helper::record_merge_write(
-          m_output, ref1, m_empty_r2.ref(), m_file2_non_common_field_numbers, m_file2_non_common_field_refs_storage);
-      }
+  // Join two inputs that are both sorted on the merge headings.
+  template <typename Input_Stream, typename Output_Stream>
+  void merge(Input_Stream &input, Output_Stream &output, io::gzfile &file2,
+             const record &file1_headers, const record &file2_headers,
+             const rstd::vector<rstd::string> &merge_heading_names,
+             const rstd::vector<size_t> &file2_non_common_field_numbers) {
+    detail::compare_specs compare_specs1(file1_headers, merge_heading_names);
+    detail::compare_specs compare_specs2(file2_headers, merge_heading_names);
+    detail::join_helper::validate_compare_specs(compare_specs1);
+    detail::join_helper::validate_compare_specs(compare_specs2);
+    record empty_r2(detail::join_helper::make_record_with_empty_fields(file2_headers.ref()));
 
-      return true;
-    }
-    
-    Output &m_output;
-    detail::record_multihashmap<detail::join_helper::empty_type> &m_map2;
-    detail::compare_specs m_specs1;
-    rstd::vector<size_t> m_file2_non_common_field_numbers;
-    rstd::vector<str::ref> m_file2_non_common_field_refs_storage;
-    record m_empty_r2;
-  };
-
-  // Make a record that contains only empty fields, using the supplied headings
-  // to figure out what "empty" is.
-  record make_record_with_empty_fields(const record_ref &headings) {
-    rstd::vector<rstd::string> empty_fields;
-
-    size_t field_id;
-    size_t number_fields = headings.number_fields();
-    for (field_id = 0; field_id < number_fields; ++field_id) {
-      str::ref heading = headings.mandatory_field(field_id);
-      str::ref empty_field = 
-        rlang::dt::empty_value(rlang::dt::mandatory_from_string(
-                                  detail::helper::mandatory_get_heading_type_tag(heading)));
-      empty_fields.push_back(empty_field.to_string());
-    }
+    detail::join_helper::record_merge_write_headings(
+      output, file1_headers, file2_headers, file2_non_common_field_numbers);
 
-    return record(empty_fields, 0);
+    typedef io::mandatory_record_reader<io::gzfile, record_ref> file2_reader_type;
+    file2_reader_type file2_reader(file2);
+    input.parse_records(
+      detail::merge_join::record_callback<Output_Stream, file2_reader_type>(
+        output, file2_reader, compare_specs1, compare_specs2,
+        detail::sort_order::from_headings(file1_headers.ref()).is_descending(), detail::join_helper::LEFT,
+        file2_non_common_field_numbers, &empty_r2));
   }
 };
 
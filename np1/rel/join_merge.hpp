@@ -0,0 +1,91 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_JOIN_MERGE_HPP
+#define NP1_REL_JOIN_MERGE_HPP
+
+
+#include "np1/io/mandatory_record_input_stream.hpp"
+#include "np1/io/gzfile.hpp"
+#include "np1/io/mandatory_record_reader.hpp"
+#include "np1/rel/detail/join_helper.hpp"
+#include "np1/rel/detail/merge_join.hpp"
+
+
+namespace np1 {
+namespace rel {
+
+/// Join an input and a file that are both sorted on the common headings, without reading either into memory.
+/// If they both remember the same sort order then that's used, otherwise they must be sorted ascending on the
+/// common headings in the order that the headings appear in the input.  Records that are out of order are an
+/// error.
+class join_merge {
+public:
+  template <typename Input_Stream, typename Output_Stream>
+  void operator()(Input_Stream &input, Output_Stream &output,
+                  const rstd::vector<rel::rlang::token> &tokens, detail::join_helper::join_type type) {
+    /* Get the arguments. */
+    rstd::string file_name2(rel::rlang::compiler::eval_to_string_only(tokens));
+
+    /* Get the list of headers from the first file. */
+    record file1_headers(input.parse_headings());
+
+    /* Get the list of headers from the second file. */
+    io::gzfile file2;
+    if (!file2.open_ro(file_name2.c_str())) {
+      NP1_ASSERT(false, "Unable to open input file " + file_name2);
+    }
+
+    io::mandatory_record_input_stream<io::gzfile, record, record_ref> file2_stream(file2);
+    record file2_headers(file2_stream.parse_headings());
+
+    /* Figure out which headings are common and not common. */
+    rstd::vector<rstd::string> common_heading_names;
+    rstd::vector<size_t> file2_non_common_field_numbers;
+
+    detail::join_helper::find_common_and_non_common_headings(
+      file1_headers, file2_headers, common_heading_names, file2_non_common_field_numbers);
+
+    NP1_ASSERT(!common_heading_names.empty(), "A merge join needs at least one common heading");
+
+    // Figure out the order that both inputs are sorted in.
+    rstd::vector<rstd::string> merge_heading_names;
+    bool is_descending = false;
+    if (detail::merge_join::get_merge_heading_names(
+          file1_headers, file2_headers, common_heading_names, merge_heading_names)) {
+      is_descending = detail::sort_order::from_headings(file1_headers.ref()).is_descending();
+    } else {
+      merge_heading_names = common_heading_names;
+    }
+
+    // Set up the compare specs.
+    detail::compare_specs compare_specs1(file1_headers, merge_heading_names);
+    detail::compare_specs compare_specs2(file2_headers, merge_heading_names);
+
+    // Check that the join participants are all data types we support.
+    detail::join_helper::validate_compare_specs(compare_specs1);
+    detail::join_helper::validate_compare_specs(compare_specs2);
+
+    // Write out the headings.
+    if (detail::join_helper::ANTI == type) {
+      file1_headers.write(output);
+    } else {
+      detail::join_helper::record_merge_write_headings(
+        output, file1_headers, file2_headers, file2_non_common_field_numbers);
+    }
+
+    // Now merge, reading just one run of equal records from file2 at a time.
+    record empty_r2(detail::join_helper::make_record_with_empty_fields(file2_headers.ref()));
+    typedef io::mandatory_record_reader<io::gzfile, record_ref> file2_reader_type;
+    file2_reader_type file2_reader(file2);
+    input.parse_records(
+      detail::merge_join::record_callback<Output_Stream, file2_reader_type>(
+        output, file2_reader, compare_specs1, compare_specs2, is_descending, type,
+        file2_non_common_field_numbers, &empty_r2));
+  }
+};
+
+} // namespaces
+}
+
+
+#endif
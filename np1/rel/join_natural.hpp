@@ -6,8 +6,12 @@
 
 #include "np1/io/mandatory_record_input_stream.hpp"
 #include "np1/io/gzfile.hpp"
+#include "np1/io/mandatory_record_reader.hpp"
 #include "np1/consistent_hash_table.hpp"
 #include "np1/rel/detail/join_helper.hpp"
+#include "np1/rel/detail/hash_join.hpp"
+#include "np1/rel/detail/record_index.hpp"
+#include "np1/rel/detail/merge_join.hpp"
 
 
 namespace np1 {
@@ -15,6 +19,10 @@ namespace rel {
 
 
 class join_natural {
+public:
+  // The input is read into memory instead of file2 only when it's at most 1/BUILD_SIDE_SIZE_RATIO of file2's size.
+  enum { BUILD_SIDE_SIZE_RATIO = 4 };
+
 public:
   template <typename Input_Stream, typename Output_Stream>
   void operator()(Input_Stream &input, Output_Stream &output,
@@ -41,63 +49,74 @@ public:
     detail::join_helper::find_common_and_non_common_headings(
       file1_headers, file2_headers, common_heading_names, file2_non_common_field_numbers);
 
-    // Now read file2 into memory.
-    detail::compare_specs compare_specs2(file2_headers, common_heading_names);
-    detail::record_multihashmap<detail::join_helper::empty_type> map2(compare_specs2);
-    file2_stream.parse_records(detail::join_helper::insert_record_callback(map2));
-    
-    // Close file2 'cause it might be using a big buffer and we can use all the RAM we can lay our mitts on.
-    file2.close();
-        
-    // Set up the compare specs for file1.
-    detail::compare_specs compare_specs1(file1_headers, common_heading_names);
-
-    // Check that the join participants are all data types we support.
+    // If both inputs are sorted on the common headings then we can just merge them.
+    rstd::vector<rstd::string> merge_heading_names;
+    if (detail::merge_join::get_merge_heading_names(
+          file1_headers, file2_headers, common_heading_names, merge_heading_names)) {
+      merge(input, output, file2, file1_headers, file2_headers, merge_heading_names, file2_non_common_field_numbers);
+      return;
+    }
+
+    // Use file2's index if it has one on the common headings.
+    detail::record_index index2;
+    detail::compare_specs compare_specs1;
+    detail::compare_specs compare_specs2;
+    bool is_indexed = detail::hash_join::open_index(
+      file_name2, file1_headers, file2_headers, common_heading_names, index2, compare_specs1, compare_specs2);
+
+    // Now read file2 into memory (or as much of it as will fit) and read in file1 and merge as we go.  But if
+    // file1 turns out to be much smaller than file2 then it's file1 that's read into memory.
+    detail::hash_join::joiner joiner(
+      detail::join_helper::NATURAL, compare_specs1, compare_specs2, file2_non_common_field_numbers, NULL);
+    if (is_indexed) {
+      detail::join_helper::record_merge_write_headings(
+        output, file1_headers, file2_headers, file2_non_common_field_numbers);
+      joiner.join_index(input, index2, output);
+      return;
+    }
+
+    uint64_t file2_size = 0;
+    io::file::get_size(file_name2.c_str(), file2_size);
+    uint64_t max_input_size = file2_size/BUILD_SIDE_SIZE_RATIO;
+    if (max_input_size > environment::max_hash_table_memory()) {
+      max_input_size = environment::max_hash_table_memory();
+    }
+
+    if (max_input_size > 0) {
+      // The joiner writes the headings because the output's order isn't known until it's seen file1.
+      joiner(input, file2_stream, output, max_input_size,
+             detail::join_helper::make_merged_headings(file1_headers, file2_headers, file2_non_common_field_numbers),
+             detail::sort_order::from_headings(file1_headers.ref()));
+    } else {
+      detail::join_helper::record_merge_write_headings(
+        output, file1_headers, file2_headers, file2_non_common_field_numbers);
+      joiner(input, file2_stream, output);
+    }
+  }
+
+private:
+  // Join two inputs that are both sorted on the merge headings.
+  template <typename Input_Stream, typename Output_Stream>
+  void merge(Input_Stream &input, Output_Stream &output, io::gzfile &file2,
+             const record &file1_headers, const record &file2_headers,
+             const rstd::vector<rstd::string> &merge_heading_names,
+             const rstd::vector<size_t> &file2_non_common_field_numbers) {
+    detail::compare_specs compare_specs1(file1_headers, merge_heading_names);
+    detail::compare_specs compare_specs2(file2_headers, merge_heading_names);
     detail::join_helper::validate_compare_specs(compare_specs1);
     detail::join_helper::validate_compare_specs(compare_specs2);
 
-    rstd::vector<str::ref> file2_non_common_field_refs_storage;
-                      
-    // Write out the headings.
-    detail::join_helper::record_merge_write(
-      output, file1_headers.ref(), file2_headers.ref(), file2_non_common_field_numbers,
-      file2_non_common_field_refs_storage);
-    
-    // Now read in file1 and merge as we go.
+    detail::join_helper::record_merge_write_headings(
+      output, file1_headers, file2_headers, file2_non_common_field_numbers);
+
+    typedef io::mandatory_record_reader<io::gzfile, record_ref> file2_reader_type;
+    file2_reader_type file2_reader(file2);
     input.parse_records(
-      natural_merge_record_callback<Output_Stream>(output, map2, compare_specs1, file2_non_common_field_numbers));
+      detail::merge_join::record_callback<Output_Stream, file2_reader_type>(
+        output, file2_reader, compare_specs1, compare_specs2,
+        detail::sort_order::from_headings(file1_headers.ref()).is_descending(), detail::join_helper::NATURAL,
+        file2_non_common_field_numbers, NULL));
   }
-
-private:  
-  // The record callback for when we're merging the file1 stream with 
-  // file2 (in memory) as part of a natural join.
-  template <typename Output>
-  struct natural_merge_record_callback {
-    natural_merge_record_callback(
-        Output &output, detail::record_multihashmap<detail::join_helper::empty_type> &map2,
-        const detail::compare_specs &specs1,
-        const rstd::vector<size_t> &file2_non_common_field_numbers)
-    : m_output(output)
-    , m_map2(map2)
-    , m_specs1(specs1)
-    , m_file2_non_common_field_numbers(file2_non_common_field_numbers) {}
-    
-    // The record_ref we get here is from file1.
-    bool operator()(const record_ref &ref1) {
-      bool unused = false;
-      return m_map2.for_each(
-              detail::join_helper::matching_record_callback<Output>(
-                  m_output, m_file2_non_common_field_numbers, m_file2_non_common_field_refs_storage, ref1, unused),
-              ref1,
-              m_specs1);       
-    }
-    
-    Output &m_output;
-    detail::record_multihashmap<detail::join_helper::empty_type> &m_map2;
-    detail::compare_specs m_specs1;
-    rstd::vector<size_t> m_file2_non_common_field_numbers;
-    rstd::vector<str::ref> m_file2_non_common_field_refs_storage;
-  };
 };
 
 } // namespaces
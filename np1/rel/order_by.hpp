@@ -7,6 +7,7 @@
 #include "np1/rel/detail/quick_sort.hpp"
 #include "np1/rel/detail/merge_sort.hpp"
 #include "np1/rel/detail/sort_manager.hpp"
+#include "np1/rel/detail/sort_order.hpp"
 #include "np1/rel/rlang/rlang.hpp"
 
 namespace np1 {
@@ -37,8 +38,9 @@ public:
     // Create the compare specs.
     detail::compare_specs comp_specs(headings, arg_headings);
 
-    // Write out the headings then do the actual sorting.
-    headings.write(output);
+    // Write out the headings, noting the new order for the benefit of downstream operators, then do the actual
+    // sorting.
+    detail::sort_order(comp_specs, ORDER_DESCENDING == sort_order).write_headings(output, headings.ref());
 
     detail::compare_specs_less_than_sort_operator lt(comp_specs);
     detail::compare_specs_greater_than_sort_operator gt(comp_specs);
@@ -0,0 +1,174 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_RECORD_ARENA_HPP
+#define NP1_REL_RECORD_ARENA_HPP
+
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "rstd/vector.hpp"
+#include "np1/rel/record_ref.hpp"
+#include "np1/environment.hpp"
+
+
+namespace np1 {
+namespace rel {
+
+/// Somewhere to keep lots of copies of records.  Record bytes are bump-allocated from big chunks and all freed
+/// together when the arena is cleared or destroyed, so there's no per-record malloc and no fragmentation.  The
+/// copies are handed out as record_refs which stay valid until the arena is cleared or reset.
+class record_arena {
+public:
+  enum {
+    INITIAL_CHUNK_SIZE = 64 * 1024,
+    MAX_CHUNK_SIZE = 32 * 1024 * 1024,
+
+    // Chunks at least this big are aligned so that the kernel can back them with huge pages.
+    HUGE_PAGE_SIZE = 2 * 1024 * 1024
+  };
+
+public:
+  record_arena()
+    : m_use_huge_pages(environment::record_arena_huge_pages()), m_next_chunk_size(INITIAL_CHUNK_SIZE),
+      m_unused_p(NULL), m_chunk_end(NULL), m_allocated_size(0) {}
+
+  ~record_arena() { clear(); }
+
+  /// Allocate some bytes.  They will be freed when the arena is.
+  unsigned char *alloc(size_t size) {
+    if ((size_t)(m_chunk_end - m_unused_p) < size) {
+      add_chunk(size);
+    }
+
+    unsigned char *p = m_unused_p;
+    m_unused_p += size;
+    return p;
+  }
+
+  /// Copy a record into the arena.
+  record_ref copy(const record_ref &r) {
+    size_t size = r.byte_size();
+    unsigned char *p = alloc(size);
+    memcpy(p, r.start(), size);
+    return record_ref(p, p + size, r.record_number());
+  }
+
+  /// Replace target, which must be in this arena, with a copy of source.  target_capacity is the number of bytes
+  /// available at target's start.  If source fits then it's copied over the top of target, otherwise a new copy
+  /// is made and target_capacity is updated.  This stops records that are replaced over and over from eating the
+  /// arena.
+  void reassign(record_ref &target, size_t &target_capacity, const record_ref &source) {
+    size_t size = source.byte_size();
+    if (size > target_capacity) {
+      target = copy(source);
+      target_capacity = size;
+      return;
+    }
+
+    unsigned char *p = (unsigned char *)target.start();
+    memcpy(p, source.start(), size);
+    target = record_ref(p, p + size, source.record_number());
+  }
+
+  /// Free everything.
+  void clear() {
+    rstd::vector<unsigned char *>::iterator chunk_i = m_chunks.begin();
+    rstd::vector<unsigned char *>::iterator chunk_iz = m_chunks.end();
+    for (; chunk_i != chunk_iz; ++chunk_i) {
+      rstd::detail::mem::free(*chunk_i);
+    }
+
+    m_chunks.clear();
+    m_next_chunk_size = INITIAL_CHUNK_SIZE;
+    m_unused_p = m_chunk_end = NULL;
+    m_allocated_size = 0;
+  }
+
+  /// Forget about everything in the arena but hang on to the newest (and usually biggest) chunk for reuse.  This
+  /// is for callers that use the arena for a short while, over and over.
+  void reset() {
+    if (m_chunks.size() > 1) {
+      unsigned char *last_chunk = m_chunks.back();
+      m_chunks.pop_back();
+      size_t last_chunk_size = m_chunk_end - last_chunk;
+      clear();
+      m_chunks.push_back(last_chunk);
+      m_chunk_end = last_chunk + last_chunk_size;
+      m_next_chunk_size = last_chunk_size;
+      m_allocated_size = last_chunk_size;
+    }
+
+    if (!m_chunks.empty()) {
+      m_unused_p = m_chunks.back();
+    }
+  }
+
+  void swap(record_arena &other) {
+    m_chunks.swap(other.m_chunks);
+    rstd::swap(m_next_chunk_size, other.m_next_chunk_size);
+    rstd::swap(m_unused_p, other.m_unused_p);
+    rstd::swap(m_chunk_end, other.m_chunk_end);
+    rstd::swap(m_allocated_size, other.m_allocated_size);
+  }
+
+  /// The total size of all the chunks.
+  size_t allocated_size() const { return m_allocated_size; }
+
+  /// The number of bytes that have been handed out, including any that were skipped at the ends of chunks.
+  size_t used_size() const { return m_allocated_size - (m_chunk_end - m_unused_p); }
+
+private:
+  /// Disable copy.
+  record_arena(const record_arena &);
+  record_arena &operator = (const record_arena &);
+
+private:
+  void add_chunk(size_t size_requirement) {
+    size_t chunk_size = m_next_chunk_size;
+    if (chunk_size < size_requirement) {
+      chunk_size = size_requirement;
+    }
+
+    unsigned char *chunk = NULL;
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+    if (m_use_huge_pages && (chunk_size >= HUGE_PAGE_SIZE)) {
+      chunk_size = ((chunk_size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+      void *p = NULL;
+      NP1_ASSERT(posix_memalign(&p, HUGE_PAGE_SIZE, chunk_size) == 0, "Out of memory");
+      // This is just a hint so we don't care if it fails.
+      madvise(p, chunk_size, MADV_HUGEPAGE);
+      chunk = (unsigned char *)p;
+    }
+#endif
+
+    if (!chunk) {
+      chunk = (unsigned char *)rstd::detail::mem::alloc(chunk_size);
+    }
+
+    m_chunks.push_back(chunk);
+    m_unused_p = chunk;
+    m_chunk_end = chunk + chunk_size;
+    m_allocated_size += chunk_size;
+
+    if (m_next_chunk_size < MAX_CHUNK_SIZE) {
+      m_next_chunk_size *= 2;
+    }
+  }
+
+private:
+  bool m_use_huge_pages;
+  rstd::vector<unsigned char *> m_chunks;
+  size_t m_next_chunk_size;
+  unsigned char *m_unused_p;
+  unsigned char *m_chunk_end;
+  size_t m_allocated_size;
+};
+
+
+} // namespaces
+}
+
+
+#endif
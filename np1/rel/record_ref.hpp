@@ -140,6 +140,29 @@ public:
   }
   
   
+  /// Call callback(field) for every field in order.  This decodes each field length just once so it's much
+  /// quicker than calling field() for every field number.
+  template <typename Callback>
+  void for_each_field(Callback &callback) const {
+    if (!m_start) {
+      return;
+    }
+
+    prelude prel;
+    const unsigned char *start_field_length = mandatory_read_prelude(prel);
+    const unsigned char *fields_end = m_end - postlude_size();
+    size_t field_counter;
+    for (field_counter = 0; field_counter < prel.number_fields; ++field_counter) {
+      NP1_ASSERT(start_field_length < fields_end,
+                  "Field lengths extend beyond end of record " + str::to_dec_str(m_record_number));
+      size_t field_size = 0;
+      const unsigned char *start_field = mandatory_decompress_size(start_field_length, fields_end, field_size);
+      callback(str::ref((const char *)start_field, field_size));
+      start_field_length = start_field + field_size;
+    }
+  }
+
+
   /// Find a field, crash on error.
   str::ref mandatory_field(size_t field_number) const {
     str::ref f = field(field_number);
@@ -349,6 +372,15 @@ public:
   }
 
   
+  /// Write this record to the output stream, replacing the checksum in the postlude.  Readers ignore the
+  /// checksum so heading records use it to carry stream metadata, see detail::sort_order.
+  template <typename Mandatory_Output_Stream>
+  void write_with_checksum(Mandatory_Output_Stream &mos, uint64_t checksum) const {
+    NP1_ASSERT(byte_size() >= postlude_size(), "Record is missing postlude");
+    mos.write(m_start, byte_size() - postlude_size());
+    mos.write((unsigned char *)&checksum, sizeof(checksum));
+  }
+
   /// Write a record to the output stream, constructing it on the fly.
   template <typename Mandatory_Output_Stream>
   static void write(Mandatory_Output_Stream &mos, int argc, const char **argv) {
@@ -446,6 +478,16 @@ public:
     return (memcmp(m_start, other.m_start, sz) == 0);
   }
 
+  /// Like is_equal but doesn't include the checksum.
+  bool is_equal_ignoring_checksum(const record_ref &other) const {
+    size_t sz = byte_size();
+    if ((sz != other.byte_size()) || (sz < postlude_size())) {
+      return is_equal(other);
+    }
+
+    return (memcmp(m_start, other.m_start, sz - postlude_size()) == 0);
+  }
+
 private:
   // The record prelude- a headerette for a single record.
   struct prelude {
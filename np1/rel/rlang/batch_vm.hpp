@@ -0,0 +1,164 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_RLANG_BATCH_VM_HPP
+#define NP1_REL_RLANG_BATCH_VM_HPP
+
+#include <string.h>
+#include "np1/rel/rlang/vm.hpp"
+#include "np1/rel/rlang/vm_batch_stack.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace rlang {
+
+/// Runs the code from a vm over a batch of records at once.  Each function is called once per batch and loops
+/// over all the records, so the dispatch overhead is shared between the records and the inner loops are tight.
+/**
+ * Not every expression can be run this way.  Branches can't, so "if" is out.  "&&" and "||" are run by
+ * evaluating both sides for every record and then combining them, which is only allowed when the right-hand
+ * side can't fail or have side effects when the left-hand side would have skipped it.  Expressions that refer
+ * to the "other" record are out too.  Check is_runnable() and fall back to the vm when it's false.
+ *
+ * Common subexpressions are just worked out again rather than being kept in slots.
+ */
+class batch_vm {
+public:
+  enum { MAX_BATCH_SIZE = vm_batch_stack::MAX_BATCH_SIZE };
+
+public:
+  explicit batch_vm(const vm &v)
+    : m_literals(v.literals()), m_return_type(v.return_type()), m_is_runnable(false) {
+    m_is_runnable = !v.refers_to_other_record() && translate(v.function_calls());
+  }
+
+  bool is_runnable() const { return m_is_runnable; }
+
+  dt::data_type return_type() const { return m_return_type; }
+
+  /// Run over number_records records, which must be no more than MAX_BATCH_SIZE.  The result is in
+  /// column(0) of the returned stack, valid only until the next run or heap reset.
+  vm_batch_stack &run(vm_heap &heap, const record_ref *this_rs, size_t number_records) {
+    NP1_ASSERT(m_is_runnable, "Attempt to run an expression over a batch when that's not supported");
+    NP1_ASSERT(number_records <= MAX_BATCH_SIZE, "Batch is too big");
+    m_stack.reset();
+
+    const vm_function_call *i = m_function_calls.begin();
+    const vm_function_call *iz = m_function_calls.end();
+    for (; i < iz; ++i) {
+      NP1_REL_RLANG_FN_TABLE_BATCH_CALL(i->id(), m_stack, heap, m_literals, this_rs, number_records, i->data());
+    }
+
+    return m_stack;
+  }
+
+private:
+  struct pending_logical_op {
+    pending_logical_op() : m_end(0), m_id(0) {}
+    pending_logical_op(size_t end, size_t id) : m_end(end), m_id(id) {}
+    size_t m_end;
+    size_t m_id;
+  };
+
+  // Build the batch code from the vm's code.  Returns false if the code can't be run over a batch.
+  bool translate(const vm_function_call_list<vm::MAX_NUMBER_FUNCTION_CALLS> &calls) {
+    // The last call is the vm's "stop" call.
+    if (calls.size() < 2) {
+      return false;
+    }
+
+    const size_t and_then_id = fn::fn_table::find_and_then();
+    const size_t or_else_id = fn::fn_table::find_or_else();
+    const size_t logical_and_id = fn::fn_table::find_logical_and();
+    const size_t logical_or_id = fn::fn_table::find_logical_or();
+    const size_t load_slot_ids[] = {
+      fn::fn_table::find_load_slot(dt::TYPE_INT), fn::fn_table::find_load_slot(dt::TYPE_STRING) };
+    const size_t store_slot_ids[] = {
+      fn::fn_table::find_store_slot(dt::TYPE_INT), fn::fn_table::find_store_slot(dt::TYPE_STRING) };
+
+    rstd::vector<pending_logical_op> pending;
+    size_t depth = 0;
+    size_t number_calls = calls.size() - 1;
+    size_t offset;
+    for (offset = 0; offset <= number_calls; ++offset) {
+      // Combine the sides of any short-circuit operators whose right-hand sides end here.
+      while (!pending.empty() && (pending.back().m_end == offset)) {
+        if (depth < 2) {
+          return false;
+        }
+
+        m_function_calls.push_back(vm_function_call(pending.back().m_id, 0));
+        --depth;
+        pending.pop_back();
+      }
+
+      if (offset == number_calls) {
+        break;
+      }
+
+      const vm_function_call &call = calls[offset];
+      if ((call.id() == and_then_id) || (call.id() == or_else_id)) {
+        pending.push_back(
+          pending_logical_op(offset + call.data(), (call.id() == and_then_id) ? logical_and_id : logical_or_id));
+        continue;
+      }
+
+      if ((call.id() == load_slot_ids[0]) || (call.id() == load_slot_ids[1])
+          || (call.id() == store_slot_ids[0]) || (call.id() == store_slot_ids[1])) {
+        continue;
+      }
+
+      const fn::fn_table::fn_info info = fn::fn_table::get_info(call.id());
+      if (!is_batchable(info, !pending.empty())) {
+        return false;
+      }
+
+      if (depth < info.number_arguments()) {
+        return false;
+      }
+
+      depth = depth - info.number_arguments() + 1;
+      if (depth > vm_batch_stack::MAX_DEPTH) {
+        return false;
+      }
+
+      m_function_calls.push_back(call);
+    }
+
+    return pending.empty() && (1 == depth);
+  }
+
+  static bool is_batchable(const fn::fn_table::fn_info &info, bool is_conditional) {
+    if (info.is_push_literal() || info.is_push_this()) {
+      return true;
+    }
+
+    if (!info.is_batchable() || !info.is_deterministic()) {
+      return false;
+    }
+
+    // Code on the right-hand side of a short-circuit operator is run even when the vm would have skipped it, so
+    // stick to operators that can't fail.
+    if (is_conditional) {
+      return info.is_operator() && (strcmp(info.name(), "/") != 0) && (strcmp(info.name(), "%") != 0);
+    }
+
+    return true;
+  }
+
+private:
+  vm_literals m_literals;
+  vm_function_call_list<vm::MAX_NUMBER_FUNCTION_CALLS> m_function_calls;
+  vm_batch_stack m_stack;
+  dt::data_type m_return_type;
+  bool m_is_runnable;
+};
+
+
+} // namespaces
+}
+}
+
+
+
+#endif
@@ -7,6 +7,7 @@
 #include "np1/rel/rlang/vm.hpp"
 #include "np1/rel/record.hpp"
 #include "rstd/pair.hpp"
+#include "rstd/swap.hpp"
 
 namespace np1 {
 namespace rel {
@@ -570,6 +571,21 @@ private:
 
 
 
+  // Where the right-hand sides of the '&&'s and '||'s are in the postfix tokens.  Calls on a right-hand side are
+  // only folded if the vm is sure to run them, ie the left-hand side is the literal that doesn't skip them.
+  struct short_circuits {
+    // For each token, the offset of the innermost '&&' or '||' whose right-hand side it's in, or -1.
+    rstd::vector<size_t> m_enclosing;
+    // For each '&&' and '||' token, the offset of the first token of its right-hand side.
+    rstd::vector<size_t> m_right_starts;
+    // For each '&&' and '||' token, true if its right-hand side is sure to be run, once it's been started.
+    rstd::vector<bool> m_is_always_run;
+
+    bool is_foldable(size_t offset) const {
+      return ((size_t)-1 == m_enclosing[offset]) || m_is_always_run[m_enclosing[offset]];
+    }
+  };
+
    // Compile a single expression from a collection of tokens.
   static vm do_compile_single_expression(const rstd::vector<token> &source,
                                           const record_ref &this_headings,
@@ -590,11 +606,15 @@ private:
     vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> function_calls;
     vm_literals literals;
     bool refers_to_other_record = false;
+    short_circuits circuits;
+    find_short_circuits(parsed_tokens, circuits);
     rstd::vector<shunting_yard::parsed_token_info>::const_iterator i = parsed_tokens.begin();
     rstd::vector<shunting_yard::parsed_token_info>::const_iterator iz = parsed_tokens.end();
     do_compile_single_expression(
-      i, iz, this_headings, other_headings, sim_stack, function_calls, literals, refers_to_other_record);
+      i, iz, this_headings, other_headings, sim_stack, function_calls, literals, refers_to_other_record, false,
+      parsed_tokens.begin(), circuits);
 
+    eliminate_common_subexpressions(function_calls, literals);
     return vm(literals, function_calls, sim_stack.top(), refers_to_other_record);
   }
 
@@ -607,14 +627,40 @@ private:
                 simulated_stack &sim_stack,
                 vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> &function_calls,
                 vm_literals &literals,
-                bool &refers_to_other_record) {
+                bool &refers_to_other_record,
+                bool is_conditional,
+                rstd::vector<shunting_yard::parsed_token_info>::const_iterator parsed_tokens_begin,
+                short_circuits &circuits) {
 
     size_t sim_stack_start_size = sim_stack.size();
 
+    // The calls before this offset can't be the arguments of a call that's folded into a literal.
+    size_t fold_start_limit = function_calls.size();
+
+    // The offset of the first call for each of the values pushed at this level.
+    rstd::vector<size_t> value_starts;
+
     // Walk the list of postfix-parsed tokens and convert them into executable
     // functions.  
 
     for (; i < iz; ++i) {
+      // Check to see if this is the start of the right-hand side of any '&&'s or '||'s.  The left-hand side is
+      // the value on top of the stack.
+      size_t offset = i - parsed_tokens_begin;
+      size_t circuit_offset = circuits.m_enclosing[offset];
+      for (; ((size_t)-1 != circuit_offset) && (circuits.m_right_starts[circuit_offset] == offset);
+            circuit_offset = circuits.m_enclosing[circuit_offset]) {
+        size_t skip_id = (parsed_tokens_begin[circuit_offset].tok().first_matching_sym_op_fn_id()
+                          == (int)fn::fn_table::find_logical_and())
+                            ? fn::fn_table::find_push_literal_boolean_false()
+                            : fn::fn_table::find_push_literal_boolean_true();
+        circuits.m_is_always_run[circuit_offset] =
+          circuits.is_foldable(circuit_offset) && (function_calls.size() > fold_start_limit)
+          && !value_starts.empty() && (value_starts.back() == function_calls.size() - 1)
+          && fn::fn_table::get_info(function_calls[function_calls.size() - 1].id()).is_push_literal()
+          && (function_calls[function_calls.size() - 1].id() != skip_id);
+      }
+
       // Check to see if this is an 'if'.
       if ((i->tok().type() == token::TYPE_IDENTIFIER_FUNCTION)
           && (str::cmp(i->tok().text(), "if") == 0)) {
@@ -623,6 +669,8 @@ private:
         i->tok().assert(sim_stack.top() == dt::TYPE_BOOL, "Non-boolean argument to 'if'.");
         i->tok().assert(i->function_arg_count() == 1, "Multiple arguments supplied to 'if'.");
         sim_stack.pop();
+        size_t if_start = value_starts.back();
+        value_starts.pop_back();
 
         // Look for the matching "then" and "else" and check that they have
         // one argument each.
@@ -644,7 +692,7 @@ private:
         // Process the "then" branch.
         do_compile_single_expression(
           i+1, then_i, this_headings, other_headings, sim_stack, function_calls,
-          literals, refers_to_other_record);
+          literals, refers_to_other_record, true, parsed_tokens_begin, circuits);
 
         // Now we know how long the "then" is, we can save the offset of the "else"
         // branch into the compiled "if".  The +1 is so that it's one past the
@@ -665,7 +713,7 @@ private:
         // Processs the "else" branch.
         do_compile_single_expression(
           then_i+1, else_i, this_headings, other_headings, sim_stack, function_calls,
-          literals, refers_to_other_record);
+          literals, refers_to_other_record, true, parsed_tokens_begin, circuits);
 
         // Now we know how long the "else" is, we can fix up the compiled goto.
         function_calls[compiled_goto_offset].data(function_calls.size() - compiled_goto_offset);
@@ -674,14 +722,45 @@ private:
         else_i->tok().assert(sim_stack.top() == then_return_type,
                               "'then' and 'else' branches do not evaluate to the same type.");
         i = else_i;
+
+        // The last call in the 'else' branch might look like a literal but the value of the whole 'if' isn't.
+        fold_start_limit = function_calls.size();
+        value_starts.push_back(if_start);
       } else {
         // It's not an 'if', it's just a normal thing.
         bool temp_refers_to_other_record = false;        
+        size_t sim_stack_size_before_call = sim_stack.size();
   
-        function_calls.push_back(
+        vm_function_call call =
           create_function_call(this_headings, other_headings, i->tok(),
                                 i->function_arg_count(), sim_stack, literals,
-                                temp_refers_to_other_record));
+                                temp_refers_to_other_record);
+
+        // The call's value starts where its first argument starts.
+        size_t number_arguments = sim_stack_size_before_call + 1 - sim_stack.size();
+        size_t first_argument_start = function_calls.size();
+        size_t last_argument_start = function_calls.size();
+        if (number_arguments > 0) {
+          first_argument_start = value_starts[value_starts.size() - number_arguments];
+          last_argument_start = value_starts.back();
+          value_starts.resize(value_starts.size() - number_arguments);
+        }
+
+        value_starts.push_back(first_argument_start);
+
+        // Calls in 'then' and 'else' branches and on the right-hand side of '&&' and '||' are not folded
+        // because they might never be run, and they might not work with the arguments they've been given, eg
+        // "if (x > 0) then (1 / 0) else (x)" or "x > 0 && 1 / 0 = 1".
+        if (!is_conditional && circuits.is_foldable(offset)
+            && fold_constant_call(call, fold_start_limit, function_calls, literals)) {
+          // The call and its arguments are now a single literal push.
+        } else if ((call.id() == fn::fn_table::find_logical_and())
+                    || (call.id() == fn::fn_table::find_logical_or())) {
+          insert_short_circuit(call, last_argument_start, function_calls);
+          fold_start_limit = function_calls.size();
+        } else {
+          function_calls.push_back(call);
+        }
   
         if (temp_refers_to_other_record) {
           refers_to_other_record = true;
@@ -881,6 +960,492 @@ private:
     return vm_function_call();
   }    
 
+
+  static void find_short_circuits(const rstd::vector<shunting_yard::parsed_token_info> &parsed_tokens,
+                                  short_circuits &circuits) {
+    // The offset of the first token of each value on the simulated stack.
+    rstd::vector<size_t> value_starts;
+    size_t i;
+    for (i = 0; i < parsed_tokens.size(); ++i) {
+      circuits.m_enclosing.push_back(-1);
+      circuits.m_right_starts.push_back(-1);
+      circuits.m_is_always_run.push_back(false);
+    }
+
+    for (i = 0; i < parsed_tokens.size(); ++i) {
+      const shunting_yard::parsed_token_info &info = parsed_tokens[i];
+      size_t number_arguments = 0;
+      if ((token::TYPE_IDENTIFIER_FUNCTION == info.type()) || (token::TYPE_OPERATOR == info.type())) {
+        number_arguments = info.function_arg_count();
+      }
+
+      // The 'if', 'then' and 'else' are three values until the 'else' makes them one.
+      if ((token::TYPE_IDENTIFIER_FUNCTION == info.type()) && (str::cmp(info.text(), "else") == 0)) {
+        number_arguments = 3;
+      }
+
+      // A malformed expression is reported when it's compiled.
+      if (number_arguments > value_starts.size()) {
+        return;
+      }
+
+      if (is_short_circuit(info)) {
+        circuits.m_right_starts[i] = value_starts.back();
+
+        // Inner right-hand sides have already been marked.
+        size_t j;
+        for (j = value_starts.back(); j < i; ++j) {
+          if ((size_t)-1 == circuits.m_enclosing[j]) {
+            circuits.m_enclosing[j] = i;
+          }
+        }
+      }
+
+      size_t start = i;
+      if (number_arguments > 0) {
+        start = value_starts[value_starts.size() - number_arguments];
+        value_starts.resize(value_starts.size() - number_arguments);
+      }
+
+      value_starts.push_back(start);
+    }
+  }
+
+  static bool is_short_circuit(const shunting_yard::parsed_token_info &info) {
+    return (token::TYPE_OPERATOR == info.type())
+            && ((info.tok().first_matching_sym_op_fn_id() == (int)fn::fn_table::find_logical_and())
+                || (info.tok().first_matching_sym_op_fn_id() == (int)fn::fn_table::find_logical_or()));
+  }
+
+
+  // "left right &&" becomes "left and_then right" where and_then jumps past the right side if the left side
+  // is false, and likewise for ||.
+  static void insert_short_circuit(const vm_function_call &call, size_t right_start,
+                                    vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> &function_calls) {
+    size_t branch_id = (call.id() == fn::fn_table::find_logical_and())
+                          ? fn::fn_table::find_and_then() : fn::fn_table::find_or_else();
+
+    // The offset is relative to the branch and goes to one past the end of the right side.
+    function_calls.insert(right_start, vm_function_call(branch_id, function_calls.size() + 1 - right_start));
+  }
+
+
+  // A value on the simulated stack while looking for common subexpressions.
+  struct cse_value {
+    cse_value() : m_start(0), m_is_pure(false) {}
+    cse_value(size_t start, bool is_pure) : m_start(start), m_is_pure(is_pure) {}
+    size_t m_start;
+    bool m_is_pure;
+  };
+
+  // A branch whose value is complete at m_end and starts at m_start.
+  struct cse_pending_branch {
+    cse_pending_branch() : m_end(0), m_start(0) {}
+    cse_pending_branch(size_t end, size_t start) : m_end(end), m_start(start) {}
+    size_t m_end;
+    size_t m_start;
+  };
+
+  // One place where a pure subexpression is worked out: the calls from m_start up to but not including m_end.
+  struct cse_occurrence {
+    cse_occurrence() : m_start(0), m_end(0), m_type(dt::TYPE_INT), m_group(0), m_slot(-1), m_is_first(false) {}
+    cse_occurrence(size_t start, size_t end, dt::data_type type)
+      : m_start(start), m_end(end), m_type(type), m_group(-1), m_slot(-1), m_is_first(false) {}
+
+    size_t length() const { return m_end - m_start; }
+    bool contains(const cse_occurrence &other) const {
+      return (m_start <= other.m_start) && (other.m_end <= m_end);
+    }
+
+    size_t m_start;
+    size_t m_end;
+    dt::data_type m_type;
+    size_t m_group;
+    size_t m_slot;
+    bool m_is_first;
+  };
+
+
+  // Find pure subexpressions that are worked out more than once, eg "x > 10 && x < 100", and work each one out
+  // just once per run.  The first occurrence of a subexpression stores its value in a slot and the later
+  // occurrences are skipped if the slot has a value.  They aren't removed because the first occurrence might
+  // be in a branch that wasn't taken.
+  static void eliminate_common_subexpressions(
+                vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> &function_calls,
+                const vm_literals &literals) {
+    rstd::vector<cse_occurrence> occurrences;
+    if (!find_pure_subexpressions(function_calls, occurrences)) {
+      return;
+    }
+
+    // Group the occurrences of the same subexpression.
+    size_t number_groups = 0;
+    size_t i;
+    size_t j;
+    for (i = 0; i < occurrences.size(); ++i) {
+      if ((size_t)-1 != occurrences[i].m_group) {
+        continue;
+      }
+
+      occurrences[i].m_group = number_groups++;
+      for (j = i + 1; j < occurrences.size(); ++j) {
+        if (((size_t)-1 == occurrences[j].m_group)
+            && is_same_subexpression(function_calls, literals, occurrences[i], occurrences[j])) {
+          occurrences[j].m_group = occurrences[i].m_group;
+        }
+      }
+    }
+
+    // Give slots to the biggest subexpressions first.  Occurrences inside subexpressions that already have
+    // slots are left alone.
+    rstd::vector<size_t> group_order;
+    for (i = 0; i < occurrences.size(); ++i) {
+      if (occurrences[i].m_group == group_order.size()) {
+        group_order.push_back(i);
+      }
+    }
+
+    for (i = 1; i < group_order.size(); ++i) {
+      for (j = i; (j > 0) && (occurrences[group_order[j-1]].length() < occurrences[group_order[j]].length()); --j) {
+        rstd::swap(group_order[j-1], group_order[j]);
+      }
+    }
+
+    size_t number_slots = 0;
+    size_t number_new_calls = 0;
+    for (i = 0; i < group_order.size(); ++i) {
+      size_t group = occurrences[group_order[i]].m_group;
+      rstd::vector<size_t> uncovered;
+      size_t first_occurrence = (size_t)-1;
+      for (j = 0; j < occurrences.size(); ++j) {
+        if ((occurrences[j].m_group != group) || is_inside_slotted_subexpression(occurrences, occurrences[j])) {
+          continue;
+        }
+
+        uncovered.push_back(j);
+        if (((size_t)-1 == first_occurrence) || (occurrences[j].m_start < occurrences[first_occurrence].m_start)) {
+          first_occurrence = j;
+        }
+      }
+
+      // Each occurrence gets a store and each one after the first also gets a load.
+      if ((uncovered.size() < 2) || (number_slots >= vm_stack::MAX_NUMBER_SLOTS)
+          || (function_calls.size() + number_new_calls + 2 * uncovered.size()
+                >= MAX_NUMBER_FUNCTION_CALLS_PER_VM - 1)) {
+        continue;
+      }
+
+      for (j = 0; j < uncovered.size(); ++j) {
+        occurrences[uncovered[j]].m_slot = number_slots;
+      }
+
+      occurrences[first_occurrence].m_is_first = true;
+      number_new_calls += 2 * uncovered.size() - 1;
+      ++number_slots;
+    }
+
+    if (0 == number_slots) {
+      return;
+    }
+
+    insert_slot_calls(occurrences, function_calls);
+  }
+
+
+  // Simulate the stack to find the subexpressions that don't branch and don't call non-deterministic functions.
+  // Returns false if the calls aren't in the shape that the compiler makes.
+  static bool find_pure_subexpressions(
+                const vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> &function_calls,
+                rstd::vector<cse_occurrence> &occurrences) {
+    const size_t if_id = fn::fn_table::find_if();
+    const size_t goto_id = fn::fn_table::find_goto();
+    const size_t and_then_id = fn::fn_table::find_and_then();
+    const size_t or_else_id = fn::fn_table::find_or_else();
+
+    rstd::vector<cse_value> values;
+    rstd::vector<cse_pending_branch> pending;
+    rstd::vector<size_t> if_starts;
+    size_t number_calls = function_calls.size();
+    size_t offset;
+    for (offset = 0; offset <= number_calls; ++offset) {
+      // The last value of a branch is the value of the whole branching expression.
+      while (!pending.empty() && (pending.back().m_end == offset)) {
+        if (values.empty()) {
+          return false;
+        }
+
+        values.back() = cse_value(pending.back().m_start, false);
+        pending.pop_back();
+      }
+
+      if (offset == number_calls) {
+        break;
+      }
+
+      const vm_function_call &call = function_calls[offset];
+      if (call.id() == if_id) {
+        if (values.empty()) {
+          return false;
+        }
+
+        if_starts.push_back(values.back().m_start);
+        values.pop_back();
+      } else if (call.id() == goto_id) {
+        // The 'then' value is replaced by the 'else' value.
+        if (values.empty() || if_starts.empty()) {
+          return false;
+        }
+
+        values.pop_back();
+        pending.push_back(cse_pending_branch(offset + call.data(), if_starts.back()));
+        if_starts.pop_back();
+      } else if ((call.id() == and_then_id) || (call.id() == or_else_id)) {
+        // The left side is replaced by the right side.
+        if (values.empty()) {
+          return false;
+        }
+
+        pending.push_back(cse_pending_branch(offset + call.data(), values.back().m_start));
+        values.pop_back();
+      } else {
+        fn::fn_table::fn_info finfo = fn::fn_table::get_info(call.id());
+        size_t number_arguments = finfo.number_arguments();
+        if (values.size() < number_arguments) {
+          return false;
+        }
+
+        cse_value value(offset, finfo.is_deterministic() || finfo.is_push_this());
+        if (number_arguments > 0) {
+          size_t first_argument = values.size() - number_arguments;
+          value.m_start = values[first_argument].m_start;
+          size_t i;
+          for (i = first_argument; i < values.size(); ++i) {
+            value.m_is_pure = value.m_is_pure && values[i].m_is_pure;
+          }
+
+          values.resize(first_argument);
+        }
+
+        values.push_back(value);
+
+        // There's nothing to gain from keeping a literal in a slot.
+        if (value.m_is_pure && !finfo.is_push_literal()) {
+          occurrences.push_back(cse_occurrence(value.m_start, offset + 1, finfo.return_type()));
+        }
+      }
+    }
+
+    return pending.empty() && if_starts.empty() && (values.size() == 1);
+  }
+
+
+  static bool is_same_subexpression(const vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> &function_calls,
+                                    const vm_literals &literals,
+                                    const cse_occurrence &o1, const cse_occurrence &o2) {
+    if (o1.length() != o2.length()) {
+      return false;
+    }
+
+    size_t i;
+    for (i = 0; i < o1.length(); ++i) {
+      const vm_function_call &c1 = function_calls[o1.m_start + i];
+      const vm_function_call &c2 = function_calls[o2.m_start + i];
+      if (c1.id() != c2.id()) {
+        return false;
+      }
+
+      // Every literal in the source has its own entry in the literals.
+      if (c1.data() != c2.data()) {
+        fn::fn_table::fn_info finfo = fn::fn_table::get_info(c1.id());
+        if (!finfo.is_push_literal() || !literals.is_same(finfo.return_type(), c1.data(), c2.data())) {
+          return false;
+        }
+      }
+    }
+
+    return true;
+  }
+
+
+  static bool is_inside_slotted_subexpression(const rstd::vector<cse_occurrence> &occurrences,
+                                              const cse_occurrence &occurrence) {
+    rstd::vector<cse_occurrence>::const_iterator i = occurrences.begin();
+    rstd::vector<cse_occurrence>::const_iterator iz = occurrences.end();
+    for (; i < iz; ++i) {
+      if (((size_t)-1 != i->m_slot) && i->contains(occurrence)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  // Put a store after every occurrence that has a slot and a load before every one but the first, then fix up
+  // the branch offsets to allow for the new calls.
+  static void insert_slot_calls(const rstd::vector<cse_occurrence> &occurrences,
+                                vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> &function_calls) {
+    const size_t if_id = fn::fn_table::find_if();
+    const size_t goto_id = fn::fn_table::find_goto();
+    const size_t and_then_id = fn::fn_table::find_and_then();
+    const size_t or_else_id = fn::fn_table::find_or_else();
+
+    vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> new_calls;
+    size_t number_calls = function_calls.size();
+
+    // new_starts[n] is where the code that was at offset n starts now.  Jumps to n go there, which is after
+    // the store for any subexpression that ends at n and before the loads for any that start at n.
+    rstd::vector<size_t> new_starts;
+    rstd::vector<size_t> new_offsets;
+    rstd::vector<rstd::pair<size_t, size_t> > loads;
+    size_t offset;
+    for (offset = 0; offset <= number_calls; ++offset) {
+      rstd::vector<cse_occurrence>::const_iterator i = occurrences.begin();
+      rstd::vector<cse_occurrence>::const_iterator iz = occurrences.end();
+      for (; i < iz; ++i) {
+        if (((size_t)-1 != i->m_slot) && (i->m_end == offset)) {
+          new_calls.push_back(vm_function_call(fn::fn_table::find_store_slot(i->m_type), i->m_slot));
+        }
+      }
+
+      new_starts.push_back(new_calls.size());
+      if (offset == number_calls) {
+        break;
+      }
+
+      // When subexpressions start at the same place, the biggest one's load goes first so that everything
+      // inside it is skipped.  Occurrences are in order of where they end, so go backwards.
+      size_t k;
+      for (k = occurrences.size(); k > 0; --k) {
+        const cse_occurrence &occurrence = occurrences[k - 1];
+        if (((size_t)-1 != occurrence.m_slot) && !occurrence.m_is_first && (occurrence.m_start == offset)) {
+          loads.push_back(rstd::make_pair(new_calls.size(), k - 1));
+          new_calls.push_back(vm_function_call(fn::fn_table::find_load_slot(occurrence.m_type), (size_t)-1));
+        }
+      }
+
+      new_offsets.push_back(new_calls.size());
+      new_calls.push_back(function_calls[offset]);
+    }
+
+    for (offset = 0; offset < number_calls; ++offset) {
+      const vm_function_call &call = function_calls[offset];
+      if ((call.id() == if_id) || (call.id() == goto_id) || (call.id() == and_then_id) || (call.id() == or_else_id)) {
+        new_calls[new_offsets[offset]].data(new_starts[offset + call.data()] - new_offsets[offset]);
+      }
+    }
+
+    rstd::vector<rstd::pair<size_t, size_t> >::const_iterator load_i = loads.begin();
+    rstd::vector<rstd::pair<size_t, size_t> >::const_iterator load_iz = loads.end();
+    for (; load_i < load_iz; ++load_i) {
+      const cse_occurrence &occurrence = occurrences[load_i->second];
+      size_t skip_offset = new_starts[occurrence.m_end] - load_i->first;
+      new_calls[load_i->first].data(occurrence.m_slot + vm_stack::MAX_NUMBER_SLOTS * skip_offset);
+    }
+
+    function_calls = new_calls;
+  }
+
+
+  // If the call is to a deterministic function and all its arguments are literals then work out its result
+  // now rather than every time the VM is run, and replace the argument pushes with a push of the result.
+  // Returns false if the call can't be folded, in which case nothing has changed.
+  static bool fold_constant_call(const vm_function_call &call, size_t fold_start_limit,
+                                  vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> &function_calls,
+                                  vm_literals &literals) {
+    fn::fn_table::fn_info finfo = fn::fn_table::get_info(call.id());
+    if (finfo.is_push_literal() || !finfo.is_deterministic()) {
+      return false;
+    }
+
+    // There are no literals of these types.
+    if ((dt::TYPE_ISTRING == finfo.return_type()) || (dt::TYPE_IPADDRESS == finfo.return_type())) {
+      return false;
+    }
+
+    // The arguments are the calls just before this one.  Earlier folding means that a literal argument is
+    // always a single push.
+    size_t number_arguments = finfo.number_arguments();
+    if (function_calls.size() < fold_start_limit + number_arguments) {
+      return false;
+    }
+
+    size_t arguments_start = function_calls.size() - number_arguments;
+    vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS_PER_VM> constant_calls;
+    size_t i;
+    for (i = arguments_start; i < function_calls.size(); ++i) {
+      if (!fn::fn_table::get_info(function_calls[i].id()).is_push_literal()) {
+        return false;
+      }
+
+      constant_calls.push_back(function_calls[i]);
+    }
+
+    constant_calls.push_back(call);
+
+    rel::record_ref empty_r;
+    vm constant_vm(literals, constant_calls, finfo.return_type(), false);
+    vm_heap heap;
+    vm_stack &stack = constant_vm.run_heap_reset(heap, empty_r, empty_r);
+
+    function_calls.resize(arguments_start);
+
+    switch (finfo.return_type()) {
+    case dt::TYPE_STRING:
+      {
+        str::ref s;
+        stack.pop(s);
+        function_calls.push_back(
+          vm_function_call(fn::fn_table::find_push_literal_string(), literals.push_back_string(s)));
+      }
+      break;
+
+    case dt::TYPE_INT:
+      {
+        int64_t value;
+        stack.pop(value);
+        function_calls.push_back(
+          vm_function_call(fn::fn_table::find_push_literal_integer(), literals.push_back_integer(value)));
+      }
+      break;
+
+    case dt::TYPE_UINT:
+      {
+        uint64_t value;
+        stack.pop(value);
+        function_calls.push_back(
+          vm_function_call(fn::fn_table::find_push_literal_uinteger(), literals.push_back_uinteger(value)));
+      }
+      break;
+
+    case dt::TYPE_DOUBLE:
+      {
+        double value;
+        stack.pop(value);
+        function_calls.push_back(
+          vm_function_call(fn::fn_table::find_push_literal_double(), literals.push_back_double(value)));
+      }
+      break;
+
+    case dt::TYPE_BOOL:
+      {
+        bool value;
+        stack.pop(value);
+        function_calls.push_back(
+          vm_function_call(value ? fn::fn_table::find_push_literal_boolean_true()
+                                  : fn::fn_table::find_push_literal_boolean_false(),
+                            -1));
+      }
+      break;
+
+    default:
+      NP1_ASSERT(false, "Unreachable: unexpected folded type");
+      break;
+    }
+
+    return true;
+  }
+
   // Find the function that starts at the supplied position.
   static rstd::vector<shunting_yard::parsed_token_info>::const_iterator
   mandatory_find_function_starting_at(
@@ -30,6 +30,9 @@ struct base {
   static const bool is_operator = false;
   static const size_t precedence = -1;
   static const bool is_left_assoc = false;
+  // False if the function can return different results for the same arguments or has side effects, in which
+  // case calls to it with literal arguments are not worked out at compile time.
+  static const bool is_deterministic = true;
   static const char *synonym() { return 0; }
 };
 
@@ -173,6 +176,10 @@ struct internal_push_rownum : public base {
 
 #define NP1_REL_RLANG_FN_NAME_IF "____internal.if"
 #define NP1_REL_RLANG_FN_NAME_GOTO "____internal.goto"
+#define NP1_REL_RLANG_FN_NAME_AND_THEN "____internal.and_then"
+#define NP1_REL_RLANG_FN_NAME_OR_ELSE "____internal.or_else"
+#define NP1_REL_RLANG_FN_NAME_LOAD_SLOT "____internal.load_slot"
+#define NP1_REL_RLANG_FN_NAME_STORE_SLOT "____internal.store_slot"
 
 struct internal_if : public base {
   static const char *name() { return NP1_REL_RLANG_FN_NAME_IF; }
@@ -190,6 +197,60 @@ struct internal_goto : public base {
   }
 };
 
+// The short-circuiting && and || go between their left and right sides.  If the left side decides the result
+// then it stays on the stack and the right side is skipped, otherwise the right side's value is the result.
+struct internal_and_then : public base {
+  static const char *name() { return NP1_REL_RLANG_FN_NAME_AND_THEN; }
+  static const char *description() { return ""; }  
+  inline static size_t call(vm_stack &stk, size_t end_offset) {
+    dt::boolean left; stk.pop(left);
+    if (left) {
+      return 1;
+    }
+
+    stk.push(left);
+    return end_offset;
+  }
+};
+
+struct internal_or_else : public base {
+  static const char *name() { return NP1_REL_RLANG_FN_NAME_OR_ELSE; }
+  static const char *description() { return ""; }  
+  inline static size_t call(vm_stack &stk, size_t end_offset) {
+    dt::boolean left; stk.pop(left);
+    if (!left) {
+      return 1;
+    }
+
+    stk.push(left);
+    return end_offset;
+  }
+};
+
+// Common subexpressions are worked out the first time they are needed in each run and then kept in one of the
+// stack's slots.  load_slot goes before a repeat of the subexpression and skips it if the slot already has a
+// value; its data is the slot number plus MAX_NUMBER_SLOTS times the offset to skip to.  store_slot goes after
+// the subexpression and its data is the slot number.
+template <size_t Number_Words>
+struct internal_load_slot : public base {
+  static const char *name() { return NP1_REL_RLANG_FN_NAME_LOAD_SLOT; }
+  static const char *description() { return ""; }  
+  inline static size_t call(vm_stack &stk, size_t slot_and_offset) {
+    return stk.load_slot(slot_and_offset % vm_stack::MAX_NUMBER_SLOTS, Number_Words)
+            ? slot_and_offset / vm_stack::MAX_NUMBER_SLOTS : 1;
+  }
+};
+
+template <size_t Number_Words>
+struct internal_store_slot : public base {
+  static const char *name() { return NP1_REL_RLANG_FN_NAME_STORE_SLOT; }
+  static const char *description() { return ""; }  
+  inline static size_t call(vm_stack &stk, size_t slot) {
+    stk.store_slot(slot, Number_Words);
+    return 1;
+  }
+};
+
 
 // Convert to case-sensitive string.
 struct to_string : public base {
@@ -495,6 +556,7 @@ struct str_contains : public base {
 
 /// UUID generation.
 struct str_uuidgen : public base {
+  static const bool is_deterministic = false;
   static const char *name() { return "str.uuidgen"; }
   static const char *description() { return "Generate a random UUID using the same random number generator as math.rand64()."; }  
   inline static dt::string call(vm_heap &h) {
@@ -568,6 +630,7 @@ private:
 
 /// Random number generation.
 struct math_rand64 : public base {
+  static const bool is_deterministic = false;
   static const char *name() { return "math.rand64"; }
   static const char *description() { return "Generate a 64-bit random number.  The seed is data from the OS's random number generator plus the process's PID and the current time in microseconds.  The random state is periodically reset with a new seed.  The random number is generated using a SHA-256 hash of the seed together with the output of the previous SHA-256 hash."; }  
   inline static dt::uinteger call() {
@@ -579,6 +642,7 @@ struct math_rand64 : public base {
 
 /// The current time in microseconds.
 struct time_now_epoch_usec : public base {
+  static const bool is_deterministic = false;
   static const char *name() { return "time.now_epoch_usec"; }
   static const char *description() { return "The number of microseconds since 1/1/1970 00:00:00 GMT."; }  
   inline static dt::uinteger call() {
@@ -749,6 +813,7 @@ struct time_format : public base {
 
 
 struct io_net_url_get : public base {
+  static const bool is_deterministic = false;
   static const char *name() { return "io.net.url.get"; }
   static const char *description() {
     return "`io.net.url.get(url)` retrieves the resource specified by the supplied URL.  If the URL is an HTTP URL, "
@@ -770,6 +835,7 @@ struct io_net_url_get : public base {
 
 
 struct io_file_read : public base {
+  static const bool is_deterministic = false;
   static const char *name() { return "io.file.read"; }
   static const char *description() {
     return "`io.file.read(path)` reads the entire file specified by `path`.  Will decompress the file if it's in gzip format. "
@@ -814,6 +880,7 @@ struct io_file_read : public base {
 
 
 struct io_file_erase : public base {
+  static const bool is_deterministic = false;
   static const char *name() { return "io.file.erase"; }
   static const char *description() {
     return "`io.file.erase(path)` erases the path specified by `path`.  Returns false on error.";
@@ -826,6 +893,7 @@ struct io_file_erase : public base {
 
 
 struct meta_shell : public base {
+  static const bool is_deterministic = false;
   enum { TEMP_FILE_READ_BUFFER_SIZE = 256 * 1024 };
   static const char *name() { return "meta.shell"; }
   static const char *description() {
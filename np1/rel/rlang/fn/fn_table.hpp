@@ -6,6 +6,7 @@
 
 #include "np1/rel/rlang/fn/fn.hpp"
 #include "np1/rel/rlang/fn/op.hpp"
+#include "np1/rel/rlang/vm_batch_stack.hpp"
 #include "np1/preproc.hpp"
 
 namespace np1 {
@@ -22,6 +23,9 @@ struct wrap_base {
   static const dt::data_type return_data_type_enum = dt::to_data_type_enum<Return>::value;
   static const bool is_push_this = false;
   static const bool is_push_other = false;
+  static const bool is_push_literal = false;
+  static const bool is_deterministic = Target::is_deterministic;
+  static const bool is_batchable = true;
 
   static bool is_name_match(const str::ref &name) {
     return ((str::cmp(name, target_type::name()) == 0)
@@ -80,6 +84,17 @@ struct wrap0_noheap : public wrap0_base<Return, Target> {
                             size_t record_or_literal_number) {    
     stk.push(Target::call()); return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call();
+    }
+
+    stk.replace(0);
+  }
 };
 
 template <typename Return, typename Target>
@@ -89,6 +104,17 @@ struct wrap0_heap : public wrap0_base<Return, Target> {
                             size_t record_or_literal_number) {    
     stk.push(Target::call(heap)); return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call(heap);
+    }
+
+    stk.replace(0);
+  }
 };
 
 
@@ -123,6 +149,18 @@ struct wrap1_noheap : public wrap1_base<Return, Target, A1> {
                             size_t record_or_literal_number) {    
     A1 v1; stk.pop(v1); stk.push(Target::call(v1));  return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    const A1 *v1 = stk.column<A1>(0);
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call(v1[i]);
+    }
+
+    stk.replace(1);
+  }
 };
 
 template <typename Return, typename Target, typename A1>
@@ -132,6 +170,18 @@ struct wrap1_heap : public wrap1_base<Return, Target, A1> {
                             size_t record_or_literal_number) {    
     A1 v1; stk.pop(v1); stk.push(Target::call(heap, v1)); return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    const A1 *v1 = stk.column<A1>(0);
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call(heap, v1[i]);
+    }
+
+    stk.replace(1);
+  }
 };
 
 
@@ -168,6 +218,19 @@ struct wrap2_noheap : public wrap2_base<Return, Target, A1, A2> {
                             size_t record_or_literal_number) {    
     A1 v1; A2 v2; stk.pop(v2); stk.pop(v1); stk.push(Target::call(v1, v2)); return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    const A1 *v1 = stk.column<A1>(1);
+    const A2 *v2 = stk.column<A2>(0);
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call(v1[i], v2[i]);
+    }
+
+    stk.replace(2);
+  }
 };
 
 template <typename Return, typename Target, typename A1, typename A2>
@@ -177,6 +240,19 @@ struct wrap2_heap : public wrap2_base<Return, Target, A1, A2> {
                             size_t record_or_literal_number) {    
     A1 v1; A2 v2; stk.pop(v2); stk.pop(v1); stk.push(Target::call(heap, v1, v2)); return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    const A1 *v1 = stk.column<A1>(1);
+    const A2 *v2 = stk.column<A2>(0);
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call(heap, v1[i], v2[i]);
+    }
+
+    stk.replace(2);
+  }
 };
 
 
@@ -218,6 +294,20 @@ struct wrap3_noheap : public wrap3_base<Return, Target, A1, A2, A3> {
     stk.push(Target::call(v1, v2, v3));
     return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    const A1 *v1 = stk.column<A1>(2);
+    const A2 *v2 = stk.column<A2>(1);
+    const A3 *v3 = stk.column<A3>(0);
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call(v1[i], v2[i], v3[i]);
+    }
+
+    stk.replace(3);
+  }
 };
 
 template <typename Return, typename Target, typename A1, typename A2, typename A3>
@@ -229,12 +319,28 @@ struct wrap3_heap : public wrap3_base<Return, Target, A1, A2, A3> {
     stk.push(Target::call(heap, v1, v2, v3));
     return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    const A1 *v1 = stk.column<A1>(2);
+    const A2 *v2 = stk.column<A2>(1);
+    const A3 *v3 = stk.column<A3>(0);
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call(heap, v1[i], v2[i], v3[i]);
+    }
+
+    stk.replace(3);
+  }
 };
 
 
 /// Wrappers for pushing literals.
 template <typename Return, typename Target>
 struct wrap_push_literal : public wrap_base<Return, Target, 0> {
+  static const bool is_push_literal = true;
+
   template <typename Receiver>
   static void get_info(Receiver &receiver) {
     receiver(Target::since(), Target::name(), Target::synonym(), Target::description(),
@@ -253,6 +359,18 @@ struct wrap_push_literal : public wrap_base<Return, Target, 0> {
                             size_t record_or_literal_number) {    
     stk.push(Target::call(lit, record_or_literal_number)); return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    Return value = Target::call(lit, record_or_literal_number);
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = value;
+    }
+
+    stk.replace(0);
+  }
 };
 
 
@@ -260,6 +378,7 @@ struct wrap_push_literal : public wrap_base<Return, Target, 0> {
 template <typename Return, typename Target>
 struct wrap_push_this : public wrap_base<Return, Target, 0> {
   static const bool is_push_this = true;
+  static const bool is_deterministic = false;
   
   template <typename Receiver>
   static void get_info(Receiver &receiver) {
@@ -279,6 +398,17 @@ struct wrap_push_this : public wrap_base<Return, Target, 0> {
                             size_t record_or_literal_number) {    
     stk.push(Target::call(this_r, record_or_literal_number)); return 1;   
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    Return *result = stk.next_column<Return>();
+    size_t i;
+    for (i = 0; i < number_records; ++i) {
+      result[i] = Target::call(this_rs[i], record_or_literal_number);
+    }
+
+    stk.replace(0);
+  }
 };
 
 
@@ -286,6 +416,8 @@ struct wrap_push_this : public wrap_base<Return, Target, 0> {
 template <typename Return, typename Target>
 struct wrap_push_other : public wrap_base<Return, Target, 0> {
   static const bool is_push_other = false;
+  static const bool is_deterministic = false;
+  static const bool is_batchable = false;
   
   template <typename Receiver>
   static void get_info(Receiver &receiver) {
@@ -305,12 +437,20 @@ struct wrap_push_other : public wrap_base<Return, Target, 0> {
                             size_t record_or_literal_number) {    
     stk.push(Target::call(other_r, record_or_literal_number)); return 1;
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t record_or_literal_number) {
+    NP1_ASSERT(false, "The 'other' record is not available when running over a batch of records");
+  }
 };
 
 
 /// Wrapper for internal branch expressions.
 template <typename Return, typename Target>
 struct wrap_branch : public wrap_base<Return, Target, 0> {
+  static const bool is_deterministic = false;
+  static const bool is_batchable = false;
+
   template <typename Receiver>
   static void get_info(Receiver &receiver) {
     receiver(Target::since(), Target::name(), Target::synonym(), Target::description(),
@@ -329,6 +469,11 @@ struct wrap_branch : public wrap_base<Return, Target, 0> {
                             size_t offset) {    
     return Target::call(stk, offset);
   }  
+
+  static void batch_call(vm_batch_stack &stk, vm_heap &heap, const vm_literals &lit,
+                          const record_ref *this_rs, size_t number_records, size_t offset) {
+    NP1_ASSERT(false, "Branches can't be run over a batch of records");
+  }
 };
 
 
@@ -406,11 +551,17 @@ struct wrap_branch : public wrap_base<Return, Target, 0> {
 \
   (wrap_branch<dt::boolean, internal_if>), \
   (wrap_branch<dt::boolean, internal_goto>), \
+  (wrap_branch<dt::boolean, internal_and_then>), \
+  (wrap_branch<dt::boolean, internal_or_else>), \
+  (wrap_branch<dt::integer, internal_load_slot<1> >), \
+  (wrap_branch<dt::string, internal_load_slot<vm_stack::STRING_WORDS> >), \
+  (wrap_branch<dt::integer, internal_store_slot<1> >), \
+  (wrap_branch<dt::string, internal_store_slot<vm_stack::STRING_WORDS> >), \
 \
   (wrap_push_literal<dt::string, internal_push_literal_string>), \
   (wrap_push_literal<dt::integer, internal_push_literal_integer>), \
-  (wrap_push_literal<dt::integer, internal_push_literal_uinteger>), \
-  (wrap_push_literal<dt::integer, internal_push_literal_double>), \
+  (wrap_push_literal<dt::uinteger, internal_push_literal_uinteger>), \
+  (wrap_push_literal<dt::fdouble, internal_push_literal_double>), \
   (wrap_push_literal<dt::boolean, internal_push_literal_boolean_true>), \
   (wrap_push_literal<dt::boolean, internal_push_literal_boolean_false>), \
 \
@@ -537,6 +688,25 @@ NP1_PREPROC_FOR_EACH(NP1_REL_RLANG_FN_TABLE_GET_FUNCTION_INFO_CASE, unused__, \
 }
 
 
+// Call one function over a whole batch of records.  The dispatch cost is only paid once per batch so a switch
+// is fine here.
+#define NP1_REL_RLANG_FN_TABLE_BATCH_CALL_CASE(n__, wrap__, batch_call__) \
+case n__: NP1_PREPROC_REMOVE_PAREN wrap__::batch_call__; break;
+
+#define NP1_REL_RLANG_FN_TABLE_BATCH_CALL(function_id__, stk__, heap__, lit__, this_rs__, number_records__, data__) \
+{ \
+  using namespace ::np1::rel::rlang::fn; \
+  switch (function_id__) { \
+  NP1_PREPROC_FOR_EACH(NP1_REL_RLANG_FN_TABLE_BATCH_CALL_CASE, \
+                        batch_call(stk__, heap__, lit__, this_rs__, number_records__, data__), \
+                        NP1_REL_RLANG_FN_TABLE) \
+  default: \
+    NP1_ASSERT(false, "Unknown function id: " + str::to_dec_str(function_id__)); \
+    break; \
+  } \
+}
+
+
 
 /// Helper for figuring out if two types are the same.
 template <typename T1, typename T2>
@@ -647,7 +817,7 @@ struct fn_table {
     fn_info()
       : m_name(0), m_synonym(0), m_description(0), m_precedence(0),
         m_is_left_assoc(false), m_is_push_this(false), m_is_push_other(false), m_is_operator(false),
-        m_number_arguments(0), m_return_type(dt::TYPE_STRING) {}
+        m_is_push_literal(false), m_is_deterministic(false), m_is_batchable(false), m_number_arguments(0), m_return_type(dt::TYPE_STRING) {}
 
 
     template <typename Wrap>
@@ -661,6 +831,9 @@ struct fn_table {
       info.m_is_push_this = Wrap::is_push_this;
       info.m_is_push_other = Wrap::is_push_this;
       info.m_is_operator = Wrap::target_type::is_operator;
+      info.m_is_push_literal = Wrap::is_push_literal;
+      info.m_is_deterministic = Wrap::is_deterministic;
+      info.m_is_batchable = Wrap::is_batchable;
       info.m_number_arguments = Wrap::number_arguments;
       info.m_return_type = Wrap::return_data_type_enum;
       return info;
@@ -674,6 +847,9 @@ struct fn_table {
     bool is_push_this() const { return m_is_push_this; }
     bool is_push_other() const { return m_is_push_other; }
     bool is_operator() const { return m_is_operator; }
+    bool is_push_literal() const { return m_is_push_literal; }
+    bool is_deterministic() const { return m_is_deterministic; }
+    bool is_batchable() const { return m_is_batchable; }
     size_t number_arguments() const { return m_number_arguments; }
     dt::data_type return_type() const { return m_return_type; }
 
@@ -687,6 +863,9 @@ struct fn_table {
     bool m_is_push_this;
     bool m_is_push_other;
     bool m_is_operator;
+    bool m_is_push_literal;
+    bool m_is_deterministic;
+    bool m_is_batchable;
     size_t m_number_arguments;
     dt::data_type m_return_type;
   };
@@ -767,6 +946,36 @@ if (is_same_type<Inner, NP1_PREPROC_REMOVE_PAREN wrap__ ::target_type>::value) {
   static size_t find_goto() {
     return mandatory_find_by_inner<internal_goto>();
   }
+
+  static size_t find_and_then() {
+    return mandatory_find_by_inner<internal_and_then>();
+  }
+
+  static size_t find_or_else() {
+    return mandatory_find_by_inner<internal_or_else>();
+  }
+
+  /// Find the functions that keep the value of a common subexpression in a slot.
+  static size_t find_load_slot(dt::data_type type) {
+    return (vm_stack::type_size(type) > sizeof(uint64_t))
+            ? mandatory_find_by_inner<internal_load_slot<vm_stack::STRING_WORDS> >()
+            : mandatory_find_by_inner<internal_load_slot<1> >();
+  }
+
+  static size_t find_store_slot(dt::data_type type) {
+    return (vm_stack::type_size(type) > sizeof(uint64_t))
+            ? mandatory_find_by_inner<internal_store_slot<vm_stack::STRING_WORDS> >()
+            : mandatory_find_by_inner<internal_store_slot<1> >();
+  }
+
+  /// Find the logical operators that are compiled to branches.
+  static size_t find_logical_and() {
+    return mandatory_find_by_inner<op::logical_and>();
+  }
+
+  static size_t find_logical_or() {
+    return mandatory_find_by_inner<op::logical_or>();
+  }
   
 
   /// Find literal-pushing functions.
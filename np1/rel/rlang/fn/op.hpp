@@ -29,6 +29,7 @@ namespace op {
 struct base {
   static const char *since() { return "1.0"; }
   static const bool is_operator = true;
+  static const bool is_deterministic = true;
 };
 
 
@@ -269,7 +270,7 @@ struct bitwise_not : public right_assoc {
 struct logical_and : public left_assoc {
   static const char *name() { return "&&"; }
   static const char *synonym() { return "and"; }
-  static const char *description() { return "Logical AND.  Note there is currently no \"shortcutting\"- both sides of the && will be executed even if the first expression returns false."; }  
+  static const char *description() { return "Logical AND.  The right-hand side is only evaluated if the left-hand side is true."; }  
   static const size_t precedence = 13;
   inline static dt::boolean call(dt::boolean one, dt::boolean two) { return one && two; }
 };
@@ -279,7 +280,7 @@ struct logical_and : public left_assoc {
 struct logical_or : public left_assoc {
   static const char *name() { return "||"; }
   static const char *synonym() { return "or"; }
-  static const char *description() { return "Logical OR.  Note there is currently no \"shortcutting\"- both sides of the || will be executed even if the first expression returns true."; }  
+  static const char *description() { return "Logical OR.  The right-hand side is only evaluated if the left-hand side is false."; }  
   static const size_t precedence = 14;
   inline static dt::boolean call(dt::boolean one, dt::boolean two) { return one || two; }
 };
@@ -12,6 +12,7 @@
 #include "np1/rel/rlang/fn/op.hpp"
 #include "np1/rel/rlang/fn/fn_table.hpp"
 #include "np1/rel/rlang/vm.hpp"
+#include "np1/rel/rlang/batch_vm.hpp"
 #include "np1/rel/rlang/compiler.hpp"
 
 #endif
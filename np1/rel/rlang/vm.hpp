@@ -46,6 +46,10 @@ public:
   /// Does this virtual machine actually refer to the "other" record?
   bool refers_to_other_record() const { return m_refers_to_other_record; }
 
+  /// The compiled code, including the final "stop" call.
+  const vm_function_call_list<MAX_NUMBER_FUNCTION_CALLS> &function_calls() const { return m_function_calls; }
+  const vm_literals &literals() const { return m_literals; }
+
 
   /// Run the virtual machine against the supplied records.  Returns a reference
   /// to the VM's stack, valid only until the next run.
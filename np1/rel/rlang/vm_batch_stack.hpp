@@ -0,0 +1,75 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_REL_RLANG_VM_BATCH_STACK_HPP
+#define NP1_REL_RLANG_VM_BATCH_STACK_HPP
+
+
+#include "rstd/vector.hpp"
+#include "rstd/swap.hpp"
+
+
+namespace np1 {
+namespace rel {
+namespace rlang {
+
+
+/// The stack for running a VM over a batch of records at once.  Each stack entry is a column that holds one
+/// value for each record in the batch.
+/**
+ * Functions read their arguments from the top columns and write their results to a spare column, which then
+ * replaces the arguments on the stack.  That way the results never overlap the arguments.
+ */
+class vm_batch_stack {
+public:
+  enum { MAX_BATCH_SIZE = 256, MAX_DEPTH = 16 };
+
+  // Every column is big enough for the biggest type, which is a string.
+  enum { COLUMN_WORDS = MAX_BATCH_SIZE * sizeof(str::ref) / sizeof(uint64_t) };
+
+public:
+  vm_batch_stack() : m_depth(0) {
+    m_storage.resize((MAX_DEPTH + 1) * COLUMN_WORDS);
+    size_t i;
+    for (i = 0; i <= MAX_DEPTH; ++i) {
+      m_column_offsets[i] = i * COLUMN_WORDS;
+    }
+  }
+
+  void reset() { m_depth = 0; }
+
+  size_t depth() const { return m_depth; }
+
+  /// Get the column that's n entries below the top of the stack.
+  template <typename T>
+  inline const T *column(size_t n) const {
+    NP1_ASSERT(n < m_depth, "Batch stack underflow");
+    return (const T *)&m_storage[m_column_offsets[m_depth - 1 - n]];
+  }
+
+  /// Get the column that the next replace() will put on top of the stack.
+  template <typename T>
+  inline T *next_column() {
+    return (T *)&m_storage[m_column_offsets[MAX_DEPTH]];
+  }
+
+  /// Pop the top number_popped columns and push the column from next_column().
+  inline void replace(size_t number_popped) {
+    NP1_ASSERT((number_popped <= m_depth) && (m_depth - number_popped < MAX_DEPTH), "Batch stack overflow");
+    m_depth -= number_popped;
+    rstd::swap(m_column_offsets[m_depth], m_column_offsets[MAX_DEPTH]);
+    ++m_depth;
+  }
+
+private:
+  rstd::vector<uint64_t> m_storage;
+  size_t m_column_offsets[MAX_DEPTH + 1];
+  size_t m_depth;
+};
+
+
+} // namespaces
+}
+}
+
+
+#endif
@@ -25,6 +25,21 @@ public:
   const vm_function_call *end() const { return &m_function_calls[m_size]; }
 
   size_t size() const { return m_size; }
+
+  void insert(size_t offset, const vm_function_call &fc) {
+    NP1_ASSERT(offset <= m_size, "Function call offset out of range!");
+    NP1_ASSERT(m_size+1 < N, "Maximum number of rlang terms exceeded.  Max: "
+                              + str::to_dec_str(N));
+    memmove(&m_function_calls[offset + 1], &m_function_calls[offset],
+            (m_size - offset) * sizeof(vm_function_call));
+    m_function_calls[offset] = fc;
+    ++m_size;
+  }
+
+  void resize(size_t new_size) {
+    NP1_ASSERT(new_size <= m_size, "Function call lists can only be made smaller");
+    m_size = new_size;
+  }
   
   vm_function_call &operator[](size_t n) {
     NP1_ASSERT(n < m_size, "Function call offset out of range!");
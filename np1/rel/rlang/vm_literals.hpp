@@ -18,47 +18,68 @@ public:
   vm_literals() : m_next_literal_offset(0), m_next_string_offset(0) {}
 
   size_t push_back(dt::data_type type, const char *s) {
-    NP1_ASSERT(m_next_literal_offset < MAX_NUMBER_LITERALS, "Too many literals");
-
     size_t s_length = strlen(s);
 
     switch (type) {
     case dt::TYPE_STRING:
     case dt::TYPE_ISTRING:
-      NP1_ASSERT(m_next_string_offset + s_length + 1 < MAX_LITERAL_STRING_COMBINED_SIZE,
-                  "Too many long string literals");
-      memcpy(&m_strings[m_next_string_offset], s, s_length);
-      m_literals[m_next_literal_offset].s.m_offset = m_next_string_offset;
-      m_literals[m_next_literal_offset].s.m_length = s_length;      
-      m_next_string_offset += s_length;
-      m_strings[m_next_string_offset] = '\0';
-      ++m_next_string_offset;
-      break;
+      return push_back_string(str::ref(s, s_length));
 
     case dt::TYPE_INT:
-      m_literals[m_next_literal_offset].i = str::dec_to_int64(s, s_length);
-      break;
+      return push_back_integer(str::dec_to_int64(s, s_length));
 
     case dt::TYPE_UINT:
-      m_literals[m_next_literal_offset].ui = str::dec_to_int64(s, s_length);
-      break;
+      return push_back_uinteger(str::dec_to_int64(s, s_length));
 
     case dt::TYPE_DOUBLE:
-      m_literals[m_next_literal_offset].d = str::dec_to_double(s, s_length);
-      break;
+      return push_back_double(str::dec_to_double(s, s_length));
 
     case dt::TYPE_BOOL:
-      m_literals[m_next_literal_offset].b = str::to_bool(s, s_length);
-      break;
+      return push_back_boolean(str::to_bool(s, s_length));
 
     default:
       NP1_ASSERT(false, "Invalid type for literal");
       break;
     }
 
-    size_t offset = m_next_literal_offset;
-    ++m_next_literal_offset;
-    return offset;
+    return -1;
+  }
+
+  size_t push_back_string(const str::ref &s) {
+    NP1_ASSERT(m_next_string_offset + s.length() + 1 < MAX_LITERAL_STRING_COMBINED_SIZE,
+                "Too many long string literals");
+    literal *l = alloc_literal();
+    memcpy(&m_strings[m_next_string_offset], s.ptr(), s.length());
+    l->s.m_offset = m_next_string_offset;
+    l->s.m_length = s.length();
+    m_next_string_offset += s.length();
+    m_strings[m_next_string_offset] = '\0';
+    ++m_next_string_offset;
+    return l - m_literals;
+  }
+
+  size_t push_back_integer(int64_t i) {
+    literal *l = alloc_literal();
+    l->i = i;
+    return l - m_literals;
+  }
+
+  size_t push_back_uinteger(uint64_t ui) {
+    literal *l = alloc_literal();
+    l->ui = ui;
+    return l - m_literals;
+  }
+
+  size_t push_back_double(double d) {
+    literal *l = alloc_literal();
+    l->d = d;
+    return l - m_literals;
+  }
+
+  size_t push_back_boolean(bool b) {
+    literal *l = alloc_literal();
+    l->b = b;
+    return l - m_literals;
   }
 
   const dt::string get_string(size_t offset) const {
@@ -82,6 +103,32 @@ public:
     return m_literals[offset].b;  
   }
 
+  /// Do the two literals of this type have the same value?
+  bool is_same(dt::data_type type, size_t offset1, size_t offset2) const {
+    switch (type) {
+    case dt::TYPE_STRING:
+    case dt::TYPE_ISTRING:
+      return str::cmp(get_string(offset1), get_string(offset2)) == 0;
+
+    case dt::TYPE_INT:
+      return get_integer(offset1) == get_integer(offset2);
+
+    case dt::TYPE_UINT:
+      return get_uinteger(offset1) == get_uinteger(offset2);
+
+    case dt::TYPE_DOUBLE:
+      return get_double(offset1) == get_double(offset2);
+
+    case dt::TYPE_BOOL:
+      return get_boolean(offset1) == get_boolean(offset2);
+
+    default:
+      break;
+    }
+
+    return false;
+  }
+
 private:
   union literal {
     struct {
@@ -94,6 +141,11 @@ private:
     bool b;
   };
 
+  literal *alloc_literal() {
+    NP1_ASSERT(m_next_literal_offset < MAX_NUMBER_LITERALS, "Too many literals");
+    return &m_literals[m_next_literal_offset++];
+  }
+
   literal m_literals[MAX_NUMBER_LITERALS];
   char m_strings[MAX_LITERAL_STRING_COMBINED_SIZE];
   size_t m_next_literal_offset;
@@ -4,6 +4,7 @@
 #define NP1_REL_RLANG_VM_STACK_HPP
 
 
+#include <string.h>
 #include "np1/rel/rlang/dt.hpp"
 
 namespace np1 {
@@ -71,8 +72,14 @@ class vm_stack {
 public:
   enum { MAX_STACK_BYTE_SIZE = 1024 };  
 
+  // Slots hold the values of common subexpressions so they are only worked out once per run.
+  enum { MAX_NUMBER_SLOTS = 32, WORDS_PER_SLOT = sizeof(str::ref)/sizeof(uint64_t) };
+  enum { STRING_WORDS = sizeof(str::ref)/sizeof(uint64_t) };
+
 public:
-  vm_stack() : m_ptr(m_data) {}
+  vm_stack() : m_ptr(m_data), m_run_number(1) {
+    memset(m_slot_run_numbers, 0, sizeof(m_slot_run_numbers));
+  }
 
   inline void push(uint64_t ui) { *m_ptr++ = ui; }
   inline void pop(uint64_t &ui) { ui = *--m_ptr; }
@@ -90,7 +97,35 @@ public:
   inline void push(const str::ref &s) { detail::push_str<sizeof(str::ref)>::f(s, m_ptr); }
   inline void pop(str::ref &s) { detail::pop_str<sizeof(str::ref)>::f(s, m_ptr); }
 
-  inline void reset() { m_ptr = m_data; }
+  /// Reset the stack for the next run, which also forgets the values in the slots.
+  inline void reset() { m_ptr = m_data; ++m_run_number; }
+
+  /// If the slot has been stored to since the last reset, push its value and return true.
+  inline bool load_slot(size_t slot, size_t number_words) {
+    if (m_slot_run_numbers[slot] != m_run_number) {
+      return false;
+    }
+
+    const uint64_t *slot_p = &m_slots[slot * WORDS_PER_SLOT];
+    size_t i;
+    for (i = 0; i < number_words; ++i) {
+      *m_ptr++ = slot_p[i];
+    }
+
+    return true;
+  }
+
+  /// Copy the value on top of the stack into the slot, leaving it on the stack.
+  inline void store_slot(size_t slot, size_t number_words) {
+    uint64_t *slot_p = &m_slots[slot * WORDS_PER_SLOT];
+    const uint64_t *value_p = m_ptr - number_words;
+    size_t i;
+    for (i = 0; i < number_words; ++i) {
+      slot_p[i] = value_p[i];
+    }
+
+    m_slot_run_numbers[slot] = m_run_number;
+  }
 
   inline bool empty() const { return m_ptr == m_data; }
 
@@ -120,6 +155,9 @@ private:
   // 8 bytes on all platforms.
   uint64_t *m_ptr;
   uint64_t m_data[MAX_STACK_BYTE_SIZE/sizeof(uint64_t)];
+  uint64_t m_run_number;
+  uint64_t m_slots[MAX_NUMBER_SLOTS * WORDS_PER_SLOT];
+  uint64_t m_slot_run_numbers[MAX_NUMBER_SLOTS];
 };
 
 
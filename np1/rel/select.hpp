@@ -39,10 +39,25 @@ public:
         record_callback<pin_prev_record_output_stream<Output_Stream> >(
             vm_infos, fastpath_summaries, pinning_os, heap));
     } else {
-      passthrough_output_stream<Output_Stream> passthrough_os(output);
-      input.parse_records(
-        record_callback<passthrough_output_stream<Output_Stream> >(
-            vm_infos, fastpath_summaries, passthrough_os, heap));
+      // Without references to the previous record, the expressions can be run over a batch of records at once.
+      rstd::vector<rlang::batch_vm> batch_vms;
+      bool any_batch_runnable = false;
+      size_t i;
+      for (i = 0; i < vm_infos.size(); ++i) {
+        batch_vms.push_back(rlang::batch_vm(vm_infos[i].get_vm()));
+        any_batch_runnable = any_batch_runnable
+                              || (!fastpath_summaries[i].is_fastpath() && batch_vms.back().is_runnable());
+      }
+
+      if (any_batch_runnable) {
+        input.template parse_record_batches<rlang::batch_vm::MAX_BATCH_SIZE>(
+          batch_callback<Output_Stream>(vm_infos, batch_vms, fastpath_summaries, output, heap));
+      } else {
+        passthrough_output_stream<Output_Stream> passthrough_os(output);
+        input.parse_records(
+          record_callback<passthrough_output_stream<Output_Stream> >(
+              vm_infos, fastpath_summaries, passthrough_os, heap));
+      }
     }
   }
 
@@ -234,6 +249,136 @@ private:
   };
 
 
+  /// Runs the expressions over a batch of records at a time.  Only for when there are no references to the
+  /// previous record.
+  template <typename Output>
+  struct batch_callback {
+    batch_callback(rstd::vector<rlang::compiler::vm_info> &vm_infos,
+                    rstd::vector<rlang::batch_vm> &batch_vms,
+                    const rstd::vector<vm_fastpath_summary> &fastpath_summaries,
+                    Output &output,
+                    rlang::vm_heap &heap)
+    : m_vm_infos(vm_infos), m_batch_vms(batch_vms), m_fastpath_summaries(fastpath_summaries),
+      m_output(output), m_heap(heap) {
+      m_field_refs.resize(m_vm_infos.size());
+      m_batch_results.resize(m_vm_infos.size());
+    }
+
+    bool operator()(const record_ref *records, size_t number_records) {
+      size_t number_columns = m_vm_infos.size();
+      size_t column;
+
+      m_heap.reset();
+
+      for (column = 0; column < number_columns; ++column) {
+        m_batch_results[column] = NULL;
+        if (!m_fastpath_summaries[column].is_fastpath() && m_batch_vms[column].is_runnable()) {
+          m_batch_results[column] = &m_batch_vms[column].run(m_heap, records, number_records);
+        }
+      }
+
+      size_t i;
+      for (i = 0; i < number_records; ++i) {
+        const record_ref &r = records[i];
+        m_num_str_buffer.clear();
+
+        for (column = 0; column < number_columns; ++column) {
+          const vm_fastpath_summary &fastpath_summary = m_fastpath_summaries[column];
+          str::ref &field_ref = m_field_refs[column];
+          if (fastpath_summary.is_fastpath()) {
+            field_ref = r.mandatory_field(fastpath_summary.field_number());
+          } else if (m_batch_results[column]) {
+            const rlang::vm_batch_stack &stack = *m_batch_results[column];
+            switch (m_batch_vms[column].return_type()) {
+            case rlang::dt::TYPE_STRING:
+            case rlang::dt::TYPE_ISTRING:
+            case rlang::dt::TYPE_IPADDRESS:
+              field_ref = stack.column<str::ref>(0)[i];
+              break;
+
+            case rlang::dt::TYPE_INT:
+              field_ref = m_num_str_buffer.append(stack.column<int64_t>(0)[i]);
+              break;
+
+            case rlang::dt::TYPE_UINT:
+              field_ref = m_num_str_buffer.append(stack.column<uint64_t>(0)[i]);
+              break;
+
+            case rlang::dt::TYPE_DOUBLE:
+              field_ref = m_num_str_buffer.append(stack.column<double>(0)[i]);
+              break;
+
+            case rlang::dt::TYPE_BOOL:
+              field_ref = str::from_bool(stack.column<bool>(0)[i]);
+              break;
+            }
+          } else {
+            rlang::vm &vm = m_vm_infos[column].get_vm();
+            rlang::vm_stack &stack = vm.run_no_heap_reset(m_heap, r, m_empty.ref());
+            switch (vm.return_type()) {
+            case rlang::dt::TYPE_STRING:
+            case rlang::dt::TYPE_ISTRING:
+            case rlang::dt::TYPE_IPADDRESS:
+              {
+                str::ref s;
+                stack.pop(s);
+                field_ref = s;
+              }
+              break;
+
+            case rlang::dt::TYPE_INT:
+              {
+                int64_t i;
+                stack.pop(i);            
+                field_ref = m_num_str_buffer.append(i);
+              }
+              break;
+
+            case rlang::dt::TYPE_UINT:
+              {
+                uint64_t ui;
+                stack.pop(ui);            
+                field_ref = m_num_str_buffer.append(ui);
+              }
+              break;
+
+            case rlang::dt::TYPE_DOUBLE:
+              {
+                double d;
+                stack.pop(d);
+                field_ref = m_num_str_buffer.append(d);
+              }
+              break;
+
+            case rlang::dt::TYPE_BOOL:
+              {
+                bool b;
+                stack.pop(b);
+                field_ref = str::from_bool(b);
+              }
+              break;
+            }
+          }
+        }
+
+        record_ref::write(m_output, m_field_refs);
+      }
+
+      return true;
+    }
+
+    rstd::vector<rlang::compiler::vm_info> &m_vm_infos;
+    rstd::vector<rlang::batch_vm> &m_batch_vms;
+    const rstd::vector<vm_fastpath_summary> &m_fastpath_summaries;
+    rstd::vector<const rlang::vm_batch_stack *> m_batch_results;
+    rstd::vector<str::ref> m_field_refs;
+    num_str_buffer m_num_str_buffer;
+    Output &m_output;
+    rlang::vm_heap &m_heap;
+    record m_empty;
+  };
+
+
   /// This output stream wrapper stores the "previous" record.
   template <typename Output_Stream>
   struct pin_prev_record_output_stream {
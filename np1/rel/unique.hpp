@@ -3,32 +3,66 @@
 #ifndef NP1_REL_UNIQUE_HPP
 #define NP1_REL_UNIQUE_HPP
 
+
+#include "np1/rel/detail/record_multihashmap.hpp"
+#include "np1/rel/detail/record_partitions.hpp"
+#include "np1/rel/detail/spilling_record_multihashmap.hpp"
+#include "np1/rel/detail/spilling_record_fingerprint_set.hpp"
+#include "np1/rel/detail/sort_order.hpp"
+
+
 namespace np1 {
 namespace rel {
 
 
+/// Writes the first record with each key.  Unless the input is sorted, the keys are kept in a hash table.  If the
+/// table outgrows its memory budget then records with new keys are partitioned into temporary files and each
+/// partition is dealt with afterwards in the same way.  Partitioned records are tagged with their record numbers
+/// so the output is always in input order.
 class unique {
 public:
   template <typename Input_Stream, typename Output_Stream>
   void operator()(Input_Stream &input, Output_Stream &output,
                   const rstd::vector<rel::rlang::token> &tokens) {
+    (*this)(input, output, tokens, false);
+  }
+
+  /// If is_fingerprint_only is true then only a 128-bit fingerprint of each key is kept instead of a copy of the
+  /// record.
+  template <typename Input_Stream, typename Output_Stream>
+  void operator()(Input_Stream &input, Output_Stream &output,
+                  const rstd::vector<rel::rlang::token> &tokens, bool is_fingerprint_only) {
     // Read the headings from stdin.
     record headings(input.parse_headings());
     
     // Make the map that will hold the groupings.
     detail::compare_specs specs(headings);
     validate_specs(specs);
-    detail::record_multihashmap<empty_type> unique_map(specs);
-  
+
     // Parse the stream and output only the first instance of each record.
     headings.write(output);
-    input.parse_records(record_callback<Output_Stream>(output, unique_map));
+
+    // If the input is sorted on all the headings then duplicates are adjacent and we just need to remember the
+    // last record we wrote.
+    if (detail::sort_order::from_headings(headings.ref()).is_grouped_by(specs)) {
+      input.parse_records(sorted_record_callback<Output_Stream>(output, specs));
+      return;
+    }
+
+    stream_sink<Output_Stream> sink(output);
+    if (is_fingerprint_only) {
+      hash_unique<detail::spilling_record_fingerprint_set>(specs, input, false, sink, 0);
+    } else {
+      hash_unique<map_type>(specs, input, false, sink, 0);
+    }
   }
 
 private:
   //TODO: put the empty type in one place.
   struct empty_type {};
 
+  typedef detail::spilling_record_multihashmap<empty_type> map_type;
+
   static void validate_specs(const detail::compare_specs &specs) {
     NP1_ASSERT(
       !specs.has_double(),
@@ -36,15 +70,103 @@ private:
   }
 
   
-  // The callback for all records.
+  template <typename Set, typename Input, typename Sink>
+  static void hash_unique(const detail::compare_specs &specs, Input &input, bool input_is_tagged, Sink &sink,
+                          size_t level) {
+    detail::record_partitions partitions(specs, level);
+
+    {
+      Set set(specs, partitions, level);
+      input.parse_records(record_callback<Set, Sink>(set, input_is_tagged, sink));
+    }
+
+    // Every partitioned record comes after every record that's been written already, but the partitions'
+    // output needs merging to get it back into input order.
+    rstd::vector<detail::record_partitions::partition *> outputs;
+    size_t i;
+    for (i = 0; i < partitions.size(); ++i) {
+      if (partitions[i].number_records() > 0) {
+        detail::record_partitions::partition *output =
+          new (rstd::detail::mem::alloc(sizeof(detail::record_partitions::partition)))
+            detail::record_partitions::partition();
+        outputs.push_back(output);
+        partition_sink output_sink(*output);
+        hash_unique<Set>(specs, partitions[i], true, output_sink, level + 1);
+      }
+    }
+
+    detail::record_partitions::merge_tagged(outputs, sink);
+
+    for (i = 0; i < outputs.size(); ++i) {
+      rstd::detail::mem::destruct_and_free(outputs[i]);
+    }
+  }
+
+
+  // Returns true if r is the first record with its key.  A record that doesn't fit goes to a partition.
+  static bool insert_if_first(map_type &m, const record_ref &r, uint64_t tag) {
+    return !m.find(r) && m.insert_with_checksum(r, empty_type(), tag);
+  }
+
+  static bool insert_if_first(detail::spilling_record_fingerprint_set &s, const record_ref &r, uint64_t tag) {
+    return s.insert_with_checksum(r, tag);
+  }
+
+
+  // Writes the unique records to the real output.
   template <typename Output>
+  struct stream_sink {
+    explicit stream_sink(Output &output) : m_output(output) {}
+
+    void write(const record_ref &r, uint64_t tag) {
+      // Records that have been through a partition have a tag in their checksum, which must not escape.
+      r.write_with_checksum(m_output, 0);
+    }
+
+    Output &m_output;
+  };
+
+
+  // Writes the unique records to a temporary file, tagged with their input record numbers.
+  struct partition_sink {
+    explicit partition_sink(detail::record_partitions::partition &p) : m_partition(p) {}
+
+    void write(const record_ref &r, uint64_t tag) { m_partition.write_with_checksum(r, tag); }
+
+    detail::record_partitions::partition &m_partition;
+  };
+
+
+  // The callback for all records.
+  template <typename Set, typename Sink>
   struct record_callback {
-    record_callback(Output &output, detail::record_multihashmap<empty_type> &m) 
-      : m_output(output), m_map(m) {}
-      
+    record_callback(Set &set, bool input_is_tagged, Sink &sink)
+      : m_set(set), m_input_is_tagged(input_is_tagged), m_sink(sink) {}
+
     bool operator()(const record_ref &r) const {
-      if (!m_map.find(r)) {
-        m_map.insert(r, empty_type());
+      uint64_t tag = m_input_is_tagged ? r.checksum() : r.record_number();
+      if (insert_if_first(m_set, r, tag)) {
+        m_sink.write(r, tag);
+      }
+
+      return true;
+    }
+
+    Set &m_set;
+    bool m_input_is_tagged;
+    Sink &m_sink;
+  };
+
+
+  // The callback for all records when the input is already sorted.
+  template <typename Output>
+  struct sorted_record_callback {
+    sorted_record_callback(Output &output, const detail::compare_specs &specs) 
+      : m_output(output), m_specs(specs) {}
+      
+    bool operator()(const record_ref &r) {
+      if (m_last.is_empty() || (detail::record_compare(m_last, r, m_specs) != 0)) {
+        m_last.assign(r);
         r.write(m_output);
       }
       
@@ -52,7 +174,8 @@ private:
     }
     
     Output &m_output;
-    detail::record_multihashmap<empty_type> &m_map;  
+    detail::compare_specs m_specs;
+    record m_last;
   };
 };
 
@@ -35,7 +35,13 @@ public:
 
     //TODO: a fast path for simple comparisons.  Remember that integers can't
     // be compared with memcmp because of leading zeroes.
-    input.parse_records(record_callback<Output_Stream>(vm, output, heap));
+    rlang::batch_vm bvm(vm);
+    if (bvm.is_runnable()) {
+      input.template parse_record_batches<rlang::batch_vm::MAX_BATCH_SIZE>(
+        batch_callback<Output_Stream>(bvm, output, heap));
+    } else {
+      input.parse_records(record_callback<Output_Stream>(vm, output, heap));
+    }
   }
 
 private:
@@ -60,6 +66,29 @@ private:
     rlang::vm_heap &m_heap;
     record m_empty;
   };
+
+  template <typename Output>
+  struct batch_callback {
+    batch_callback(rlang::batch_vm &bvm, Output &o, rlang::vm_heap &h)
+      : m_bvm(bvm), m_output(o), m_heap(h) {}  
+
+    bool operator()(const record_ref *records, size_t number_records) const {
+      m_heap.reset();
+      const bool *results = m_bvm.run(m_heap, records, number_records).column<bool>(0);
+      size_t i;
+      for (i = 0; i < number_records; ++i) {
+        if (results[i]) {
+          records[i].write(m_output);
+        }
+      }
+
+      return true;
+    }        
+
+    rlang::batch_vm &m_bvm;
+    Output &m_output;
+    rlang::vm_heap &m_heap;
+  };
 };
 
 
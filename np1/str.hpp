@@ -4,7 +4,11 @@
 #define NP1_STR_HPP
 
 #include "rstd/string.hpp"
+#include "np1/detail/powers_of_five.hpp"
 #include <ctype.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 // String utilities.
 
@@ -42,11 +46,50 @@ private:
 enum { MAX_NUM_STR_LENGTH = 64 };
 
 
+namespace detail {
+
+// isdigit() and isspace() for the "C" locale, without the function calls.
+inline bool is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+inline bool is_space(char c) { return (' ' == c) || ((unsigned char)(c - '\t') < 5); }
+
+// SWAR ("SIMD within a register") helpers for working on 8 decimal digits at a time.  See Lemire,
+// "Parsing series of integers with SIMD" and the simdjson number parser.
+
+// Load 8 characters into a uint64_t with the first character in the lowest byte.
+inline uint64_t load_8_chars(const char *s) {
+  uint64_t v;
+  memcpy(&v, s, sizeof(v));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+// True if all 8 characters are '0'..'9'.
+inline bool is_8_digits(uint64_t v) {
+  return (((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+          == 0x3333333333333333ULL);
+}
+
+// Convert 8 digit characters loaded by load_8_chars() to their value.
+inline uint32_t parse_8_digits(uint64_t v) {
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 100 + (1000000ULL << 32);
+  const uint64_t mul2 = 1 + (10000ULL << 32);
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+  return (uint32_t)v;
+}
+
+} // namespace detail
+
+
 /* Don't be tempted to use strtoll, it sets things to LONG_MAX on overflow and
-   does other useless crap. */
+   does other useless crap.  Numbers that are too big wrap around, as they always have. */
 int64_t partial_dec_to_int64(const char *s, const char *s_end,
                              char **end_of_number_p) {
-  while ((s < s_end) && isspace(*s)) {
+  while ((s < s_end) && detail::is_space(*s)) {
     ++s;
   }
 
@@ -56,21 +99,24 @@ int64_t partial_dec_to_int64(const char *s, const char *s_end,
   }
   
   bool is_negative = ('-' == *s);
-  int64_t end_multiplier = 1;
   if (is_negative) {
     ++s;
-    end_multiplier = -1;
   }
 
-  int64_t i = 0;
+  // Unsigned arithmetic so that wrapping around is well-defined.
+  uint64_t i = 0;
+
+  while ((s_end - s >= 8) && detail::is_8_digits(detail::load_8_chars(s))) {
+    i = (i * 100000000) + detail::parse_8_digits(detail::load_8_chars(s));
+    s += 8;
+  }
 
-  for (; (s < s_end) && isdigit(*s); ++s) {
+  for (; (s < s_end) && detail::is_digit(*s); ++s) {
     i = (i * 10) + (*s - '0');
   }
 
-  i *= end_multiplier;
   *end_of_number_p = (char *)s;
-  return i;
+  return is_negative ? (int64_t)(0 - i) : (int64_t)i;
 }
 
 
@@ -141,8 +187,47 @@ int64_t hex_to_int64(const char *s) {
   return result;
 }
 
-// Ideally we would do our own translation here to avoid the weirdnesses in strtod but it's too hard for now.
-double partial_dec_to_double(const char *s, const char *s_end, char **end_of_number_p) {
+namespace detail {
+
+// 64 x 64 -> 128 bit unsigned multiply.
+inline void multiply_64(uint64_t a, uint64_t b, uint64_t &low, uint64_t &high) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 r = a;
+  r *= b;
+  low = (uint64_t)r;
+  high = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  low = t + (rm1 << 32);
+  c += low < t;
+  high = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+inline double double_from_bits(uint64_t bits) {
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+inline uint64_t double_to_bits(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+enum {
+  DOUBLE_MANTISSA_BITS = 52,
+  DOUBLE_EXPONENT_BIAS = 1023,
+  DOUBLE_INFINITE_EXPONENT = 0x7FF,
+  MAX_FAST_SIGNIFICANT_DIGITS = 19
+};
+
+// strtod() doesn't take a length so it needs the number to be NUL-terminated.
+inline double libc_partial_dec_to_double(const char *s, const char *s_end, char **end_of_number_p) {
   char old_char = *s_end;
   *((char *)s_end) = '\0';
   const double d = strtod(s, end_of_number_p);
@@ -150,6 +235,195 @@ double partial_dec_to_double(const char *s, const char *s_end, char **end_of_num
   return d;
 }
 
+// Work out w * 10^q, correctly rounded, using the Eisel-Lemire algorithm.  w must not be zero.  Returns false in
+// the very rare cases where 128 bits of 5^q aren't enough to be sure of the rounding.  See Lemire, "Number
+// Parsing at a Gigabyte per Second".
+inline bool eisel_lemire(uint64_t w, int64_t q, bool is_negative, double &result) {
+  const uint64_t sign = is_negative ? ((uint64_t)1 << 63) : 0;
+  if (q < ::np1::detail::MIN_POWER_OF_FIVE) {
+    result = double_from_bits(sign);
+    return true;
+  }
+
+  if (q > ::np1::detail::MAX_POWER_OF_FIVE) {
+    result = double_from_bits(sign | ((uint64_t)DOUBLE_INFINITE_EXPONENT << DOUBLE_MANTISSA_BITS));
+    return true;
+  }
+
+  const int leading_zeros = __builtin_clzll(w);
+  w <<= leading_zeros;
+
+  const size_t power_index = 2 * (size_t)(q - ::np1::detail::MIN_POWER_OF_FIVE);
+  uint64_t low;
+  uint64_t high;
+  multiply_64(w, ::np1::detail::POWERS_OF_FIVE_128[power_index], low, high);
+
+  // We need 55 good bits.  If the bits below them are all ones then the low half of 5^q might carry into them.
+  if (0x1FF == (high & 0x1FF)) {
+    uint64_t second_low;
+    uint64_t second_high;
+    multiply_64(w, ::np1::detail::POWERS_OF_FIVE_128[power_index + 1], second_low, second_high);
+    low += second_high;
+    if (second_high > low) {
+      ++high;
+    }
+
+    if ((0xFFFFFFFFFFFFFFFFULL == low) && ((q < -27) || (q > 55))) {
+      return false;
+    }
+  }
+
+  const int upper_bit = (int)(high >> 63);
+  const int shift = upper_bit + 64 - DOUBLE_MANTISSA_BITS - 3;
+  uint64_t mantissa = high >> shift;
+  // floor(q * log2(10)) + 63, see the paper.
+  int64_t power2 = ((((152170 + 65536) * q) >> 16) + 63) + upper_bit - leading_zeros + DOUBLE_EXPONENT_BIAS;
+
+  if (power2 <= 0) {
+    // Subnormal.
+    if (-power2 + 1 >= 64) {
+      result = double_from_bits(sign);
+      return true;
+    }
+
+    mantissa >>= -power2 + 1;
+    mantissa += (mantissa & 1);
+    mantissa >>= 1;
+    power2 = (mantissa < ((uint64_t)1 << DOUBLE_MANTISSA_BITS)) ? 0 : 1;
+    result = double_from_bits(sign | ((uint64_t)power2 << DOUBLE_MANTISSA_BITS) | mantissa);
+    return true;
+  }
+
+  // Exactly halfway between two doubles, round to even.  This can only happen for small q.
+  if ((low <= 1) && (q >= -4) && (q <= 23) && (1 == (mantissa & 3))) {
+    if ((mantissa << shift) == high) {
+      mantissa &= ~(uint64_t)1;
+    }
+  }
+
+  mantissa += (mantissa & 1);
+  mantissa >>= 1;
+  if (mantissa >= ((uint64_t)2 << DOUBLE_MANTISSA_BITS)) {
+    mantissa = (uint64_t)1 << DOUBLE_MANTISSA_BITS;
+    ++power2;
+  }
+
+  mantissa &= ~((uint64_t)1 << DOUBLE_MANTISSA_BITS);
+  if (power2 >= DOUBLE_INFINITE_EXPONENT) {
+    power2 = DOUBLE_INFINITE_EXPONENT;
+    mantissa = 0;
+  }
+
+  result = double_from_bits(sign | ((uint64_t)power2 << DOUBLE_MANTISSA_BITS) | mantissa);
+  return true;
+}
+
+} // namespace detail
+
+
+/// Like strtod() but doesn't need a NUL-terminated string and is a lot faster on ordinary decimal numbers.
+/**
+ * Numbers with up to 19 significant digits are converted exactly, first by Clinger's fast path when both the
+ * digits and the power of ten fit in a double and then by the Eisel-Lemire algorithm.  Anything else- longer
+ * numbers, hexadecimal, "inf", "nan", and things that aren't numbers at all- is handed to strtod().
+ */
+double partial_dec_to_double(const char *s, const char *s_end, char **end_of_number_p) {
+  const char *p = s;
+  while ((p < s_end) && detail::is_space(*p)) {
+    ++p;
+  }
+
+  bool is_negative = false;
+  if ((p < s_end) && (('-' == *p) || ('+' == *p))) {
+    is_negative = ('-' == *p);
+    ++p;
+  }
+
+  if ((s_end - p >= 2) && ('0' == p[0]) && (('x' == p[1]) || ('X' == p[1]))) {
+    return detail::libc_partial_dec_to_double(s, s_end, end_of_number_p);
+  }
+
+  // The significant digits, not counting leading zeros.
+  uint64_t w = 0;
+  size_t number_significant_digits = 0;
+  const char *integer_start = p;
+  for (; (p < s_end) && detail::is_digit(*p); ++p) {
+    if ((0 != w) || ('0' != *p)) {
+      w = (w * 10) + (*p - '0');
+      ++number_significant_digits;
+    }
+  }
+
+  size_t number_digits = p - integer_start;
+  int64_t exponent = 0;
+  if ((p < s_end) && ('.' == *p)) {
+    ++p;
+    const char *fraction_start = p;
+    for (; (p < s_end) && detail::is_digit(*p); ++p) {
+      if ((0 != w) || ('0' != *p)) {
+        w = (w * 10) + (*p - '0');
+        ++number_significant_digits;
+      }
+    }
+
+    number_digits += p - fraction_start;
+    exponent = -(int64_t)(p - fraction_start);
+  }
+
+  if ((0 == number_digits) || (number_significant_digits > detail::MAX_FAST_SIGNIFICANT_DIGITS)) {
+    return detail::libc_partial_dec_to_double(s, s_end, end_of_number_p);
+  }
+
+  // The exponent is only part of the number if there's at least one digit in it.
+  if ((p < s_end) && (('e' == *p) || ('E' == *p))) {
+    const char *exponent_p = p + 1;
+    bool is_negative_exponent = false;
+    if ((exponent_p < s_end) && (('-' == *exponent_p) || ('+' == *exponent_p))) {
+      is_negative_exponent = ('-' == *exponent_p);
+      ++exponent_p;
+    }
+
+    if ((exponent_p < s_end) && detail::is_digit(*exponent_p)) {
+      int64_t explicit_exponent = 0;
+      for (; (exponent_p < s_end) && detail::is_digit(*exponent_p); ++exponent_p) {
+        // Anything this big is zero or infinity anyway.
+        if (explicit_exponent < 0x10000000) {
+          explicit_exponent = (explicit_exponent * 10) + (*exponent_p - '0');
+        }
+      }
+
+      exponent += is_negative_exponent ? -explicit_exponent : explicit_exponent;
+      p = exponent_p;
+    }
+  }
+
+  *end_of_number_p = (char *)p;
+
+  if (0 == w) {
+    return is_negative ? -0.0 : 0.0;
+  }
+
+#if defined(FLT_EVAL_METHOD) && (0 == FLT_EVAL_METHOD)
+  static const double EXACT_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  if ((exponent >= -22) && (exponent <= 22) && (w <= ((uint64_t)1 << 53))) {
+    double d = (double)w;
+    d = (exponent < 0) ? d / EXACT_POWERS_OF_TEN[-exponent] : d * EXACT_POWERS_OF_TEN[exponent];
+    return is_negative ? -d : d;
+  }
+#endif
+
+  double d;
+  if (detail::eisel_lemire(w, exponent, is_negative, d)) {
+    return d;
+  }
+
+  return detail::libc_partial_dec_to_double(s, s_end, end_of_number_p);
+}
+
 double dec_to_double(const char *s, size_t length) {
   char *end_of_number_p;
   const char *s_end = s + length;
@@ -166,28 +440,52 @@ double dec_to_double(const str::ref &s) {
 
 
 
+namespace detail {
+static const char DIGIT_PAIRS[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+} // namespace detail
+
+
+// Two digits at a time from a lookup table, which halves the number of divisions.
 void to_dec_str(char *num_str, uint64_t i) {
-  char reversed[MAX_NUM_STR_LENGTH];
-  char *reversed_ptr = reversed;
-  do {
-    *reversed_ptr++ = '0' + i % 10;
-    i = i/10;
-  } while (i != 0);
-  
-  while (--reversed_ptr >= reversed) {
-    *num_str++ = *reversed_ptr;
+  char buffer[MAX_NUM_STR_LENGTH];
+  char *p = buffer + sizeof(buffer);
+  while (i >= 100) {
+    const size_t pair = (size_t)(i % 100) * 2;
+    i /= 100;
+    p -= 2;
+    memcpy(p, &detail::DIGIT_PAIRS[pair], 2);
   }
-  
-  *num_str = '\0';
+
+  if (i >= 10) {
+    p -= 2;
+    memcpy(p, &detail::DIGIT_PAIRS[(size_t)i * 2], 2);
+  } else {
+    *--p = (char)('0' + i);
+  }
+
+  const size_t length = buffer + sizeof(buffer) - p;
+  memcpy(num_str, p, length);
+  num_str[length] = '\0';
 }
 
 void to_dec_str(char *num_str, int64_t i) {
+  uint64_t ui = (uint64_t)i;
   if (i < 0) {
     *num_str++ = '-';
-    i = -i;
+    ui = 0 - ui;
   }
   
-  to_dec_str(num_str, (uint64_t)i);
+  to_dec_str(num_str, ui);
 }
 
 void to_dec_str(char *num_str, int32_t i) {
@@ -321,8 +619,106 @@ rstd::string to_hex_str(int64_t i) {
 }
 
 
+namespace detail {
+
+// Write the 6 digits after the decimal point, with leading zeros.
+inline void write_6_digit_fraction(char *p, uint32_t fraction) {
+  memcpy(p, &DIGIT_PAIRS[(fraction / 10000) * 2], 2);
+  memcpy(p + 2, &DIGIT_PAIRS[((fraction / 100) % 100) * 2], 2);
+  memcpy(p + 4, &DIGIT_PAIRS[(fraction % 100) * 2], 2);
+}
+
+// Work out d * 10^6 rounded to the nearest integer, ties to even, which is what printf("%f") prints.  Returns
+// false if the answer doesn't fit in 64 bits, or d is infinite or NaN.
+inline bool to_rounded_millionths(double d, uint64_t &result) {
+  const uint64_t bits = double_to_bits(d);
+  const int biased_exponent = (int)((bits >> DOUBLE_MANTISSA_BITS) & DOUBLE_INFINITE_EXPONENT);
+  uint64_t mantissa = bits & (((uint64_t)1 << DOUBLE_MANTISSA_BITS) - 1);
+  if (DOUBLE_INFINITE_EXPONENT == biased_exponent) {
+    return false;
+  }
+
+  int exponent = -DOUBLE_EXPONENT_BIAS - DOUBLE_MANTISSA_BITS + 1;
+  if (biased_exponent > 0) {
+    mantissa |= (uint64_t)1 << DOUBLE_MANTISSA_BITS;
+    exponent = biased_exponent - DOUBLE_EXPONENT_BIAS - DOUBLE_MANTISSA_BITS;
+  }
+
+  // |d| * 10^6 = (high:low) * 2^exponent, exactly.
+  uint64_t low;
+  uint64_t high;
+  multiply_64(mantissa, 1000000, low, high);
+
+  if (exponent >= 0) {
+    if ((0 != high) || (exponent >= 64) || ((low >> (63 - exponent)) > 1)) {
+      return false;
+    }
+
+    result = low << exponent;
+    return true;
+  }
+
+  // (high:low) is less than 2^73, so shifting right by 75 or more leaves less than a half.
+  const int shift = -exponent;
+  if (shift >= 75) {
+    result = 0;
+    return true;
+  }
+
+  uint64_t quotient;
+  bool is_more_than_half;
+  bool is_half;
+  if (shift < 64) {
+    if (0 != (high >> shift)) {
+      return false;
+    }
+
+    quotient = (low >> shift) | (high << (63 - shift) << 1);
+    const uint64_t remainder = low & (((uint64_t)1 << shift) - 1);
+    const uint64_t half = (uint64_t)1 << (shift - 1);
+    is_more_than_half = (remainder > half);
+    is_half = (remainder == half);
+  } else if (64 == shift) {
+    quotient = high;
+    is_more_than_half = (low > ((uint64_t)1 << 63));
+    is_half = (low == ((uint64_t)1 << 63));
+  } else {
+    quotient = high >> (shift - 64);
+    const uint64_t remainder_high = high & (((uint64_t)1 << (shift - 64)) - 1);
+    const uint64_t half_high = (uint64_t)1 << (shift - 65);
+    is_more_than_half = (remainder_high > half_high) || ((remainder_high == half_high) && (0 != low));
+    is_half = (remainder_high == half_high) && (0 == low);
+  }
+
+  if (is_more_than_half || (is_half && (0 != (quotient & 1)))) {
+    ++quotient;
+  }
+
+  result = quotient;
+  return true;
+}
+
+} // namespace detail
+
+
+/// The same as sprintf("%f"), without the sprintf.  Numbers too big for MAX_NUM_STR_LENGTH characters are
+/// written with an exponent instead.
 void to_dec_str(char *num_str, double d) {
-  sprintf(num_str, "%f", d);
+  uint64_t millionths;
+  if (!detail::to_rounded_millionths(d, millionths)) {
+    sprintf(num_str, ((d > -1e50) && (d < 1e50)) ? "%f" : "%.17g", d);
+    return;
+  }
+
+  if (detail::double_to_bits(d) >> 63) {
+    *num_str++ = '-';
+  }
+
+  to_dec_str(num_str, millionths / 1000000);
+  num_str += strlen(num_str);
+  *num_str++ = '.';
+  detail::write_6_digit_fraction(num_str, (uint32_t)(millionths % 1000000));
+  num_str[6] = '\0';
 }
 
 rstd::string to_dec_str(double d) {
@@ -331,6 +727,222 @@ rstd::string to_dec_str(double d) {
   return num_str;
 }
 
+
+namespace detail {
+
+// The Grisu2 algorithm for the shortest (nearly always) decimal digits that read back as the same double.  See
+// Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers".  This follows Milo Yip's
+// public-domain implementation.
+
+struct diy_fp {
+  diy_fp() : m_f(0), m_e(0) {}
+  diy_fp(uint64_t f, int e) : m_f(f), m_e(e) {}
+
+  explicit diy_fp(double d) {
+    const uint64_t bits = double_to_bits(d);
+    const int biased_exponent = (int)((bits >> DOUBLE_MANTISSA_BITS) & DOUBLE_INFINITE_EXPONENT);
+    const uint64_t significand = bits & (((uint64_t)1 << DOUBLE_MANTISSA_BITS) - 1);
+    if (0 != biased_exponent) {
+      m_f = significand + ((uint64_t)1 << DOUBLE_MANTISSA_BITS);
+      m_e = biased_exponent - DOUBLE_EXPONENT_BIAS - DOUBLE_MANTISSA_BITS;
+    } else {
+      m_f = significand;
+      m_e = 1 - DOUBLE_EXPONENT_BIAS - DOUBLE_MANTISSA_BITS;
+    }
+  }
+
+  diy_fp operator - (const diy_fp &other) const { return diy_fp(m_f - other.m_f, m_e); }
+
+  // The top 64 bits of the product, rounded.
+  diy_fp operator * (const diy_fp &other) const {
+    uint64_t low;
+    uint64_t high;
+    multiply_64(m_f, other.m_f, low, high);
+    return diy_fp(high + (low >> 63), m_e + other.m_e + 64);
+  }
+
+  diy_fp normalize() const {
+    const int shift = __builtin_clzll(m_f);
+    return diy_fp(m_f << shift, m_e - shift);
+  }
+
+  // The points halfway to the doubles either side, normalized to the same exponent.
+  void normalized_boundaries(diy_fp &minus, diy_fp &plus) const {
+    plus = diy_fp((m_f << 1) + 1, m_e - 1).normalize();
+    minus = (m_f == ((uint64_t)1 << DOUBLE_MANTISSA_BITS))
+              ? diy_fp((m_f << 2) - 1, m_e - 2) : diy_fp((m_f << 1) - 1, m_e - 1);
+    minus.m_f <<= minus.m_e - plus.m_e;
+    minus.m_e = plus.m_e;
+  }
+
+  uint64_t m_f;
+  int m_e;
+};
+
+// A power of ten c = 10^-k such that c * 2^e has a binary exponent between -60 and -32.
+inline diy_fp get_cached_power(int e, int &k) {
+  const double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = (int)dk;
+  if (dk - ik > 0.0) {
+    ++ik;
+  }
+
+  const size_t index = (size_t)((ik >> 3) + 1);
+  k = -(::np1::detail::MIN_CACHED_POWER_OF_TEN + (int)index * ::np1::detail::CACHED_POWER_OF_TEN_STEP);
+  return diy_fp(::np1::detail::CACHED_POWERS_OF_TEN[index].m_f, ::np1::detail::CACHED_POWERS_OF_TEN[index].m_e);
+}
+
+static const uint32_t POWERS_OF_TEN_32[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+inline int count_decimal_digits_32(uint32_t n) {
+  int number_digits = 1;
+  while ((number_digits < 10) && (n >= POWERS_OF_TEN_32[number_digits])) {
+    ++number_digits;
+  }
+
+  return number_digits;
+}
+
+inline void grisu_round(char *buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa,
+                        uint64_t wp_w) {
+  while ((rest < wp_w) && (delta - rest >= ten_kappa)
+         && ((rest + ten_kappa < wp_w) || (wp_w - rest > rest + ten_kappa - wp_w))) {
+    --buffer[length - 1];
+    rest += ten_kappa;
+  }
+}
+
+inline void grisu_digit_gen(const diy_fp &w, const diy_fp &mp, uint64_t delta, char *buffer, int &length,
+                            int &k) {
+  const diy_fp one((uint64_t)1 << -mp.m_e, mp.m_e);
+  const diy_fp wp_w = mp - w;
+  uint32_t p1 = (uint32_t)(mp.m_f >> -one.m_e);
+  uint64_t p2 = mp.m_f & (one.m_f - 1);
+  int kappa = count_decimal_digits_32(p1);
+  length = 0;
+
+  while (kappa > 0) {
+    const uint32_t divisor = POWERS_OF_TEN_32[kappa - 1];
+    const uint32_t digit = p1 / divisor;
+    p1 %= divisor;
+    if ((0 != digit) || (0 != length)) {
+      buffer[length++] = (char)('0' + digit);
+    }
+
+    --kappa;
+    const uint64_t rest = ((uint64_t)p1 << -one.m_e) + p2;
+    if (rest <= delta) {
+      k += kappa;
+      grisu_round(buffer, length, delta, rest, (uint64_t)POWERS_OF_TEN_32[kappa] << -one.m_e, wp_w.m_f);
+      return;
+    }
+  }
+
+  while (true) {
+    p2 *= 10;
+    delta *= 10;
+    const char digit = (char)(p2 >> -one.m_e);
+    if ((0 != digit) || (0 != length)) {
+      buffer[length++] = (char)('0' + digit);
+    }
+
+    p2 &= one.m_f - 1;
+    --kappa;
+    if (p2 < delta) {
+      k += kappa;
+      grisu_round(buffer, length, delta, p2, one.m_f, (-kappa < 10) ? wp_w.m_f * POWERS_OF_TEN_32[-kappa] : 0);
+      return;
+    }
+  }
+}
+
+// Put the digits of d, which must be finite and greater than zero, in buffer so that d ~= digits * 10^k.
+inline void grisu2(double d, char *buffer, int &length, int &k) {
+  const diy_fp v(d);
+  diy_fp w_minus;
+  diy_fp w_plus;
+  v.normalized_boundaries(w_minus, w_plus);
+
+  const diy_fp c_mk = get_cached_power(w_plus.m_e, k);
+  const diy_fp w = v.normalize() * c_mk;
+  diy_fp wp = w_plus * c_mk;
+  diy_fp wm = w_minus * c_mk;
+  ++wm.m_f;
+  --wp.m_f;
+  grisu_digit_gen(w, wp, wp.m_f - wm.m_f, buffer, length, k);
+}
+
+} // namespace detail
+
+
+/// Write the shortest (nearly always) decimal string that partial_dec_to_double() or strtod() will read back
+/// as exactly the same double.  Use this when the string will be read back by a program, and
+/// to_dec_str(double) when it will be read by a person.
+/**
+ * Numbers from 1e-6 up to 1e21 are written without an exponent, like "0.1", "12.5" or "100".  Bigger and
+ * smaller numbers get one, like "1e+21" or "1.5e-7".
+ */
+void to_round_trip_dec_str(char *num_str, double d) {
+  const uint64_t bits = detail::double_to_bits(d);
+  if (detail::DOUBLE_INFINITE_EXPONENT == ((bits >> detail::DOUBLE_MANTISSA_BITS) & detail::DOUBLE_INFINITE_EXPONENT)) {
+    sprintf(num_str, "%.17g", d);
+    return;
+  }
+
+  if (bits >> 63) {
+    *num_str++ = '-';
+    d = -d;
+  }
+
+  if (0.0 == d) {
+    memcpy(num_str, "0", 2);
+    return;
+  }
+
+  char digits[32];
+  int length;
+  int k;
+  detail::grisu2(d, digits, length, k);
+
+  // The decimal point goes after the first point_position digits.
+  const int point_position = length + k;
+  if ((k >= 0) && (point_position <= 21)) {
+    memcpy(num_str, digits, length);
+    memset(num_str + length, '0', k);
+    num_str[point_position] = '\0';
+  } else if ((point_position > 0) && (point_position <= 21)) {
+    memcpy(num_str, digits, point_position);
+    num_str[point_position] = '.';
+    memcpy(num_str + point_position + 1, digits + point_position, length - point_position);
+    num_str[length + 1] = '\0';
+  } else if ((point_position > -6) && (point_position <= 0)) {
+    memcpy(num_str, "0.", 2);
+    memset(num_str + 2, '0', -point_position);
+    memcpy(num_str + 2 - point_position, digits, length);
+    num_str[2 - point_position + length] = '\0';
+  } else {
+    *num_str++ = digits[0];
+    if (length > 1) {
+      *num_str++ = '.';
+      memcpy(num_str, digits + 1, length - 1);
+      num_str += length - 1;
+    }
+
+    *num_str++ = 'e';
+    const int exponent = point_position - 1;
+    *num_str++ = (exponent < 0) ? '-' : '+';
+    to_dec_str(num_str, (uint32_t)((exponent < 0) ? -exponent : exponent));
+  }
+}
+
+rstd::string to_round_trip_dec_str(double d) {
+  char num_str[MAX_NUM_STR_LENGTH];
+  to_round_trip_dec_str(num_str, d);
+  return num_str;
+}
+
 bool partial_to_bool(const char *s, const char *s_end, char **end_of_bool_p) {
   *end_of_bool_p = (char *)s;
 
@@ -9,6 +9,9 @@ namespace rstd {
 /// A replacement for std::pair.
 template <typename F, typename S>
 struct pair {
+  typedef F first_type;
+  typedef S second_type;
+
   pair(const F &f, const S &s) : first(f), second(s) {}
   F first;
   S second;
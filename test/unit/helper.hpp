@@ -11,5 +11,9 @@ NP1_ASSERT(assertion__, rstd::string(__FILE__) + ": " + ::np1::str::to_dec_str(_
 #define NP1_TEST_RUN_TEST(test__) \
 do { printf("%s\n", #test__); fflush(stdout); test__(); } while (0)
 
+// Benchmarks print their timings so they only run when NP1_TEST_BENCHMARKS is set.
+#define NP1_TEST_RUN_BENCHMARK(benchmark__) \
+do { if (getenv("NP1_TEST_BENCHMARKS")) { NP1_TEST_RUN_TEST(benchmark__); } } while (0)
+
 
 #endif
@@ -5,6 +5,7 @@
 
 
 #include "test/unit/np1/hash/test_sha256.hpp"
+#include "test/unit/np1/hash/test_wyhash64.hpp"
 
 
 
@@ -16,6 +17,7 @@ namespace hash {
 
 void test_all() {
   test_sha256();
+  test_wyhash64();
 }
 
 
@@ -0,0 +1,130 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_HASH_TEST_WYHASH64_HPP
+#define NP1_TEST_UNIT_NP1_HASH_TEST_WYHASH64_HPP
+
+
+#include "np1/hash/wyhash64.hpp"
+#include "np1/rel/detail/helper.hpp"
+
+
+
+namespace test {
+namespace unit {
+namespace np1 {
+namespace hash {
+
+
+void test_wyhash64_every_byte_counts() {
+  // The short-key path reads overlapping words and the long-key path reads the tail twice, so make sure that
+  // every byte of every length makes a difference.
+  unsigned char buf[200];
+  size_t i;
+  for (i = 0; i < sizeof(buf); ++i) {
+    buf[i] = (unsigned char)i;
+  }
+
+  size_t length;
+  for (length = 1; length <= sizeof(buf); ++length) {
+    uint64_t hval = ::np1::hash::wyhash64::add(buf, length, ::np1::hash::wyhash64::init());
+    for (i = 0; i < length; ++i) {
+      buf[i] ^= 0x10;
+      NP1_TEST_ASSERT(::np1::hash::wyhash64::add(buf, length, ::np1::hash::wyhash64::init()) != hval);
+      buf[i] ^= 0x10;
+    }
+
+    NP1_TEST_ASSERT(::np1::hash::wyhash64::add(buf, length - 1, ::np1::hash::wyhash64::init()) != hval);
+  }
+}
+
+
+void test_wyhash64_alignment_and_seed() {
+  char aligned[64];
+  char unaligned[65];
+  memset(aligned, 'x', sizeof(aligned));
+  memset(unaligned, 'x', sizeof(unaligned));
+
+  size_t length;
+  for (length = 0; length <= sizeof(aligned); ++length) {
+    uint64_t hval = ::np1::hash::wyhash64::add(aligned, length, 1);
+    NP1_TEST_ASSERT(::np1::hash::wyhash64::add(unaligned + 1, length, 1) == hval);
+    NP1_TEST_ASSERT(::np1::hash::wyhash64::add(aligned, length, 2) != hval);
+  }
+}
+
+
+// Hash values are written to files and sent to other hosts, so they must be the same everywhere.
+void test_wyhash64_known_values() {
+  NP1_TEST_ASSERT(::np1::hash::wyhash64::init() == 0x6dcecfb9bf270aa7ULL);
+  NP1_TEST_ASSERT(::np1::hash::wyhash64::add("", 0, ::np1::hash::wyhash64::init()) == 0xfd9e5df62eddfc02ULL);
+  NP1_TEST_ASSERT(::np1::hash::wyhash64::add("a", 1, ::np1::hash::wyhash64::init()) == 0x856ad25245fe4c4eULL);
+  NP1_TEST_ASSERT(::np1::hash::wyhash64::add("fred", 4, ::np1::hash::wyhash64::init()) == 0x18f50ed3af8e0873ULL);
+  NP1_TEST_ASSERT(
+    ::np1::hash::wyhash64::add("hello, world", 12, ::np1::hash::wyhash64::init()) == 0x4f375be258aa09ffULL);
+
+  const char *long_key = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789";
+  NP1_TEST_ASSERT(
+    ::np1::hash::wyhash64::add(long_key, strlen(long_key), ::np1::hash::wyhash64::init())
+      == 0xef88679f2c754ef1ULL);
+}
+
+
+void test_wyhash64_distribution() {
+  // Sequential keys should spread evenly over both the low bits and the high bits.
+  enum { NUMBER_KEYS = 1 << 16, NUMBER_BUCKETS = 1 << 8 };
+  size_t low_counts[NUMBER_BUCKETS];
+  size_t high_counts[NUMBER_BUCKETS];
+  memset(low_counts, 0, sizeof(low_counts));
+  memset(high_counts, 0, sizeof(high_counts));
+
+  uint64_t i;
+  for (i = 0; i < NUMBER_KEYS; ++i) {
+    char key[32];
+    sprintf(key, "%llu", (unsigned long long)i);
+    uint64_t hval = ::np1::hash::wyhash64::add(key, strlen(key), ::np1::hash::wyhash64::init());
+    ++low_counts[hval & (NUMBER_BUCKETS - 1)];
+    ++high_counts[hval >> 56];
+  }
+
+  size_t expected = NUMBER_KEYS/NUMBER_BUCKETS;
+  for (i = 0; i < NUMBER_BUCKETS; ++i) {
+    NP1_TEST_ASSERT((low_counts[i] > expected/2) && (low_counts[i] < expected * 2));
+    NP1_TEST_ASSERT((high_counts[i] > expected/2) && (high_counts[i] < expected * 2));
+  }
+}
+
+
+void test_wyhash64_istring() {
+  // Case-insensitive strings are folded a chunk at a time, check that long ones hash the same regardless of case.
+  char lower[1000];
+  char upper[1000];
+  size_t i;
+  for (i = 0; i < sizeof(lower); ++i) {
+    lower[i] = 'a' + (i % 26);
+    upper[i] = 'A' + (i % 26);
+  }
+
+  size_t length;
+  for (length = 0; length <= sizeof(lower); length += 7) {
+    uint64_t hval = ::np1::rel::detail::helper::hash_init();
+    NP1_TEST_ASSERT(::np1::rel::detail::helper::istring_hash_add(lower, length, hval)
+                    == ::np1::rel::detail::helper::istring_hash_add(upper, length, hval));
+  }
+}
+
+
+void test_wyhash64() {
+  NP1_TEST_RUN_TEST(test_wyhash64_every_byte_counts);
+  NP1_TEST_RUN_TEST(test_wyhash64_alignment_and_seed);
+  NP1_TEST_RUN_TEST(test_wyhash64_known_values);
+  NP1_TEST_RUN_TEST(test_wyhash64_distribution);
+  NP1_TEST_RUN_TEST(test_wyhash64_istring);
+}
+
+
+} // namespaces
+}
+}
+}
+
+#endif
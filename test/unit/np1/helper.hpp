@@ -3,6 +3,9 @@
 #ifndef NP1_TEST_UNIT_NP1_HELPER_HPP
 #define NP1_TEST_UNIT_NP1_HELPER_HPP
 
+#include <sys/resource.h>
+#include "np1/io/directory.hpp"
+
 namespace test {
 namespace unit {
 namespace np1 {
@@ -44,6 +47,43 @@ void make_very_large_test_data_record_string(rstd::string &test_data) {
 }
 
 
+struct highest_fd_finder {
+  explicit highest_fd_finder(size_t &highest_fd) : m_highest_fd(highest_fd) {}
+  void operator()(const ::np1::io::directory::entry &e) const {
+    size_t fd = (size_t)::np1::str::dec_to_int64(e.file_name().c_str());
+    if (fd > m_highest_fd) {
+      m_highest_fd = fd;
+    }
+  }
+
+  size_t &m_highest_fd;
+};
+
+
+// While this is in scope, this process and the processes it starts can only open number_extra more files than
+// are open now.  Operators that partition to temporary files fail if they go more levels deep than that allows.
+class open_file_limit {
+public:
+  explicit open_file_limit(size_t number_extra) {
+    NP1_TEST_ASSERT(getrlimit(RLIMIT_NOFILE, &m_original) == 0);
+
+    // New files get the lowest free descriptor, so the limit is on the highest descriptor.
+    size_t highest_fd = 0;
+    ::np1::io::directory::mandatory_iterate("/proc/self/fd", highest_fd_finder(highest_fd));
+    struct rlimit limit = m_original;
+    limit.rlim_cur = highest_fd + 1 + number_extra;
+    NP1_TEST_ASSERT(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+  }
+
+  ~open_file_limit() {
+    NP1_TEST_ASSERT(setrlimit(RLIMIT_NOFILE, &m_original) == 0);
+  }
+
+private:
+  struct rlimit m_original;
+};
+
+
 } // namespaces
 }
 }
@@ -419,6 +419,14 @@ void test_join() {
     "int:value1\tstring:name\n0\tbarney\n"
   );
 
+  run_script(
+    "rel.from_tsv() | rel.join.consistent_hash(\"" + rstd::string(join_file_name) + "\", 16) | rel.to_tsv();",
+
+    "int:value1\n0\n1\n2\n",
+
+    "int:value1\tstring:name\n0\tfred\n1\tfred\n2\tbarney\n"
+  );
+
 
   // Test joins where the file HAS non-common fields.
   run_script("rel.from_tsv() | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
@@ -464,6 +472,320 @@ void test_join() {
   );
 
 
+
+  // Joins through an index of the file give the same output as joins that read the file into memory.
+  run_script("rel.from_tsv() | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
+              "string:name\tint:value3\nfred\t10\nbarney\t20\nfred\t11\n",
+              "");
+  run_script("io.index.build(\"" + rstd::string(join_file_name) + "\", name);", "", "");
+  NP1_TEST_ASSERT(::np1::io::file::exists(::np1::rel::detail::record_index::index_file_name(join_file_name).c_str()));
+
+  run_script(
+    "rel.from_tsv() | rel.join.natural(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "fred\t1\t2\t10\n"
+    "fred\t1\t2\t11\n"
+    "fred\t3\t4\t10\n"
+    "fred\t3\t4\t11\n"
+    "barney\t5\t6\t20\n"
+    "fred\t7\t8\t10\n"
+    "fred\t7\t8\t11\n"
+  );
+
+  run_script(
+    "rel.from_tsv() | rel.join.left(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "fred\t1\t2\t10\n"
+    "fred\t1\t2\t11\n"
+    "fred\t3\t4\t10\n"
+    "fred\t3\t4\t11\n"
+    "barney\t5\t6\t20\n"
+    "fred\t7\t8\t10\n"
+    "fred\t7\t8\t11\n"
+    "betty\t7\t8\t0\n"
+    "wilma\t100\t-1\t0\n"
+  );
+
+  run_script(
+    "rel.from_tsv() | rel.join.anti(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\n"
+    "betty\t7\t8\n"
+    "wilma\t100\t-1\n"
+  );
+
+  // Rewriting the file, even at the same size and within the same second, means the index is out of date.
+  rstd::vector<rstd::string> index_heading_names;
+  index_heading_names.push_back("string:name");
+  ::np1::rel::detail::record_index index;
+  NP1_TEST_ASSERT(index.open(join_file_name, index_heading_names));
+  index.close();
+  run_script("rel.from_tsv() | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
+              "string:name\tint:value3\nfred\t12\nbarney\t22\nfred\t13\n",
+              "");
+  NP1_TEST_ASSERT(!index.open(join_file_name, index_heading_names));
+
+  ::np1::io::file::erase(::np1::rel::detail::record_index::index_file_name(join_file_name).c_str());
+
+
+  // Joins where the input and the file are both sorted on the common headings.
+  run_script("rel.from_tsv() | rel.order_by(name) | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
+              "string:name\tint:value3\nfred\t10\nbarney\t20\nbarney\t21\n",
+              "");
+
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.join.natural(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "barney\t5\t6\t20\n"
+    "barney\t5\t6\t21\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "fred\t7\t8\t10\n"
+  );
+
+
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.join.left(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "barney\t5\t6\t20\n"
+    "barney\t5\t6\t21\n"
+    "betty\t7\t8\t0\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "fred\t7\t8\t10\n"
+    "wilma\t100\t-1\t0\n"
+  );
+
+
+  // The input is sorted the other way so this is an ordinary join.
+  run_script(
+    "rel.from_tsv() | rel.order_by.desc(name) | rel.join.natural(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "fred\t7\t8\t10\n"
+    "fred\t3\t4\t10\n"
+    "fred\t1\t2\t10\n"
+    "barney\t5\t6\t20\n"
+    "barney\t5\t6\t21\n"
+  );
+
+
+  // Explicit merge joins.  The file is still sorted by name.
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.join.merge(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "barney\t5\t6\t20\n"
+    "barney\t5\t6\t21\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "fred\t7\t8\t10\n"
+  );
+
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.join.merge.left(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "barney\t5\t6\t20\n"
+    "barney\t5\t6\t21\n"
+    "betty\t7\t8\t0\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "fred\t7\t8\t10\n"
+    "wilma\t100\t-1\t0\n"
+  );
+
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.join.merge.anti(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\n"
+    "betty\t7\t8\n"
+    "wilma\t100\t-1\n"
+  );
+
+  // Neither side remembers a sort order so they're assumed to be sorted ascending.
+  run_script("rel.from_tsv() | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
+              "string:name\tint:value3\nbarney\t20\nbarney\t21\nfred\t10\n",
+              "");
+
+  run_script(
+    "rel.from_tsv() | rel.join.merge.left(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    "string:name\tuint:value1\tint:value2\n"
+    "barney\t5\t6\n"
+    "betty\t7\t8\n"
+    "fred\t1\t2\n"
+    "fred\t3\t4\n"
+    "wilma\t100\t-1\n",
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "barney\t5\t6\t20\n"
+    "barney\t5\t6\t21\n"
+    "betty\t7\t8\t0\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "wilma\t100\t-1\t0\n"
+  );
+
+  // Both sides sorted descending.
+  run_script("rel.from_tsv() | rel.order_by.desc(name) | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
+              "string:name\tint:value3\nfred\t10\nbarney\t20\nbarney\t21\n",
+              "");
+
+  run_script(
+    "rel.from_tsv() | rel.order_by.desc(name) | rel.join.merge(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "fred\t7\t8\t10\n"
+    "fred\t3\t4\t10\n"
+    "fred\t1\t2\t10\n"
+    "barney\t5\t6\t21\n"
+    "barney\t5\t6\t20\n"
+  );
+
+  // Put the file back the way the following tests expect.
+  run_script("rel.from_tsv() | rel.order_by(name) | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
+              "string:name\tint:value3\nfred\t10\nbarney\t20\nbarney\t21\n",
+              "");
+
+
+  // When the file doesn't fit in memory both sides are partitioned off to temporary files, but the output is the
+  // same.  A budget of 1 byte means that only one key fits in memory at each level of partitioning.
+  setenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY, "1", 1);
+  run_script(
+    "rel.from_tsv() | rel.join.natural(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "barney\t5\t6\t20\n"
+    "barney\t5\t6\t21\n"
+    "fred\t7\t8\t10\n"
+  );
+
+  run_script(
+    "rel.from_tsv() | rel.join.left(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "barney\t5\t6\t20\n"
+    "barney\t5\t6\t21\n"
+    "fred\t7\t8\t10\n"
+    "betty\t7\t8\t0\n"
+    "wilma\t100\t-1\t0\n"
+  );
+
+  run_script(
+    "rel.from_tsv() | rel.join.anti(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\n"
+    "betty\t7\t8\n"
+    "wilma\t100\t-1\n"
+  );
+  unsetenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY);
+
+
+  // When the input is much smaller than the file, the input is read into memory instead of the file.  The
+  // columns are the same but the records come out in the file's order.
+  rstd::string big_join_file_data("string:name\tint:value3\n");
+  size_t i;
+  for (i = 0; i < 100; ++i) {
+    big_join_file_data = big_join_file_data + "dino\t" + ::np1::str::to_dec_str(i) + "\n";
+  }
+
+  big_join_file_data = big_join_file_data + "barney\t20\nfred\t10\n";
+  run_script("rel.from_tsv() | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
+              big_join_file_data,
+              "");
+
+  run_script(
+    "rel.from_tsv() | rel.join.natural(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "barney\t5\t6\t20\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "fred\t7\t8\t10\n"
+  );
+
+
+  // Joining in child processes makes no difference to the output.
+  setenv(NP1_ENVIRONMENT_JOIN_INITIAL_NUMBER_THREADS, "2", 1);
+  run_script(
+    "rel.from_tsv() | rel.join.left(\"" + rstd::string(join_file_name) + "\") | rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "string:name\tuint:value1\tint:value2\tint:value3\n"
+    "fred\t1\t2\t10\n"
+    "fred\t3\t4\t10\n"
+    "barney\t5\t6\t20\n"
+    "fred\t7\t8\t10\n"
+    "betty\t7\t8\t0\n"
+    "wilma\t100\t-1\t0\n"
+  );
+  unsetenv(NP1_ENVIRONMENT_JOIN_INITIAL_NUMBER_THREADS);
+
+
+  // When the input is read into memory, the output must not claim to be in the input's sort order.
+  rstd::string interleaved_join_file_data("string:name\n");
+  for (i = 0; i < 100; ++i) {
+    interleaved_join_file_data = interleaved_join_file_data + "dino\n";
+  }
+
+  interleaved_join_file_data = interleaved_join_file_data + "fred\nbarney\nfred\n";
+  run_script("rel.from_tsv() | io.file.overwrite(\"" + rstd::string(join_file_name) + "\");",
+              interleaved_join_file_data,
+              "");
+
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.join.natural(\"" + rstd::string(join_file_name) + "\")"
+    " | rel.group(count) | rel.to_tsv();",
+
+    "string:name\n"
+    "wilma\n"
+    "fred\n"
+    "barney\n"
+    "fred\n",
+
+    "string:name\tuint:_count\n"
+    "fred\t4\n"
+    "barney\t1\n"
+  );
+
   //TODO: MUCH more join testing!
 }
 
@@ -481,10 +803,27 @@ void test_group() {
     "wilma\n"
     "wilma\n",
     
-    "string:name\tuint:_count\n"   // NOTE the ordering here is hash-ordering so if the implementation changes
-    "barney\t1\n"                  // this test will fail
-    "wilma\t2\n"
-    "fred\t3\n");
+    "string:name\tuint:_count\n"   // NOTE the groups come out in the order they first appear in the input
+    "fred\t3\n"
+    "barney\t1\n"
+    "wilma\t2\n");
+
+  // count, sorted input.  The groups come out in sorted order.
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.group(count) | rel.to_tsv();",
+    
+    "string:name\n"
+    "fred\n"
+    "wilma\n"
+    "fred\n"
+    "barney\n"
+    "wilma\n"
+    "fred\n",
+    
+    "string:name\tuint:_count\n"
+    "barney\t1\n"
+    "fred\t3\n"
+    "wilma\t2\n");
   
   // sum
   run_script(
@@ -578,6 +917,75 @@ void test_group() {
     "double:value\n"
     "3.3\n");
 
+  // The selected records change length as we go.
+  run_script(
+    "rel.from_tsv() | rel.group(max value) | rel.to_tsv();",
+    
+    "string:name\tint:value\n"
+    "fred\t9\n"
+    "barney\t5\n"
+    "fred\t10\n"
+    "barney\t-7\n"
+    "fred\t100000\n",
+    
+    "string:name\tint:value\n"
+    "fred\t100000\n"
+    "barney\t5\n");
+
+  // min & max, sorted input.
+  run_script(
+    "rel.from_tsv() | rel.order_by.desc(name) | rel.group(min value) | rel.to_tsv();",
+    
+    "string:name\tint:value\n"
+    "fred\t3\n"
+    "barney\t2\n"
+    "fred\t1\n"
+    "barney\t5\n",
+    
+    "string:name\tint:value\n"
+    "fred\t1\n"
+    "barney\t2\n");
+
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.group(max value) | rel.to_tsv();",
+    
+    "string:name\tint:value\n"
+    "fred\t3\n"
+    "barney\t2\n"
+    "fred\t1\n"
+    "barney\t5\n",
+    
+    "string:name\tint:value\n"
+    "barney\t5\n"
+    "fred\t3\n");
+
+  // sum & avg, sorted input.  The input may be sorted on more headings than the group uses.
+  run_script(
+    "rel.from_tsv() | rel.order_by(name, value) | rel.group(sum value) | rel.to_tsv();",
+    
+    "string:name\tint:value\n"
+    "fred\t3\n"
+    "barney\t2\n"
+    "fred\t1\n"
+    "barney\t5\n",
+    
+    "string:name\tint:_sum\n"
+    "barney\t7\n"
+    "fred\t4\n");
+
+  run_script(
+    "rel.from_tsv() | rel.order_by(name) | rel.group(avg value) | rel.to_tsv();",
+    
+    "string:name\tint:value\n"
+    "fred\t3\n"
+    "barney\t2\n"
+    "fred\t1\n"
+    "barney\t6\n",
+    
+    "string:name\tint:_avg\n"
+    "barney\t4\n"
+    "fred\t2\n");
+
   // median, test 1
   run_script(
     "rel.from_tsv() | rel.group(median value) | rel.to_tsv();",
@@ -610,6 +1018,283 @@ void test_group() {
     "fred\t2\n"
     "wilma\t5\n");
 
+  // median, test 3: doubles and a median column that isn't the last one
+  run_script(
+    "rel.from_tsv() | rel.group(median value) | rel.to_tsv();",
+
+    "double:value\tstring:name\n"
+    "2.5\tfred\n"
+    "1\tbarney\n"
+    "-3\tfred\n"
+    "3.25\tbarney\n"
+    "0.5\tfred\n"
+    "2\tbarney\n",
+
+    "string:name\tdouble:_median\n"
+    "barney\t2\n"
+    "fred\t0.5\n");
+
+  // median, test 4: the median is written as it was in the input, and so are the group's fields, which come
+  // from the median's own record.  Equal values are taken in the order they arrived.
+  run_script(
+    "rel.from_tsv() | rel.group(median value) | rel.to_tsv();",
+
+    "istring:name\tdouble:value\n"
+    "Cd\t-120.1229\n"
+    "cd\t5.5\n"
+    "ab\t1.0\n"
+    "AB\t1\n"
+    "cd\t-1e2\n"
+    "ab\t2.50\n"
+    "CD\t-120.1229\n",
+
+    "istring:name\tdouble:_median\n"
+    "AB\t1\n"
+    "CD\t-120.1229\n");
+
+  // Approximate median and percentiles are exact for small groups.
+  run_script(
+    "rel.from_tsv() | rel.group(median_approx value) | rel.to_tsv();",
+
+    "string:name\tint:value\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t3\n"
+    "barney\t3\n"
+    "barney\t-1\n"
+    "barney\t3\n"
+    "barney\t10\n"
+    "wilma\t5\n",
+
+    "string:name\tint:_median_approx\n"
+    "fred\t2\n"
+    "barney\t3\n"
+    "wilma\t5\n");
+
+  run_script(
+    "rel.from_tsv() | rel.group(percentile(80, value)) | rel.to_tsv();",
+
+    "string:name\tint:value\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t3\n"
+    "barney\t3\n"
+    "barney\t-1\n"
+    "barney\t3\n"
+    "barney\t10\n"
+    "wilma\t5\n",
+
+    "string:name\tint:_percentile\n"
+    "fred\t3\n"
+    "barney\t3\n"
+    "wilma\t5\n");
+
+  // Sketches can be merged later, eg from different hosts.
+  run_script(
+    "rel.from_tsv() | rel.group(quantile_sketch value) | rel.select(_quantile_sketch) "
+      "| rel.group(median_approx _quantile_sketch) | rel.to_tsv();",
+
+    "string:name\tint:value\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t3\n"
+    "barney\t3\n"
+    "barney\t-1\n"
+    "barney\t3\n"
+    "barney\t10\n"
+    "wilma\t5\n",
+
+    "double:_median_approx\n"
+    "3.000000\n");
+
+  // Approximate distinct counts are exact for small groups.
+  run_script(
+    "rel.from_tsv() | rel.group(count_distinct_approx user) | rel.to_tsv();",
+
+    "string:name\tint:user\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t2\n"
+    "barney\t3\n"
+    "barney\t01\n"
+    "barney\t3\n"
+    "wilma\t5\n",
+
+    "string:name\tuint:_count_distinct_approx\n"
+    "fred\t1\n"
+    "barney\t2\n"
+    "wilma\t1\n");
+
+  // Counters can be merged later, eg from different hosts.
+  run_script(
+    "rel.from_tsv() | rel.group(hll_sketch(12, user)) | rel.select(_hll_sketch) "
+      "| rel.group(hll_merge _hll_sketch) | rel.to_tsv();",
+
+    "string:name\tint:user\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t2\n"
+    "barney\t3\n"
+    "barney\t01\n"
+    "barney\t3\n"
+    "wilma\t5\n",
+
+    "uint:_count_distinct_approx\n"
+    "4\n");
+
+  // Groups that don't fit in memory are partitioned off to temporary files.  A budget of 1 byte means that only
+  // one group fits in memory at each level of partitioning.
+  setenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY, "1", 1);
+  run_script(
+    "rel.from_tsv() | rel.group(sum value) | rel.order_by(name) | rel.to_tsv();",
+
+    "string:name\tint:value\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t3\n"
+    "betty\t3\n"
+    "barney\t-1\n"
+    "wilma\t3\n"
+    "barney\t10\n"
+    "wilma\t5\n",
+
+    "string:name\tint:_sum\n"
+    "barney\t10\n"
+    "betty\t3\n"
+    "fred\t5\n"
+    "wilma\t8\n");
+
+  run_script(
+    "rel.from_tsv() | rel.group(median value) | rel.order_by(name) | rel.to_tsv();",
+
+    "string:name\tint:value\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t3\n"
+    "betty\t3\n"
+    "barney\t-1\n"
+    "wilma\t3\n"
+    "barney\t10\n"
+    "wilma\t5\n",
+
+    "string:name\tint:_median\n"
+    "barney\t1\n"
+    "betty\t3\n"
+    "fred\t2\n"
+    "wilma\t3\n");
+
+  run_script(
+    "rel.from_tsv() | rel.group(count, sum value, max value) | rel.order_by(name) | rel.to_tsv();",
+
+    "string:name\tint:value\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t3\n"
+    "betty\t3\n"
+    "barney\t-1\n"
+    "wilma\t3\n"
+    "barney\t10\n"
+    "wilma\t5\n",
+
+    "string:name\tuint:_count\tint:_sum_value\tint:_max_value\n"
+    "barney\t3\t10\t10\n"
+    "betty\t1\t3\t3\n"
+    "fred\t2\t5\t3\n"
+    "wilma\t2\t8\t5\n");
+  unsetenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY);
+
+  // Several aggregators at once.  Each gets its own column, named after the aggregator and the heading.
+  run_script(
+    "rel.from_tsv() | rel.group(count, sum bytes, min ts, max ts, avg latency) | rel.to_tsv();",
+
+    "string:host\tuint:bytes\tint:ts\tdouble:latency\n"
+    "a\t10\t5\t1.5\n"
+    "b\t20\t3\t2.5\n"
+    "a\t30\t-1\t0.5\n"
+    "b\t5\t9\t4\n"
+    "a\t1\t2\t1\n",
+
+    "string:host\tuint:_count\tuint:_sum_bytes\tint:_min_ts\tint:_max_ts\tdouble:_avg_latency\n"
+    "a\t3\t41\t-1\t5\t1.000000\n"
+    "b\t2\t25\t3\t9\t3.250000\n");
+
+  // Several aggregators, sorted input.
+  run_script(
+    "rel.from_tsv() | rel.order_by(host) | rel.group(min bytes, avg ts, count) | rel.to_tsv();",
+
+    "string:host\tuint:bytes\tint:ts\n"
+    "b\t20\t3\n"
+    "a\t10\t5\n"
+    "b\t5\t9\n"
+    "a\t30\t-1\n"
+    "a\t1\t2\n",
+
+    "string:host\tuint:_min_bytes\tint:_avg_ts\tuint:_count\n"
+    "a\t1\t2\t3\n"
+    "b\t5\t6\t2\n");
+
+  // Mins and maxes are written with the text of the field they came from, and ties go to the first one.
+  run_script(
+    "rel.from_tsv() | rel.group(count, min latency, max latency) | rel.order_by(host) | rel.to_tsv();",
+
+    "string:host\tdouble:latency\n"
+    "a\t1.50\n"
+    "b\t-120.1229\n"
+    "a\t0.250\n"
+    "b\t3e2\n"
+    "a\t1.5\n"
+    "b\t-120.12290\n",
+
+    "string:host\tuint:_count\tdouble:_min_latency\tdouble:_max_latency\n"
+    "a\t3\t0.250\t1.50\n"
+    "b\t3\t-120.1229\t3e2\n");
+
+  // Grouping in child processes makes no difference to the output apart from the order of the groups.
+  setenv(NP1_ENVIRONMENT_GROUP_INITIAL_NUMBER_THREADS, "3", 1);
+  run_script(
+    "rel.from_tsv() | rel.group(count, sum bytes, min ts, max ts, avg latency) | rel.order_by(host) | rel.to_tsv();",
+
+    "string:host\tuint:bytes\tint:ts\tdouble:latency\n"
+    "a\t10\t5\t1.5\n"
+    "b\t20\t3\t2.5\n"
+    "a\t30\t-1\t0.5\n"
+    "b\t5\t9\t4\n"
+    "a\t1\t2\t1\n",
+
+    "string:host\tuint:_count\tuint:_sum_bytes\tint:_min_ts\tint:_max_ts\tdouble:_avg_latency\n"
+    "a\t3\t41\t-1\t5\t1.000000\n"
+    "b\t2\t25\t3\t9\t3.250000\n");
+
+  run_script(
+    "rel.from_tsv() | rel.group(count, min latency, max latency) | rel.order_by(host) | rel.to_tsv();",
+
+    "string:host\tdouble:latency\n"
+    "a\t1.50\n"
+    "b\t-120.1229\n"
+    "a\t0.250\n"
+    "b\t3e2\n"
+    "a\t1.5\n"
+    "b\t-120.12290\n",
+
+    "string:host\tuint:_count\tdouble:_min_latency\tdouble:_max_latency\n"
+    "a\t3\t0.250\t1.50\n"
+    "b\t3\t-120.1229\t3e2\n");
+
+  run_script(
+    "rel.from_tsv() | rel.group(avg value) | rel.order_by(name) | rel.to_tsv();",
+
+    "string:name\tint:value\n"
+    "fred\t2\n"
+    "barney\t1\n"
+    "fred\t3\n"
+    "barney\t-1\n"
+    "barney\t10\n",
+
+    "string:name\tint:_avg\n"
+    "barney\t3\n"
+    "fred\t2\n");
+  unsetenv(NP1_ENVIRONMENT_GROUP_INITIAL_NUMBER_THREADS);
+
   //TODO: much more group testing!
   
 }
@@ -630,7 +1315,82 @@ void test_unique() {
     "1\n"
     "2\n"
   );
-  
+
+  // Sorted input.
+  run_script(
+    "rel.from_tsv() | rel.order_by(value2, value1) | rel.unique() | rel.to_tsv();",
+    
+    "int:value1\tint:value2\n"
+    "1\t2\n"
+    "2\t1\n"
+    "1\t2\n"
+    "1\t1\n"
+    "2\t1\n",
+    
+    "int:value1\tint:value2\n"
+    "1\t1\n"
+    "2\t1\n"
+    "1\t2\n"
+  );
+
+  // Keys that don't fit in memory are partitioned off, the output must still be the first copy of each record
+  // in input order.
+  const char *unique_input =
+    "string:name\tint:value\n"
+    "fred\t1\n"
+    "barney\t2\n"
+    "fred\t1\n"
+    "wilma\t3\n"
+    "betty\t4\n"
+    "barney\t2\n"
+    "fred\t5\n"
+    "betty\t4\n"
+    "pebbles\t6\n"
+    "fred\t5\n";
+
+  const char *unique_expected =
+    "string:name\tint:value\n"
+    "fred\t1\n"
+    "barney\t2\n"
+    "wilma\t3\n"
+    "betty\t4\n"
+    "fred\t5\n"
+    "pebbles\t6\n";
+
+  run_script("rel.from_tsv() | rel.unique() | rel.to_tsv();", unique_input, unique_expected);
+  run_script("rel.from_tsv() | rel.unique.fingerprint() | rel.to_tsv();", unique_input, unique_expected);
+
+  setenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY, "1", 1);
+  run_script("rel.from_tsv() | rel.unique() | rel.to_tsv();", unique_input, unique_expected);
+  run_script("rel.from_tsv() | rel.unique.fingerprint() | rel.to_tsv();", unique_input, unique_expected);
+  unsetenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY);
+
+  // With a small budget a good fraction of the keys still fit in memory, so one level of partitioning is
+  // enough.  That's the partitions and one output for each, and each level deeper would need as many again.
+  rstd::string many_unique_input("string:name\tint:value\n");
+  rstd::string many_unique_expected("string:name\tint:value\n");
+  size_t i;
+  for (i = 0; i < 20000; ++i) {
+    size_t key = (i * 7919) % 4000;
+    rstd::string line = "name_" + ::np1::str::to_dec_str(key) + "\t" + ::np1::str::to_dec_str(key % 10) + "\n";
+    many_unique_input.append(line);
+    if (i < 4000) {
+      many_unique_expected.append(line);
+    }
+  }
+
+  {
+    open_file_limit limit(2 * ::np1::rel::detail::record_partitions::NUMBER_PARTITIONS + 12);
+    setenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY, "100000", 1);
+    run_script("rel.from_tsv() | rel.unique() | rel.to_tsv();", many_unique_input, many_unique_expected);
+
+    // Fingerprints are smaller than records so they need a smaller budget to spill.
+    setenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY, "20000", 1);
+    run_script(
+      "rel.from_tsv() | rel.unique.fingerprint() | rel.to_tsv();", many_unique_input, many_unique_expected);
+    unsetenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY);
+  }
+
   //TODO: much more unique testing!
 }
 
@@ -682,6 +1442,22 @@ void test_select() {
     "7\t8\tfred\n"
     "7\t8\tbetty\n"
     "100\t-1\twilma\n");  
+
+  // The right-hand sides of '&&' and '||' are never run when they're skipped, even at compile time.
+  run_script(
+    "rel.from_tsv() "
+    "| rel.select(value1, (value1 > 1000U) && (1 / 0 = 1) as r, (value1 > 1000U) && str.regex_match('(', 'x') as m) "
+    "| rel.to_tsv();",
+
+    basic_flintstones_data(),
+
+    "uint:value1\tbool:r\tbool:m\n"
+    "1\tfalse\tfalse\n"
+    "3\tfalse\tfalse\n"
+    "5\tfalse\tfalse\n"
+    "7\tfalse\tfalse\n"
+    "7\tfalse\tfalse\n"
+    "100\tfalse\tfalse\n");
 }
 
 
@@ -1112,6 +1888,43 @@ void test_parallel() {
     + file_prefix + ::np1::str::to_hex_str_pad_16(9) + ".gz\tlocalhost\n",
 
     "string:dummy\tuint:_count\na\t142858\n");
+
+  // A group at the end of the script is done in two steps, so the output is the same as grouping everything.
+  rstd::string mapping =
+    "string:file_name\tstring:host_name\n"
+    + file_prefix + ::np1::str::to_hex_str_pad_16(0) + ".gz\tlocalhost\n"
+    + file_prefix + ::np1::str::to_hex_str_pad_16(1) + ".gz\t127.0.0.1\n"
+    + file_prefix + ::np1::str::to_hex_str_pad_16(2) + ".gz\tlocalhost\n"
+    + file_prefix + ::np1::str::to_hex_str_pad_16(3) + ".gz\tlocalhost\n";
+
+  run_script(
+    "rel.from_tsv() | meta.parallel_explicit_mapping(rel.where(mul1_int % 7 = 0) | rel.select(mul7_str, mul1_int) | rel.group(count, sum mul1_int, avg mul1_int, min mul1_int, max mul1_int)) | rel.to_tsv();",
+
+    mapping,
+
+    "string:mul7_str\tuint:_count\tint:_sum_mul1_int\tint:_avg_mul1_int\tint:_min_mul1_int\tint:_max_mul1_int\n"
+    "name_0\t57143\t11428428571\t199997\t0\t399994\n");
+
+  run_script(
+    "rel.from_tsv() | meta.parallel_explicit_mapping(rel.select(mul7_str, mul1_int) | rel.group(avg mul1_int)) | rel.order_by(mul7_str) | rel.to_tsv();",
+
+    mapping,
+
+    "string:mul7_str\tint:_avg\n"
+    "name_0\t199997\n"
+    "name_1\t199998\n"
+    "name_2\t199999\n"
+    "name_3\t200000\n"
+    "name_4\t200001\n"
+    "name_5\t200002\n"
+    "name_6\t199999\n");
+
+  run_script(
+    "rel.from_tsv() | meta.parallel_explicit_mapping(rel.select(mul7_str, mul1_str) | rel.group(count_distinct_approx mul1_str)) | rel.where(mul7_str = 'name_3') | rel.select(_count_distinct_approx > 56000U && _count_distinct_approx < 58000U as is_close) | rel.to_tsv();",
+
+    mapping,
+
+    "bool:is_close\ntrue\n");
 }
 
 
@@ -9,6 +9,7 @@
 #include "test/unit/np1/rel/rlang/test_vm_stack.hpp"
 #include "test/unit/np1/rel/rlang/test_shunting_yard.hpp"
 #include "test/unit/np1/rel/rlang/test_compiler.hpp"
+#include "test/unit/np1/rel/rlang/test_batch_vm.hpp"
 
 namespace test {
 namespace unit {
@@ -21,6 +22,7 @@ void test_all() {
   test_vm_stack();
   test_shunting_yard();
   test_compiler();
+  test_batch_vm();
 }
 
 } // namespaces
@@ -0,0 +1,146 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_REL_RLANG_TEST_BATCH_VM_HPP
+#define NP1_TEST_UNIT_NP1_REL_RLANG_TEST_BATCH_VM_HPP
+
+
+
+namespace test {
+namespace unit {
+namespace np1 {
+namespace rel {
+namespace rlang {
+
+typedef ::np1::rel::rlang::batch_vm batch_vm_type;
+typedef ::np1::rel::rlang::vm_batch_stack vm_batch_stack_type;
+
+
+// More than one batch, and the last batch isn't full.
+void make_batch_test_records(rstd::vector<record_type> &records) {
+  size_t i;
+  for (i = 0; i < 2 * batch_vm_type::MAX_BATCH_SIZE + 17; ++i) {
+    char k[32];
+    char v[32];
+    char d[32];
+    sprintf(k, "a%u", (unsigned int)(i % 13));
+    sprintf(v, "%d", (int)i - 200);
+    sprintf(d, "%g", (double)(i % 10) / 10);
+    records.push_back(record_type(k, v, d, i + 1));
+  }
+}
+
+
+template <typename T>
+void check_batch_value(vm_stack_type &stack, const vm_batch_stack_type &batch_stack, size_t n) {
+  T value;
+  stack.pop(value);
+  NP1_TEST_ASSERT(batch_stack.column<T>(0)[n] == value);
+}
+
+template <>
+void check_batch_value< ::np1::str::ref>(vm_stack_type &stack, const vm_batch_stack_type &batch_stack, size_t n) {
+  ::np1::str::ref value;
+  stack.pop(value);
+  NP1_TEST_ASSERT(::np1::str::cmp(batch_stack.column< ::np1::str::ref>(0)[n], value) == 0);
+}
+
+
+// Check that running over batches gives the same answers as running one record at a time.
+void execute_batch_vm_test(const char *script, bool expected_is_runnable) {
+  NP1_TEST_UNIT_REL_RLANG_DEFINE_INPUT_STREAM(input, script);
+  record_type headings("string:k", "int:v", "double:d", 0);
+  record_type empty_record;
+  vm_type vm = compiler_type::compile_single_expression(input, headings.ref(), empty_record.ref());
+  batch_vm_type bvm(vm);
+  NP1_TEST_ASSERT(bvm.is_runnable() == expected_is_runnable);
+  if (!expected_is_runnable) {
+    return;
+  }
+
+  NP1_TEST_ASSERT(bvm.return_type() == vm.return_type());
+
+  rstd::vector<record_type> records;
+  make_batch_test_records(records);
+
+  vm_heap_type batch_heap;
+  vm_heap_type heap;
+  size_t batch_start;
+  for (batch_start = 0; batch_start < records.size(); batch_start += batch_vm_type::MAX_BATCH_SIZE) {
+    rstd::vector< ::np1::rel::record_ref> refs;
+    size_t i;
+    for (i = batch_start; (i < records.size()) && (refs.size() < batch_vm_type::MAX_BATCH_SIZE); ++i) {
+      refs.push_back(records[i].ref());
+    }
+
+    batch_heap.reset();
+    const vm_batch_stack_type &batch_stack = bvm.run(batch_heap, refs.begin(), refs.size());
+    NP1_TEST_ASSERT(1 == batch_stack.depth());
+
+    for (i = 0; i < refs.size(); ++i) {
+      vm_stack_type &stack = vm.run_heap_reset(heap, refs[i], empty_record.ref());
+      switch (vm.return_type()) {
+      case dt::TYPE_STRING:
+      case dt::TYPE_ISTRING:
+      case dt::TYPE_IPADDRESS:
+        check_batch_value< ::np1::str::ref>(stack, batch_stack, i);
+        break;
+
+      case dt::TYPE_INT:
+        check_batch_value<int64_t>(stack, batch_stack, i);
+        break;
+
+      case dt::TYPE_UINT:
+        check_batch_value<uint64_t>(stack, batch_stack, i);
+        break;
+
+      case dt::TYPE_DOUBLE:
+        check_batch_value<double>(stack, batch_stack, i);
+        break;
+
+      case dt::TYPE_BOOL:
+        check_batch_value<bool>(stack, batch_stack, i);
+        break;
+      }
+    }
+  }
+}
+
+
+void test_batch_vm_runnable() {
+  execute_batch_vm_test("v", true);
+  execute_batch_vm_test("42", true);
+  execute_batch_vm_test("v * 2 + 1", true);
+  execute_batch_vm_test("-v", true);
+  execute_batch_vm_test("d * 3.0 - 1.5", true);
+  execute_batch_vm_test("k + 'x'", true);
+  execute_batch_vm_test("str.to_upper_case(k)", true);
+  execute_batch_vm_test("v % 7 = 0", true);
+  execute_batch_vm_test("v > 300 && d < 0.5", true);
+  execute_batch_vm_test("v > 300 || k = 'a3'", true);
+  execute_batch_vm_test("(v > 10 && v < 20) || (v > 100 && !(v = 150))", true);
+}
+
+
+void test_batch_vm_not_runnable() {
+  execute_batch_vm_test("if (v > 0) then (1) else (2)", false);
+
+  // The right-hand side of a short-circuit operator would be run when it shouldn't be.
+  execute_batch_vm_test("v != 0 && 100 / v > 2", false);
+  execute_batch_vm_test("v = 0 || str.to_upper_case(k) = 'A1'", false);
+
+  execute_batch_vm_test("math.rand64() > 0U", false);
+}
+
+
+void test_batch_vm() {
+  NP1_TEST_RUN_TEST(test_batch_vm_runnable);
+  NP1_TEST_RUN_TEST(test_batch_vm_not_runnable);
+}
+
+} // namespaces
+}
+}
+}
+}
+
+#endif
@@ -462,6 +462,15 @@ void test_logical_and() {
   execute_boolean_test("true && !interesting", "bool:interesting", "true", false);
   execute_boolean_test("true && interesting", "bool:interesting", "false", false);
   execute_boolean_test("!true && interesting", "bool:interesting", "false", false);
+  execute_boolean_test("interesting && true", "bool:interesting", "true", true);
+  execute_boolean_test("interesting && false", "bool:interesting", "true", false);
+  execute_boolean_test("interesting && interesting && !interesting", "bool:interesting", "true", false);
+  execute_boolean_test("(interesting && true) = false", "bool:interesting", "false", true);
+  execute_boolean_test("(if (interesting) then (true) else (false)) && !interesting", "bool:interesting", "true", false);
+
+  // The right-hand side is not evaluated if the left-hand side is false.
+  execute_boolean_test("(interesting != 0) && (10 / interesting > 1)", "int:interesting", "0", false);
+  execute_boolean_test("(interesting != 0) && (10 / interesting > 1)", "int:interesting", "5", true);
 }
 
 void test_logical_or() {
@@ -471,6 +480,15 @@ void test_logical_or() {
   execute_boolean_test("true || interesting", "bool:interesting", "false", true);
   execute_boolean_test("!true || interesting", "bool:interesting", "true", true);
   execute_boolean_test("!true || interesting", "bool:interesting", "false", false);
+  execute_boolean_test("interesting || false", "bool:interesting", "true", true);
+  execute_boolean_test("interesting || false", "bool:interesting", "false", false);
+  execute_boolean_test("interesting || interesting || !interesting", "bool:interesting", "false", true);
+  execute_boolean_test("interesting && false || !interesting && true", "bool:interesting", "false", true);
+  execute_boolean_test("interesting && false || !interesting && true", "bool:interesting", "true", false);
+
+  // The right-hand side is not evaluated if the left-hand side is true.
+  execute_boolean_test("(interesting = 0) || (10 / interesting > 1)", "int:interesting", "0", true);
+  execute_boolean_test("(interesting = 0) || (10 / interesting > 1)", "int:interesting", "20", false);
 }
 
 
@@ -815,6 +833,110 @@ void test_meta_shell() {
 }
 
 
+template <typename Expected>
+void execute_constant_folding_test(const char *script, const char *heading_name, const char *value,
+                                    bool expected_is_single_call, Expected expected_value) {
+  NP1_TEST_UNIT_REL_RLANG_DEFINE_INPUT_STREAM(input, script);
+  record_type headings(heading_name, 0);
+  record_type value_record(value, 1);
+  record_type empty_record;
+
+  vm_type vm = compiler_type::compile_single_expression(input, headings.ref(), empty_record.ref());
+  NP1_TEST_ASSERT(vm.is_single_call() == expected_is_single_call);
+  run_and_check_return_type(vm, value_record, empty_record, expected_value);
+}
+
+
+void test_constant_folding() {
+  execute_constant_folding_test("time.sec_to_usec(86400 * 7)", "int:x", "1", true, (int64_t)604800000000LL);
+  execute_constant_folding_test("-(2 + 3)", "int:x", "1", true, -5);
+  execute_constant_folding_test("1.5 * 4.0", "int:x", "1", true, 6.0);
+  execute_constant_folding_test("'abc' + str.to_upper_case('def')", "int:x", "1", true, "abcDEF");
+  execute_constant_folding_test("(1 < 2) && !false", "int:x", "1", true, true);
+
+  // Only the constant parts of the expression are folded.
+  execute_constant_folding_test("x + 2 * 3", "int:x", "1", false, 7);
+  execute_constant_folding_test("x", "int:x", "1", true, 1);
+
+  // Non-deterministic functions are run every time.
+  execute_constant_folding_test("math.rand64() * 0U + 1U", "int:x", "1", false, 1);
+
+  // The value of an 'if' is not a literal even if its last call is.
+  execute_constant_folding_test("(if (x > 0) then (1) else (2)) + 3", "int:x", "1", false, 4);
+  execute_constant_folding_test("(if (x > 0) then (1) else (2)) + 3", "int:x", "-1", false, 5);
+
+  // Branches that aren't taken are never run, even at compile time.
+  execute_constant_folding_test("if (x > 0) then (1 / 0) else (x)", "int:x", "-1", false, -1);
+  execute_constant_folding_test("(x > 1000) && (1 / 0 = 1)", "int:x", "1", false, false);
+  execute_constant_folding_test("(x > 1000) && str.regex_match('(', 'x')", "int:x", "1", false, false);
+  execute_constant_folding_test("(x < 1000) || (1 / 0 = 1)", "int:x", "1", false, true);
+  execute_constant_folding_test("false && (1 / 0 = 1)", "int:x", "1", false, false);
+
+  // The right-hand side is folded when the left-hand side means it's always run.
+  execute_constant_folding_test("true && (x > 2 * 3)", "int:x", "7", false, true);
+  execute_constant_folding_test("(1 > 2) || (x > 2 * 3)", "int:x", "1", false, false);
+}
+
+
+size_t count_slot_stores(const vm_type &vm) {
+  size_t number_stores = 0;
+  const ::np1::rel::rlang::vm_function_call *i = vm.function_calls().begin();
+  const ::np1::rel::rlang::vm_function_call *iz = vm.function_calls().end();
+  for (; i < iz; ++i) {
+    if ((i->id() == fn_table_type::find_store_slot(dt::TYPE_INT))
+        || (i->id() == fn_table_type::find_store_slot(dt::TYPE_STRING))) {
+      ++number_stores;
+    }
+  }
+
+  return number_stores;
+}
+
+
+// Run the same vm over two records to check that values in slots don't leak from one run to the next.
+template <typename Expected1, typename Expected2>
+void execute_cse_test(const char *script, size_t expected_number_slot_stores,
+                      const char *value1, Expected1 expected_value1,
+                      const char *value2, Expected2 expected_value2) {
+  NP1_TEST_UNIT_REL_RLANG_DEFINE_INPUT_STREAM(input, script);
+  record_type headings("int:x", "string:s", 0);
+  record_type value_record1(value1, "Fred", 1);
+  record_type value_record2(value2, "wilma", 2);
+  record_type empty_record;
+
+  vm_type vm = compiler_type::compile_single_expression(input, headings.ref(), empty_record.ref());
+  NP1_TEST_ASSERT(count_slot_stores(vm) == expected_number_slot_stores);
+  run_and_check_return_type(vm, value_record1, empty_record, expected_value1);
+  run_and_check_return_type(vm, value_record2, empty_record, expected_value2);
+}
+
+
+void test_common_subexpression_elimination() {
+  // Each occurrence of a repeated subexpression stores its value.
+  execute_cse_test("x * x + x", 3, "3", 12, "-2", 2);
+  execute_cse_test("x > 10 && x < 100", 2, "50", true, "5", false);
+  execute_cse_test("str.to_lower_case(s) + str.to_lower_case(s)", 2, "1", "fredfred", "1", "wilmawilma");
+
+  // The field push inside the repeated function call doesn't need its own slot.
+  execute_cse_test("str.to_lower_case(s) = 'fred' || str.to_lower_case(s) = 'wilma'", 2, "1", true, "1", true);
+
+  // The first occurrence is skipped when the left side is false, so the second one works it out.
+  execute_cse_test("(x > 5 && str.to_upper_case(s) = 'FRED') || str.to_upper_case(s) = 'WILMA'", 2,
+                    "1", false, "1", true);
+  execute_cse_test("(x > 5 && str.to_upper_case(s) = 'FRED') || str.to_upper_case(s) = 'WILMA'", 2,
+                    "10", true, "10", true);
+
+  // Only one of the branches is run.
+  execute_cse_test("if (x > 0) then (x + 1) else (x - 1)", 3, "1", 2, "-1", -2);
+  execute_cse_test("(if (x > 0) then (x * 2) else (x * 3)) + x * 2", 4, "4", 16, "-4", -20);
+
+  // Literals and non-deterministic functions are never shared.
+  execute_cse_test("math.rand64() * 0U = math.rand64() * 0U", 0, "1", true, "1", true);
+  execute_cse_test("1 + 1", 0, "1", 2, "1", 2);
+  execute_cse_test("x + 1", 0, "7", 8, "8", 9);
+}
+
+
 void test_eval_to_string() {
   NP1_TEST_UNIT_REL_RLANG_DEFINE_INPUT_STREAM(input, "1+1");  
   rstd::vector<token_type> tokens;
@@ -1091,6 +1213,9 @@ void test_compiler() {
 
   //TODO: more permutations
 
+  NP1_TEST_RUN_TEST(test_constant_folding);
+  NP1_TEST_RUN_TEST(test_common_subexpression_elimination);
+
   // Evaluate expression testing.
   NP1_TEST_RUN_TEST(test_eval_to_string);
   NP1_TEST_RUN_TEST(test_eval_to_string_only);
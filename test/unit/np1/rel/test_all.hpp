@@ -6,6 +6,10 @@
 
 #include "test/unit/np1/rel/test_record_ref.hpp"
 #include "test/unit/np1/rel/test_record.hpp"
+#include "test/unit/np1/rel/test_record_arena.hpp"
+#include "test/unit/np1/rel/test_helper.hpp"
+#include "test/unit/np1/rel/test_spilling_record_multihashmap.hpp"
+#include "test/unit/np1/rel/test_hash_join.hpp"
 #include "test/unit/np1/rel/rlang/test_all.hpp"
 
 namespace test {
@@ -16,6 +20,10 @@ namespace rel {
 void test_all() {
   test_record_ref();
   test_record();
+  test_record_arena();
+  test_helper();
+  test_spilling_record_multihashmap();
+  test_hash_join();
   rlang::test_all();
 }
 
@@ -0,0 +1,85 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_REL_TEST_HASH_JOIN_HPP
+#define NP1_TEST_UNIT_NP1_REL_TEST_HASH_JOIN_HPP
+
+
+#include "np1/io/buffer_input_stream.hpp"
+#include "np1/io/heap_buffer_output_stream.hpp"
+#include "np1/rel/detail/hash_join.hpp"
+
+
+namespace test {
+namespace unit {
+namespace np1 {
+namespace rel {
+
+typedef ::np1::rel::detail::record_partitions::partition partition_type;
+
+
+struct hash_join_count_record_callback {
+  explicit hash_join_count_record_callback(size_t &n) : m_n(n) {}
+  bool operator()(const ::np1::rel::record_ref &r) const { ++m_n; return true; }
+  size_t &m_n;
+};
+
+
+void test_hash_join_partition_fan_out() {
+  // Only a fraction of the keys fit in memory, but that fraction is still big enough that one level of
+  // partitioning is plenty.
+  setenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY, "100000", 1);
+
+  const size_t number_keys = 5000;
+  partition_type input1;
+  partition_type input2;
+  size_t number_input1_records = 0;
+  size_t i;
+  for (i = 0; i < number_keys; ++i) {
+    rstd::string key = "k" + ::np1::str::to_dec_str(i);
+    input2.write(::np1::rel::record(key, ::np1::str::to_dec_str(i), i + 1).ref());
+    if (i % 3 == 0) {
+      input1.write(::np1::rel::record(key, ::np1::str::to_dec_str(i * 2), i + 1).ref());
+      ++number_input1_records;
+    }
+  }
+
+  const char *key_heading_name = "string:k";
+  ::np1::rel::record headings1("string:k", "int:y", 0);
+  ::np1::rel::record headings2("string:k", "int:x", 0);
+  ::np1::rel::detail::compare_specs specs1(headings1, &key_heading_name, 1);
+  ::np1::rel::detail::compare_specs specs2(headings2, &key_heading_name, 1);
+  rstd::vector<size_t> file2_non_common_field_numbers;
+  file2_non_common_field_numbers.push_back(1);
+
+  // One level of partitioning has both inputs' partitions, the resident output and one output per partition
+  // open at once.  Each level deeper needs as many again, so going deeper runs out of files.
+  ::np1::io::heap_buffer_output_stream output(4096);
+  {
+    open_file_limit limit(3 * ::np1::rel::detail::record_partitions::NUMBER_PARTITIONS + 4);
+    ::np1::rel::detail::hash_join::joiner joiner(
+      ::np1::rel::detail::join_helper::NATURAL, specs1, specs2, file2_non_common_field_numbers, NULL);
+    joiner(input1, input2, output);
+  }
+
+  // Every input1 record matches exactly one input2 record.
+  ::np1::io::buffer_input_stream output_input(output.ptr(), output.size());
+  ::np1::io::mandatory_record_input_stream< ::np1::io::buffer_input_stream, ::np1::rel::record,
+                                            ::np1::rel::record_ref> output_records(output_input);
+  size_t number_output_records = 0;
+  output_records.parse_records(hash_join_count_record_callback(number_output_records));
+  NP1_TEST_ASSERT(number_output_records == number_input1_records);
+
+  unsetenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY);
+}
+
+
+void test_hash_join() {
+  NP1_TEST_RUN_TEST(test_hash_join_partition_fan_out);
+}
+
+} // namespaces
+}
+}
+}
+
+#endif
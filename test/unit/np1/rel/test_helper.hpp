@@ -0,0 +1,36 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_REL_TEST_HELPER_HPP
+#define NP1_TEST_UNIT_NP1_REL_TEST_HELPER_HPP
+
+
+#include "np1/rel/detail/helper.hpp"
+
+
+namespace test {
+namespace unit {
+namespace np1 {
+namespace rel {
+
+void test_helper_int_compare_zero() {
+  // Zero is stripped down to nothing, make sure that whatever comes after it in memory doesn't matter.
+  const char *zero_then_minus = "0-";
+  const char *zero_then_digit = "09";
+  NP1_TEST_ASSERT(::np1::rel::detail::helper::int_compare(zero_then_minus, 1, zero_then_minus, 1) == 0);
+  NP1_TEST_ASSERT(::np1::rel::detail::helper::int_compare(zero_then_minus, 1, zero_then_digit, 1) == 0);
+  NP1_TEST_ASSERT(::np1::rel::detail::helper::int_compare(zero_then_minus, 1, "-1", 2) > 0);
+  NP1_TEST_ASSERT(::np1::rel::detail::helper::int_compare("-1", 2, zero_then_minus, 1) < 0);
+  NP1_TEST_ASSERT(::np1::rel::detail::helper::int_compare(zero_then_minus, 1, "1", 1) < 0);
+}
+
+
+void test_helper() {
+  NP1_TEST_RUN_TEST(test_helper_int_compare_zero);
+}
+
+} // namespaces
+}
+}
+}
+
+#endif
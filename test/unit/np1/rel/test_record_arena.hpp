@@ -0,0 +1,87 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_REL_TEST_RECORD_ARENA_HPP
+#define NP1_TEST_UNIT_NP1_REL_TEST_RECORD_ARENA_HPP
+
+
+namespace test {
+namespace unit {
+namespace np1 {
+namespace rel {
+
+typedef ::np1::rel::record_arena record_arena_type;
+
+
+void test_record_arena_copy() {
+  record_arena_type arena;
+  ::np1::rel::record r1("fred", "barney", 1);
+  ::np1::rel::record r2("wilma", 2);
+
+  ::np1::rel::record_ref copy1 = arena.copy(r1.ref());
+  ::np1::rel::record_ref copy2 = arena.copy(r2.ref());
+  NP1_TEST_ASSERT(copy1.is_equal(r1.ref()));
+  NP1_TEST_ASSERT(copy2.is_equal(r2.ref()));
+  NP1_TEST_ASSERT(copy1.start() != r1.ref().start());
+  NP1_TEST_ASSERT(copy2.record_number() == 2);
+
+  // Lots of copies.
+  size_t i;
+  for (i = 0; i < 100000; ++i) {
+    arena.copy(r1.ref());
+  }
+
+  NP1_TEST_ASSERT(copy1.is_equal(r1.ref()));
+  NP1_TEST_ASSERT(arena.allocated_size() >= 100000 * r1.ref().byte_size());
+  NP1_TEST_ASSERT(arena.used_size() >= 100000 * r1.ref().byte_size());
+  NP1_TEST_ASSERT(arena.used_size() <= arena.allocated_size());
+
+  arena.reset();
+  NP1_TEST_ASSERT(arena.allocated_size() < 100000 * r1.ref().byte_size());
+  NP1_TEST_ASSERT(arena.copy(r2.ref()).is_equal(r2.ref()));
+
+  arena.clear();
+  NP1_TEST_ASSERT(arena.allocated_size() == 0);
+  NP1_TEST_ASSERT(arena.used_size() == 0);
+}
+
+
+void test_record_arena_reassign() {
+  record_arena_type arena;
+  ::np1::rel::record longer("fred", "barney", 1);
+  ::np1::rel::record shorter("wilma", 2);
+
+  ::np1::rel::record_ref target = arena.copy(longer.ref());
+  size_t capacity = longer.ref().byte_size();
+  const unsigned char *original_start = (const unsigned char *)target.start();
+
+  // A shorter record goes over the top.
+  arena.reassign(target, capacity, shorter.ref());
+  NP1_TEST_ASSERT(target.is_equal(shorter.ref()));
+  NP1_TEST_ASSERT((const unsigned char *)target.start() == original_start);
+  NP1_TEST_ASSERT(capacity == longer.ref().byte_size());
+
+  // So does the original.
+  arena.reassign(target, capacity, longer.ref());
+  NP1_TEST_ASSERT(target.is_equal(longer.ref()));
+  NP1_TEST_ASSERT((const unsigned char *)target.start() == original_start);
+
+  // But something longer than that doesn't.
+  ::np1::rel::record longest("fred", "barney", "wilma", "betty", 3);
+  arena.reassign(target, capacity, longest.ref());
+  NP1_TEST_ASSERT(target.is_equal(longest.ref()));
+  NP1_TEST_ASSERT((const unsigned char *)target.start() != original_start);
+  NP1_TEST_ASSERT(capacity == longest.ref().byte_size());
+}
+
+
+void test_record_arena() {
+  NP1_TEST_RUN_TEST(test_record_arena_copy);
+  NP1_TEST_RUN_TEST(test_record_arena_reassign);
+}
+
+} // namespaces
+}
+}
+}
+
+#endif
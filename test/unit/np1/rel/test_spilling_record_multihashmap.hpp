@@ -0,0 +1,68 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_REL_TEST_SPILLING_RECORD_MULTIHASHMAP_HPP
+#define NP1_TEST_UNIT_NP1_REL_TEST_SPILLING_RECORD_MULTIHASHMAP_HPP
+
+
+#include "np1/rel/detail/spilling_record_multihashmap.hpp"
+
+
+namespace test {
+namespace unit {
+namespace np1 {
+namespace rel {
+
+typedef ::np1::rel::detail::spilling_record_multihashmap<size_t> spilling_record_multihashmap_type;
+
+
+void test_spilling_record_multihashmap_small_budget() {
+  // The empty table is bigger than this, but it mustn't count against the budget or every level would only get
+  // one key.
+  setenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY, "100000", 1);
+
+  ::np1::rel::record headings("string:k", "int:v", 0);
+  const char *key_heading_name = "string:k";
+  ::np1::rel::detail::compare_specs specs(headings, &key_heading_name, 1);
+  ::np1::rel::detail::record_partitions partitions(specs, 0);
+  spilling_record_multihashmap_type map(specs, partitions, 0);
+
+  size_t number_in_map = 0;
+  size_t i;
+  for (i = 0; i < 10000; ++i) {
+    ::np1::rel::record r("k" + ::np1::str::to_dec_str(i), ::np1::str::to_dec_str(i), i + 1);
+    spilling_record_multihashmap_type::equal_list_type *equal_list = map.insert(r.ref(), i);
+    if (equal_list) {
+      NP1_TEST_ASSERT(equal_list == map.find(r.ref()));
+      ++number_in_map;
+    }
+  }
+
+  NP1_TEST_ASSERT(map.size() == number_in_map);
+  NP1_TEST_ASSERT(map.size() >= 100);
+  NP1_TEST_ASSERT(map.size() < 10000);
+  NP1_TEST_ASSERT(partitions.size() > 0);
+
+  // Once the map is full, keys that it already has still go in.
+  ::np1::rel::record existing("k0", "-1", 10001);
+  NP1_TEST_ASSERT(map.insert(existing.ref(), 10000));
+  NP1_TEST_ASSERT(map.find(existing.ref())->size() == 2);
+  NP1_TEST_ASSERT(map.size() == number_in_map);
+
+  ::np1::rel::record missing("k_missing", "-1", 10002);
+  NP1_TEST_ASSERT(!map.insert(missing.ref(), 10001));
+  NP1_TEST_ASSERT(!map.find(missing.ref()));
+
+  unsetenv(NP1_ENVIRONMENT_MAX_RECORD_HASH_TABLE_MEMORY);
+}
+
+
+void test_spilling_record_multihashmap() {
+  NP1_TEST_RUN_TEST(test_spilling_record_multihashmap_small_budget);
+}
+
+} // namespaces
+}
+}
+}
+
+#endif
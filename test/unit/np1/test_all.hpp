@@ -9,6 +9,9 @@
 #include "test/unit/np1/json/test_all.hpp"
 #include "test/unit/np1/test_skip_list.hpp"
 #include "test/unit/np1/test_consistent_hash_table.hpp"
+#include "test/unit/np1/test_bloom_filter.hpp"
+#include "test/unit/np1/test_quantile_sketch.hpp"
+#include "test/unit/np1/test_hyperloglog.hpp"
 #include "test/unit/np1/test_compressed_int.hpp"
 #include "test/unit/np1/io/test_all.hpp"
 #include "test/unit/np1/rel/test_all.hpp"
@@ -22,6 +25,9 @@ void test_all() {
   np1::test_str();
   np1::test_skip_list();
   np1::test_consistent_hash_table();
+  np1::test_bloom_filter();
+  np1::test_quantile_sketch();
+  np1::test_hyperloglog();
   np1::test_compressed_int();
   np1::hash::test_all();
   np1::json::test_all();
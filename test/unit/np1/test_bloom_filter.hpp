@@ -0,0 +1,63 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_TEST_BLOOM_FILTER_HPP
+#define NP1_TEST_UNIT_NP1_TEST_BLOOM_FILTER_HPP
+
+#include "np1/hash/fnv1a64.hpp"
+#include "np1/bloom_filter.hpp"
+
+namespace test {
+namespace unit {
+namespace np1 {
+
+static uint64_t bloom_filter_test_hash(uint64_t i) {
+  return ::np1::hash::fnv1a64::add(&i, sizeof(i), ::np1::hash::fnv1a64::init());
+}
+
+
+void test_bloom_filter_no_false_negatives() {
+  static const uint64_t NUMBER_INSERTIONS = 100000;
+  ::np1::bloom_filter filter(NUMBER_INSERTIONS);
+
+  uint64_t i;
+  for (i = 0; i < NUMBER_INSERTIONS; ++i) {
+    filter.insert(bloom_filter_test_hash(i));
+  }
+
+  for (i = 0; i < NUMBER_INSERTIONS; ++i) {
+    NP1_TEST_ASSERT(filter.might_contain(bloom_filter_test_hash(i)));
+  }
+}
+
+
+void test_bloom_filter_false_positive_rate() {
+  static const uint64_t NUMBER_INSERTIONS = 100000;
+  ::np1::bloom_filter filter(NUMBER_INSERTIONS);
+
+  uint64_t i;
+  for (i = 0; i < NUMBER_INSERTIONS; ++i) {
+    filter.insert(bloom_filter_test_hash(i));
+  }
+
+  uint64_t number_false_positives = 0;
+  for (i = NUMBER_INSERTIONS; i < NUMBER_INSERTIONS * 2; ++i) {
+    if (filter.might_contain(bloom_filter_test_hash(i))) {
+      ++number_false_positives;
+    }
+  }
+
+  // Allow plenty of slack over the expected 1%.
+  NP1_TEST_ASSERT(number_false_positives < NUMBER_INSERTIONS/33);
+}
+
+
+void test_bloom_filter() {
+  NP1_TEST_RUN_TEST(test_bloom_filter_no_false_negatives);
+  NP1_TEST_RUN_TEST(test_bloom_filter_false_positive_rate);
+}
+
+} // namespaces
+}
+}
+
+#endif
@@ -119,10 +119,91 @@ void test_consistent_hash_table_lower_bound() {
 
 
 
+void test_consistent_hash_table_lower_bound_matches_linear_search() {
+  static const int NUMBER_DUPLICATES = 3;
+  static const int NUMBER_INSERTIONS = 257;
+  consistent_hash_table_type table(NUMBER_DUPLICATES);
+  hash_function hf;
+
+  int i;
+  for (i = 0; i < NUMBER_INSERTIONS; ++i) {
+    NP1_TEST_ASSERT(table.insert(i));
+  }
+
+  for (i = -NUMBER_INSERTIONS; i < NUMBER_INSERTIONS * 10; ++i) {
+    // The answer is the value with the smallest point >= the key's point, or the smallest point of all if there's
+    // no such point.
+    uint64_t point = hf(i, 0);
+    bool found = false;
+    uint64_t best_point = 0;
+    int best_value = -1;
+    uint64_t lowest_point = 0;
+    int lowest_value = -1;
+    int v;
+    for (v = 0; v < NUMBER_INSERTIONS; ++v) {
+      uint64_t vnode;
+      for (vnode = 0; vnode < NUMBER_DUPLICATES; ++vnode) {
+        uint64_t p = hf(v, vnode);
+        if ((p >= point) && (!found || (p < best_point))) {
+          found = true;
+          best_point = p;
+          best_value = v;
+        }
+
+        if ((lowest_value < 0) || (p < lowest_point)) {
+          lowest_point = p;
+          lowest_value = v;
+        }
+      }
+    }
+
+    NP1_TEST_ASSERT(*table.lower_bound(i) == (found ? best_value : lowest_value));
+  }
+}
+
+
+void test_consistent_hash_table_insert_allow_duplicates() {
+  static const int NUMBER_DUPLICATES = 4;
+  consistent_hash_table_type table(NUMBER_DUPLICATES);
+
+  // Every copy of a value gets its own set of points.
+  table.insert_allow_duplicates(1);
+  table.insert_allow_duplicates(1);
+  table.insert_allow_duplicates(0);
+  NP1_TEST_ASSERT(table.size() == 3);
+
+  int counts[2] = { 0, 0 };
+  consistent_hash_table_type::const_iterator iter = table.lower_bound(42);
+  for (; iter != table.end(); ++iter) {
+    ++counts[*iter];
+  }
+
+  NP1_TEST_ASSERT(counts[0] == NUMBER_DUPLICATES);
+  NP1_TEST_ASSERT(counts[1] == 2 * NUMBER_DUPLICATES);
+
+  // Inserting after a lookup still catches duplicate points.
+  NP1_TEST_ASSERT(!table.insert(0));
+  NP1_TEST_ASSERT(table.insert(2));
+  NP1_TEST_ASSERT(table.size() == 4);
+  int number_twos = 0;
+  for (iter = table.lower_bound(2); iter != table.end(); ++iter) {
+    number_twos += (2 == *iter);
+  }
+
+  NP1_TEST_ASSERT(number_twos == NUMBER_DUPLICATES);
+
+  table.clear();
+  NP1_TEST_ASSERT(table.size() == 0);
+  NP1_TEST_ASSERT(table.lower_bound(1) == table.end());
+}
+
+
 void test_consistent_hash_table() {
   NP1_TEST_RUN_TEST(test_consistent_hash_table_insert);
   NP1_TEST_RUN_TEST(test_consistent_hash_table_insert_random);
   NP1_TEST_RUN_TEST(test_consistent_hash_table_lower_bound);
+  NP1_TEST_RUN_TEST(test_consistent_hash_table_lower_bound_matches_linear_search);
+  NP1_TEST_RUN_TEST(test_consistent_hash_table_insert_allow_duplicates);
 }
 
 } // namespaces
@@ -0,0 +1,109 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_TEST_HYPERLOGLOG_HPP
+#define NP1_TEST_UNIT_NP1_TEST_HYPERLOGLOG_HPP
+
+#include "np1/hash/wyhash64.hpp"
+#include "np1/hyperloglog.hpp"
+
+namespace test {
+namespace unit {
+namespace np1 {
+
+static uint64_t hyperloglog_test_hash(uint64_t i) {
+  return ::np1::hash::wyhash64::add(&i, sizeof(i), ::np1::hash::wyhash64::init());
+}
+
+static bool hyperloglog_is_close(uint64_t estimate, uint64_t expected, double max_error) {
+  double error = ((double)estimate - (double)expected)/(double)expected;
+  return (error < max_error) && (error > -max_error);
+}
+
+
+void test_hyperloglog_small_is_exact() {
+  ::np1::hyperloglog counter;
+  NP1_TEST_ASSERT(counter.estimate() == 0);
+
+  uint64_t i;
+  for (i = 0; i < 10; ++i) {
+    counter.add(hyperloglog_test_hash(i));
+    counter.add(hyperloglog_test_hash(i));
+  }
+
+  NP1_TEST_ASSERT(counter.estimate() == 10);
+}
+
+
+void test_hyperloglog_accuracy() {
+  size_t precision;
+  for (precision = ::np1::hyperloglog::MIN_PRECISION + 6; precision <= ::np1::hyperloglog::MAX_PRECISION;
+       precision += 4) {
+    ::np1::hyperloglog counter(precision);
+    uint64_t i;
+    for (i = 0; i < 1000000; ++i) {
+      counter.add(hyperloglog_test_hash(i % 300000));
+      // Check on the way through, while the counter is still using the pair list.
+      if (1000 == i) {
+        NP1_TEST_ASSERT(hyperloglog_is_close(counter.estimate(), 1001, 0.1));
+      }
+    }
+
+    // Allow plenty of slack over the expected error.
+    NP1_TEST_ASSERT(hyperloglog_is_close(counter.estimate(), 300000, 5 * 1.04/sqrt((double)(1 << precision))));
+  }
+}
+
+
+void test_hyperloglog_merge_and_string() {
+  ::np1::hyperloglog counter1;
+  ::np1::hyperloglog counter2;
+  ::np1::hyperloglog small_counter;
+  uint64_t i;
+  for (i = 0; i < 200000; ++i) {
+    counter1.add(hyperloglog_test_hash(i));
+    counter2.add(hyperloglog_test_hash(i + 100000));
+  }
+
+  for (i = 0; i < 100; ++i) {
+    small_counter.add(hyperloglog_test_hash(i));
+  }
+
+  rstd::string counter2_string = counter2.to_string();
+  rstd::string small_counter_string = small_counter.to_string();
+  ::np1::hyperloglog counter2_copy;
+  ::np1::hyperloglog small_counter_copy;
+  NP1_TEST_ASSERT(counter2_copy.from_string(counter2_string.c_str(), counter2_string.length()));
+  NP1_TEST_ASSERT(counter2_copy.to_string() == counter2_string);
+  NP1_TEST_ASSERT(small_counter_copy.from_string(small_counter_string.c_str(), small_counter_string.length()));
+  NP1_TEST_ASSERT(small_counter_copy.to_string() == small_counter_string);
+  NP1_TEST_ASSERT(small_counter_copy.estimate() == small_counter.estimate());
+
+  NP1_TEST_ASSERT(counter1.merge(counter2_copy));
+  NP1_TEST_ASSERT(counter1.merge(small_counter_copy));
+  NP1_TEST_ASSERT(hyperloglog_is_close(counter1.estimate(), 300000, 0.05));
+
+  ::np1::hyperloglog other_precision(10);
+  NP1_TEST_ASSERT(!counter1.merge(other_precision));
+
+  ::np1::hyperloglog not_a_counter;
+  NP1_TEST_ASSERT(!not_a_counter.from_string("fred", 4));
+
+  // Counters without the current format tag might have hashed the values differently.
+  NP1_TEST_ASSERT(strncmp(small_counter_string.c_str(), "hll1 14 s ", 10) == 0);
+  NP1_TEST_ASSERT(!not_a_counter.from_string(small_counter_string.c_str() + 5, small_counter_string.length() - 5));
+  rstd::string other_version = "hll2" + rstd::string(small_counter_string.c_str() + 4);
+  NP1_TEST_ASSERT(!not_a_counter.from_string(other_version.c_str(), other_version.length()));
+}
+
+
+void test_hyperloglog() {
+  NP1_TEST_RUN_TEST(test_hyperloglog_small_is_exact);
+  NP1_TEST_RUN_TEST(test_hyperloglog_accuracy);
+  NP1_TEST_RUN_TEST(test_hyperloglog_merge_and_string);
+}
+
+} // namespaces
+}
+}
+
+#endif
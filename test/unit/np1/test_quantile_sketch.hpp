@@ -0,0 +1,95 @@
+// Copyright 2012 Matthew Nourse and n plus 1 computing pty limited unless otherwise noted.
+// Please see LICENSE file for details.
+#ifndef NP1_TEST_UNIT_NP1_TEST_QUANTILE_SKETCH_HPP
+#define NP1_TEST_UNIT_NP1_TEST_QUANTILE_SKETCH_HPP
+
+#include "np1/quantile_sketch.hpp"
+
+namespace test {
+namespace unit {
+namespace np1 {
+
+// A shuffled 0..n-1, so that the exact quantile q is q * n.
+static uint64_t quantile_sketch_test_value(uint64_t i, uint64_t n) {
+  return (i * 7919) % n;
+}
+
+
+void test_quantile_sketch_small_is_exact() {
+  ::np1::quantile_sketch sketch;
+  sketch.add(5);
+  sketch.add(1);
+  sketch.add(3);
+  NP1_TEST_ASSERT(sketch.count() == 3);
+  NP1_TEST_ASSERT(sketch.quantile(0) == 1);
+  NP1_TEST_ASSERT(sketch.quantile(0.5) == 3);
+  NP1_TEST_ASSERT(sketch.quantile(1) == 5);
+
+  // The lower middle value for an even number of values.
+  sketch.add(4);
+  NP1_TEST_ASSERT(sketch.quantile(0.5) == 3);
+}
+
+
+void test_quantile_sketch_accuracy() {
+  static const uint64_t NUMBER_VALUES = 1000000;
+  ::np1::quantile_sketch sketch;
+  uint64_t i;
+  for (i = 0; i < NUMBER_VALUES; ++i) {
+    sketch.add((double)quantile_sketch_test_value(i, NUMBER_VALUES));
+  }
+
+  NP1_TEST_ASSERT(sketch.count() == NUMBER_VALUES);
+
+  // Allow plenty of slack over the expected rank error.
+  double q;
+  for (q = 0.05; q < 1; q += 0.05) {
+    double error = sketch.quantile(q) - q * NUMBER_VALUES;
+    NP1_TEST_ASSERT((error < NUMBER_VALUES/20.0) && (error > -(NUMBER_VALUES/20.0)));
+  }
+
+  // The memory used doesn't depend on the number of values.
+  NP1_TEST_ASSERT(sketch.to_string().length() < 20 * ::np1::quantile_sketch::DEFAULT_K * 3);
+}
+
+
+void test_quantile_sketch_merge_and_string() {
+  static const uint64_t NUMBER_VALUES = 100000;
+  ::np1::quantile_sketch sketch1;
+  ::np1::quantile_sketch sketch2;
+  uint64_t i;
+  for (i = 0; i < NUMBER_VALUES; ++i) {
+    double value = (double)quantile_sketch_test_value(i, NUMBER_VALUES);
+    if (i % 3 == 0) {
+      sketch1.add(value);
+    } else {
+      sketch2.add(value);
+    }
+  }
+
+  rstd::string sketch2_string = sketch2.to_string();
+  ::np1::quantile_sketch sketch2_copy;
+  NP1_TEST_ASSERT(sketch2_copy.from_string(sketch2_string.c_str(), sketch2_string.length()));
+  NP1_TEST_ASSERT(sketch2_copy.to_string() == sketch2_string);
+
+  sketch1.merge(sketch2_copy);
+  NP1_TEST_ASSERT(sketch1.count() == NUMBER_VALUES);
+  double error = sketch1.quantile(0.5) - NUMBER_VALUES/2;
+  NP1_TEST_ASSERT((error < NUMBER_VALUES/20.0) && (error > -(NUMBER_VALUES/20.0)));
+
+  ::np1::quantile_sketch not_a_sketch;
+  NP1_TEST_ASSERT(!not_a_sketch.from_string("fred", 4));
+}
+
+
+void test_quantile_sketch() {
+  NP1_TEST_RUN_TEST(test_quantile_sketch_small_is_exact);
+  NP1_TEST_RUN_TEST(test_quantile_sketch_accuracy);
+  NP1_TEST_RUN_TEST(test_quantile_sketch_merge_and_string);
+}
+
+} // namespaces
+}
+}
+
+#endif
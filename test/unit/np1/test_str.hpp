@@ -5,6 +5,7 @@
 
 #include "np1/str.hpp"
 #include "np1/io/static_buffer_output_stream.hpp"
+#include "np1/time.hpp"
 #include "test/unit/helper.hpp"
 
 namespace test {
@@ -409,6 +410,404 @@ void test_to_dec_str_signed() {
   NP1_TEST_ASSERT(::np1::str::cmp(buf, "-210301") == 0);
 }
 
+void check_partial_dec_to_int64(const char *input, int64_t expected, size_t expected_length) {
+  size_t number_length;
+  NP1_TEST_ASSERT(::np1::str::partial_dec_to_int64(input, strlen(input), number_length) == expected);
+  NP1_TEST_ASSERT(number_length == expected_length);
+}
+
+void test_partial_dec_to_int64() {
+  check_partial_dec_to_int64("", 0, 0);
+  check_partial_dec_to_int64("0", 0, 1);
+  check_partial_dec_to_int64("  7", 7, 3);
+  check_partial_dec_to_int64("-7", -7, 2);
+  check_partial_dec_to_int64("1234567", 1234567, 7);
+  check_partial_dec_to_int64("12345678", 12345678, 8);
+  check_partial_dec_to_int64("-123456789", -123456789, 10);
+  check_partial_dec_to_int64("1234567890123456", 1234567890123456LL, 16);
+  check_partial_dec_to_int64("12345678x1234567", 12345678, 8);
+  check_partial_dec_to_int64("1234567/12345678", 1234567, 7);
+  check_partial_dec_to_int64("1234567:12345678", 1234567, 7);
+  check_partial_dec_to_int64("00000000000000000042 ", 42, 20);
+  check_partial_dec_to_int64("9223372036854775807", 9223372036854775807LL, 19);
+  check_partial_dec_to_int64("-9223372036854775808", (int64_t)((uint64_t)1 << 63), 20);
+
+  // Numbers that are too big wrap around rather than stopping at the largest value.
+  check_partial_dec_to_int64("18446744073709551615", -1, 20);
+  check_partial_dec_to_int64("18446744073709551616", 0, 20);
+
+  NP1_TEST_ASSERT(::np1::str::dec_to_int64("  -42  ") == -42);
+}
+
+
+// The conversions as they were before they worked on more than one digit at a time, to compare against.
+uint64_t reference_dec_to_uint64(const char *s, const char *s_end) {
+  uint64_t i = 0;
+  for (; (s < s_end) && isdigit(*s); ++s) {
+    i = (i * 10) + (*s - '0');
+  }
+
+  return i;
+}
+
+void reference_to_dec_str(char *num_str, uint64_t i) {
+  char reversed[::np1::str::MAX_NUM_STR_LENGTH];
+  char *reversed_ptr = reversed;
+  do {
+    *reversed_ptr++ = '0' + i % 10;
+    i = i/10;
+  } while (i != 0);
+  
+  while (--reversed_ptr >= reversed) {
+    *num_str++ = *reversed_ptr;
+  }
+  
+  *num_str = '\0';
+}
+
+// The conversions give the same answers as the one-digit-at-a-time ones over a spread of values.
+void test_dec_conversion_matches_reference() {
+  enum { NUMBER_VALUES = 1024, NUMBER_ROUNDS = 4 };
+  static char strings[NUMBER_VALUES][::np1::str::MAX_NUM_STR_LENGTH];
+  size_t lengths[NUMBER_VALUES];
+  uint64_t values[NUMBER_VALUES];
+  uint64_t value = 1;
+  size_t i;
+  for (i = 0; i < NUMBER_VALUES; ++i) {
+    // A spread of lengths from 1 to 20 digits.
+    value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+    ::np1::str::to_dec_str(strings[i], value >> (i % 64));
+    char reference[::np1::str::MAX_NUM_STR_LENGTH];
+    reference_to_dec_str(reference, value >> (i % 64));
+    NP1_TEST_ASSERT(::np1::str::cmp(strings[i], reference) == 0);
+    NP1_TEST_ASSERT((uint64_t)::np1::str::dec_to_int64(strings[i]) == (value >> (i % 64)));
+    lengths[i] = strlen(strings[i]);
+    values[i] = value >> (i % 64);
+  }
+
+  char buf[::np1::str::MAX_NUM_STR_LENGTH];
+  char reference_buf[::np1::str::MAX_NUM_STR_LENGTH];
+  char *end_of_number_p;
+  size_t round;
+  for (i = 0; i < NUMBER_VALUES; ++i) {
+    NP1_TEST_ASSERT(
+      (uint64_t)::np1::str::partial_dec_to_int64(strings[i], strings[i] + lengths[i], &end_of_number_p)
+        == reference_dec_to_uint64(strings[i], strings[i] + lengths[i]));
+    NP1_TEST_ASSERT(end_of_number_p == strings[i] + lengths[i]);
+
+    for (round = 0; round < NUMBER_ROUNDS; ++round) {
+      ::np1::str::to_dec_str(buf, values[i] + round);
+      reference_to_dec_str(reference_buf, values[i] + round);
+      NP1_TEST_ASSERT(::np1::str::cmp(buf, reference_buf) == 0);
+    }
+  }
+}
+
+// Times the conversions against the one-digit-at-a-time ones.
+void benchmark_dec_conversion() {
+  enum { NUMBER_VALUES = 1024, NUMBER_ROUNDS = 2000 };
+  static char strings[NUMBER_VALUES][::np1::str::MAX_NUM_STR_LENGTH];
+  size_t lengths[NUMBER_VALUES];
+  uint64_t values[NUMBER_VALUES];
+  uint64_t value = 1;
+  size_t i;
+  for (i = 0; i < NUMBER_VALUES; ++i) {
+    // A spread of lengths from 1 to 20 digits.
+    value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+    ::np1::str::to_dec_str(strings[i], value >> (i % 64));
+    char reference[::np1::str::MAX_NUM_STR_LENGTH];
+    reference_to_dec_str(reference, value >> (i % 64));
+    NP1_TEST_ASSERT(::np1::str::cmp(strings[i], reference) == 0);
+    NP1_TEST_ASSERT((uint64_t)::np1::str::dec_to_int64(strings[i]) == (value >> (i % 64)));
+    lengths[i] = strlen(strings[i]);
+    values[i] = value >> (i % 64);
+  }
+
+  uint64_t checksum = 0;
+  uint64_t reference_checksum = 0;
+  char buf[::np1::str::MAX_NUM_STR_LENGTH];
+  char *end_of_number_p;
+  size_t round;
+
+  uint64_t start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      reference_checksum += reference_dec_to_uint64(strings[i], strings[i] + lengths[i]);
+    }
+  }
+
+  uint64_t reference_parse_usec = ::np1::time::now_epoch_usec() - start;
+  start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      checksum += (uint64_t)::np1::str::partial_dec_to_int64(strings[i], strings[i] + lengths[i], &end_of_number_p);
+    }
+  }
+
+  uint64_t parse_usec = ::np1::time::now_epoch_usec() - start;
+  NP1_TEST_ASSERT(checksum == reference_checksum);
+
+  start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      reference_to_dec_str(buf, values[i] + round);
+      reference_checksum += buf[0];
+    }
+  }
+
+  uint64_t reference_format_usec = ::np1::time::now_epoch_usec() - start;
+  start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      ::np1::str::to_dec_str(buf, values[i] + round);
+      checksum += buf[0];
+    }
+  }
+
+  uint64_t format_usec = ::np1::time::now_epoch_usec() - start;
+  NP1_TEST_ASSERT(checksum == reference_checksum);
+
+  printf("  parse: %llu usec (one digit at a time: %llu usec)  format: %llu usec (one digit at a time: %llu usec)\n",
+         (unsigned long long)parse_usec, (unsigned long long)reference_parse_usec,
+         (unsigned long long)format_usec, (unsigned long long)reference_format_usec);
+}
+
+// The conversions give the same answers as libc over a spread of values.
+void test_double_conversion_matches_reference() {
+  enum { NUMBER_VALUES = 1024 };
+  char string[::np1::str::MAX_NUM_STR_LENGTH];
+  char buf[512];
+  char reference_buf[512];
+  char *end_of_number_p;
+  char *reference_end_of_number_p;
+  uint64_t bits = 1;
+  size_t i;
+  for (i = 0; i < NUMBER_VALUES; ++i) {
+    // Sensor-style readings like "-34.009709" and some with all their digits.
+    bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+    double value = (double)(int64_t)(bits >> 40) / 1000.0;
+    if (i % 4 == 0) {
+      ::np1::str::to_round_trip_dec_str(string, value / 3.0);
+    } else {
+      ::np1::str::to_dec_str(string, value);
+    }
+
+    size_t length = strlen(string);
+    double d = ::np1::str::partial_dec_to_double(string, string + length, &end_of_number_p);
+    double expected = ::np1::str::detail::libc_partial_dec_to_double(string, string + length,
+                                                                     &reference_end_of_number_p);
+    NP1_TEST_ASSERT(memcmp(&d, &expected, sizeof(d)) == 0);
+    NP1_TEST_ASSERT(end_of_number_p == reference_end_of_number_p);
+
+    ::np1::str::to_dec_str(buf, value);
+    sprintf(reference_buf, "%f", value);
+    NP1_TEST_ASSERT(::np1::str::cmp(buf, reference_buf) == 0);
+
+    ::np1::str::to_round_trip_dec_str(buf, value / 3.0);
+    d = strtod(buf, &end_of_number_p);
+    expected = value / 3.0;
+    NP1_TEST_ASSERT(memcmp(&d, &expected, sizeof(d)) == 0);
+  }
+}
+
+// Times the conversions against libc.
+void benchmark_double_conversion() {
+  enum { NUMBER_VALUES = 1024, NUMBER_ROUNDS = 200 };
+  static char strings[NUMBER_VALUES][::np1::str::MAX_NUM_STR_LENGTH];
+  size_t lengths[NUMBER_VALUES];
+  double values[NUMBER_VALUES];
+  uint64_t bits = 1;
+  size_t i;
+  for (i = 0; i < NUMBER_VALUES; ++i) {
+    // Sensor-style readings like "-34.009709" and some with all their digits.
+    bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+    values[i] = (double)(int64_t)(bits >> 40) / 1000.0;
+    if (i % 4 == 0) {
+      ::np1::str::to_round_trip_dec_str(strings[i], values[i] / 3.0);
+    } else {
+      ::np1::str::to_dec_str(strings[i], values[i]);
+    }
+
+    lengths[i] = strlen(strings[i]);
+  }
+
+  double checksum = 0;
+  double reference_checksum = 0;
+  char buf[512];
+  char *end_of_number_p;
+  size_t round;
+
+  uint64_t start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      reference_checksum += ::np1::str::detail::libc_partial_dec_to_double(strings[i], strings[i] + lengths[i],
+                                                                           &end_of_number_p);
+    }
+  }
+
+  uint64_t reference_parse_usec = ::np1::time::now_epoch_usec() - start;
+  start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      checksum += ::np1::str::partial_dec_to_double(strings[i], strings[i] + lengths[i], &end_of_number_p);
+    }
+  }
+
+  uint64_t parse_usec = ::np1::time::now_epoch_usec() - start;
+  NP1_TEST_ASSERT(checksum == reference_checksum);
+
+  uint64_t reference_length = 0;
+  uint64_t length = 0;
+  start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      sprintf(buf, "%f", values[i]);
+      reference_length += strlen(buf);
+    }
+  }
+
+  uint64_t reference_format_usec = ::np1::time::now_epoch_usec() - start;
+  start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      ::np1::str::to_dec_str(buf, values[i]);
+      length += strlen(buf);
+    }
+  }
+
+  uint64_t format_usec = ::np1::time::now_epoch_usec() - start;
+  NP1_TEST_ASSERT(length == reference_length);
+
+  start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      sprintf(buf, "%.17g", values[i] / 3.0);
+      reference_length += strlen(buf);
+    }
+  }
+
+  uint64_t reference_round_trip_usec = ::np1::time::now_epoch_usec() - start;
+  start = ::np1::time::now_epoch_usec();
+  for (round = 0; round < NUMBER_ROUNDS; ++round) {
+    for (i = 0; i < NUMBER_VALUES; ++i) {
+      ::np1::str::to_round_trip_dec_str(buf, values[i] / 3.0);
+      length += strlen(buf);
+    }
+  }
+
+  uint64_t round_trip_usec = ::np1::time::now_epoch_usec() - start;
+
+  printf("  parse: %llu usec (strtod: %llu usec)  format: %llu usec (%%f: %llu usec)"
+         "  round trip format: %llu usec (%%.17g: %llu usec)\n",
+         (unsigned long long)parse_usec, (unsigned long long)reference_parse_usec,
+         (unsigned long long)format_usec, (unsigned long long)reference_format_usec,
+         (unsigned long long)round_trip_usec, (unsigned long long)reference_round_trip_usec);
+}
+
+
+void check_dec_to_double(const char *input) {
+  // partial_dec_to_double may write to the end of the string so it can't be a literal.
+  rstd::string s(input);
+  char *end_of_number_p;
+  char *strtod_end_of_number_p;
+  double d = ::np1::str::partial_dec_to_double(s.c_str(), s.c_str() + s.length(), &end_of_number_p);
+  double expected = strtod(s.c_str(), &strtod_end_of_number_p);
+  NP1_TEST_ASSERT(memcmp(&d, &expected, sizeof(d)) == 0);
+  NP1_TEST_ASSERT(end_of_number_p == strtod_end_of_number_p);
+}
+
+void test_partial_dec_to_double() {
+  const char *inputs[] = {
+    "0", "-0", "1", "-1", " 12.5 ", ".5", "5.", "-.5", "+3", "0.0078125", "1e5", "1e", "1e+", "1e-5x", "",
+    "-", "abc", "inf", "-inf", "0x1p3", "1.7976931348623157e308", "1.7976931348623159e308",
+    "2.2250738585072014e-308", "2.2250738585072011e-308", "4.9e-324", "2.4e-324", "2.5e-324", "1e-400",
+    "1e400", "9007199254740993", "9007199254740992.5", "7.2057594037927933e16", "1e23",
+    "123456789012345678901234", "00000000000000000000000001.5", "0.000000000000000000000000000000000001e36",
+    "-34.009709", "151.2099", "0.1", "0.3", "1.0000000000000002", 0
+  };
+
+  size_t i;
+  for (i = 0; inputs[i]; ++i) {
+    check_dec_to_double(inputs[i]);
+  }
+
+  // The digits after the end mustn't make a difference.
+  rstd::string number("12.34567");
+  char *end_of_number_p;
+  NP1_TEST_ASSERT(::np1::str::partial_dec_to_double(number.c_str(), number.c_str() + 4, &end_of_number_p) == 12.3);
+  NP1_TEST_ASSERT(end_of_number_p == number.c_str() + 4);
+}
+
+void test_to_dec_str_double() {
+  const double values[] = {
+    0.0, -0.0, 1.0, -1.0, 0.5, 123.0, 0.0078125, -0.0078125, 0.0000005, 0.0000015, 1e-9, -1e-9, 2.5e-7,
+    -208.92911, 34.0097085, 1234567.8912345, 9007199254740993.0, 1e40, -1e40, 5e-324
+  };
+
+  char buf[::np1::str::MAX_NUM_STR_LENGTH];
+  char sprintf_buf[512];
+  size_t i;
+  for (i = 0; i < sizeof(values)/sizeof(values[0]); ++i) {
+    rstd::string s = ::np1::str::to_dec_str(values[i]);
+    sprintf(sprintf_buf, "%f", values[i]);
+    NP1_TEST_ASSERT(::np1::str::cmp(s.c_str(), sprintf_buf) == 0);
+  }
+
+  ::np1::str::to_dec_str(buf, -1e300);
+  NP1_TEST_ASSERT(strtod(buf, 0) == -1e300);
+
+  uint64_t bits = 1;
+  for (i = 0; i < 100000; ++i) {
+    bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+    double d = (double)(int64_t)(bits >> 20) / (double)((uint64_t)1 << (i % 64));
+    ::np1::str::to_dec_str(buf, d);
+    sprintf(sprintf_buf, "%f", d);
+    NP1_TEST_ASSERT(::np1::str::cmp(buf, sprintf_buf) == 0);
+  }
+}
+
+void test_to_round_trip_dec_str() {
+  char buf[::np1::str::MAX_NUM_STR_LENGTH];
+  ::np1::str::to_round_trip_dec_str(buf, 0.0);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "0") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, -0.0);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "-0") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, 0.1);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "0.1") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, -123.456);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "-123.456") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, 100.0);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "100") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, 0.000001);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "0.000001") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, 1.5e-7);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "1.5e-7") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, 1e21);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "1e+21") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, 5e-324);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "5e-324") == 0);
+  ::np1::str::to_round_trip_dec_str(buf, -1.7976931348623157e308);
+  NP1_TEST_ASSERT(::np1::str::cmp(buf, "-1.7976931348623157e+308") == 0);
+
+  // Any finite double must come back the same.
+  uint64_t bits = 1;
+  size_t i;
+  for (i = 0; i < 100000; ++i) {
+    bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    if (isnan(d) || isinf(d)) {
+      continue;
+    }
+
+    ::np1::str::to_round_trip_dec_str(buf, d);
+    double back = ::np1::str::dec_to_double(buf, strlen(buf));
+    NP1_TEST_ASSERT(memcmp(&back, &d, sizeof(d)) == 0);
+    NP1_TEST_ASSERT(strtod(buf, 0) == d);
+  }
+}
+
+
 void validate_hex_decode(const char *input, const char *expected) {
   ::np1::io::static_buffer_output_stream<100> buf_stream;
   ::np1::str::write_decoded_hex(input, buf_stream);
@@ -439,6 +838,14 @@ void test_str() {
   NP1_TEST_RUN_TEST(test_replace_invalid_utf8_sequences);
   NP1_TEST_RUN_TEST(test_to_dec_str_unsigned);
   NP1_TEST_RUN_TEST(test_to_dec_str_signed);
+  NP1_TEST_RUN_TEST(test_partial_dec_to_int64);
+  NP1_TEST_RUN_TEST(test_dec_conversion_matches_reference);
+  NP1_TEST_RUN_BENCHMARK(benchmark_dec_conversion);
+  NP1_TEST_RUN_TEST(test_partial_dec_to_double);
+  NP1_TEST_RUN_TEST(test_to_dec_str_double);
+  NP1_TEST_RUN_TEST(test_to_round_trip_dec_str);
+  NP1_TEST_RUN_TEST(test_double_conversion_matches_reference);
+  NP1_TEST_RUN_BENCHMARK(benchmark_double_conversion);
   NP1_TEST_RUN_TEST(test_write_decoded_hex);
 }
 